@@ -0,0 +1,219 @@
+"""Request latency of an asyncio service under the collector's modes.
+
+An asyncio "service" handles requests that arrive on a fixed schedule
+(open loop, so a stalled loop shows up as queueing delay). Each request
+allocates a small object graph, stores it in a steady live set of recent
+sessions, does one socket round trip through the event loop and reads back
+a random earlier session. Latency runs from a request's scheduled arrival
+to its completion.
+
+Each mode runs in a fresh subprocess:
+
+  thread   the background GC thread collects (pyzgc.start_gc)
+  idle     pyzgc.asyncio.install(loop) collects while the loop is idle
+  both     both; the GC thread only takes over when idle time runs short
+
+    python benchmarks/benchmark_asyncio.py --duration 5 --rate 4000
+
+pyzgc only traces from explicit roots, so the live set is re-added as a
+root by every request.
+"""
+import argparse
+import asyncio
+import json
+import os
+import random
+import socket
+import subprocess
+import sys
+import time
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+NSLOTS = 10
+SESSIONS = 20000
+MODES = ("thread", "idle", "both")
+
+
+def percentiles(values):
+    if not values:
+        return {"p50_ns": 0, "p99_ns": 0, "p999_ns": 0, "max_ns": 0}
+    values = sorted(values)
+
+    def rank(q):
+        return values[min(len(values) - 1, int(q * len(values)))]
+
+    return {"p50_ns": rank(0.50), "p99_ns": rank(0.99),
+            "p999_ns": rank(0.999), "max_ns": values[-1]}
+
+
+class Ring:
+    """SESSIONS slots in a 10-ary tree of pyzgc objects (the GC root)."""
+
+    def __init__(self, pyzgc):
+        self.pyzgc = pyzgc
+        self.depth = 1
+        while NSLOTS ** self.depth < SESSIONS:
+            self.depth += 1
+        self.root = self._build(self.depth)
+
+    def _build(self, level):
+        node = self.pyzgc.Object()
+        if level > 1:
+            for i in range(NSLOTS):
+                node.store(i, self._build(level - 1))
+        return node
+
+    def _leaf(self, i):
+        node = self.root
+        for _ in range(self.depth - 1):
+            node = node.load(i % NSLOTS)
+            i //= NSLOTS
+        return node, i % NSLOTS
+
+    def set(self, i, value):
+        leaf, slot = self._leaf(i)
+        leaf.store(slot, value)
+
+    def get(self, i):
+        leaf, slot = self._leaf(i)
+        return leaf.load(slot)
+
+
+async def serve(pyzgc, rate, duration, seed):
+    loop = asyncio.get_running_loop()
+    rng = random.Random(seed)
+    ring = Ring(pyzgc)
+    server, client = socket.socketpair()
+    server.setblocking(False)
+    client.setblocking(False)
+    latencies = []
+
+    async def handle(i, scheduled):
+        pyzgc.add_root(ring.root)
+        req = pyzgc.Object()
+        body = pyzgc.Object()
+        req.store(0, body)
+        body.store(0, req)
+        for k in range(1, 6):
+            part = pyzgc.Object()
+            part.store(1, i)
+            body.store(k, part)
+        ring.set(i % SESSIONS, req)
+        # One round trip through the selector
+        await loop.sock_sendall(client, b"x")
+        await loop.sock_recv(server, 1)
+        prev = ring.get(rng.randrange(SESSIONS))
+        if prev is not None:
+            prev.load(0).load(1)
+        latencies.append(time.perf_counter_ns() - scheduled)
+
+    tasks = set()
+    start = time.perf_counter_ns()
+    interval = int(1e9 / rate)
+    n = int(duration * rate)
+    for i in range(n):
+        scheduled = start + i * interval
+        delay = scheduled - time.perf_counter_ns()
+        if delay > 0:
+            await asyncio.sleep(delay / 1e9)
+        task = loop.create_task(handle(i, scheduled))
+        tasks.add(task)
+        task.add_done_callback(tasks.discard)
+    await asyncio.gather(*tasks)
+    wall_ns = time.perf_counter_ns() - start
+    server.close()
+    client.close()
+    return latencies, wall_ns
+
+
+def run_child(mode, rate, duration, seed):
+    import pyzgc
+    import pyzgc.asyncio
+    loop = asyncio.new_event_loop()
+    idle = pyzgc.asyncio.install(loop) if mode in ("idle", "both") else None
+    if mode in ("thread", "both"):
+        pyzgc.start_gc()
+    before = pyzgc.stats()
+    latencies, wall_ns = loop.run_until_complete(
+        serve(pyzgc, rate, duration, seed))
+    after = pyzgc.stats()
+    if mode in ("thread", "both"):
+        pyzgc.stop_gc()
+    loop.close()
+
+    cycles = after["cycles"] - before["cycles"]
+    idle_cycles = after["idle_cycles"] - before["idle_cycles"]
+    return {
+        "mode": mode,
+        "requests": len(latencies),
+        "requests_per_sec": len(latencies) / (wall_ns / 1e9),
+        "gc_cycles": cycles,
+        "idle_cycles": idle_cycles,
+        "idle_steps": idle.steps if idle else 0,
+        "idle_backoffs": idle.backoffs if idle else 0,
+        "idle_share": (idle.idle_ns if idle else 0) / wall_ns,
+        "pauses": after["pause"]["count"] - before["pause"]["count"],
+        "latency": percentiles(latencies),
+    }
+
+
+def us(ns):
+    return f"{ns / 1e3:.0f}"
+
+
+def print_table(results):
+    header = (f"{'mode':<7} {'req/s':>8} {'cycles':>6} {'idle':>5} "
+              f"{'steps':>6} {'backoffs':>8} {'idle time':>9}  "
+              f"{'latency p50/p99/p999/max (us)':<30}")
+    print(header)
+    print("-" * len(header))
+    for r in results:
+        lat = r["latency"]
+        latency = "/".join(us(lat[k]) for k in ("p50_ns", "p99_ns",
+                                                "p999_ns", "max_ns"))
+        print(f"{r['mode']:<7} {r['requests_per_sec']:>8,.0f} "
+              f"{r['gc_cycles']:>6} {r['idle_cycles']:>5} "
+              f"{r['idle_steps']:>6} {r['idle_backoffs']:>8} "
+              f"{r['idle_share']:>8.1%}  {latency:<30}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--duration", type=float, default=5.0,
+                        help="seconds per mode")
+    parser.add_argument("--rate", type=float, default=4000.0,
+                        help="requests per second")
+    parser.add_argument("--modes", default=",".join(MODES))
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", metavar="FILE",
+                        help="also write results as JSON")
+    parser.add_argument("--child", metavar="MODE", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.child:
+        result = run_child(args.child, args.rate, args.duration, args.seed)
+        print("RESULT " + json.dumps(result), flush=True)
+        return
+
+    print(f"Python {sys.version.split()[0]}, {args.duration:g}s per mode, "
+          f"{args.rate:g} requests/s\n")
+    results = []
+    for mode in args.modes.split(","):
+        out = subprocess.run(
+            [sys.executable, os.path.abspath(__file__), "--child", mode,
+             "--duration", str(args.duration), "--rate", str(args.rate),
+             "--seed", str(args.seed)],
+            check=True, stdout=subprocess.PIPE, text=True).stdout
+        # The collector thread logs to stdout too
+        line = next(l for l in out.splitlines() if l.startswith("RESULT "))
+        results.append(json.loads(line[len("RESULT "):]))
+    print_table(results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "duration": args.duration,
+                       "rate": args.rate, "seed": args.seed,
+                       "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,121 @@
+"""Memory per entry and lookup throughput of pyzgc.Dict against dict.
+
+Each container is filled with N str keys in a fresh subprocess (the value
+of a key is the key itself, so only the table is measured on top of the
+keys), then looked up with LOOKUPS random keys, built anew like keys read
+from input:
+
+  memory   RSS growth while filling, per entry; for pyzgc.Dict also the
+           growth of the heap's committed bytes (replaced tables that had
+           large pages of their own are given back)
+  fill     insertions per second, growth included
+  lookup   d[k] per second for present keys
+
+    python benchmarks/benchmark_dict.py --sizes 1000000,10000000
+
+No collector runs meanwhile: the numbers are those of the tables alone.
+"""
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+import time
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+KINDS = ("dict", "pyzgc.Dict")
+LOOKUPS = 1000000
+
+
+def rss_bytes():
+    with open("/proc/self/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1]) * 1024
+    return 0
+
+
+def run_child(kind, n, seed):
+    import pyzgc
+
+    def committed():
+        return pyzgc.heap_info()["memory"]["heap_bytes"]
+
+    keys = ["key%d" % i for i in range(n)]
+    rng = random.Random(seed)
+    probes = ["key%d" % rng.randrange(n) for _ in range(LOOKUPS)]
+    table = dict if kind == "dict" else pyzgc.Dict
+
+    rss_before, heap_before = rss_bytes(), committed()
+    start = time.perf_counter()
+    d = table()
+    for k in keys:
+        d[k] = k
+    fill_s = time.perf_counter() - start
+    rss_after, heap_after = rss_bytes(), committed()
+
+    start = time.perf_counter()
+    for k in probes:
+        d[k]
+    lookup_s = time.perf_counter() - start
+    return {
+        "kind": kind,
+        "entries": n,
+        "rss_per_entry": (rss_after - rss_before) / n,
+        "heap_per_entry": (heap_after - heap_before) / n,
+        "fills_per_sec": n / fill_s,
+        "lookups_per_sec": LOOKUPS / lookup_s,
+    }
+
+
+def print_table(results):
+    header = (f"{'entries':>10} {'kind':<11} {'RSS B/entry':>11} "
+              f"{'heap B/entry':>12} {'fills/s':>11} {'lookups/s':>11}")
+    print(header)
+    print("-" * len(header))
+    for r in results:
+        heap = (f"{r['heap_per_entry']:.1f}" if r["kind"] != "dict"
+                else "-")
+        print(f"{r['entries']:>10,} {r['kind']:<11} "
+              f"{r['rss_per_entry']:>11.1f} {heap:>12} "
+              f"{r['fills_per_sec']:>11,.0f} {r['lookups_per_sec']:>11,.0f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sizes", default="1000000,10000000",
+                        help="comma-separated entry counts")
+    parser.add_argument("--kinds", default=",".join(KINDS))
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", metavar="FILE",
+                        help="also write results as JSON")
+    parser.add_argument("--child", metavar="KIND", help=argparse.SUPPRESS)
+    parser.add_argument("--entries", type=int, help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.child:
+        result = run_child(args.child, args.entries, args.seed)
+        print("RESULT " + json.dumps(result), flush=True)
+        return
+
+    print(f"Python {sys.version.split()[0]}, {LOOKUPS:,} lookups per run\n")
+    results = []
+    for n in (int(s) for s in args.sizes.split(",")):
+        for kind in args.kinds.split(","):
+            out = subprocess.run(
+                [sys.executable, os.path.abspath(__file__), "--child", kind,
+                 "--entries", str(n), "--seed", str(args.seed)],
+                check=True, stdout=subprocess.PIPE, text=True).stdout
+            line = next(l for l in out.splitlines()
+                        if l.startswith("RESULT "))
+            results.append(json.loads(line[len("RESULT "):]))
+    print_table(results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "lookups": LOOKUPS,
+                       "seed": args.seed, "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
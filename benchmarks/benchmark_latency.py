@@ -0,0 +1,429 @@
+"""End-to-end GC latency and throughput suite.
+
+Runs realistic workloads for a fixed time against pyzgc (background
+collector running) and against plain CPython objects (cyclic gc enabled),
+each in a fresh subprocess, and reports side by side:
+
+  * throughput (ops/s)
+  * RSS over time (start / peak / end, sampled every 100 ms)
+  * GC CPU share (collector CPU time / wall time)
+  * collector pauses: p50/p99/p999/max
+      pyzgc:   safepoint pauses from pyzgc.stats()
+      CPython: gc.callbacks start -> stop
+  * mutator stalls: p50/p99/p999/max latency of single operations
+
+Workloads:
+  request     request/response with a steady live set of recent sessions
+  graph       a graph whose edges and nodes are rewired over time
+  cache       an LRU cache with churn (1/3 hit rate)
+  old_young   long-lived (old) objects receiving stores of fresh objects
+
+    python benchmarks/benchmark_latency.py --duration 5 --json latency.json
+
+pyzgc only traces from explicit roots, so each workload keeps its live set
+in a pyzgc object tree and re-adds the root every ROOT_INTERVAL operations.
+"""
+import argparse
+import collections
+import gc
+import json
+import os
+import random
+import subprocess
+import sys
+import threading
+import time
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+ROOT_INTERVAL = 1000
+NSLOTS = 10
+
+
+# --- Object models ---
+
+class PyNode:
+    __slots__ = ("slots", "__weakref__")
+
+    def __init__(self):
+        self.slots = [None] * NSLOTS
+
+
+class CPythonModel:
+    name = "cpython"
+
+    new = PyNode
+
+    @staticmethod
+    def store(obj, i, value):
+        obj.slots[i] = value
+
+    @staticmethod
+    def load(obj, i):
+        return obj.slots[i]
+
+    @staticmethod
+    def array(n):
+        return [None] * n
+
+    @staticmethod
+    def array_set(arr, i, value):
+        arr[i] = value
+
+    @staticmethod
+    def array_get(arr, i):
+        return arr[i]
+
+    def add_root(self, arr):
+        pass
+
+
+class PyZGCModel:
+    """Live sets live in a 10-ary tree of pyzgc objects (the GC root)."""
+    name = "pyzgc"
+
+    def __init__(self):
+        import pyzgc
+        self.pyzgc = pyzgc
+        self.new = pyzgc.Object
+
+    @staticmethod
+    def store(obj, i, value):
+        obj.store(i, value)
+
+    @staticmethod
+    def load(obj, i):
+        return obj.load(i)
+
+    def array(self, n):
+        depth = 1
+        while NSLOTS ** depth < n:
+            depth += 1
+
+        def build(level):
+            node = self.pyzgc.Object()
+            if level > 1:
+                for i in range(NSLOTS):
+                    node.store(i, build(level - 1))
+            return node
+
+        return (build(depth), depth)
+
+    @staticmethod
+    def _leaf(arr, i):
+        node, depth = arr
+        digits = []
+        for _ in range(depth):
+            digits.append(i % NSLOTS)
+            i //= NSLOTS
+        for d in reversed(digits[1:]):
+            node = node.load(d)
+        return node, digits[0]
+
+    def array_set(self, arr, i, value):
+        leaf, slot = self._leaf(arr, i)
+        leaf.store(slot, value)
+
+    def array_get(self, arr, i):
+        leaf, slot = self._leaf(arr, i)
+        return leaf.load(slot)
+
+    def add_root(self, arr):
+        self.pyzgc.add_root(arr[0])
+
+
+# --- Workloads ---
+# Each workload is set up once and returns (op, root); op(i) runs one
+# operation, root is the array holding the live set.
+
+def wl_request(m, rng):
+    sessions = 5000
+    ring = m.array(sessions)
+
+    def op(i):
+        # A request: header <-> body cycle plus a few payload objects
+        req = m.new()
+        body = m.new()
+        m.store(req, 0, body)
+        m.store(body, 0, req)
+        for k in range(1, 6):
+            part = m.new()
+            m.store(part, 1, i)
+            m.store(body, k, part)
+        # Response reads back from a random recent session
+        prev = m.array_get(ring, rng.randrange(sessions))
+        if prev is not None:
+            m.load(m.load(prev, 0), 1)
+        m.array_set(ring, i % sessions, req)
+
+    return op, ring
+
+
+def wl_graph(m, rng):
+    n = 20000
+    nodes = m.array(n)
+    for i in range(n):
+        m.array_set(nodes, i, m.new())
+    for i in range(n):
+        src = m.array_get(nodes, i)
+        for k in range(3):
+            m.store(src, k, m.array_get(nodes, rng.randrange(n)))
+
+    def op(i):
+        src = m.array_get(nodes, rng.randrange(n))
+        if rng.random() < 0.3:
+            # Replace a node: new node takes over a random slot
+            fresh = m.new()
+            for k in range(3):
+                m.store(fresh, k, m.array_get(nodes, rng.randrange(n)))
+            m.array_set(nodes, rng.randrange(n), fresh)
+            m.store(src, rng.randrange(3), fresh)
+        else:
+            m.store(src, rng.randrange(3), m.array_get(nodes, rng.randrange(n)))
+
+    return op, nodes
+
+
+def wl_cache(m, rng):
+    capacity = 10000
+    cache = collections.OrderedDict()
+    # The cache's values also live in a ring so pyzgc can trace them
+    ring = m.array(capacity)
+    state = {"next": 0}
+
+    def op(i):
+        key = rng.randrange(3 * capacity)
+        value = cache.get(key)
+        if value is not None:
+            cache.move_to_end(key)
+            m.load(value, 0)
+            return
+        value = m.new()
+        m.store(value, 0, m.new())
+        m.store(m.load(value, 0), 0, m.new())
+        cache[key] = value
+        m.array_set(ring, state["next"] % capacity, value)
+        state["next"] += 1
+        if len(cache) > capacity:
+            cache.popitem(last=False)
+
+    return op, ring
+
+
+def wl_old_young(m, rng):
+    holders = 2000
+    olds = m.array(holders)
+    for i in range(holders):
+        m.array_set(olds, i, m.new())
+    if m.name == "pyzgc":
+        # Survive a cycle so the holders are promoted to the old generation
+        m.add_root(olds)
+        m.pyzgc.gc()
+    else:
+        gc.collect()
+    held = [m.array_get(olds, i) for i in range(holders)]
+
+    def op(i):
+        young = m.new()
+        m.store(young, 0, i)
+        m.store(held[rng.randrange(holders)], rng.randrange(NSLOTS), young)
+
+    return op, olds
+
+
+WORKLOADS = {
+    "request": wl_request,
+    "graph": wl_graph,
+    "cache": wl_cache,
+    "old_young": wl_old_young,
+}
+
+
+# --- Measurement ---
+
+def rss_mb():
+    try:
+        with open("/proc/self/statm") as f:
+            pages = int(f.read().split()[1])
+        return pages * os.sysconf("SC_PAGE_SIZE") / (1 << 20)
+    except (OSError, ValueError):
+        import resource
+        # Peak, not current, where /proc is unavailable
+        kb = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        return kb / 1024 if sys.platform != "darwin" else kb / (1 << 20)
+
+
+def percentiles(values):
+    if not values:
+        return {"p50_ns": 0, "p99_ns": 0, "p999_ns": 0, "max_ns": 0}
+    values = sorted(values)
+
+    def rank(q):
+        return values[min(len(values) - 1, int(q * len(values)))]
+
+    return {"p50_ns": rank(0.50), "p99_ns": rank(0.99),
+            "p999_ns": rank(0.999), "max_ns": values[-1]}
+
+
+def histogram_delta(before, after):
+    """Percentiles of the pauses recorded between two pyzgc.stats() calls.
+
+    Buckets only give upper bounds, so values are bucket upper bounds capped
+    by the observed maximum.
+    """
+    counts = collections.Counter(dict(after["histogram"]))
+    counts.subtract(dict(before["histogram"]))
+    samples = []
+    for upper_us, count in sorted(counts.items()):
+        samples.extend([min(upper_us * 1000, after["max_ns"])] * count)
+    result = percentiles(samples)
+    result["count"] = after["count"] - before["count"]
+    return result
+
+
+def run_child(workload, collector, duration, seed):
+    rng = random.Random(seed)
+    model = PyZGCModel() if collector == "pyzgc" else CPythonModel()
+    op, root = WORKLOADS[workload](model, rng)
+    model.add_root(root)
+
+    rss = []
+    stop = threading.Event()
+    t0 = time.perf_counter()
+
+    def sampler():
+        while not stop.is_set():
+            rss.append((round(time.perf_counter() - t0, 3), round(rss_mb(), 1)))
+            stop.wait(0.1)
+
+    pauses = []
+    gc_start = [0]
+
+    def on_gc(phase, info):
+        if phase == "start":
+            gc_start[0] = time.perf_counter_ns()
+        else:
+            pauses.append(time.perf_counter_ns() - gc_start[0])
+
+    if collector == "pyzgc":
+        before = model.pyzgc.stats()
+        model.pyzgc.start_gc()
+    else:
+        gc.callbacks.append(on_gc)
+
+    sampler_thread = threading.Thread(target=sampler, daemon=True)
+    sampler_thread.start()
+
+    latencies = []
+    clock = time.perf_counter_ns
+    deadline = clock() + int(duration * 1e9)
+    ops = 0
+    start = clock()
+    while True:
+        t = clock()
+        if t >= deadline:
+            break
+        op(ops)
+        latencies.append(clock() - t)
+        ops += 1
+        if ops % ROOT_INTERVAL == 0:
+            model.add_root(root)
+    wall_ns = clock() - start
+
+    if collector == "pyzgc":
+        model.pyzgc.stop_gc()
+        after = model.pyzgc.stats()
+        pause = histogram_delta(before["pause"], after["pause"])
+        gc_cpu_ns = after["gc_cpu_ns"] - before["gc_cpu_ns"]
+        cycles = after["cycles"] - before["cycles"]
+    else:
+        gc.callbacks.remove(on_gc)
+        pause = percentiles(pauses)
+        pause["count"] = len(pauses)
+        # CPython collects on the mutator thread: pause time is GC CPU time
+        gc_cpu_ns = sum(pauses)
+        cycles = len(pauses)
+
+    stop.set()
+    sampler_thread.join()
+    rss.append((round(time.perf_counter() - t0, 3), round(rss_mb(), 1)))
+
+    return {
+        "workload": workload,
+        "collector": collector,
+        "ops": ops,
+        "ops_per_sec": ops / (wall_ns / 1e9),
+        "gc_cycles": cycles,
+        "gc_cpu_share": gc_cpu_ns / wall_ns,
+        "pause": pause,
+        "stall": percentiles(latencies),
+        "rss_mb": {"start": rss[0][1], "peak": max(r for _, r in rss),
+                   "end": rss[-1][1], "samples": rss},
+    }
+
+
+def us(ns):
+    return f"{ns / 1e3:.0f}"
+
+
+def print_table(results):
+    header = (f"{'workload':<10} {'collector':<8} {'ops/s':>10} "
+              f"{'rss peak':>9} {'gc cpu':>7} {'cycles':>6}  "
+              f"{'pause p50/p99/p999/max (us)':<28} "
+              f"{'stall p50/p99/p999/max (us)':<28}")
+    print(header)
+    print("-" * len(header))
+    for r in results:
+        p, s = r["pause"], r["stall"]
+        pause = "/".join(us(p[k]) for k in ("p50_ns", "p99_ns", "p999_ns",
+                                            "max_ns"))
+        stall = "/".join(us(s[k]) for k in ("p50_ns", "p99_ns", "p999_ns",
+                                            "max_ns"))
+        print(f"{r['workload']:<10} {r['collector']:<8} "
+              f"{r['ops_per_sec']:>10,.0f} {r['rss_mb']['peak']:>7.1f}MB "
+              f"{r['gc_cpu_share']:>6.1%} {r['gc_cycles']:>6}  "
+              f"{pause:<28} {stall:<28}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--duration", type=float, default=5.0,
+                        help="seconds per workload and collector")
+    parser.add_argument("--workloads", default=",".join(WORKLOADS))
+    parser.add_argument("--collectors", default="cpython,pyzgc")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", metavar="FILE",
+                        help="also write results (with RSS series) as JSON")
+    parser.add_argument("--child", nargs=2, metavar=("WORKLOAD", "COLLECTOR"),
+                        help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.child:
+        result = run_child(args.child[0], args.child[1], args.duration,
+                           args.seed)
+        print("RESULT " + json.dumps(result), flush=True)
+        return
+
+    print(f"Python {sys.version.split()[0]}, {args.duration:g}s per run, "
+          f"seed {args.seed}\n")
+    results = []
+    for workload in args.workloads.split(","):
+        for collector in args.collectors.split(","):
+            # Fresh process per run: RSS and heaps do not carry over
+            out = subprocess.run(
+                [sys.executable, os.path.abspath(__file__), "--child",
+                 workload, collector, "--duration", str(args.duration),
+                 "--seed", str(args.seed)],
+                check=True, stdout=subprocess.PIPE, text=True).stdout
+            # The collector thread logs to stdout too
+            line = next(l for l in out.splitlines() if l.startswith("RESULT "))
+            results.append(json.loads(line[len("RESULT "):]))
+    print_table(results)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "duration": args.duration,
+                       "seed": args.seed, "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
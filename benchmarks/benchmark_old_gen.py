@@ -0,0 +1,176 @@
+"""Copying against mark-region old generation (configure(old_gen=...)).
+
+A table of LIVE slots, each holding a short list of pyzgc.Objects, is
+promoted, then churned: every operation replaces the list of a random slot,
+so that the old generation fills with dead bodies scattered over every
+page. After OPS operations the table is rooted and a cycle runs, a full one
+after every MINOR minor ones. Each mode runs in a fresh process:
+
+  throughput  operations per second, collections included
+  gc          wall time spent in the collections, per full cycle
+  RSS         peak and final resident set
+  pauses      p99 and max of the safepoint pauses, from pyzgc.stats()
+  swept       old pages swept in place / evacuated to defragment them
+              (mark_region only)
+
+    python benchmarks/benchmark_old_gen.py --live 200000 --cycles 20
+"""
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+import time
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+MODES = ("copying", "mark_region")
+
+
+def rss_bytes():
+    with open("/proc/self/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1]) * 1024
+    return 0
+
+
+def histogram_percentile(before, after, q):
+    """Upper bound of the bucket holding the q-th pause between two
+    pyzgc.stats() calls, capped by the observed maximum."""
+    counts = dict(after["histogram"])
+    for upper_us, count in before["histogram"]:
+        counts[upper_us] = counts.get(upper_us, 0) - count
+    total = sum(counts.values())
+    seen = 0
+    for upper_us, count in sorted(counts.items()):
+        seen += count
+        if total and seen >= q * total:
+            return min(upper_us * 1000, after["max_ns"])
+    return 0
+
+
+def new_list(length, value):
+    import pyzgc
+    head = None
+    for _ in range(length):
+        node = pyzgc.Object()
+        node.store(0, value)
+        node.store(1, head)
+        head = node
+    return head
+
+
+def run_child(mode, live, ops, cycles, minor, seed):
+    import pyzgc
+    pyzgc.configure(old_gen=mode)
+    rng = random.Random(seed)
+    table = pyzgc.Array('ref', live)
+    for i in range(live):
+        table[i] = new_list(rng.randrange(1, 5), i)
+    for _ in range(2):
+        pyzgc.add_root(table)
+        pyzgc.gc()
+
+    before = pyzgc.stats()
+    peak = rss_bytes()
+    gc_s = 0.0
+    start = time.perf_counter()
+    for cycle in range(cycles * (minor + 1)):
+        for _ in range(ops):
+            i = rng.randrange(live)
+            table[i] = new_list(rng.randrange(1, 5), i)
+        pyzgc.add_root(table)
+        gc_start = time.perf_counter()
+        if cycle % (minor + 1) == minor:
+            pyzgc.gc()
+        else:
+            pyzgc.minor_gc()
+        gc_s += time.perf_counter() - gc_start
+        peak = max(peak, rss_bytes())
+    elapsed = time.perf_counter() - start
+    after = pyzgc.stats()
+
+    for i in range(0, live, max(1, live // 1000)):
+        assert table[i].load(0) == i
+    return {
+        "mode": mode,
+        "live": live,
+        "ops_per_sec": ops * cycles * (minor + 1) / elapsed,
+        "gc_ms_per_full_cycle": gc_s * 1000 / cycles,
+        "rss_peak": peak,
+        "rss_end": rss_bytes(),
+        "pause_p99_ns": histogram_percentile(before["pause"], after["pause"],
+                                             0.99),
+        "pause_max_ns": after["pause"]["max_ns"],
+        "swept_pages": after["swept_pages"] - before["swept_pages"],
+        "defrag_pages": after["defrag_pages"] - before["defrag_pages"],
+    }
+
+
+def print_table(results):
+    header = (f"{'live':>9} {'mode':<12} {'ops/s':>10} {'gc ms/full':>10} "
+              f"{'RSS peak/end (MB)':>18} {'pause p99/max (us)':>19} "
+              f"{'swept/defrag':>13}")
+    print(header)
+    print("-" * len(header))
+    for r in results:
+        rss = f"{r['rss_peak'] / 2**20:.0f}/{r['rss_end'] / 2**20:.0f}"
+        pause = (f"{r['pause_p99_ns'] / 1000:.0f}/"
+                 f"{r['pause_max_ns'] / 1000:.0f}")
+        swept = (f"{r['swept_pages']}/{r['defrag_pages']}"
+                 if r["mode"] == "mark_region" else "-")
+        print(f"{r['live']:>9,} {r['mode']:<12} {r['ops_per_sec']:>10,.0f} "
+              f"{r['gc_ms_per_full_cycle']:>10.1f} {rss:>18} {pause:>19} "
+              f"{swept:>13}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--live", default="200000",
+                        help="comma-separated table sizes")
+    parser.add_argument("--ops", type=int, default=50000,
+                        help="operations between two cycles")
+    parser.add_argument("--cycles", type=int, default=20,
+                        help="full cycles per run")
+    parser.add_argument("--minor", type=int, default=3,
+                        help="minor cycles before each full one")
+    parser.add_argument("--modes", default=",".join(MODES))
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", metavar="FILE",
+                        help="also write results as JSON")
+    parser.add_argument("--child", metavar="MODE", help=argparse.SUPPRESS)
+    parser.add_argument("--slots", type=int, help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.child:
+        result = run_child(args.child, args.slots, args.ops, args.cycles,
+                           args.minor, args.seed)
+        print("RESULT " + json.dumps(result), flush=True)
+        return
+
+    print(f"Python {sys.version.split()[0]}, {args.ops:,} operations per "
+          f"cycle, {args.cycles} full cycles after {args.minor} minor "
+          f"ones each\n")
+    results = []
+    for live in (int(s) for s in args.live.split(",")):
+        for mode in args.modes.split(","):
+            out = subprocess.run(
+                [sys.executable, os.path.abspath(__file__), "--child", mode,
+                 "--slots", str(live), "--ops", str(args.ops),
+                 "--cycles", str(args.cycles), "--minor", str(args.minor),
+                 "--seed", str(args.seed)],
+                check=True, stdout=subprocess.PIPE, text=True).stdout
+            line = next(l for l in out.splitlines()
+                        if l.startswith("RESULT "))
+            results.append(json.loads(line[len("RESULT "):]))
+    print_table(results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "ops": args.ops,
+                       "cycles": args.cycles, "minor": args.minor,
+                       "seed": args.seed, "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,135 @@
+"""Thread scaling benchmark.
+
+Runs each workload with 1..N threads and reports throughput, speedup over
+one thread and parallel efficiency. Meant for free-threaded CPython
+(3.13t and later), where pyzgc runs without the GIL; on a regular build the
+numbers show how much the GIL serializes the same work.
+
+    python benchmarks/benchmark_scaling.py --max-threads 8 --json out.json
+"""
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+import pyzgc
+
+
+def work_alloc(ops):
+    # Pure TLAB allocation, objects die right away
+    for _ in range(ops):
+        pyzgc.Object()
+
+
+def work_store_load(ops):
+    # Slot traffic on a thread-private object (barriers, no allocation)
+    o = pyzgc.Object()
+    child = pyzgc.Object()
+    for i in range(ops):
+        o.store(i % 10, child)
+        o.load(i % 10)
+
+
+def work_graph(ops):
+    # Build and drop short linked lists: allocation plus old-value stores
+    head = None
+    for i in range(ops):
+        n = pyzgc.Object()
+        n.store(0, head)
+        head = n if i % 64 else None
+
+
+WORKLOADS = {
+    "alloc": work_alloc,
+    "store_load": work_store_load,
+    "graph": work_graph,
+}
+
+
+def run(fn, threads, ops):
+    barrier = threading.Barrier(threads + 1)
+
+    def worker():
+        barrier.wait()
+        fn(ops)
+
+    pool = [threading.Thread(target=worker) for _ in range(threads)]
+    for t in pool:
+        t.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for t in pool:
+        t.join()
+    elapsed = time.perf_counter() - start
+    return threads * ops / elapsed
+
+
+def gil_enabled():
+    check = getattr(sys, "_is_gil_enabled", None)
+    return True if check is None else check()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--max-threads", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--ops", type=int, default=200000,
+                        help="operations per thread")
+    parser.add_argument("--workloads", default=",".join(WORKLOADS))
+    parser.add_argument("--no-gc", action="store_true",
+                        help="do not run the background collector")
+    parser.add_argument("--json", metavar="FILE",
+                        help="also write results as JSON")
+    args = parser.parse_args()
+
+    counts = []
+    n = 1
+    while n < args.max_threads:
+        counts.append(n)
+        n *= 2
+    counts.append(args.max_threads)
+
+    print(f"Python {sys.version.split()[0]}, GIL enabled: {gil_enabled()}, "
+          f"cpus: {os.cpu_count()}\n")
+
+    if not args.no_gc:
+        pyzgc.start_gc()
+
+    results = {}
+    for name in args.workloads.split(","):
+        fn = WORKLOADS[name]
+        fn(args.ops // 10)  # Warm up TLABs and freelists
+        rows = []
+        print(f"[{name}]")
+        print(f"  {'threads':>7} {'ops/s':>14} {'speedup':>8} {'eff':>6}")
+        base = None
+        for threads in counts:
+            ops_per_sec = run(fn, threads, args.ops)
+            base = base or ops_per_sec
+            speedup = ops_per_sec / base
+            rows.append({"threads": threads, "ops_per_sec": ops_per_sec,
+                         "speedup": speedup,
+                         "efficiency": speedup / threads})
+            print(f"  {threads:>7} {ops_per_sec:>14,.0f} {speedup:>7.2f}x "
+                  f"{speedup / threads:>5.0%}")
+        results[name] = rows
+        print()
+
+    if not args.no_gc:
+        pyzgc.stop_gc()
+
+    s = pyzgc.stats()
+    print(f"safepoints: {s['safepoints']}, "
+          f"time-to-safepoint p99: {s['time_to_safepoint']['p99_ns'] / 1e3:.0f}us, "
+          f"pause p99: {s['pause']['p99_ns'] / 1e3:.0f}us")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "gil_enabled": gil_enabled(),
+                       "cpus": os.cpu_count(), "ops_per_thread": args.ops,
+                       "workloads": results, "stats": s}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
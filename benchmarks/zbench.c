@@ -0,0 +1,599 @@
+// C microbenchmarks for the collector's hot paths.
+//
+// Build:   python3 setup.py build_bench           (-> benchmarks/zbench)
+// Run:     benchmarks/zbench [--json FILE] [--filter STR] [--quick]
+//                            [--mark-nodes N] [--mark-fanout K]
+//                            [--density D,D,...]
+// Compare: benchmarks/zbench --compare BASE.json NEW.json [--threshold PCT]
+//
+// Every benchmark takes a number of samples (one timed batch each) and
+// reports the mean ns/op, p50/p90/p99 over the samples and cycles/op where a
+// cycle counter is available. The JSON output has one benchmark per line in
+// a fixed key order, so runs diff cleanly and --compare can read them back
+// without a JSON library. --compare exits with 1 if any p50 got slower than
+// the threshold (default 5%).
+//
+// The interpreter is embedded only to get real handles (pyzgc.Object); no
+// Python code runs while timing.
+#define PY_SSIZE_T_CLEAN
+#include "zbarrier.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zobject.h"
+#include "zpool.h"
+#include <Python.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ZB_HAVE_CYCLES 1
+#endif
+
+#define ZB_MAX_SAMPLES 256
+#define ZB_MAX_RESULTS 64
+#define ZB_MAX_DENSITIES 8
+
+typedef struct {
+  char name[64];
+  int nsamples;
+  double samples[ZB_MAX_SAMPLES]; // ns/op of each batch
+  uint64_t total_ns;
+  uint64_t total_cycles;
+  uint64_t total_ops;
+  // Current batch
+  uint64_t t0;
+  uint64_t c0;
+} ZBench;
+
+static struct {
+  const char *json_path;
+  const char *filter;
+  int quick;
+  size_t mark_nodes;
+  int mark_fanout;
+  double densities[ZB_MAX_DENSITIES];
+  int ndensities;
+} opts = {NULL, NULL, 0, 100000, 4, {0.1, 0.5, 0.9}, 3};
+
+static ZBench results[ZB_MAX_RESULTS];
+static int nresults = 0;
+
+// --- Timing ---
+
+static uint64_t zb_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t zb_cycles(void) {
+#ifdef ZB_HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Deterministic PRNG so that every run builds the same graphs and pages
+static uint64_t zb_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t zb_random(void) {
+  zb_rng ^= zb_rng << 13;
+  zb_rng ^= zb_rng >> 7;
+  zb_rng ^= zb_rng << 17;
+  return zb_rng;
+}
+
+static ZBench *zb_open(const char *fmt, ...) {
+  char name[64];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(name, sizeof(name), fmt, ap);
+  va_end(ap);
+
+  if ((opts.filter && !strstr(name, opts.filter)) ||
+      nresults == ZB_MAX_RESULTS)
+    return NULL;
+  ZBench *b = &results[nresults++];
+  memset(b, 0, sizeof(*b));
+  strcpy(b->name, name);
+  return b;
+}
+
+static inline void zb_start(ZBench *b) {
+  b->c0 = zb_cycles();
+  b->t0 = zb_now_ns();
+}
+
+static inline void zb_stop(ZBench *b, uint64_t ops) {
+  uint64_t ns = zb_now_ns() - b->t0;
+  uint64_t cycles = zb_cycles() - b->c0;
+  if (ops == 0)
+    return;
+  b->total_ns += ns;
+  b->total_cycles += cycles;
+  b->total_ops += ops;
+  if (b->nsamples < ZB_MAX_SAMPLES)
+    b->samples[b->nsamples++] = (double)ns / (double)ops;
+}
+
+static int zb_compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile; samples must be sorted
+static double zb_percentile(const ZBench *b, double p) {
+  if (b->nsamples == 0)
+    return 0;
+  int rank = (int)(p / 100.0 * b->nsamples + 0.999999);
+  if (rank < 1)
+    rank = 1;
+  if (rank > b->nsamples)
+    rank = b->nsamples;
+  return b->samples[rank - 1];
+}
+
+static int zb_samples(int full) { return opts.quick ? (full + 3) / 4 : full; }
+
+// --- Fixtures ---
+
+static ZObject *zb_new_object(void) {
+  PyTypeObject *type = zstate->types.object;
+  ZObject *obj = (ZObject *)type->tp_alloc(type, 0);
+  if (!obj) {
+    fprintf(stderr, "zbench: out of memory\n");
+    exit(2);
+  }
+  return obj;
+}
+
+static uintptr_t zb_bad_color(void) {
+  return zstate->good_color == ZPOINTER_MARKED0_BIT ? ZPOINTER_MARKED1_BIT
+                                                : ZPOINTER_MARKED0_BIT;
+}
+
+static void zb_clear_marks(void) {
+  for (ZPage *p = zheap_get_head_page(); p; p = p->next)
+    zpage_clear_bitmap(p);
+}
+
+// Fills a fresh young page with bodies, marks about `density` of them and
+// puts the page into the relocation set. The live (uncolored) bodies are
+// returned through `live` (caller frees).
+static ZPage *zb_make_relocation_page(double density, void ***live,
+                                      size_t *nlive) {
+  // Run to the start of a new page
+  void *body = Z_ADDRESS(zheap_alloc_inline(sizeof(ZBody)));
+  ZPage *start = zheap_get_page(body);
+  while (zheap_get_page(body) == start)
+    body = Z_ADDRESS(zheap_alloc_inline(sizeof(ZBody)));
+
+  ZPage *page = zheap_get_page(body);
+  size_t capacity = ZPAGE_SIZE / sizeof(ZBody);
+  void **bodies = malloc(capacity * sizeof(void *));
+  size_t n = 0;
+  zpage_clear_bitmap(page);
+  while (zheap_get_page(body) == page) {
+    if ((double)(zb_random() % 10000) < density * 10000) {
+      zpage_mark_object(page, body);
+      page->live_bytes += sizeof(ZBody);
+      bodies[n++] = body;
+    }
+    body = Z_ADDRESS(zheap_alloc_inline(sizeof(ZBody)));
+  }
+
+  zpage_start_evacuation(page);
+  atomic_store(&page->is_relocating, true);
+  *live = bodies;
+  *nlive = n;
+  return page;
+}
+
+// --- Benchmarks ---
+
+static void bench_alloc_inline(void) {
+  ZBench *b = zb_open("alloc_inline");
+  if (!b)
+    return;
+  const int batch = 1000;
+  for (int s = 0; s < zb_samples(100); s++) {
+    zb_start(b);
+    for (int i = 0; i < batch; i++) {
+      void *volatile body = zheap_alloc_inline(sizeof(ZBody));
+      (void)body;
+    }
+    zb_stop(b, batch);
+  }
+}
+
+static void bench_tlab_refill(void) {
+  ZBench *b = zb_open("tlab_refill");
+  if (!b)
+    return;
+  const int batch = 8;
+  for (int s = 0; s < zb_samples(50); s++) {
+    zb_start(b);
+    for (int i = 0; i < batch; i++) {
+      zheap_tlab.top = zheap_tlab.end; // Exhausted: next alloc refills
+      void *volatile body = zheap_alloc(sizeof(ZBody), ZGEN_YOUNG);
+      (void)body;
+    }
+    zb_stop(b, batch);
+  }
+}
+
+// Refills that need a new page: mapped on the spot, or taken from the pool
+static void bench_page_refill(void) {
+  ZBench *direct = zb_open("page_refill");
+  ZBench *pooled = zb_open("page_refill_pooled");
+  const int batch = 4;
+  for (int s = 0; s < zb_samples(20); s++) {
+    for (int pool = 0; pool < 2; pool++) {
+      ZBench *b = pool ? pooled : direct;
+      if (!b)
+        continue;
+      // Let the filler catch up
+      zpool_configure(pool ? batch : 0, false);
+      ZPoolStats stats;
+      do {
+        usleep(1000);
+        zpool_get_stats(&stats);
+      } while (pool && stats.ready < (size_t)batch);
+      zb_start(b);
+      for (int i = 0; i < batch; i++) {
+        ZPage *page = zheap_get_current_page();
+        page->top = page->end; // Exhausted: next refill maps a page
+        zheap_tlab.top = zheap_tlab.end;
+        void *volatile body = zheap_alloc(sizeof(ZBody), ZGEN_YOUNG);
+        (void)body;
+      }
+      zb_stop(b, batch);
+    }
+  }
+  zpool_configure(ZPOOL_DEFAULT_PAGES, false);
+}
+
+#define ZB_HANDLES 1024
+
+static void bench_barrier(void) {
+  ZBench *fast = zb_open("barrier_fast");
+  ZBench *remap = zb_open("barrier_slow_remap");
+  ZBench *forward = zb_open("barrier_slow_forward");
+  ZBench *resolve = zb_open("resolve_forwarding");
+  if (!fast && !remap && !forward && !resolve)
+    return;
+
+  ZObject *handles[ZB_HANDLES];
+  ZBody *saved[ZB_HANDLES];
+  for (int i = 0; i < ZB_HANDLES; i++) {
+    handles[i] = zb_new_object();
+    saved[i] = handles[i]->body;
+  }
+
+  // Fast path: good color, one compare per load
+  for (int s = 0; fast && s < zb_samples(200); s++) {
+    zb_start(fast);
+    for (int pass = 0; pass < 10; pass++)
+      for (int i = 0; i < ZB_HANDLES; i++)
+        zbarrier_load((PyObject *)handles[i]);
+    zb_stop(fast, 10 * ZB_HANDLES);
+  }
+
+  // Slow path, page not evacuated: recolor only
+  uintptr_t bad = zb_bad_color();
+  for (int s = 0; remap && s < zb_samples(200); s++) {
+    for (int i = 0; i < ZB_HANDLES; i++)
+      handles[i]->body = (ZBody *)Z_WITH_COLOR(saved[i], bad);
+    zb_start(remap);
+    for (int i = 0; i < ZB_HANDLES; i++)
+      zbarrier_fix_pointer(handles[i]);
+    zb_stop(remap, ZB_HANDLES);
+  }
+
+  // Slow path through the forwarding table of a relocated page
+  void **live;
+  size_t nlive;
+  ZPage *page = zb_make_relocation_page(1.0, &live, &nlive);
+  zgc_relocate_page(page);
+  size_t nfwd = nlive < ZB_HANDLES ? nlive : ZB_HANDLES;
+  for (int s = 0; forward && s < zb_samples(200); s++) {
+    for (size_t i = 0; i < nfwd; i++)
+      handles[i]->body = (ZBody *)Z_WITH_COLOR(live[i], bad);
+    zb_start(forward);
+    for (size_t i = 0; i < nfwd; i++)
+      zbarrier_fix_pointer(handles[i]);
+    zb_stop(forward, nfwd);
+  }
+
+  // Forwarding table lookups at random offsets
+  size_t *order = malloc(nlive * sizeof(size_t));
+  for (size_t i = 0; i < nlive; i++)
+    order[i] = zb_random() % nlive;
+  for (int s = 0; resolve && s < zb_samples(200); s++) {
+    zb_start(resolve);
+    for (size_t i = 0; i < nlive; i++) {
+      void *volatile to = zpage_resolve_forwarding(page, live[order[i]]);
+      (void)to;
+    }
+    zb_stop(resolve, nlive);
+  }
+  free(order);
+  free(live);
+
+  for (int i = 0; i < ZB_HANDLES; i++) {
+    handles[i]->body = saved[i];
+    Py_DECREF(handles[i]);
+  }
+}
+
+typedef enum { ZB_LIST, ZB_TREE, ZB_RANDOM } ZGraphShape;
+
+static const char *zb_shape_names[] = {"list", "tree", "random"};
+
+static void bench_mark_shape(ZGraphShape shape) {
+  size_t n = opts.quick ? opts.mark_nodes / 5 : opts.mark_nodes;
+  ZBench *b = zb_open("mark/%s/n=%zu", zb_shape_names[shape], n);
+  if (!b)
+    return;
+
+  int fanout = opts.mark_fanout;
+  ZObject **nodes = malloc(n * sizeof(ZObject *));
+  for (size_t i = 0; i < n; i++)
+    nodes[i] = zb_new_object();
+
+  for (size_t i = 0; i < n; i++) {
+    switch (shape) {
+    case ZB_LIST:
+      if (i + 1 < n)
+        zobject_store_slot(nodes[i], 0, (PyObject *)nodes[i + 1]);
+      break;
+    case ZB_TREE:
+      for (int k = 0; k < fanout; k++) {
+        size_t child = i * fanout + k + 1;
+        if (child < n)
+          zobject_store_slot(nodes[i], k, (PyObject *)nodes[child]);
+      }
+      break;
+    case ZB_RANDOM:
+      // A spine keeps everything reachable; the rest are random edges
+      if (i + 1 < n)
+        zobject_store_slot(nodes[i], 0, (PyObject *)nodes[i + 1]);
+      for (int k = 1; k <= fanout && k < ZOBJECT_SLOTS; k++)
+        zobject_store_slot(nodes[i], k, (PyObject *)nodes[zb_random() % n]);
+      break;
+    }
+  }
+
+  for (int s = 0; s < zb_samples(10); s++) {
+    zb_clear_marks();
+    zgc_add_root(nodes[0]);
+    zb_start(b);
+    zgc_mark();
+    zb_stop(b, n);
+  }
+
+  // Slots are not released by dealloc; the graph is simply abandoned
+  for (size_t i = 0; i < n; i++)
+    Py_DECREF(nodes[i]);
+  free(nodes);
+}
+
+static void bench_relocate(double density) {
+  ZBench *b = zb_open("relocate/density=%.2f", density);
+  if (!b)
+    return;
+  for (int s = 0; s < zb_samples(8); s++) {
+    void **live;
+    size_t nlive;
+    ZPage *page = zb_make_relocation_page(density, &live, &nlive);
+    zb_start(b);
+    zgc_relocate_page(page);
+    zb_stop(b, nlive);
+    free(live);
+  }
+}
+
+// --- Output ---
+
+static void zb_report(FILE *json) {
+  printf("%-28s %10s %10s %10s %10s %10s\n", "benchmark", "ns/op", "p50",
+         "p90", "p99", "cycles/op");
+  if (json)
+    fprintf(json, "{\n  \"schema\": 1,\n  \"quick\": %s,\n  \"benchmarks\": [\n",
+            opts.quick ? "true" : "false");
+
+  for (int r = 0; r < nresults; r++) {
+    ZBench *b = &results[r];
+    qsort(b->samples, b->nsamples, sizeof(double), zb_compare_double);
+    double mean = b->total_ops ? (double)b->total_ns / b->total_ops : 0;
+    double cycles = b->total_ops ? (double)b->total_cycles / b->total_ops : 0;
+    double p50 = zb_percentile(b, 50), p90 = zb_percentile(b, 90),
+           p99 = zb_percentile(b, 99);
+
+    printf("%-28s %10.2f %10.2f %10.2f %10.2f", b->name, mean, p50, p90, p99);
+#ifdef ZB_HAVE_CYCLES
+    printf(" %10.1f\n", cycles);
+#else
+    printf(" %10s\n", "-");
+#endif
+
+    if (json) {
+      fprintf(json,
+              "    {\"name\": \"%s\", \"ops\": %llu, \"samples\": %d, "
+              "\"ns_per_op\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, "
+              "\"p99_ns\": %.3f, ",
+              b->name, (unsigned long long)b->total_ops, b->nsamples, mean,
+              p50, p90, p99);
+#ifdef ZB_HAVE_CYCLES
+      fprintf(json, "\"cycles_per_op\": %.2f}", cycles);
+#else
+      fprintf(json, "\"cycles_per_op\": null}");
+#endif
+      fprintf(json, "%s\n", r + 1 < nresults ? "," : "");
+    }
+  }
+
+  if (json)
+    fprintf(json, "  ]\n}\n");
+}
+
+// --- Compare mode ---
+
+typedef struct {
+  char name[64];
+  double p50;
+} ZBaseline;
+
+// Reads back what zb_report wrote: one benchmark object per line
+static int zb_load(const char *path, ZBaseline *out, int max) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+  char line[1024];
+  int n = 0;
+  while (n < max && fgets(line, sizeof(line), f)) {
+    char *name = strstr(line, "\"name\": \"");
+    char *p50 = strstr(line, "\"p50_ns\": ");
+    if (!name || !p50)
+      continue;
+    name += strlen("\"name\": \"");
+    char *end = strchr(name, '"');
+    if (!end || end - name >= (long)sizeof(out[n].name))
+      continue;
+    memcpy(out[n].name, name, end - name);
+    out[n].name[end - name] = '\0';
+    out[n].p50 = strtod(p50 + strlen("\"p50_ns\": "), NULL);
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+static int zb_compare(const char *base_path, const char *new_path,
+                      double threshold) {
+  ZBaseline base[ZB_MAX_RESULTS], cur[ZB_MAX_RESULTS];
+  int nbase = zb_load(base_path, base, ZB_MAX_RESULTS);
+  int ncur = zb_load(new_path, cur, ZB_MAX_RESULTS);
+  if (nbase < 0 || ncur < 0)
+    return 2;
+
+  int regressions = 0;
+  printf("%-28s %10s %10s %8s\n", "benchmark (p50 ns/op)", "base", "new",
+         "delta");
+  for (int i = 0; i < ncur; i++) {
+    const ZBaseline *b = NULL;
+    for (int j = 0; j < nbase; j++) {
+      if (strcmp(base[j].name, cur[i].name) == 0)
+        b = &base[j];
+    }
+    if (!b) {
+      printf("%-28s %10s %10.2f %8s\n", cur[i].name, "-", cur[i].p50, "new");
+      continue;
+    }
+    double delta = b->p50 > 0 ? (cur[i].p50 / b->p50 - 1.0) * 100.0 : 0;
+    int regressed = delta > threshold;
+    regressions += regressed;
+    printf("%-28s %10.2f %10.2f %+7.1f%%%s\n", cur[i].name, b->p50, cur[i].p50,
+           delta, regressed ? "  REGRESSION" : "");
+  }
+  printf("\n%d regression(s) over %.1f%%\n", regressions, threshold);
+  return regressions ? 1 : 0;
+}
+
+// --- Main ---
+
+static void zb_usage(void) {
+  fprintf(stderr,
+          "usage: zbench [--json FILE] [--filter STR] [--quick]\n"
+          "              [--mark-nodes N] [--mark-fanout K] [--density "
+          "D,D,...]\n"
+          "       zbench --compare BASE.json NEW.json [--threshold PCT]\n");
+}
+
+int main(int argc, char **argv) {
+  const char *compare_base = NULL, *compare_new = NULL;
+  double threshold = 5.0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    int has_value = i + 1 < argc;
+    if (strcmp(arg, "--json") == 0 && has_value) {
+      opts.json_path = argv[++i];
+    } else if (strcmp(arg, "--filter") == 0 && has_value) {
+      opts.filter = argv[++i];
+    } else if (strcmp(arg, "--quick") == 0) {
+      opts.quick = 1;
+    } else if (strcmp(arg, "--mark-nodes") == 0 && has_value) {
+      opts.mark_nodes = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--mark-fanout") == 0 && has_value) {
+      opts.mark_fanout = atoi(argv[++i]);
+    } else if (strcmp(arg, "--density") == 0 && has_value) {
+      opts.ndensities = 0;
+      for (char *tok = strtok(argv[++i], ","); tok && opts.ndensities <
+                                                      ZB_MAX_DENSITIES;
+           tok = strtok(NULL, ","))
+        opts.densities[opts.ndensities++] = strtod(tok, NULL);
+    } else if (strcmp(arg, "--compare") == 0 && i + 2 < argc) {
+      compare_base = argv[++i];
+      compare_new = argv[++i];
+    } else if (strcmp(arg, "--threshold") == 0 && has_value) {
+      threshold = strtod(argv[++i], NULL);
+    } else {
+      zb_usage();
+      return 2;
+    }
+  }
+
+  if (compare_base)
+    return zb_compare(compare_base, compare_new, threshold);
+
+  if (opts.mark_nodes < 2 || opts.mark_fanout < 1 ||
+      opts.mark_fanout > ZOBJECT_SLOTS) {
+    fprintf(stderr, "zbench: need --mark-nodes >= 2 and 1 <= --mark-fanout "
+                    "<= %d\n",
+            ZOBJECT_SLOTS);
+    return 2;
+  }
+
+  Py_Initialize();
+  zstate_attach(zstate_get(PyInterpreterState_Get()));
+  zheap_init();
+  // Made the way the module makes it (pyzgc_init_types), without the rest
+  // of the module
+  zstate->types.object = (PyTypeObject *)PyType_FromSpec(&ZObjectSpec);
+  if (!zstate->types.object) {
+    PyErr_Print();
+    return 2;
+  }
+
+  bench_alloc_inline();
+  bench_tlab_refill();
+  bench_page_refill();
+  bench_barrier();
+  bench_mark_shape(ZB_LIST);
+  bench_mark_shape(ZB_TREE);
+  bench_mark_shape(ZB_RANDOM);
+  for (int i = 0; i < opts.ndensities; i++)
+    bench_relocate(opts.densities[i]);
+
+  FILE *json = NULL;
+  if (opts.json_path) {
+    json = fopen(opts.json_path, "w");
+    if (!json) {
+      perror(opts.json_path);
+      return 2;
+    }
+  }
+  zb_report(json);
+  if (json)
+    fclose(json);
+  return 0;
+}
@@ -1,19 +1,80 @@
-from setuptools import setup, Extension
+import sysconfig
+from setuptools import Command, setup, Extension
+
+SOURCES = [
+    'src/zheap.c',
+    'src/zobject.c',
+    'src/zgc.c',
+    'src/zbarrier.c',
+    'src/zcgroup.c',
+    'src/zmarkstack.c',
+    'src/zsatb.c',
+    'src/zsafepoint.c',
+    'src/zimage.c',
+    'src/zstruct.c',
+    'src/zarray.c',
+    'src/zdict.c',
+    'src/zref.c',
+    'src/zpin.c',
+    'src/zpool.c',
+    'src/zprof.c',
+    'src/zregion.c',
+    'src/zcard.c',
+    'src/zfork.c',
+    'src/zasyncio.c',
+    'src/zstate.c',
+]
+COMPILE_ARGS = ['-std=c11', '-O3', '-pthread']
+LIBRARIES = ['m']
 
 module = Extension(
     'pyzgc',
-    sources=[
-        'src/pyzgcmodule.c',
-        'src/zheap.c',
-        'src/zobject.c',
-        'src/zgc.c',
-        'src/zbarrier.c',
-        'src/zmarkstack.c',
-    ],
+    sources=['src/pyzgcmodule.c'] + SOURCES,
     include_dirs=['src'],
-    extra_compile_args=['-std=c11', '-O3', '-pthread'],
+    extra_compile_args=COMPILE_ARGS,
+    libraries=LIBRARIES,
 )
 
+
+class BuildBench(Command):
+    """Build the C microbenchmarks (benchmarks/zbench) against libpython."""
+
+    description = "build the C microbenchmark harness benchmarks/zbench"
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        from distutils.ccompiler import new_compiler
+        from distutils.sysconfig import customize_compiler
+
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        build_temp = self.get_finalized_command('build').build_temp
+        objects = compiler.compile(
+            SOURCES + ['benchmarks/zbench.c'],
+            output_dir=build_temp,
+            include_dirs=['src', sysconfig.get_paths()['include']],
+            extra_postargs=COMPILE_ARGS,
+        )
+        libdir = sysconfig.get_config_var('LIBDIR')
+        compiler.link_executable(
+            objects,
+            'benchmarks/zbench',
+            libraries=['python' + sysconfig.get_config_var('LDVERSION')] +
+            LIBRARIES,
+            library_dirs=[libdir],
+            runtime_library_dirs=[libdir],
+            extra_postargs=['-pthread'] +
+            sysconfig.get_config_var('LIBS').split(),
+        )
+
+
 setup(
     ext_modules=[module],
+    cmdclass={'build_bench': BuildBench},
 )
@@ -0,0 +1,184 @@
+#ifndef PYZGC_CAPI_H
+#define PYZGC_CAPI_H
+
+#include <Python.h>
+#include <stdint.h>
+
+// Stable C-level ABI for JITs (PyPy, Cinder) and C/Cython extensions.
+//
+// This is the only header an external consumer needs. It is self-contained
+// (no zheap.h / zobject.h) and its constants are checked against the
+// collector's own definitions at build time in pyzgcmodule.c, so the two can
+// never drift apart.
+//
+// Usage:
+//   if (PyZGC_ImportAPI() < 0) return NULL;   // in your PyInit_*
+//
+//   PyZGC_API->enter();                       // free-threaded builds
+//   PyObject **slots = PyZGC_Slots(obj);      // load barrier on obj
+//   PyObject *child = slots[3];               // borrowed, unless encoded
+//   PyZGC_API->leave();
+//   PyZGC_API->store_slot(obj, 3, value);     // write barrier + refcount
+
+// Bump when the layout of PyZGC_CAPI, any constant below or what callers
+// may assume about slots and inline allocation changes incompatibly. New
+// members are only ever appended (check struct_size). An extension built
+// against another version fails PyZGC_ImportAPI and must be rebuilt.
+//   1  first release
+//   2  slots may hold encoded references (heap images, references to
+//      bodies tagged 0x5), read through load_slot; PyZGC_AllocInline only
+//      takes whole bodies inside pyzgc.region() and under mark_region
+//   3  one static table for every interpreter: object_type and good_color
+//      are functions returning the calling interpreter's
+#define PYZGC_CAPI_VERSION 3
+#define PYZGC_CAPSULE_NAME "pyzgc._C_API"
+
+// --- Colored Pointers (mirror of zheap.h) ---
+#define PYZGC_MARKED0_BIT (1ULL << 60)
+#define PYZGC_MARKED1_BIT (1ULL << 61)
+#define PYZGC_REMAPPED_BIT (1ULL << 62)
+#define PYZGC_FINALIZABLE_BIT (1ULL << 63)
+#define PYZGC_COLOR_MASK                                                       \
+  (PYZGC_MARKED0_BIT | PYZGC_MARKED1_BIT | PYZGC_REMAPPED_BIT |                \
+   PYZGC_FINALIZABLE_BIT)
+#define PYZGC_ADDRESS_MASK (~PYZGC_COLOR_MASK)
+
+// Mirror of ZTLAB (zheap.h)
+typedef struct {
+  uintptr_t top;
+  uintptr_t end;
+} PyZGC_TLAB;
+
+typedef struct {
+  // ABI identification
+  unsigned int version;
+  size_t struct_size;
+
+  // Object layout
+  Py_ssize_t body_offset;      // offsetof(ZObject, body)
+  Py_ssize_t nslots;           // slots per body
+  size_t body_size;            // sizeof(ZBody)
+
+  // Each interpreter has a collector and types of its own; these return
+  // the calling interpreter's. Call them with the GIL held.
+  // pyzgc.Object (borrowed).
+  PyTypeObject *(*object_type)(void);
+  // Address of the collector's current "Good Color", valid for the life of
+  // the process. Read it on every barrier check; it flips at the start of
+  // each cycle.
+  const volatile uintptr_t *(*good_color)(void);
+
+  // Barrier slow paths. Like the allocation slow path, these are safepoint
+  // polls and may briefly release the GIL: re-derive raw body pointers after
+  // calling them.
+  // Heals obj->body (remap + recolor). obj must be a pyzgc.Object.
+  void (*fix_pointer)(PyObject *obj);
+  // Barrier on a loaded reference; returns obj (borrowed).
+  PyObject *(*load_barrier)(PyObject *obj);
+
+  // Allocation
+  // TLAB of the calling thread (valid for that thread's lifetime). The
+  // call also switches the thread to the heap of the interpreter it runs:
+  // fetch it on each call from Python rather than once per thread.
+  PyZGC_TLAB *(*current_tlab)(void);
+  // Slow path: refills the TLAB. Returns a colored body pointer or NULL.
+  void *(*alloc_slow)(size_t size);
+  // Creates a new pyzgc.Object (new reference).
+  PyObject *(*new_object)(void);
+
+  // Slot accessors with barriers applied
+  // New reference, None for empty slots. NULL + exception on error.
+  PyObject *(*load_slot)(PyObject *obj, Py_ssize_t index);
+  // 0 on success, -1 + exception on error. value may be NULL (clear).
+  int (*store_slot)(PyObject *obj, Py_ssize_t index, PyObject *value);
+
+  // Body access sections (present when struct_size reaches them). On
+  // free-threaded builds, bracket every use of PyZGC_Slots /
+  // PyZGC_AllocInline results with enter/leave so the collector cannot stop
+  // the world in between. Sections nest; with the GIL they are no-ops.
+  void (*enter)(void);
+  void (*leave)(void);
+
+  // Pinning (present when struct_size reaches them). pin applies the load
+  // barrier and keeps the body of obj (any pyzgc object) at its address
+  // until the matching unpin; pins nest. Returns the raw body pointer,
+  // usable outside enter/leave and from any thread, or NULL + exception.
+  void *(*pin)(PyObject *obj);
+  void (*unpin)(void *body);
+} PyZGC_CAPI;
+
+#ifndef PYZGC_CAPI_INTERNAL
+
+// The table is static in pyzgc and the same for every interpreter, so
+// PyZGC_API stays valid for the life of the process. PyZGC_ObjectType and
+// PyZGC_GoodColor are one variable per extension, not per interpreter:
+// they hold the values of the interpreter that ran PyZGC_ImportAPI last.
+// An extension imported into several interpreters that use pyzgc must
+// keep each one's values itself (object_type() and good_color() in its
+// module exec, into its module state) and not use PyZGC_Check or
+// PyZGC_IsGood, which read these.
+static const PyZGC_CAPI *PyZGC_API = NULL;
+static PyTypeObject *PyZGC_ObjectType = NULL;
+static const volatile uintptr_t *PyZGC_GoodColor = NULL;
+
+static inline int PyZGC_ImportAPI(void) {
+  PyZGC_API = (const PyZGC_CAPI *)PyCapsule_Import(PYZGC_CAPSULE_NAME, 0);
+  if (PyZGC_API == NULL)
+    return -1;
+  if (PyZGC_API->version != PYZGC_CAPI_VERSION) {
+    PyErr_Format(PyExc_ImportError,
+                 "pyzgc C-API version mismatch (module %u, header %u): "
+                 "rebuild the extension against this pyzgc",
+                 PyZGC_API->version, PYZGC_CAPI_VERSION);
+    PyZGC_API = NULL;
+    return -1;
+  }
+  PyZGC_ObjectType = PyZGC_API->object_type();
+  PyZGC_GoodColor = PyZGC_API->good_color();
+  return 0;
+}
+
+static inline int PyZGC_Check(PyObject *obj) {
+  return Py_TYPE(obj) == PyZGC_ObjectType;
+}
+
+// Fast-path check: does this colored pointer carry the good color?
+static inline int PyZGC_IsGood(uintptr_t ptr) {
+  return (ptr & PYZGC_COLOR_MASK) == *PyZGC_GoodColor;
+}
+
+// Load barrier on obj, then the raw (uncolored) slot array of its body.
+// The pointer is valid until the next GC safepoint; do not cache it.
+// Slots holding another pyzgc object, and those of objects loaded with
+// pyzgc.load_image, are encoded references (odd values, see
+// PyZGC_IsEncoded); read those through load_slot instead.
+static inline PyObject **PyZGC_Slots(PyObject *obj) {
+  uintptr_t *field = (uintptr_t *)((char *)obj + PyZGC_API->body_offset);
+  if (!PyZGC_IsGood(*field)) {
+    PyZGC_API->fix_pointer(obj);
+  }
+  return (PyObject **)(*field & PYZGC_ADDRESS_MASK);
+}
+
+static inline int PyZGC_IsEncoded(PyObject *slot) {
+  return ((uintptr_t)slot & 1) != 0;
+}
+
+// Inline bump allocation from a TLAB obtained via current_tlab(). Inside a
+// pyzgc.region, allocate whole bodies (body_size) only: the region walks
+// its pages body by body when it ends. With
+// configure(old_gen="mark_region"), cycles walk every page that way, so the
+// same holds outside regions.
+static inline void *PyZGC_AllocInline(PyZGC_TLAB *tlab, size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  if (tlab->top + size <= tlab->end) {
+    void *ptr = (void *)tlab->top;
+    tlab->top += size;
+    return (void *)((uintptr_t)ptr | *PyZGC_GoodColor);
+  }
+  return PyZGC_API->alloc_slow(size);
+}
+
+#endif // PYZGC_CAPI_INTERNAL
+
+#endif // PYZGC_CAPI_H
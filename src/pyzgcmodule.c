@@ -1,15 +1,60 @@
 #define PY_SSIZE_T_CLEAN
+#define PYZGC_CAPI_INTERNAL
+#include "pyzgc_capi.h"
+#include "zarray.h"
+#include "zasyncio.h"
+#include "zbarrier.h"
+#include "zcgroup.h"
+#include "zdict.h"
 #include "zgc.h"
 #include "zheap.h"
+#include "zimage.h"
 #include "zobject.h"
+#include "zpin.h"
+#include "zpool.h"
+#include "zprof.h"
+#include "zref.h"
+#include "zregion.h"
+#include "zsafepoint.h"
+#include "zsatb.h"
+#include "zstruct.h"
 #include <Python.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// The public ABI header must agree with the collector's definitions.
+_Static_assert(PYZGC_MARKED0_BIT == ZPOINTER_MARKED0_BIT, "MARKED0 drift");
+_Static_assert(PYZGC_MARKED1_BIT == ZPOINTER_MARKED1_BIT, "MARKED1 drift");
+_Static_assert(PYZGC_REMAPPED_BIT == ZPOINTER_REMAPPED_BIT, "REMAPPED drift");
+_Static_assert(PYZGC_FINALIZABLE_BIT == ZPOINTER_FINALIZABLE_BIT,
+               "FINALIZABLE drift");
+_Static_assert(sizeof(PyZGC_TLAB) == sizeof(ZTLAB), "TLAB layout drift");
+_Static_assert(offsetof(PyZGC_TLAB, top) == offsetof(ZTLAB, top),
+               "TLAB layout drift");
+_Static_assert(offsetof(PyZGC_TLAB, end) == offsetof(ZTLAB, end),
+               "TLAB layout drift");
+
+// Releasing the GIL around a blocking GC call is a safepoint checkpoint:
+// on the way back in we honor any pending safepoint before touching the heap.
+#define ZGC_BEGIN_ALLOW_THREADS Py_BEGIN_ALLOW_THREADS
+#define ZGC_END_ALLOW_THREADS                                                  \
+  Py_END_ALLOW_THREADS zsafepoint_poll();
 
 static PyObject *pyzgc_allocate(PyObject *self, PyObject *args) {
+  zstate_enter();
   Py_ssize_t size;
   if (!PyArg_ParseTuple(args, "n", &size))
     return NULL;
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "size must be >= 0");
+    return NULL;
+  }
 
-  void *ptr = zheap_alloc((size_t)size, ZGEN_YOUNG);
+  void *ptr = zheap_alloc_raw((size_t)size);
+  ZRegion *region = zheap_current_region();
+  if (ptr && region)
+    region->raw_memory = true;
   if (!ptr) {
     return PyErr_NoMemory();
   }
@@ -17,16 +62,22 @@ static PyObject *pyzgc_allocate(PyObject *self, PyObject *args) {
 }
 
 static PyObject *pyzgc_start_gc(PyObject *self, PyObject *args) {
+  zstate_enter();
   zgc_start_thread();
   Py_RETURN_NONE;
 }
 
 static PyObject *pyzgc_stop_gc(PyObject *self, PyObject *args) {
+  zstate_enter();
+  // The GC thread may be waiting for the GIL to start a pause
+  ZGC_BEGIN_ALLOW_THREADS
   zgc_stop_thread();
+  ZGC_END_ALLOW_THREADS
   Py_RETURN_NONE;
 }
 
 static PyObject *pyzgc_add_root(PyObject *self, PyObject *args) {
+  zstate_enter();
   PyObject *obj;
   if (!PyArg_ParseTuple(args, "O", &obj))
     return NULL;
@@ -35,6 +86,7 @@ static PyObject *pyzgc_add_root(PyObject *self, PyObject *args) {
 }
 
 static PyObject *pyzgc_is_marked(PyObject *self, PyObject *args) {
+  zstate_enter();
   PyObject *obj;
   if (!PyArg_ParseTuple(args, "O", &obj))
     return NULL;
@@ -47,28 +99,579 @@ static PyObject *pyzgc_is_marked(PyObject *self, PyObject *args) {
   }
 }
 
-static PyObject *pyzgc_gc(PyObject *self, PyObject *args) {
-  zgc_run_cycle();
-  Py_RETURN_NONE;
+static PyObject *pyzgc_gc(PyObject *self, PyObject *args, PyObject *kwds) {
+  zstate_enter();
+  static char *kwlist[] = {"budget_us", NULL};
+  PyObject *budget_obj = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:gc", kwlist, &budget_obj))
+    return NULL;
+  double budget_us = -1.0;
+  if (budget_obj != Py_None) {
+    budget_us = PyFloat_AsDouble(budget_obj);
+    if (budget_us == -1.0 && PyErr_Occurred())
+      return NULL;
+    if (budget_us < 0.0) {
+      PyErr_SetString(PyExc_ValueError, "budget_us must be >= 0");
+      return NULL;
+    }
+  }
+
+  // Marking and relocation run without the GIL; pauses re-acquire it
+  bool done = true;
+  ZGC_BEGIN_ALLOW_THREADS
+  if (budget_us < 0.0)
+    zgc_run_cycle();
+  else
+    done = zgc_run_cycle_step((uint64_t)(budget_us * 1000.0));
+  ZGC_END_ALLOW_THREADS
+  // Callbacks of references the cycle cleared, rather than at some later
+  // pending-call check
+  zref_run_callbacks();
+  return PyBool_FromLong(done);
+}
+
+// Configured cgroup directory, or None
+static PyObject *zcgroup_path_object(void) {
+  char path[PATH_MAX];
+  if (!zcgroup_get_path(path, sizeof(path)))
+    Py_RETURN_NONE;
+  return PyUnicode_DecodeFSDefault(path);
+}
+
+// configure(**settings): change collector tunables, return all of them
+static PyObject *pyzgc_configure(PyObject *self, PyObject *args,
+                                 PyObject *kwds) {
+  zstate_enter();
+  static char *kwlist[] = {"assist_ratio",    "assist_max_us",
+                           "max_heap_bytes",  "soft_max_heap_bytes",
+                           "memory_pressure", "cgroup_path",
+                           "page_pool",       "page_pool_populate",
+                           "old_gen",         NULL};
+  ZGCConfig cfg;
+  zgc_get_config(&cfg);
+  double assist_ratio = cfg.assist_ratio;
+  double assist_max_us = (double)cfg.assist_max_ns / 1000.0;
+  Py_ssize_t max_heap = (Py_ssize_t)cfg.max_heap_bytes;
+  Py_ssize_t soft_max_heap = (Py_ssize_t)cfg.soft_max_heap_bytes;
+  double memory_pressure = cfg.memory_pressure;
+  PyObject *cgroup_path = NULL;
+  Py_ssize_t page_pool = (Py_ssize_t)cfg.page_pool;
+  int page_pool_populate = cfg.page_pool_populate;
+  const char *old_gen = NULL;
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwds, "|$ddnndOnps:configure", kwlist, &assist_ratio,
+          &assist_max_us, &max_heap, &soft_max_heap, &memory_pressure,
+          &cgroup_path, &page_pool, &page_pool_populate, &old_gen))
+    return NULL;
+  if (assist_ratio < 0.0 || assist_max_us < 0.0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "assist_ratio and assist_max_us must be >= 0");
+    return NULL;
+  }
+  if (max_heap < 0 || soft_max_heap < 0 || memory_pressure < 0.0 ||
+      page_pool < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "max_heap_bytes, soft_max_heap_bytes, memory_pressure "
+                    "and page_pool must be >= 0");
+    return NULL;
+  }
+  if (old_gen) {
+    if (strcmp(old_gen, "copying") == 0) {
+      cfg.old_gen = ZGC_OLD_GEN_COPYING;
+    } else if (strcmp(old_gen, "mark_region") == 0) {
+      cfg.old_gen = ZGC_OLD_GEN_MARK_REGION;
+    } else {
+      PyErr_SetString(PyExc_ValueError,
+                      "old_gen must be 'copying' or 'mark_region'");
+      return NULL;
+    }
+  }
+  if (cgroup_path == Py_None) {
+    zcgroup_set_path(NULL);
+  } else if (cgroup_path) {
+    PyObject *bytes;
+    if (!PyUnicode_FSConverter(cgroup_path, &bytes))
+      return NULL;
+    zcgroup_set_path(PyBytes_AS_STRING(bytes));
+    Py_DECREF(bytes);
+  }
+  cfg.assist_ratio = assist_ratio;
+  cfg.assist_max_ns = (uint64_t)(assist_max_us * 1000.0);
+  cfg.max_heap_bytes = (size_t)max_heap;
+  cfg.soft_max_heap_bytes = (size_t)soft_max_heap;
+  cfg.memory_pressure = memory_pressure;
+  cfg.page_pool = (size_t)page_pool;
+  cfg.page_pool_populate = page_pool_populate;
+  zgc_set_config(&cfg);
+
+  return Py_BuildValue(
+      "{sdsdsnsnsdsNsnsOss}", "assist_ratio", cfg.assist_ratio, "assist_max_us",
+      (double)cfg.assist_max_ns / 1000.0, "max_heap_bytes",
+      (Py_ssize_t)cfg.max_heap_bytes, "soft_max_heap_bytes",
+      (Py_ssize_t)cfg.soft_max_heap_bytes, "memory_pressure",
+      cfg.memory_pressure, "cgroup_path", zcgroup_path_object(), "page_pool",
+      (Py_ssize_t)cfg.page_pool, "page_pool_populate",
+      cfg.page_pool_populate ? Py_True : Py_False, "old_gen",
+      cfg.old_gen == ZGC_OLD_GEN_MARK_REGION ? "mark_region" : "copying");
 }
 
 static PyObject *pyzgc_minor_gc(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZGC_BEGIN_ALLOW_THREADS
   zgc_minor_cycle();
+  ZGC_END_ALLOW_THREADS
+  zref_run_callbacks();
+  Py_RETURN_NONE;
+}
+
+static PyObject *pyzgc_freeze(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZGC_BEGIN_ALLOW_THREADS
+  zgc_freeze();
+  ZGC_END_ALLOW_THREADS
+  zref_run_callbacks();
+  Py_RETURN_NONE;
+}
+
+static PyObject *pyzgc_unfreeze(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZGC_BEGIN_ALLOW_THREADS
+  zgc_unfreeze();
+  ZGC_END_ALLOW_THREADS
+  Py_RETURN_NONE;
+}
+
+// os.register_at_fork hooks (see zgc_before_fork). The forking
+// interpreter's hooks quiesce the collectors of all of them.
+static bool zfork_before(void *arg) {
+  zgc_before_fork();
+  return true;
+}
+
+static bool zfork_after(void *child) {
+  zgc_after_fork(*(bool *)child);
+  return true;
+}
+
+static PyObject *pyzgc_before_fork(PyObject *self, PyObject *args) {
+  zstate_enter();
+  zstate_for_each(zfork_before, NULL);
+  Py_RETURN_NONE;
+}
+
+static PyObject *pyzgc_after_fork_parent(PyObject *self, PyObject *args) {
+  zstate_enter();
+  bool child = false;
+  zstate_for_each(zfork_after, &child);
+  Py_RETURN_NONE;
+}
+
+static PyObject *pyzgc_after_fork_child(PyObject *self, PyObject *args) {
+  zstate_enter();
+  bool child = true;
+  zstate_for_each(zfork_after, &child);
   Py_RETURN_NONE;
 }
 
 static PyObject *pyzgc_get_body_address(PyObject *self, PyObject *args) {
+  zstate_enter();
   PyObject *obj;
   if (!PyArg_ParseTuple(args, "O", &obj))
     return NULL;
 
-  if (Py_TYPE(obj) == &ZObjectType) {
+  if (zobject_is_handle(obj)) {
     ZObject *zobj = (ZObject *)obj;
     return PyLong_FromVoidPtr(zobj->body);
   }
   Py_RETURN_NONE;
 }
 
+// Estimate a percentile as the upper bound of the bucket that contains it
+static uint64_t zhistogram_percentile_ns(const ZHistogram *hist, double q) {
+  if (hist->count == 0)
+    return 0;
+  uint64_t rank = (uint64_t)(q * (double)hist->count);
+  if (rank >= hist->count)
+    rank = hist->count - 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < ZHISTOGRAM_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen > rank) {
+      uint64_t upper_ns = (1ULL << i) * 1000;
+      return upper_ns < hist->max_ns ? upper_ns : hist->max_ns;
+    }
+  }
+  return hist->max_ns;
+}
+
+static PyObject *zhistogram_to_dict(const ZHistogram *hist) {
+  PyObject *buckets = PyList_New(0);
+  if (!buckets)
+    return NULL;
+  for (int i = 0; i < ZHISTOGRAM_BUCKETS; i++) {
+    if (hist->buckets[i] == 0)
+      continue;
+    // (upper bound in microseconds, count)
+    PyObject *item = Py_BuildValue("(KK)", (unsigned long long)(1ULL << i),
+                                   (unsigned long long)hist->buckets[i]);
+    if (!item || PyList_Append(buckets, item) < 0) {
+      Py_XDECREF(item);
+      Py_DECREF(buckets);
+      return NULL;
+    }
+    Py_DECREF(item);
+  }
+  return Py_BuildValue(
+      "{sKsKsKsKsKsKsN}", "count", (unsigned long long)hist->count,
+      "total_ns", (unsigned long long)hist->total_ns, "max_ns",
+      (unsigned long long)hist->max_ns, "p50_ns",
+      (unsigned long long)zhistogram_percentile_ns(hist, 0.50), "p99_ns",
+      (unsigned long long)zhistogram_percentile_ns(hist, 0.99), "p999_ns",
+      (unsigned long long)zhistogram_percentile_ns(hist, 0.999), "histogram",
+      buckets);
+}
+
+static PyObject *pyzgc_stats(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZSafepointStats sp;
+  ZGCStats gc;
+  ZPoolStats pool;
+  ZRegionStats region;
+  zsafepoint_get_stats(&sp);
+  zgc_get_stats(&gc);
+  zpool_get_stats(&pool);
+  zregion_get_stats(&region);
+  return Py_BuildValue(
+      "{sKsKsKsKsKsKsKsKsKsKsKsKsKsnsKsKsKsKsKsKsK"
+      "snsnsKsKsKsKsKsKsKsKsKsKsKsNsN}",
+      "cycles",
+      (unsigned long long)gc.cycles,
+      "minor_cycles", (unsigned long long)gc.minor_cycles, "gc_cpu_ns",
+      (unsigned long long)gc.cpu_ns, "gc_wall_ns",
+      (unsigned long long)gc.wall_ns, "weak_cleared",
+      (unsigned long long)gc.weak_cleared, "finalizers_queued",
+      (unsigned long long)gc.finalizers_queued, "assists",
+      (unsigned long long)gc.assists, "assist_ns",
+      (unsigned long long)gc.assist_ns, "assist_max_ns",
+      (unsigned long long)gc.assist_max_ns, "assist_bytes",
+      (unsigned long long)gc.assist_bytes, "pressure_cycles",
+      (unsigned long long)gc.pressure_cycles, "released_bytes",
+      (unsigned long long)gc.released_bytes, "freezes",
+      (unsigned long long)gc.freezes, "frozen_bytes",
+      (Py_ssize_t)atomic_load(&zstate->frozen_bytes), "cards_scanned",
+      (unsigned long long)gc.cards_scanned, "idle_steps",
+      (unsigned long long)gc.idle_steps, "idle_cycles",
+      (unsigned long long)gc.idle_cycles, "idle_ns",
+      (unsigned long long)gc.idle_ns, "swept_pages",
+      (unsigned long long)gc.swept_pages, "swept_free_bytes",
+      (unsigned long long)gc.swept_free_bytes, "defrag_pages",
+      (unsigned long long)gc.defrag_pages, "pool_pages",
+      (Py_ssize_t)pool.ready, "pool_target", (Py_ssize_t)pool.target,
+      "pool_hits", (unsigned long long)pool.hits, "pool_misses",
+      (unsigned long long)pool.misses, "pool_filled",
+      (unsigned long long)pool.filled, "pool_returned",
+      (unsigned long long)pool.returned, "regions",
+      (unsigned long long)region.regions, "region_fallbacks",
+      (unsigned long long)region.fallbacks, "region_pages",
+      (unsigned long long)region.pages, "region_released_bytes",
+      (unsigned long long)region.released_bytes, "region_escaped",
+      (unsigned long long)region.escaped, "region_escaped_bytes",
+      (unsigned long long)region.escaped_bytes, "safepoints",
+      (unsigned long long)sp.pause.count, "time_to_safepoint",
+      zhistogram_to_dict(&sp.time_to_safepoint), "pause",
+      zhistogram_to_dict(&sp.pause));
+}
+
+static const char *const zgen_names[] = {"young", "old", "shared"};
+
+static PyObject *zpage_info_to_dict(const ZPageInfo *info) {
+  return Py_BuildValue(
+      "{sKsssnsnsnsnsnsOsOsOsOsOsOsOsOsnsisi}", "address",
+      (unsigned long long)info->start, "generation",
+      zgen_names[info->generation], "size_bytes", (Py_ssize_t)info->size_bytes,
+      "used_bytes", (Py_ssize_t)info->used_bytes, "header_bytes",
+      (Py_ssize_t)info->header_bytes, "live_bytes",
+      (Py_ssize_t)info->live_bytes, "forwarding_entries",
+      (Py_ssize_t)info->forwarding_entries, "evacuated",
+      info->is_evacuating ? Py_True : Py_False, "relocating",
+      info->is_relocating ? Py_True : Py_False, "current",
+      info->is_current ? Py_True : Py_False, "immortal",
+      info->is_immortal ? Py_True : Py_False, "large",
+      info->is_large ? Py_True : Py_False, "released",
+      info->is_released ? Py_True : Py_False, "region",
+      info->is_region ? Py_True : Py_False, "frozen",
+      info->is_frozen ? Py_True : Py_False, "dirty_cards",
+      (Py_ssize_t)info->dirty_cards, "pins", info->pin_count,
+      "numa_node", info->numa_node);
+}
+
+// cgroup limit, or None for "max"
+static PyObject *zcgroup_limit_object(uint64_t limit) {
+  if (limit == ZCGROUP_UNLIMITED)
+    Py_RETURN_NONE;
+  return PyLong_FromUnsignedLongLong(limit);
+}
+
+// Heap limits in effect and the last cgroup reading (see zgc.h)
+static PyObject *zmemory_to_dict(void) {
+  ZGCMemory m;
+  zgc_get_memory(&m);
+  PyObject *cgroup;
+  if (m.has_cgroup) {
+    cgroup = Py_BuildValue(
+        "{sNsNsNsKsd}", "path", zcgroup_path_object(), "max",
+        zcgroup_limit_object(m.cgroup.max), "high",
+        zcgroup_limit_object(m.cgroup.high), "current",
+        (unsigned long long)m.cgroup.current, "pressure", m.cgroup.pressure);
+    if (!cgroup)
+      return NULL;
+  } else {
+    cgroup = Py_NewRef(Py_None);
+  }
+  return Py_BuildValue(
+      "{snsnsnsOsN}", "heap_bytes", (Py_ssize_t)m.committed_bytes,
+      "max_heap_bytes", (Py_ssize_t)m.max_heap_bytes, "soft_max_heap_bytes",
+      (Py_ssize_t)m.soft_max_heap_bytes, "pressure",
+      m.pressure ? Py_True : Py_False, "cgroup", cgroup);
+}
+
+static PyObject *pyzgc_heap_info(PyObject *self, PyObject *args) {
+  zstate_enter();
+  size_t count;
+  ZPageInfo *infos = zheap_page_info(&count);
+  if (!infos)
+    return PyErr_NoMemory();
+
+  size_t committed = 0, used = 0, live = 0, object_bytes = 0;
+  size_t evacuated_pages = 0, evacuated_bytes = 0;
+  size_t young_pages = 0, young_used = 0, old_pages = 0, old_used = 0;
+  size_t shared_pages = 0, shared_used = 0;
+  size_t frozen_pages = 0, frozen_used = 0;
+
+  PyObject *pages = PyList_New((Py_ssize_t)count);
+  if (!pages) {
+    free(infos);
+    return NULL;
+  }
+  for (size_t i = 0; i < count; i++) {
+    const ZPageInfo *info = &infos[i];
+    PyObject *page = zpage_info_to_dict(info);
+    if (!page) {
+      Py_DECREF(pages);
+      free(infos);
+      return NULL;
+    }
+    PyList_SET_ITEM(pages, (Py_ssize_t)i, page);
+
+    committed += info->size_bytes;
+    used += info->used_bytes;
+    if (info->generation == ZGEN_SHARED) {
+      // Never marked or collected, so not part of the fragmentation score
+      shared_pages++;
+      shared_used += info->used_bytes;
+      continue;
+    }
+    if (info->is_frozen) {
+      // Likewise, until pyzgc.unfreeze()
+      frozen_pages++;
+      frozen_used += info->used_bytes;
+      continue;
+    }
+    if (info->generation == ZGEN_OLD) {
+      old_pages++;
+      old_used += info->used_bytes;
+    } else {
+      young_pages++;
+      young_used += info->used_bytes;
+    }
+    if (info->is_evacuating) {
+      // Live objects were copied out; everything left is reclaimable
+      evacuated_pages++;
+      evacuated_bytes += info->used_bytes;
+    } else {
+      live += info->live_bytes;
+      object_bytes += info->marked_bytes;
+    }
+  }
+  free(infos);
+
+  // Share of object space in resident pages that the last mark found dead.
+  // None until a cycle has completed: live_bytes are all 0 before.
+  ZGCStats stats;
+  zgc_get_stats(&stats);
+  PyObject *fragmentation = Py_None;
+  if (stats.cycles) {
+    double dead =
+        object_bytes ? 1.0 - (double)live / (double)object_bytes : 0.0;
+    fragmentation = PyFloat_FromDouble(dead < 0.0 ? 0.0 : dead);
+    if (!fragmentation) {
+      Py_DECREF(pages);
+      return NULL;
+    }
+  } else {
+    Py_INCREF(fragmentation);
+  }
+
+  PyObject *totals = Py_BuildValue(
+      "{snsnsnsnsnsnsnsnsnsnsnsnsnsnsN}", "pages", (Py_ssize_t)count,
+      "committed_bytes", (Py_ssize_t)committed, "used_bytes",
+      (Py_ssize_t)used, "live_bytes", (Py_ssize_t)live, "young_pages",
+      (Py_ssize_t)young_pages, "young_used_bytes", (Py_ssize_t)young_used,
+      "old_pages", (Py_ssize_t)old_pages, "old_used_bytes",
+      (Py_ssize_t)old_used, "shared_pages", (Py_ssize_t)shared_pages,
+      "shared_used_bytes", (Py_ssize_t)shared_used, "frozen_pages",
+      (Py_ssize_t)frozen_pages, "frozen_used_bytes", (Py_ssize_t)frozen_used,
+      "evacuated_pages",
+      (Py_ssize_t)evacuated_pages, "evacuated_bytes",
+      (Py_ssize_t)evacuated_bytes, "fragmentation", fragmentation);
+  if (!totals) {
+    Py_DECREF(pages);
+    return NULL;
+  }
+
+  PyObject *memory = zmemory_to_dict();
+  if (!memory) {
+    Py_DECREF(totals);
+    Py_DECREF(pages);
+    return NULL;
+  }
+
+  return Py_BuildValue("{snsOsNsNsN}", "page_size", (Py_ssize_t)ZPAGE_SIZE,
+                       "marking",
+                       atomic_load(&zstate->satb_active) ? Py_True : Py_False,
+                       "totals", totals, "memory", memory, "pages", pages);
+}
+
+static PyObject *pyzgc_save_image(PyObject *self, PyObject *args) {
+  zstate_enter();
+  PyObject *root;
+  PyObject *path;
+  if (!PyArg_ParseTuple(args, "O!O&", zstate->types.object, &root,
+                        PyUnicode_FSConverter, &path))
+    return NULL;
+  int rc = zimage_save((ZObject *)root, PyBytes_AS_STRING(path));
+  Py_DECREF(path);
+  if (rc < 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject *pyzgc_load_image(PyObject *self, PyObject *args) {
+  zstate_enter();
+  PyObject *path;
+  if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &path))
+    return NULL;
+  PyObject *root = zimage_load(PyBytes_AS_STRING(path));
+  Py_DECREF(path);
+  return root;
+}
+
+static PyObject *pyzgc_share_image(PyObject *self, PyObject *args) {
+  zstate_enter();
+  PyObject *root;
+  if (!PyArg_ParseTuple(args, "O!", zstate->types.object, &root))
+    return NULL;
+  int fd = zimage_share((ZObject *)root);
+  if (fd < 0)
+    return NULL;
+  return PyLong_FromLong(fd);
+}
+
+static PyObject *pyzgc_attach_image(PyObject *self, PyObject *args) {
+  zstate_enter();
+  int fd;
+  if (!PyArg_ParseTuple(args, "i", &fd))
+    return NULL;
+  return zimage_attach(fd);
+}
+
+// --- C-API (pyzgc._C_API) ---
+
+static PyTypeObject *capi_object_type(void) {
+  zstate_enter();
+  return zstate->types.object;
+}
+
+// ZStates are never freed (zstate.h), so the address stays valid
+static const volatile uintptr_t *capi_good_color(void) {
+  zstate_enter();
+  return &zstate->good_color;
+}
+
+static void capi_fix_pointer(PyObject *obj) {
+  zbarrier_fix_pointer((ZObject *)obj);
+}
+
+static PyZGC_TLAB *capi_current_tlab(void) {
+  zstate_enter();
+  return (PyZGC_TLAB *)&zheap_tlab;
+}
+
+static void *capi_alloc_slow(size_t size) {
+  return zheap_alloc(size, ZGEN_YOUNG);
+}
+
+static PyObject *capi_new_object(void) {
+  zstate_enter();
+  return PyObject_CallObject((PyObject *)zstate->types.object, NULL);
+}
+
+static PyObject *capi_load_slot(PyObject *obj, Py_ssize_t index) {
+  zstate_enter();
+  if (Py_TYPE(obj) != zstate->types.object) {
+    PyErr_SetString(PyExc_TypeError, "expected pyzgc.Object");
+    return NULL;
+  }
+  return zobject_load_slot((ZObject *)obj, index);
+}
+
+static int capi_store_slot(PyObject *obj, Py_ssize_t index, PyObject *value) {
+  zstate_enter();
+  if (Py_TYPE(obj) != zstate->types.object) {
+    PyErr_SetString(PyExc_TypeError, "expected pyzgc.Object");
+    return -1;
+  }
+  return zobject_store_slot((ZObject *)obj, index, value);
+}
+
+// Out-of-line so extensions get the free-threaded behaviour of the module
+// they are loaded into, not of the headers they were compiled against
+static void capi_enter(void) { zsafepoint_enter(); }
+
+static void capi_leave(void) { zsafepoint_leave(); }
+
+static void *capi_pin(PyObject *obj) {
+  if (!zobject_is_handle(obj)) {
+    PyErr_SetString(PyExc_TypeError, "expected a pyzgc object");
+    return NULL;
+  }
+  void *body = zobject_pin(obj);
+  if (!body)
+    PyErr_SetString(PyExc_ValueError, "object has no body");
+  return body;
+}
+
+static const PyZGC_CAPI pyzgc_capi = {
+    .version = PYZGC_CAPI_VERSION,
+    .struct_size = sizeof(PyZGC_CAPI),
+    .body_offset = offsetof(ZObject, body),
+    .nslots = ZOBJECT_SLOTS,
+    .body_size = sizeof(ZBody),
+    .object_type = capi_object_type,
+    .good_color = capi_good_color,
+    .fix_pointer = capi_fix_pointer,
+    .load_barrier = zbarrier_load,
+    .current_tlab = capi_current_tlab,
+    .alloc_slow = capi_alloc_slow,
+    .new_object = capi_new_object,
+    .load_slot = capi_load_slot,
+    .store_slot = capi_store_slot,
+    .enter = capi_enter,
+    .leave = capi_leave,
+    .pin = capi_pin,
+    .unpin = zobject_unpin,
+};
+
 static PyMethodDef PyZGCMethods[] = {
     {"allocate", pyzgc_allocate, METH_VARARGS, "Allocate memory in ZGC heap."},
     {"start_gc", pyzgc_start_gc, METH_NOARGS,
@@ -80,32 +683,256 @@ static PyMethodDef PyZGCMethods[] = {
      "Check if an object is marked (for testing)."},
     {"get_body_address", pyzgc_get_body_address, METH_VARARGS,
      "Get the address of the ZBody (for testing relocation)."},
-    {"gc", pyzgc_gc, METH_NOARGS, "Run a synchronous Full GC cycle."},
+    {"gc", (PyCFunction)(void (*)(void))pyzgc_gc,
+     METH_VARARGS | METH_KEYWORDS,
+     "gc(budget_us=None): run a synchronous Full GC cycle, or with a budget, "
+     "advance the current cycle for about budget_us microseconds. Returns "
+     "True once the cycle has ended."},
+    {"configure", (PyCFunction)(void (*)(void))pyzgc_configure,
+     METH_VARARGS | METH_KEYWORDS,
+     "configure(*, assist_ratio, assist_max_us, max_heap_bytes, "
+     "soft_max_heap_bytes, memory_pressure, cgroup_path, page_pool, "
+     "page_pool_populate, old_gen): set collector tunables and return the "
+     "current ones. Heap limits of 0 are derived from the cgroup v2 memory "
+     "limits; cgroup_path=None detects the cgroup again. A background "
+     "thread keeps at least page_pool pages ready (0 turns it off). "
+     "old_gen='mark_region' sweeps old pages in place and reuses their free "
+     "lines instead of copying them ('copying', the default)."},
     {"minor_gc", pyzgc_minor_gc, METH_NOARGS,
      "Run a synchronous Minor GC cycle."},
+    {"freeze", pyzgc_freeze, METH_NOARGS,
+     "Move every live object into a permanent generation that later cycles "
+     "neither mark nor move, so that processes forked afterwards keep "
+     "sharing its pages."},
+    {"unfreeze", pyzgc_unfreeze, METH_NOARGS,
+     "Return frozen objects to the old generation."},
+    {"_before_fork", pyzgc_before_fork, METH_NOARGS, NULL},
+    {"_after_fork_parent", pyzgc_after_fork_parent, METH_NOARGS, NULL},
+    {"_after_fork_child", pyzgc_after_fork_child, METH_NOARGS, NULL},
+    {"stats", pyzgc_stats, METH_NOARGS,
+     "Collector statistics: cycles, GC CPU time, time-to-safepoint and "
+     "pause histograms."},
+    {"save_image", pyzgc_save_image, METH_VARARGS,
+     "save_image(root, path): write the graph reachable from root to a heap "
+     "image file."},
+    {"load_image", pyzgc_load_image, METH_VARARGS,
+     "load_image(path): map a heap image and return its root object."},
+    {"share_image", pyzgc_share_image, METH_VARARGS,
+     "share_image(root): write the graph reachable from root to a sealed "
+     "memfd and return its file descriptor."},
+    {"attach_image", pyzgc_attach_image, METH_VARARGS,
+     "attach_image(fd): map a shared heap image read-only and return its "
+     "root object."},
+    {"define", (PyCFunction)(void (*)(void))zstruct_define,
+     METH_VARARGS | METH_KEYWORDS,
+     "define(name='Struct', /, **fields): build a pyzgc.Struct type whose "
+     "fields are 'i64', 'f64' (stored unboxed) or 'ref'."},
+    {"finalize", zref_finalize, METH_VARARGS,
+     "finalize(obj, callback): call callback(obj) once, after a cycle finds "
+     "obj unreachable from the roots. Everything obj references is kept "
+     "until then."},
+    {"start_alloc_profile", (PyCFunction)(void (*)(void))zprof_start,
+     METH_VARARGS | METH_KEYWORDS,
+     "start_alloc_profile(sample_bytes=524288): sample ZGC heap allocations, "
+     "about one per sample_bytes allocated, with their Python stack. "
+     "Discards an earlier profile."},
+    {"stop_alloc_profile", zprof_stop, METH_NOARGS,
+     "Stop sampling and discard the profile."},
+    {"alloc_profile", (PyCFunction)(void (*)(void))zprof_profile,
+     METH_VARARGS | METH_KEYWORDS,
+     "alloc_profile(*, format='dict'): allocated and in-use objects and "
+     "bytes per Python stack, estimated from the samples. format='pprof' "
+     "returns a gzipped profile.proto for `pprof`."},
+    {"heap_info", pyzgc_heap_info, METH_NOARGS,
+     "Per-page occupancy, generation and evacuation state, plus heap-wide "
+     "totals and a fragmentation score."},
     {NULL, NULL, 0, NULL}};
 
-static struct PyModuleDef pyzgcmodule = {
-    PyModuleDef_HEAD_INIT, "pyzgc", "Python ZGC Extension", -1, PyZGCMethods};
+// Each interpreter importing the module gets a collector of its own
+// (zstate.h), shared by the module objects it creates
+typedef struct {
+  ZState *state;
+} PyZGCModuleState;
 
-PyMODINIT_FUNC PyInit_pyzgc(void) {
-  PyObject *m;
+// The interpreter's types (ZState.types), made with its first module
+static int pyzgc_init_types(ZTypes *types) {
+  const struct {
+    PyTypeObject **type;
+    PyType_Spec *spec;
+  } specs[] = {
+      {&types->object, &ZObjectSpec},
+      {&types->structure, &ZStructSpec},
+      {&types->array, &ZArraySpec},
+      {&types->dict, &ZDictSpec},
+      {&types->dict_iter, &ZDictIterSpec},
+      {&types->weakref, &ZWeakRefSpec},
+      {&types->pin, &ZPinSpec},
+      {&types->region, &ZRegionSpec},
+      {&types->idle_selector, &ZIdleSelectorSpec},
+  };
+  for (size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); i++) {
+    *specs[i].type = (PyTypeObject *)PyType_FromSpec(specs[i].spec);
+    if (!*specs[i].type)
+      return -1;
+  }
+  return 0;
+}
 
-  zheap_init();
+static void pyzgc_clear_types(ZTypes *types) {
+  Py_CLEAR(types->object);
+  Py_CLEAR(types->structure);
+  Py_CLEAR(types->array);
+  Py_CLEAR(types->dict);
+  Py_CLEAR(types->dict_iter);
+  Py_CLEAR(types->weakref);
+  Py_CLEAR(types->pin);
+  Py_CLEAR(types->region);
+  Py_CLEAR(types->idle_selector);
+}
 
-  if (PyType_Ready(&ZObjectType) < 0)
-    return NULL;
+static int pyzgc_exec(PyObject *m) {
+  PyZGCModuleState *mod = (PyZGCModuleState *)PyModule_GetState(m);
+  ZState *state = zstate_get(PyInterpreterState_Get());
+  if (!state) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  zstate_attach(state);
+  // From here on pyzgc_free undoes the count
+  mod->state = state;
+  if (state->modules++ == 0) {
+    zheap_init();
+    // Heap limits from the cgroup, if any
+    zgc_update_memory();
+    if (pyzgc_init_types(&state->types) < 0)
+      return -1;
+  }
 
-  m = PyModule_Create(&pyzgcmodule);
-  if (m == NULL)
-    return NULL;
+  ZTypes *types = &state->types;
+  if (PyModule_AddType(m, types->object) < 0 ||
+      PyModule_AddType(m, types->structure) < 0 ||
+      PyModule_AddType(m, types->array) < 0 ||
+      PyModule_AddType(m, types->dict) < 0 ||
+      PyModule_AddType(m, types->weakref) < 0 ||
+      PyModule_AddType(m, types->pin) < 0 ||
+      PyModule_AddType(m, types->region) < 0)
+    return -1;
 
-  Py_INCREF(&ZObjectType);
-  if (PyModule_AddObject(m, "Object", (PyObject *)&ZObjectType) < 0) {
-    Py_DECREF(&ZObjectType);
-    Py_DECREF(m);
-    return NULL;
+  // pyzgc.asyncio, importable as such too
+  PyObject *aio = zasyncio_module();
+  if (!aio || PyDict_SetItemString(PyImport_GetModuleDict(), "pyzgc.asyncio",
+                                   aio) < 0 ||
+      PyModule_AddObject(m, "asyncio", aio) < 0) {
+    Py_XDECREF(aio);
+    return -1;
+  }
+
+  // isinstance(d, collections.abc.MutableMapping) for pyzgc.Dict
+  PyObject *abc = PyImport_ImportModule("collections.abc");
+  PyObject *mapping =
+      abc ? PyObject_GetAttrString(abc, "MutableMapping") : NULL;
+  PyObject *res = mapping ? PyObject_CallMethod(mapping, "register", "O",
+                                                (PyObject *)types->dict)
+                          : NULL;
+  Py_XDECREF(res);
+  Py_XDECREF(mapping);
+  Py_XDECREF(abc);
+  if (res == NULL) {
+    return -1;
+  }
+
+  // Stop the GC thread before the interpreter is torn down
+  PyObject *atexit = PyImport_ImportModule("atexit");
+  PyObject *stop_gc = PyObject_GetAttrString(m, "stop_gc");
+  res = (atexit && stop_gc)
+                      ? PyObject_CallMethod(atexit, "register", "O", stop_gc)
+                      : NULL;
+  Py_XDECREF(res);
+  Py_XDECREF(stop_gc);
+  Py_XDECREF(atexit);
+  if (res == NULL) {
+    return -1;
+  }
+
+  // Quiesce the collector around os.fork() (zfork.h)
+  zfork_init();
+  PyObject *os = PyImport_ImportModule("os");
+  PyObject *before = PyObject_GetAttrString(m, "_before_fork");
+  PyObject *parent = PyObject_GetAttrString(m, "_after_fork_parent");
+  PyObject *child = PyObject_GetAttrString(m, "_after_fork_child");
+  PyObject *register_at_fork =
+      os ? PyObject_GetAttrString(os, "register_at_fork") : NULL;
+  PyObject *kwargs =
+      (before && parent && child)
+          ? Py_BuildValue("{sOsOsO}", "before", before, "after_in_parent",
+                          parent, "after_in_child", child)
+          : NULL;
+  PyObject *empty = PyTuple_New(0);
+  res = (register_at_fork && kwargs && empty)
+            ? PyObject_Call(register_at_fork, empty, kwargs)
+            : NULL;
+  Py_XDECREF(res);
+  Py_XDECREF(empty);
+  Py_XDECREF(kwargs);
+  Py_XDECREF(register_at_fork);
+  Py_XDECREF(child);
+  Py_XDECREF(parent);
+  Py_XDECREF(before);
+  Py_XDECREF(os);
+  if (res == NULL) {
+    return -1;
   }
 
-  return m;
+  // The table is static, so a consumer's pointer to it never dangles
+  PyObject *capsule =
+      PyCapsule_New((void *)&pyzgc_capi, PYZGC_CAPSULE_NAME, NULL);
+  if (PyModule_AddObject(m, "_C_API", capsule) < 0) {
+    Py_XDECREF(capsule);
+    return -1;
+  }
+  return 0;
+}
+
+// The last module of an interpreter is going away, and the collector with
+// it
+static void pyzgc_free(void *m) {
+  PyZGCModuleState *mod = (PyZGCModuleState *)PyModule_GetState(m);
+  ZState *state = mod ? mod->state : NULL;
+  if (!state || --state->modules > 0)
+    return;
+  ZState *saved = zstate;
+  zstate_attach(state);
+  // The GC thread may be waiting for the GIL to start a pause
+  Py_BEGIN_ALLOW_THREADS
+  zgc_stop_thread();
+  Py_END_ALLOW_THREADS
+  zstate_attach(saved);
+  // Instances left over own their types
+  pyzgc_clear_types(&state->types);
+  zstate_close(state);
 }
+
+static PyModuleDef_Slot pyzgc_slots[] = {
+    {Py_mod_exec, pyzgc_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+    // Nothing Python is shared between interpreters (zstate.h), and pauses
+    // take the GIL of their own (zsafepoint_begin)
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_GIL_DISABLED
+    // Safe without the GIL: see zsafepoint.h
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}};
+
+static struct PyModuleDef pyzgcmodule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "pyzgc",
+    .m_doc = "Python ZGC Extension",
+    .m_size = sizeof(PyZGCModuleState),
+    .m_methods = PyZGCMethods,
+    .m_slots = pyzgc_slots,
+    .m_free = pyzgc_free,
+};
+
+PyMODINIT_FUNC PyInit_pyzgc(void) { return PyModuleDef_Init(&pyzgcmodule); }
@@ -0,0 +1,563 @@
+#define PY_SSIZE_T_CLEAN
+#include "zarray.h"
+#include "zbarrier.h"
+#include "zheap.h"
+#include "zobject.h"
+#include "zsafepoint.h"
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <structmember.h>
+
+static const struct {
+  const char *name;
+  const char *format; // struct module format of the buffer, NULL for refs
+} zarray_dtypes[] = {
+    [ZARRAY_I64] = {"i64", "q"}, [ZARRAY_F64] = {"f64", "d"},
+    [ZARRAY_I32] = {"i32", "i"}, [ZARRAY_F32] = {"f32", "f"},
+    [ZARRAY_U8] = {"u8", "B"},   [ZARRAY_REF] = {"ref", NULL},
+};
+#define ZARRAY_NDTYPES (sizeof(zarray_dtypes) / sizeof(zarray_dtypes[0]))
+
+// Element data of self, after the load barrier. Call between
+// zsafepoint_enter and zsafepoint_leave.
+static inline char *zarray_data(ZArray *self) {
+  if (!Z_HAS_COLOR(self->body, zstate->good_color)) {
+    zbarrier_fix_pointer((ZObject *)self);
+  }
+  return (char *)Z_ADDRESS(zobject_get_body((ZObject *)self)) +
+         ZARRAY_HEADER_SIZE;
+}
+
+// --- Element conversion (outside safepoint sections: may run Python code)
+
+static int zarray_pack(ZArrayDtype dtype, PyObject *value, char *out) {
+  long long i;
+  double d;
+
+  switch (dtype) {
+  case ZARRAY_I64:
+    i = PyLong_AsLongLong(value);
+    if (i == -1 && PyErr_Occurred())
+      return -1;
+    int64_t i64 = i;
+    memcpy(out, &i64, sizeof(i64));
+    return 0;
+  case ZARRAY_I32:
+  case ZARRAY_U8:
+    i = PyLong_AsLongLong(value);
+    if (i == -1 && PyErr_Occurred())
+      return -1;
+    if (dtype == ZARRAY_I32 && (i < INT32_MIN || i > INT32_MAX)) {
+      PyErr_SetString(PyExc_OverflowError, "value out of range for i32");
+      return -1;
+    }
+    if (dtype == ZARRAY_U8 && (i < 0 || i > UINT8_MAX)) {
+      PyErr_SetString(PyExc_OverflowError, "value out of range for u8");
+      return -1;
+    }
+    if (dtype == ZARRAY_I32) {
+      int32_t i32 = (int32_t)i;
+      memcpy(out, &i32, sizeof(i32));
+    } else {
+      *(uint8_t *)out = (uint8_t)i;
+    }
+    return 0;
+  case ZARRAY_F64:
+  case ZARRAY_F32:
+    d = PyFloat_AsDouble(value);
+    if (d == -1.0 && PyErr_Occurred())
+      return -1;
+    if (dtype == ZARRAY_F64) {
+      memcpy(out, &d, sizeof(d));
+    } else {
+      float f32 = (float)d;
+      memcpy(out, &f32, sizeof(f32));
+    }
+    return 0;
+  case ZARRAY_REF:
+    break;
+  }
+  PyErr_SetString(PyExc_SystemError, "zarray_pack on a reference array");
+  return -1;
+}
+
+static PyObject *zarray_unpack(ZArrayDtype dtype, const char *in) {
+  int64_t i64;
+  int32_t i32;
+  double f64;
+  float f32;
+
+  switch (dtype) {
+  case ZARRAY_I64:
+    memcpy(&i64, in, sizeof(i64));
+    return PyLong_FromLongLong(i64);
+  case ZARRAY_I32:
+    memcpy(&i32, in, sizeof(i32));
+    return PyLong_FromLong(i32);
+  case ZARRAY_U8:
+    return PyLong_FromLong(*(const uint8_t *)in);
+  case ZARRAY_F64:
+    memcpy(&f64, in, sizeof(f64));
+    return PyFloat_FromDouble(f64);
+  case ZARRAY_F32:
+    memcpy(&f32, in, sizeof(f32));
+    return PyFloat_FromDouble(f32);
+  case ZARRAY_REF:
+    break;
+  }
+  PyErr_SetString(PyExc_SystemError, "zarray_unpack on a reference array");
+  return NULL;
+}
+
+// Does a buffer with this format hold our elements bit for bit?
+static bool zarray_format_matches(const Py_buffer *view, ZArrayDtype dtype) {
+  const char *format = view->format ? view->format : "B";
+  if (*format == '@' || *format == '=' || *format == '<')
+    format++;
+  if (view->itemsize != (Py_ssize_t)zarray_itemsize(dtype) || !format[0] ||
+      format[1])
+    return false;
+  if (dtype == ZARRAY_I64 && format[0] == 'l')
+    return true; // Same size checked above
+  return format[0] == zarray_dtypes[dtype].format[0];
+}
+
+// --- Allocation ---
+
+static ZArray *zarray_new_handle(ZArrayDtype dtype, Py_ssize_t length) {
+  zstate_enter();
+  ZArray *self = PyObject_New(ZArray, zstate->types.array);
+  if (self == NULL)
+    return NULL;
+  self->body = NULL;
+  self->weakreflist = NULL;
+  self->registered = 0;
+  self->dtype = dtype;
+  self->length = length;
+  self->itemsize = (Py_ssize_t)zarray_itemsize(dtype);
+  return self;
+}
+
+PyObject *zarray_wrap_body(ZBody *body) {
+  uint64_t header = zbody_get_word(body, 0);
+  ZArray *self = zarray_new_handle(zarray_header_dtype(header),
+                                   (Py_ssize_t)zarray_header_length(header));
+  if (self == NULL)
+    return NULL;
+  self->body = (ZBody *)Z_WITH_COLOR(body, zstate->good_color);
+  return (PyObject *)self;
+}
+
+ZArray *zarray_new(ZArrayDtype dtype, Py_ssize_t length) {
+  size_t itemsize = zarray_itemsize(dtype);
+  if (length < 0 ||
+      (size_t)length > (PY_SSIZE_T_MAX - 3 * ZARRAY_HEADER_SIZE) / itemsize) {
+    PyErr_SetString(PyExc_ValueError, "invalid array length");
+    return NULL;
+  }
+  size_t size = zarray_body_size(length, itemsize);
+
+  ZArray *self = zarray_new_handle(dtype, length);
+  if (self == NULL)
+    return NULL;
+
+  // Fresh heap memory is zeroed: 0, 0.0 and None. Nothing else can reach
+  // the body before its header is in place.
+  zsafepoint_enter();
+  ZBody *body = (ZBody *)(size > ZLARGE_OBJECT_SIZE
+                              ? zheap_alloc_large(size)
+                              : zheap_alloc_inline(size));
+  if (body) {
+    ZBody *raw = (ZBody *)Z_ADDRESS(body);
+    zbody_set_word(raw, 0,
+                   ((uint64_t)length << 8) | ((uint64_t)dtype << 3) |
+                       ZARRAY_TAG);
+    *zbody_handle_slot(raw) = (PyObject *)self;
+  }
+  self->body = body;
+  zsafepoint_leave();
+
+  if (body == NULL) {
+    Py_DECREF(self);
+    PyErr_NoMemory();
+    return NULL;
+  }
+  return self;
+}
+
+static PyObject *ZArray_new(PyTypeObject *type, PyObject *args,
+                            PyObject *kwds) {
+  static char *kwlist[] = {"dtype", "n", NULL};
+  const char *name;
+  Py_ssize_t length;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "sn:Array", kwlist, &name,
+                                   &length))
+    return NULL;
+
+  for (size_t d = 0; d < ZARRAY_NDTYPES; d++) {
+    if (strcmp(name, zarray_dtypes[d].name) == 0)
+      return (PyObject *)zarray_new((ZArrayDtype)d, length);
+  }
+  PyErr_Format(PyExc_ValueError,
+               "dtype must be 'i64', 'f64', 'i32', 'f32', 'u8' or 'ref', "
+               "not '%s'",
+               name);
+  return NULL;
+}
+
+static void ZArray_dealloc(ZArray *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  if (!zobject_forget_handle((ZObject *)self))
+    return;
+  if (self->weakreflist != NULL) {
+    PyObject_ClearWeakRefs((PyObject *)self);
+  }
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+// --- Elements ---
+
+static PyObject *zarray_get(ZArray *self, Py_ssize_t i) {
+  if (self->dtype == ZARRAY_REF)
+    return zobject_load_ref((ZObject *)self, 1 + i);
+
+  char item[8];
+  zsafepoint_enter();
+  memcpy(item, zarray_data(self) + i * self->itemsize, self->itemsize);
+  zsafepoint_leave();
+  return zarray_unpack(self->dtype, item);
+}
+
+static int zarray_set(ZArray *self, Py_ssize_t i, PyObject *value) {
+  if (self->dtype == ZARRAY_REF)
+    return zobject_store_ref((ZObject *)self, 1 + i,
+                             value == Py_None ? NULL : value);
+
+  char item[8];
+  if (zarray_pack(self->dtype, value, item) < 0)
+    return -1;
+  zsafepoint_enter();
+  memcpy(zarray_data(self) + i * self->itemsize, item, self->itemsize);
+  zsafepoint_leave();
+  return 0;
+}
+
+static Py_ssize_t ZArray_length(ZArray *self) { return self->length; }
+
+static PyObject *ZArray_item(ZArray *self, Py_ssize_t i) {
+  if (i < 0 || i >= self->length) {
+    PyErr_SetString(PyExc_IndexError, "array index out of range");
+    return NULL;
+  }
+  return zarray_get(self, i);
+}
+
+// New array with elements start, start + step, ... of self
+static PyObject *zarray_slice(ZArray *self, Py_ssize_t start, Py_ssize_t step,
+                              Py_ssize_t count) {
+  ZArray *result = zarray_new(self->dtype, count);
+  if (!result)
+    return NULL;
+
+  if (self->dtype == ZARRAY_REF) {
+    for (Py_ssize_t k = 0; k < count; k++) {
+      PyObject *value =
+          zobject_load_ref((ZObject *)self, 1 + start + k * step);
+      int rc = value ? zobject_store_ref((ZObject *)result, 1 + k,
+                                         value == Py_None ? NULL : value)
+                     : -1;
+      Py_XDECREF(value);
+      if (rc < 0) {
+        Py_DECREF(result);
+        return NULL;
+      }
+    }
+    return (PyObject *)result;
+  }
+
+  Py_ssize_t itemsize = self->itemsize;
+  zsafepoint_enter();
+  const char *src = zarray_data(self) + start * itemsize;
+  char *dst = zarray_data(result);
+  if (step == 1) {
+    memcpy(dst, src, count * itemsize);
+  } else {
+    for (Py_ssize_t k = 0; k < count; k++)
+      memcpy(dst + k * itemsize, src + k * step * itemsize, itemsize);
+  }
+  zsafepoint_leave();
+  return (PyObject *)result;
+}
+
+// Writes `count` packed elements from src to start, start + step, ...
+static void zarray_write(ZArray *self, Py_ssize_t start, Py_ssize_t step,
+                         Py_ssize_t count, const char *src) {
+  Py_ssize_t itemsize = self->itemsize;
+  zsafepoint_enter();
+  char *dst = zarray_data(self) + start * itemsize;
+  if (step == 1) {
+    memmove(dst, src, count * itemsize);
+  } else {
+    for (Py_ssize_t k = 0; k < count; k++)
+      memcpy(dst + k * step * itemsize, src + k * itemsize, itemsize);
+  }
+  zsafepoint_leave();
+}
+
+static int zarray_assign_slice(ZArray *self, Py_ssize_t start,
+                               Py_ssize_t step, Py_ssize_t count,
+                               PyObject *value) {
+  // Fast path: a contiguous buffer with the same element type
+  if (self->dtype != ZARRAY_REF && PyObject_CheckBuffer(value)) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(value, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) ==
+        0) {
+      if (zarray_format_matches(&view, self->dtype)) {
+        int rc = 0;
+        if (view.len != count * self->itemsize) {
+          PyErr_Format(PyExc_ValueError,
+                       "cannot assign %zd elements to a slice of %zd",
+                       view.len / self->itemsize, count);
+          rc = -1;
+        } else if (step == 1) {
+          zarray_write(self, start, step, count, (const char *)view.buf);
+        } else {
+          // The source may overlap the destination (a[::2] = a[:n])
+          char *copy = (char *)PyMem_Malloc(view.len ? view.len : 1);
+          if (copy) {
+            memcpy(copy, view.buf, view.len);
+            zarray_write(self, start, step, count, copy);
+            PyMem_Free(copy);
+          } else {
+            PyErr_NoMemory();
+            rc = -1;
+          }
+        }
+        PyBuffer_Release(&view);
+        return rc;
+      }
+      PyBuffer_Release(&view);
+    } else {
+      PyErr_Clear();
+    }
+  }
+
+  // Element by element from any sequence
+  PyObject *seq = PySequence_Fast(value, "can only assign a sequence or "
+                                         "buffer to an array slice");
+  if (!seq)
+    return -1;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+  PyObject **items = PySequence_Fast_ITEMS(seq);
+  int rc = 0;
+  if (n != count) {
+    PyErr_Format(PyExc_ValueError,
+                 "cannot assign %zd elements to a slice of %zd", n, count);
+    rc = -1;
+  } else if (self->dtype == ZARRAY_REF) {
+    for (Py_ssize_t k = 0; rc == 0 && k < n; k++)
+      rc = zarray_set(self, start + k * step, items[k]);
+  } else {
+    char *packed = (char *)PyMem_Malloc(n ? n * self->itemsize : 1);
+    if (!packed) {
+      PyErr_NoMemory();
+      rc = -1;
+    }
+    for (Py_ssize_t k = 0; rc == 0 && k < n; k++)
+      rc = zarray_pack(self->dtype, items[k], packed + k * self->itemsize);
+    if (rc == 0)
+      zarray_write(self, start, step, n, packed);
+    PyMem_Free(packed);
+  }
+  Py_DECREF(seq);
+  return rc;
+}
+
+static PyObject *ZArray_subscript(ZArray *self, PyObject *key) {
+  if (PySlice_Check(key)) {
+    Py_ssize_t start, stop, step;
+    if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+      return NULL;
+    Py_ssize_t count =
+        PySlice_AdjustIndices(self->length, &start, &stop, step);
+    return zarray_slice(self, start, step, count);
+  }
+  Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+  if (i == -1 && PyErr_Occurred())
+    return NULL;
+  if (i < 0)
+    i += self->length;
+  return ZArray_item(self, i);
+}
+
+static int ZArray_ass_subscript(ZArray *self, PyObject *key,
+                                PyObject *value) {
+  if (value == NULL) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete array elements");
+    return -1;
+  }
+  if (PySlice_Check(key)) {
+    Py_ssize_t start, stop, step;
+    if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+      return -1;
+    Py_ssize_t count =
+        PySlice_AdjustIndices(self->length, &start, &stop, step);
+    return zarray_assign_slice(self, start, step, count, value);
+  }
+  Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+  if (i == -1 && PyErr_Occurred())
+    return -1;
+  if (i < 0)
+    i += self->length;
+  if (i < 0 || i >= self->length) {
+    PyErr_SetString(PyExc_IndexError, "array assignment index out of range");
+    return -1;
+  }
+  return zarray_set(self, i, value);
+}
+
+// --- Methods ---
+
+static PyObject *ZArray_fill(ZArray *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"value", "start", "stop", NULL};
+  PyObject *value;
+  Py_ssize_t start = 0, stop = self->length;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|nn:fill", kwlist, &value,
+                                   &start, &stop))
+    return NULL;
+  PySlice_AdjustIndices(self->length, &start, &stop, 1);
+
+  if (self->dtype == ZARRAY_REF) {
+    for (Py_ssize_t i = start; i < stop; i++) {
+      if (zarray_set(self, i, value) < 0)
+        return NULL;
+    }
+    Py_RETURN_NONE;
+  }
+
+  char item[8];
+  if (zarray_pack(self->dtype, value, item) < 0)
+    return NULL;
+  Py_ssize_t itemsize = self->itemsize;
+  zsafepoint_enter();
+  char *data = zarray_data(self);
+  if (stop > start) {
+    // One element, then double the filled prefix
+    char *dst = data + start * itemsize;
+    size_t total = (stop - start) * itemsize, filled = itemsize;
+    memcpy(dst, item, itemsize);
+    while (filled < total) {
+      size_t n = filled < total - filled ? filled : total - filled;
+      memcpy(dst + filled, dst, n);
+      filled += n;
+    }
+  }
+  zsafepoint_leave();
+  Py_RETURN_NONE;
+}
+
+static PyObject *ZArray_copy(ZArray *self, PyObject *Py_UNUSED(ignored)) {
+  return zarray_slice(self, 0, 1, self->length);
+}
+
+static PyObject *ZArray_get_dtype(ZArray *self, void *closure) {
+  return PyUnicode_FromString(zarray_dtypes[self->dtype].name);
+}
+
+static PyObject *ZArray_get_itemsize(ZArray *self, void *closure) {
+  return PyLong_FromSsize_t(self->itemsize);
+}
+
+static PyObject *ZArray_get_nbytes(ZArray *self, void *closure) {
+  return PyLong_FromSsize_t(self->length * self->itemsize);
+}
+
+static PyObject *ZArray_repr(ZArray *self) {
+  return PyUnicode_FromFormat("pyzgc.Array('%s', %zd)",
+                              zarray_dtypes[self->dtype].name, self->length);
+}
+
+// --- Buffer protocol ---
+
+static int ZArray_getbuffer(ZArray *self, Py_buffer *view, int flags) {
+  if (self->dtype == ZARRAY_REF) {
+    PyErr_SetString(PyExc_BufferError,
+                    "reference arrays do not export buffers");
+    view->obj = NULL;
+    return -1;
+  }
+
+  // The page stays pinned until the export is released, so the pointer we
+  // hand out survives every relocation in between
+  zsafepoint_enter();
+  char *data = zarray_data(self);
+  ZPage *page = zheap_get_page(data);
+  zpage_pin(page);
+  zsafepoint_leave();
+
+  view->buf = data;
+  view->obj = Py_NewRef(self);
+  view->len = self->length * self->itemsize;
+  view->readonly = 0;
+  view->itemsize = self->itemsize;
+  view->format =
+      (flags & PyBUF_FORMAT) ? (char *)zarray_dtypes[self->dtype].format : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? &self->length : NULL;
+  view->strides = (flags & PyBUF_STRIDES) ? &self->itemsize : NULL;
+  view->suboffsets = NULL;
+  view->internal = page;
+  return 0;
+}
+
+static void ZArray_releasebuffer(ZArray *self, Py_buffer *view) {
+  zpage_unpin((ZPage *)view->internal);
+}
+
+static PyMethodDef ZArray_methods[] = {
+    {"fill", (PyCFunction)(void (*)(void))ZArray_fill,
+     METH_VARARGS | METH_KEYWORDS,
+     "fill(value, start=0, stop=len): set a range of elements to value."},
+    {"copy", (PyCFunction)ZArray_copy, METH_NOARGS,
+     "Return a new array with the same elements."},
+    {NULL}};
+
+static PyGetSetDef ZArray_getset[] = {
+    {"dtype", (getter)ZArray_get_dtype, NULL, "Element type.", NULL},
+    {"itemsize", (getter)ZArray_get_itemsize, NULL, "Bytes per element.",
+     NULL},
+    {"nbytes", (getter)ZArray_get_nbytes, NULL, "Bytes of element data.",
+     NULL},
+    {NULL}};
+
+static PyMemberDef ZArray_members[] = {
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(ZArray, weakreflist),
+     READONLY},
+    {NULL}};
+
+static PyType_Slot ZArray_slots[] = {
+    {Py_tp_doc, "Array(dtype, n): n elements of 'i64', 'f64', 'i32', 'f32', "
+                "'u8' or 'ref' stored in the ZGC heap"},
+    {Py_tp_new, ZArray_new},
+    {Py_tp_dealloc, ZArray_dealloc},
+    {Py_tp_repr, ZArray_repr},
+    {Py_sq_length, ZArray_length},
+    {Py_sq_item, ZArray_item},
+    {Py_mp_length, ZArray_length},
+    {Py_mp_subscript, ZArray_subscript},
+    {Py_mp_ass_subscript, ZArray_ass_subscript},
+    {Py_bf_getbuffer, ZArray_getbuffer},
+    {Py_bf_releasebuffer, ZArray_releasebuffer},
+    {Py_tp_methods, ZArray_methods},
+    {Py_tp_getset, ZArray_getset},
+    {Py_tp_members, ZArray_members},
+    {0, NULL}};
+
+PyType_Spec ZArraySpec = {
+    .name = "pyzgc.Array",
+    .basicsize = sizeof(ZArray),
+    .flags = ZTYPE_FLAGS,
+    .slots = ZArray_slots,
+};
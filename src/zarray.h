@@ -0,0 +1,95 @@
+#ifndef ZARRAY_H
+#define ZARRAY_H
+
+#include "zobject.h"
+#include "zstruct.h"
+#include <Python.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Heap-resident typed arrays (pyzgc.Array). An array body is variable-sized:
+//   word 0   header: (length << 8) | (dtype << 3) | ZARRAY_TAG
+//   then     length elements of the dtype's itemsize, padded to 8 bytes
+//   last     the handle back-pointer every body ends with (zobject.h)
+// Like the struct header (zstruct.h), the tag can't appear in word 0 of a
+// plain body. Bodies above ZLARGE_OBJECT_SIZE get a dedicated large page.
+// Reference arrays hold slot words like a plain body and are traced by the
+// marker; numeric arrays export their data through the buffer protocol,
+// pinning the page while an export is alive.
+
+#define ZARRAY_TAG 0x2
+#define ZARRAY_TAG_MASK 0x7
+#define ZARRAY_HEADER_SIZE 8
+
+typedef enum {
+  ZARRAY_I64,
+  ZARRAY_F64,
+  ZARRAY_I32,
+  ZARRAY_F32,
+  ZARRAY_U8,
+  ZARRAY_REF,
+} ZArrayDtype;
+
+// Handle. Starts like ZObject so the barriers work on it unchanged.
+typedef struct {
+  PyObject_HEAD ZBody *body;
+  PyObject *weakreflist;
+  Py_ssize_t registered; // See ZObject
+  ZArrayDtype dtype;
+  Py_ssize_t length;
+  Py_ssize_t itemsize; // Also the stride of buffer exports
+} ZArray;
+
+static inline bool zarray_is_header(uint64_t word) {
+  return (word & ZARRAY_TAG_MASK) == ZARRAY_TAG;
+}
+
+static inline ZArrayDtype zarray_header_dtype(uint64_t header) {
+  return (ZArrayDtype)((header >> 3) & 0x1f);
+}
+
+static inline uint64_t zarray_header_length(uint64_t header) {
+  return header >> 8;
+}
+
+static inline size_t zarray_itemsize(ZArrayDtype dtype) {
+  switch (dtype) {
+  case ZARRAY_I32:
+  case ZARRAY_F32:
+    return 4;
+  case ZARRAY_U8:
+    return 1;
+  default:
+    return 8;
+  }
+}
+
+static inline size_t zarray_body_size(size_t length, size_t itemsize) {
+  return ZARRAY_HEADER_SIZE + ((length * itemsize + 7) & ~(size_t)7) +
+         sizeof(PyObject *);
+}
+
+// Size of the body in bytes: arrays carry it in their header, structs in
+// their layout, every other body is a ZBody
+static inline size_t zbody_size(ZBody *body) {
+  uint64_t header = zbody_get_word(body, 0);
+  if (!zarray_is_header(header)) {
+    const ZLayout *layout = zstruct_body_layout(body);
+    return layout ? zstruct_body_size(layout) : sizeof(ZBody);
+  }
+  return zarray_body_size(zarray_header_length(header),
+                          zarray_itemsize(zarray_header_dtype(header)));
+}
+
+// The handle back-pointer (ZBody.handle), last word of every body
+static inline PyObject **zbody_handle_slot(ZBody *body) {
+  return (PyObject **)body + zbody_size(body) / sizeof(PyObject *) - 1;
+}
+
+// New array of `length` zeroed elements. New reference.
+ZArray *zarray_new(ZArrayDtype dtype, Py_ssize_t length);
+
+// New handle for an existing array body. New reference.
+PyObject *zarray_wrap_body(ZBody *body);
+
+#endif
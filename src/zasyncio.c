@@ -0,0 +1,307 @@
+#define PY_SSIZE_T_CLEAN
+#include "zasyncio.h"
+#include "zgc.h"
+#include "zsafepoint.h"
+#include <Python.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <structmember.h>
+#include <time.h>
+
+#define ZASYNCIO_SLICE_US 1000.0
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *selector;   // The loop's own
+  uint64_t slice_ns;    // Longest step between two polls for I/O
+  Py_ssize_t steps;     // Idle steps that did work
+  Py_ssize_t backoffs;  // Idle periods cut short by I/O
+  uint64_t idle_ns;     // Time spent collecting in idle periods
+} ZIdleSelector;
+
+static uint64_t zasyncio_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// selector.select(timeout); UINT64_MAX waits for I/O without a timeout
+static PyObject *zasyncio_poll(ZIdleSelector *self, uint64_t timeout_ns) {
+  if (timeout_ns == UINT64_MAX)
+    return PyObject_CallMethod(self->selector, "select", "O", Py_None);
+  return PyObject_CallMethod(self->selector, "select", "d",
+                             (double)timeout_ns / 1e9);
+}
+
+static PyObject *ZIdleSelector_select(ZIdleSelector *self, PyObject *args,
+                                      PyObject *kwds) {
+  static char *kwlist[] = {"timeout", NULL};
+  PyObject *timeout_obj = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:select", kwlist,
+                                   &timeout_obj))
+    return NULL;
+  zstate_enter();
+  uint64_t deadline = UINT64_MAX;
+  if (timeout_obj != Py_None) {
+    double timeout = PyFloat_AsDouble(timeout_obj);
+    if (timeout == -1.0 && PyErr_Occurred())
+      return NULL;
+    // Callbacks are ready: the loop is not idle
+    if (timeout <= 0.0)
+      return zasyncio_poll(self, 0);
+    deadline = zasyncio_now_ns() + (uint64_t)(timeout * 1e9);
+  }
+
+  for (;;) {
+    uint64_t due = zgc_idle_due_ns();
+    uint64_t now = zasyncio_now_ns();
+    uint64_t remaining = deadline == UINT64_MAX ? UINT64_MAX
+                         : deadline > now       ? deadline - now
+                                                : 0;
+    // Nothing to do before the loop's own timeout
+    if (remaining == 0 || due >= remaining)
+      return zasyncio_poll(self, remaining);
+
+    // Wait for I/O until the cycle is due, and poll for it between steps
+    PyObject *events = zasyncio_poll(self, due);
+    if (!events)
+      return NULL;
+    int ready = PyObject_IsTrue(events);
+    if (ready != 0) {
+      if (ready > 0 && due == 0)
+        self->backoffs++;
+      if (ready < 0)
+        Py_CLEAR(events);
+      return events;
+    }
+    Py_DECREF(events);
+    if (due > 0)
+      continue;
+
+    uint64_t budget = remaining < self->slice_ns ? remaining : self->slice_ns;
+    uint64_t start = zasyncio_now_ns();
+    bool worked;
+    // Steps take pauses of their own, which need the GIL
+    Py_BEGIN_ALLOW_THREADS
+    worked = zgc_idle_step(budget);
+    Py_END_ALLOW_THREADS
+    zsafepoint_poll();
+    // The GC thread has the cycle: just wait for I/O
+    if (!worked) {
+      now = zasyncio_now_ns();
+      return zasyncio_poll(self, deadline == UINT64_MAX ? UINT64_MAX
+                                 : deadline > now       ? deadline - now
+                                                        : 0);
+    }
+    self->steps++;
+    self->idle_ns += zasyncio_now_ns() - start;
+  }
+}
+
+// Everything else (register, unregister, get_map, ...) is the selector's
+static PyObject *ZIdleSelector_getattro(ZIdleSelector *self, PyObject *name) {
+  PyObject *attr = PyObject_GenericGetAttr((PyObject *)self, name);
+  if (attr || !PyErr_ExceptionMatches(PyExc_AttributeError))
+    return attr;
+  PyErr_Clear();
+  return PyObject_GetAttr(self->selector, name);
+}
+
+static void ZIdleSelector_dealloc(ZIdleSelector *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  Py_XDECREF(self->selector);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static PyObject *ZIdleSelector_get_slice_us(ZIdleSelector *self,
+                                            void *closure) {
+  return PyFloat_FromDouble((double)self->slice_ns / 1e3);
+}
+
+static PyObject *ZIdleSelector_get_idle_ns(ZIdleSelector *self,
+                                           void *closure) {
+  return PyLong_FromUnsignedLongLong(self->idle_ns);
+}
+
+static PyObject *ZIdleSelector_repr(ZIdleSelector *self) {
+  return PyUnicode_FromFormat("<pyzgc.asyncio.IdleSelector wrapping %R; "
+                              "%zd steps, %zd backoffs>",
+                              self->selector, self->steps, self->backoffs);
+}
+
+static PyMethodDef ZIdleSelector_methods[] = {
+    {"select", (PyCFunction)(void (*)(void))ZIdleSelector_select,
+     METH_VARARGS | METH_KEYWORDS,
+     "select(timeout=None): collect while waiting, then the selector's "
+     "select()."},
+    {NULL}};
+
+static PyMemberDef ZIdleSelector_members[] = {
+    {"selector", T_OBJECT, offsetof(ZIdleSelector, selector), READONLY,
+     "The loop's own selector."},
+    {"steps", T_PYSSIZET, offsetof(ZIdleSelector, steps), READONLY,
+     "Collection steps run while the loop was idle."},
+    {"backoffs", T_PYSSIZET, offsetof(ZIdleSelector, backoffs), READONLY,
+     "Times I/O became ready while a cycle was still open."},
+    {NULL}};
+
+static PyGetSetDef ZIdleSelector_getset[] = {
+    {"slice_us", (getter)ZIdleSelector_get_slice_us, NULL,
+     "Longest step between two polls for I/O, in microseconds.", NULL},
+    {"idle_ns", (getter)ZIdleSelector_get_idle_ns, NULL,
+     "Time spent collecting while the loop was idle.", NULL},
+    {NULL}};
+
+static PyType_Slot ZIdleSelector_slots[] = {
+    {Py_tp_doc, "Selector of an event loop that collects while the loop is "
+                "idle (see pyzgc.asyncio.install)."},
+    {Py_tp_dealloc, ZIdleSelector_dealloc},
+    {Py_tp_repr, ZIdleSelector_repr},
+    {Py_tp_getattro, ZIdleSelector_getattro},
+    {Py_tp_methods, ZIdleSelector_methods},
+    {Py_tp_members, ZIdleSelector_members},
+    {Py_tp_getset, ZIdleSelector_getset},
+    {0, NULL}};
+
+// Made by install() only
+PyType_Spec ZIdleSelectorSpec = {
+    .name = "pyzgc.asyncio.IdleSelector",
+    .basicsize = sizeof(ZIdleSelector),
+    .flags = ZTYPE_FLAGS | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = ZIdleSelector_slots,
+};
+
+// --- pyzgc.asyncio ---
+
+// Whether obj is an instance of module.name
+static int zasyncio_is_instance(PyObject *obj, const char *module,
+                                const char *name) {
+  PyObject *mod = PyImport_ImportModule(module);
+  if (!mod)
+    return -1;
+  PyObject *cls = PyObject_GetAttrString(mod, name);
+  Py_DECREF(mod);
+  if (!cls)
+    return -1;
+  int rc = PyObject_IsInstance(obj, cls);
+  Py_DECREF(cls);
+  return rc;
+}
+
+// The loop's selector; TypeError for loops without one. asyncio has no
+// public way to reach it: BaseSelectorEventLoop keeps it in the private
+// _selector attribute, which _run_once calls select() on (CPython 3.4 to
+// 3.13 at least). So only loops of that class are accepted, and only if
+// the attribute still holds a selectors.BaseSelector (or ours).
+static PyObject *zasyncio_selector(PyObject *loop) {
+  zstate_enter();
+  int rc = zasyncio_is_instance(loop, "asyncio.selector_events",
+                                "BaseSelectorEventLoop");
+  if (rc <= 0) {
+    if (rc == 0)
+      PyErr_SetString(PyExc_TypeError,
+                      "pyzgc.asyncio needs a selector event loop");
+    return NULL;
+  }
+  PyObject *selector = PyObject_GetAttrString(loop, "_selector");
+  if (!selector) {
+    if (PyErr_ExceptionMatches(PyExc_AttributeError)) {
+      PyErr_Clear();
+      PyErr_SetString(PyExc_TypeError,
+                      "this asyncio keeps no _selector on its loops");
+    }
+    return NULL;
+  }
+  rc = Py_IS_TYPE(selector, zstate->types.idle_selector)
+           ? 1
+           : zasyncio_is_instance(selector, "selectors", "BaseSelector");
+  if (rc <= 0) {
+    if (rc == 0)
+      PyErr_Format(PyExc_TypeError,
+                   "loop._selector is a %.100s, not a selector",
+                   Py_TYPE(selector)->tp_name);
+    Py_DECREF(selector);
+    return NULL;
+  }
+  return selector;
+}
+
+static PyObject *zasyncio_install(PyObject *module, PyObject *args,
+                                  PyObject *kwds) {
+  static char *kwlist[] = {"loop", "slice_us", NULL};
+  PyObject *loop;
+  double slice_us = ZASYNCIO_SLICE_US;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$d:install", kwlist, &loop,
+                                   &slice_us))
+    return NULL;
+  if (!(slice_us > 0.0)) {
+    PyErr_SetString(PyExc_ValueError, "slice_us must be > 0");
+    return NULL;
+  }
+
+  PyObject *selector = zasyncio_selector(loop);
+  if (!selector)
+    return NULL;
+  // Installed already: only the slice changes
+  if (Py_IS_TYPE(selector, zstate->types.idle_selector)) {
+    ((ZIdleSelector *)selector)->slice_ns = (uint64_t)(slice_us * 1e3);
+    return selector;
+  }
+
+  PyTypeObject *type = zstate->types.idle_selector;
+  ZIdleSelector *idle = (ZIdleSelector *)type->tp_alloc(type, 0);
+  if (!idle) {
+    Py_DECREF(selector);
+    return NULL;
+  }
+  idle->selector = selector;
+  idle->slice_ns = (uint64_t)(slice_us * 1e3);
+  if (PyObject_SetAttrString(loop, "_selector", (PyObject *)idle) < 0) {
+    Py_DECREF(idle);
+    return NULL;
+  }
+  return (PyObject *)idle;
+}
+
+static PyObject *zasyncio_uninstall(PyObject *module, PyObject *loop) {
+  PyObject *selector = zasyncio_selector(loop);
+  if (!selector)
+    return NULL;
+  int rc = 0;
+  if (Py_IS_TYPE(selector, zstate->types.idle_selector))
+    rc = PyObject_SetAttrString(loop, "_selector",
+                                ((ZIdleSelector *)selector)->selector);
+  Py_DECREF(selector);
+  if (rc < 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef zasyncio_methods[] = {
+    {"install", (PyCFunction)(void (*)(void))zasyncio_install,
+     METH_VARARGS | METH_KEYWORDS,
+     "install(loop, *, slice_us=1000): collect while loop is idle, in steps "
+     "of up to slice_us between polls for I/O. Returns the loop's new "
+     "selector, which counts the steps."},
+    {"uninstall", zasyncio_uninstall, METH_O,
+     "uninstall(loop): give loop its own selector back."},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef zasyncio_def = {
+    PyModuleDef_HEAD_INIT, "pyzgc.asyncio",
+    "Idle-time collection for asyncio event loops.", 0, zasyncio_methods};
+
+PyObject *zasyncio_module(void) {
+  PyObject *m = PyModule_Create(&zasyncio_def);
+  if (!m)
+    return NULL;
+  PyObject *type = (PyObject *)zstate->types.idle_selector;
+  Py_INCREF(type);
+  if (PyModule_AddObject(m, "IdleSelector", type) < 0) {
+    Py_DECREF(type);
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
@@ -0,0 +1,31 @@
+#ifndef ZASYNCIO_H
+#define ZASYNCIO_H
+
+#include <Python.h>
+
+// Idle-time collection for asyncio (pyzgc.asyncio.install).
+//
+// An event loop that has nothing ready blocks in its selector's select()
+// until I/O arrives or its next timer is due. install() wraps the loop's
+// selector so that such a wait is spent collecting first: while a cycle is
+// due or open (zgc_idle_due_ns), it alternates steps of about slice_us of
+// marking, relocation and page release (zgc_idle_step) with a select(0)
+// for I/O, and returns the events as soon as there are any. A select()
+// that is not meant to block (timeout 0: callbacks are ready) goes
+// straight through, so request handling never waits for the collector
+// for more than one slice.
+//
+// Idle steps leave the cycle to the GC thread while it runs one. The GC
+// thread skips the cycles idle steps have already run, and gives the loop
+// an extra interval to start a due one: with a loop that is idle often
+// enough, all collection work moves there.
+//
+// Only selector event loops (asyncio's default on Unix) have a selector
+// to wrap.
+
+extern PyType_Spec ZIdleSelectorSpec;
+
+// The pyzgc.asyncio module. New reference.
+PyObject *zasyncio_module(void);
+
+#endif
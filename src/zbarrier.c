@@ -1,44 +1,51 @@
 #include "zbarrier.h"
+#include "zgc.h"
 #include "zheap.h"
 #include "zobject.h"
-#include <stdio.h>
+#include "zprobe.h"
+#include "zsafepoint.h"
+
+void *zbarrier_resolve(void *body) {
+  void *raw_body = Z_ADDRESS(body);
+
+  // Follow the forwarding tables, which evacuated pages keep. A body that
+  // hasn't been reached for a while may have moved more than once.
+  for (;;) {
+    ZPage *page = zheap_get_page(raw_body);
+    if (!page || !page->is_evacuating)
+      return raw_body;
+    // While the GC is still copying this page we may have to relocate the
+    // object ourselves.
+    void *new_body = atomic_load(&page->is_relocating)
+                         ? zgc_relocate_object(page, raw_body)
+                         : zpage_resolve_forwarding(page, raw_body);
+    if (!new_body)
+      return raw_body; // Not copied: dead, or out of memory
+    raw_body = new_body;
+  }
+}
 
 void zbarrier_fix_pointer(ZObject *zobj) {
   if (!zobj || !zobj->body)
     return;
 
-  // 1. Strip color to get raw address
-  void *raw_body = Z_ADDRESS(zobj->body);
-
-  // 2. Check if page is evacuated
-  ZPage *page = zheap_get_page(raw_body);
-  if (page && page->is_evacuating) {
-    // Resolve forwarding
-    void *new_body = zpage_resolve_forwarding(page, raw_body);
-    if (new_body) {
-      // Found new address!
-      // Update with new address AND good color
-      zobj->body = (ZBody *)Z_WITH_COLOR(new_body, zgc_good_color);
-      // printf("[ZBarrier] Fixed %p -> %p\n", raw_body, zobj->body);
-      return;
-    } else {
-      // printf("[ZBarrier] Failed to resolve %p (Page Count: %zu)\n", raw_body,
-      //        page->forwarding_table.count);
-    }
-  } else {
-    if (page) {
-      // printf("[ZBarrier] Page %p not evacuating (Gen: %d)\n", page,
-      //        page->generation);
-    } else {
-      // printf("[ZBarrier] Page not found for %p\n", raw_body);
-    }
-  }
+  // 0. Safepoint poll: nothing has been read from the body yet
+  zsafepoint_poll();
+
+  // 1. Current address of the body. If its page wasn't evacuated, only
+  // the global color changed (e.g., next marking phase).
+  ZBody *seen = zobject_get_body(zobj);
+  void *raw_body = zbarrier_resolve(seen);
 
-  // 3. If not evacuated (or not found in forwarding), just update color
-  // This happens if the object is in a page that wasn't evacuated,
-  // but the global color changed (e.g., next marking phase).
-  // We just "heal" the color.
-  zobj->body = (ZBody *)Z_WITH_COLOR(raw_body, zgc_good_color);
+  // 2. Heal with the good color. Several threads (and the marker) may race
+  // to heal the same handle; they all install the same forwarded body, so
+  // losing the CAS is fine.
+  if (raw_body == Z_ADDRESS(seen))
+    ZPROBE2(barrier__heal, zobj, raw_body);
+  else
+    ZPROBE3(barrier__forward, zobj, Z_ADDRESS(seen), raw_body);
+  zobject_heal_body(zobj, seen,
+                    (ZBody *)Z_WITH_COLOR(raw_body, zstate->good_color));
 }
 
 PyObject *zbarrier_load(PyObject *obj) {
@@ -46,11 +53,11 @@ PyObject *zbarrier_load(PyObject *obj) {
     return NULL;
 
   // Check if it's a ZObject
-  if (Py_TYPE(obj) == &ZObjectType) {
+  if (zobject_is_handle(obj)) {
     ZObject *zobj = (ZObject *)obj;
 
     // Check color
-    if (!Z_HAS_COLOR(zobj->body, zgc_good_color)) {
+    if (!Z_HAS_COLOR(zobj->body, zstate->good_color)) {
       zbarrier_fix_pointer(zobj);
     }
   }
@@ -7,6 +7,10 @@
 // Load Barrier: Ensures the object is valid to be returned to Python
 PyObject *zbarrier_load(PyObject *obj);
 
+// Current (uncolored) address of a possibly stale body pointer, relocating
+// the body first if its page is being evacuated right now
+void *zbarrier_resolve(void *body);
+
 // Fix Pointer: Ensures the ZObject's body pointer is up to date (correct color
 // and address)
 void zbarrier_fix_pointer(ZObject *zobj);
@@ -0,0 +1,81 @@
+#include <Python.h>
+#include "zcard.h"
+#include "zarray.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool zcard_init(ZPage *page, uintptr_t end) {
+  size_t ncards = (end - page->start + ZCARD_SIZE - 1) >> ZCARD_SHIFT;
+  uint8_t *cards = (uint8_t *)calloc(ncards, 1);
+  uint16_t *first = (uint16_t *)malloc(ncards * sizeof(uint16_t));
+  if (!cards || !first) {
+    free(cards);
+    free(first);
+    return false;
+  }
+  memset(first, 0xff, ncards * sizeof(uint16_t)); // ZCARD_NONE
+  page->ncards = ncards;
+  page->cards = cards;
+  page->card_first = first;
+  atomic_store(&page->cards_dirty, false);
+  return true;
+}
+
+void zcard_free(ZPage *page) {
+  free(page->cards);
+  free(page->card_first);
+  page->cards = NULL;
+  page->card_first = NULL;
+  page->ncards = 0;
+  atomic_store(&page->cards_dirty, false);
+}
+
+// Visits the bodies starting in one card. Returns true if one of them
+// refers to a mutable body.
+static bool zcard_scan_card(ZPage *page, size_t card,
+                            bool (*fn)(ZBody *body, void *arg), void *arg) {
+  uintptr_t card_start = page->start + (card << ZCARD_SHIFT);
+  uintptr_t card_end = card_start + ZCARD_SIZE;
+  bool refers_out = false;
+  uintptr_t addr = card_start + page->card_first[card];
+  while (addr < card_end && addr < page->top) {
+    ZBody *body = (ZBody *)addr;
+    refers_out |= fn(body, arg);
+    addr += zbody_size(body);
+  }
+  return refers_out;
+}
+
+size_t zcard_scan(bool all, bool clean, bool (*fn)(ZBody *body, void *arg),
+                  void *arg) {
+  size_t visited = 0;
+  for (ZPage *page = zheap_get_head_page(); page; page = page->next) {
+    if (!page->is_frozen || (!all && !atomic_load(&page->cards_dirty)))
+      continue;
+    bool dirty = false;
+    if (clean)
+      atomic_store(&page->cards_dirty, false);
+    for (size_t card = 0; card < page->ncards; card++) {
+      if (page->card_first[card] == ZCARD_NONE ||
+          (!all && !__atomic_load_n(&page->cards[card], __ATOMIC_RELAXED)))
+        continue;
+      visited++;
+      if (zcard_scan_card(page, card, fn, arg)) {
+        __atomic_store_n(&page->cards[card], 1, __ATOMIC_RELAXED);
+        dirty = true;
+      } else if (clean) {
+        __atomic_store_n(&page->cards[card], 0, __ATOMIC_RELAXED);
+      }
+    }
+    if (dirty)
+      atomic_store(&page->cards_dirty, true);
+  }
+  return visited;
+}
+
+size_t zcard_count_dirty(ZPage *page) {
+  size_t dirty = 0;
+  for (size_t card = 0; card < page->ncards; card++)
+    dirty += __atomic_load_n(&page->cards[card], __ATOMIC_RELAXED) != 0;
+  return dirty;
+}
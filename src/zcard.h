@@ -0,0 +1,66 @@
+#ifndef ZCARD_H
+#define ZCARD_H
+
+#include "zheap.h"
+#include "zobject.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Card tables of frozen pages (pyzgc.freeze).
+//
+// Cycles never trace through frozen bodies, so the few that refer to
+// mutable bodies have to be found another way. Every frozen page has one
+// byte per ZCARD_SIZE bytes, which the store barrier dirties when a body
+// starting in that card is given a reference to a mutable body. Marking
+// starts from the bodies in dirty cards (zgc.c) and cleans the cards whose
+// bodies no longer refer out.
+//
+// Frozen pages are filled body after body, and card_first records where
+// the first body starting in each card is, so a card can be walked on its
+// own. Cards are keyed by where a body starts, not by the slot written.
+
+#define ZCARD_SHIFT 9
+#define ZCARD_SIZE (1 << ZCARD_SHIFT)
+#define ZCARD_NONE UINT16_MAX
+
+// Gives `page` clean cards up to `end` (a page address). False when out of
+// memory.
+bool zcard_init(ZPage *page, uintptr_t end);
+void zcard_free(ZPage *page);
+
+static inline size_t zcard_index(ZPage *page, void *body) {
+  return ((uintptr_t)Z_ADDRESS(body) - page->start) >> ZCARD_SHIFT;
+}
+
+// A body was just allocated at `body`, after every other body of the page
+static inline void zcard_record(ZPage *page, void *body) {
+  size_t card = zcard_index(page, body);
+  if (page->card_first[card] == ZCARD_NONE)
+    page->card_first[card] =
+        (uint16_t)(((uintptr_t)body - page->start) & (ZCARD_SIZE - 1));
+}
+
+// `body` was given a reference to a mutable body. Cards are only cleaned
+// in pauses, so this needs no ordering with the store.
+static inline void zcard_dirty(ZPage *page, void *body) {
+  uint8_t *card = &page->cards[zcard_index(page, body)];
+  if (!__atomic_load_n(card, __ATOMIC_RELAXED)) {
+    __atomic_store_n(card, 1, __ATOMIC_RELAXED);
+    atomic_store_explicit(&page->cards_dirty, true, memory_order_relaxed);
+  }
+}
+
+// Calls fn on every body starting in a dirty card of a frozen page, or in
+// any card with `all`. fn returns true if the body refers to a mutable
+// body, which leaves its card dirty (or dirties it). With `clean`, which
+// is only allowed in a pause, the other cards visited are cleaned. Returns
+// the cards visited.
+size_t zcard_scan(bool all, bool clean, bool (*fn)(ZBody *body, void *arg),
+                  void *arg);
+
+// Dirty cards of one page (pyzgc.heap_info)
+size_t zcard_count_dirty(ZPage *page);
+
+#endif
@@ -0,0 +1,181 @@
+#include "zcgroup.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static pthread_mutex_t cgroup_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool cgroup_detected = false; // zcgroup_set_path has run
+static char cgroup_dir[PATH_MAX];    // "" when there is none
+// Mount point of a detected cgroup: limits are read up to here. "" for an
+// explicit directory, which is read alone.
+static char cgroup_mount[PATH_MAX];
+
+// Reads a single value file. "max" is ZCGROUP_UNLIMITED; returns false if
+// the file is missing or malformed.
+static bool zcgroup_read_value(const char *dir, const char *name,
+                               uint64_t *out) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+    return false;
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+  char buf[64];
+  bool ok = fgets(buf, sizeof(buf), f) != NULL;
+  fclose(f);
+  if (!ok)
+    return false;
+  if (strncmp(buf, "max", 3) == 0) {
+    *out = ZCGROUP_UNLIMITED;
+    return true;
+  }
+  char *end;
+  unsigned long long value = strtoull(buf, &end, 10);
+  if (end == buf)
+    return false;
+  *out = (uint64_t)value;
+  return true;
+}
+
+// "some avg10=1.23 avg60=... total=..." on the first line
+static double zcgroup_read_pressure(const char *dir) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/memory.pressure", dir) >=
+      (int)sizeof(path))
+    return 0.0;
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return 0.0;
+  double avg10 = 0.0;
+  if (fscanf(f, "some avg10=%lf", &avg10) != 1)
+    avg10 = 0.0;
+  fclose(f);
+  return avg10;
+}
+
+static bool zcgroup_has_memory(const char *dir) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/memory.current", dir) >=
+      (int)sizeof(path))
+    return false;
+  return access(path, R_OK) == 0;
+}
+
+// Finds the cgroup2 mount and the process's cgroup below it
+static bool zcgroup_detect(char *dir, char *mount) {
+  FILE *f = fopen("/proc/self/mounts", "r");
+  if (!f)
+    return false;
+  char line[PATH_MAX + 256];
+  char point[PATH_MAX], type[64];
+  bool found = false;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%*s %4095s %63s", point, type) == 2 &&
+        strcmp(type, "cgroup2") == 0) {
+      found = true;
+      break;
+    }
+  }
+  fclose(f);
+  if (!found)
+    return false;
+
+  f = fopen("/proc/self/cgroup", "r");
+  if (!f)
+    return false;
+  found = false;
+  while (fgets(line, sizeof(line), f)) {
+    // The unified hierarchy is the entry with ID 0 and no controllers
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      const char *rel = line + 3;
+      if (strcmp(rel, "/") == 0)
+        rel = "";
+      found = snprintf(dir, PATH_MAX, "%s%s", point, rel) < PATH_MAX;
+      break;
+    }
+  }
+  fclose(f);
+  if (!found)
+    return false;
+  strcpy(mount, point);
+  return true;
+}
+
+bool zcgroup_set_path(const char *path) {
+  char dir[PATH_MAX] = "", mount[PATH_MAX] = "";
+  bool found;
+  if (path) {
+    found = strlen(path) < sizeof(dir);
+    if (found)
+      strcpy(dir, path);
+  } else {
+    found = zcgroup_detect(dir, mount);
+  }
+  if (found)
+    found = zcgroup_has_memory(dir);
+
+  pthread_mutex_lock(&cgroup_lock);
+  strcpy(cgroup_dir, found ? dir : "");
+  strcpy(cgroup_mount, found ? mount : "");
+  cgroup_detected = true;
+  pthread_mutex_unlock(&cgroup_lock);
+  return found;
+}
+
+static void zcgroup_ensure_path(void) {
+  pthread_mutex_lock(&cgroup_lock);
+  bool detected = cgroup_detected;
+  pthread_mutex_unlock(&cgroup_lock);
+  if (!detected)
+    zcgroup_set_path(NULL);
+}
+
+bool zcgroup_get_path(char *buf, size_t size) {
+  zcgroup_ensure_path();
+  pthread_mutex_lock(&cgroup_lock);
+  snprintf(buf, size, "%s", cgroup_dir);
+  pthread_mutex_unlock(&cgroup_lock);
+  return buf[0] != '\0';
+}
+
+void zcgroup_atfork(ZForkStage stage) {
+  if (stage == ZFORK_CHILD)
+    pthread_mutex_init(&cgroup_lock, NULL);
+}
+
+bool zcgroup_read(ZCgroupMemory *out) {
+  zcgroup_ensure_path();
+  char dir[PATH_MAX], mount[PATH_MAX];
+  pthread_mutex_lock(&cgroup_lock);
+  strcpy(dir, cgroup_dir);
+  strcpy(mount, cgroup_mount);
+  pthread_mutex_unlock(&cgroup_lock);
+  if (!dir[0])
+    return false;
+
+  out->max = out->high = ZCGROUP_UNLIMITED;
+  if (!zcgroup_read_value(dir, "memory.current", &out->current))
+    out->current = 0;
+  out->pressure = zcgroup_read_pressure(dir);
+
+  // Walk up to the mount (the root cgroup has no limit files)
+  size_t mount_len = strlen(mount);
+  for (;;) {
+    uint64_t value;
+    if (zcgroup_read_value(dir, "memory.max", &value) && value < out->max)
+      out->max = value;
+    if (zcgroup_read_value(dir, "memory.high", &value) && value < out->high)
+      out->high = value;
+    if (!mount_len || strlen(dir) <= mount_len)
+      break;
+    char *slash = strrchr(dir, '/');
+    if (!slash || (size_t)(slash - dir) < mount_len)
+      break;
+    *slash = '\0';
+  }
+  return true;
+}
@@ -0,0 +1,41 @@
+#ifndef ZCGROUP_H
+#define ZCGROUP_H
+
+#include "zfork.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// cgroup v2 memory limits and pressure of the cgroup the process runs in.
+//
+// The directory is found from /proc/self/cgroup ("0::<path>") and the
+// cgroup2 mount in /proc/self/mounts, or set explicitly (pyzgc.configure
+// cgroup_path=..., e.g. a fake directory in tests). Limits of a detected
+// cgroup are the tightest along its ancestors up to the mount, since any of
+// them can trigger the OOM killer. An explicit directory is read alone.
+
+#define ZCGROUP_UNLIMITED UINT64_MAX
+
+typedef struct {
+  uint64_t max;     // memory.max; ZCGROUP_UNLIMITED for "max" or no file
+  uint64_t high;    // memory.high; same
+  uint64_t current; // memory.current; 0 if unreadable
+  double pressure;  // "some avg10" of memory.pressure (PSI), in percent
+} ZCgroupMemory;
+
+// Sets the cgroup directory; NULL detects it again. Returns false if the
+// directory has no memory.current (the process is not in a cgroup v2 with
+// the memory controller), in which case nothing is read until the next
+// call.
+bool zcgroup_set_path(const char *path);
+
+// Copies the directory in use to buf. Returns false (and sets buf to "")
+// if there is none.
+bool zcgroup_get_path(char *buf, size_t size);
+
+// Reads the files. Returns false if there is no cgroup directory.
+bool zcgroup_read(ZCgroupMemory *out);
+
+void zcgroup_atfork(ZForkStage stage);
+
+#endif
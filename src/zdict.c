@@ -0,0 +1,1072 @@
+#define PY_SSIZE_T_CLEAN
+#include "zdict.h"
+#include "zarray.h"
+#include "zbarrier.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zobject.h"
+#include "zregion.h"
+#include "zsafepoint.h"
+#include <Python.h>
+#include <structmember.h>
+
+#define ZDICT_META 1
+#define ZDICT_INDEX 2
+#define ZDICT_PERTURB_SHIFT 5
+// Index slots besides 2 + entry
+#define ZDICT_EMPTY 0
+#define ZDICT_DUMMY 1
+// Indexes up to this size take 15-bit slots, larger ones 30-bit slots
+#define ZDICT_NARROW_LOG2 15
+#define ZDICT_MAX_LOG2 30
+
+static inline uint64_t zdict_hash_word(uint64_t bits) {
+  return (bits << 3) | ZDICT_TAG;
+}
+
+static inline Py_ssize_t zdict_usable(Py_ssize_t capacity) {
+  return (capacity << 1) / 3;
+}
+
+static inline uint64_t zdict_meta(unsigned log2, unsigned words) {
+  return ((uint64_t)log2 << 5) | ((uint64_t)words << 3) | ZDICT_TAG;
+}
+
+static void zdict_layout(uint64_t meta, ZDictLayout *layout) {
+  unsigned log2 = (unsigned)(meta >> 5);
+  layout->mask = ((Py_ssize_t)1 << log2) - 1;
+  layout->usable = zdict_usable(layout->mask + 1);
+  layout->words = (unsigned)(meta >> 3) & 3;
+  layout->shift = log2 <= ZDICT_NARROW_LOG2 ? 2 : 1;
+  layout->bits = 60 >> layout->shift;
+  layout->entries = ZDICT_INDEX + ((layout->mask + 1) >> layout->shift);
+}
+
+static inline size_t zdict_key_word(const ZDictLayout *layout,
+                                    Py_ssize_t entry) {
+  return layout->entries + entry * layout->words + layout->words - 2;
+}
+
+static inline size_t zdict_value_word(const ZDictLayout *layout,
+                                      Py_ssize_t entry) {
+  return layout->entries + entry * layout->words + layout->words - 1;
+}
+
+static inline size_t zdict_slot_get(const ZDictLayout *layout, ZBody *table,
+                                    size_t i) {
+  uint64_t word = zbody_get_word(table, ZDICT_INDEX + (i >> layout->shift));
+  unsigned shift =
+      3 + (unsigned)(i & ((1u << layout->shift) - 1)) * layout->bits;
+  return (size_t)((word >> shift) & ((UINT64_C(1) << layout->bits) - 1));
+}
+
+static inline void zdict_slot_set(const ZDictLayout *layout, ZBody *table,
+                                  size_t i, size_t value) {
+  size_t index = ZDICT_INDEX + (i >> layout->shift);
+  unsigned shift =
+      3 + (unsigned)(i & ((1u << layout->shift) - 1)) * layout->bits;
+  uint64_t word = zbody_get_word(table, index) | ZDICT_TAG;
+  word &= ~(((UINT64_C(1) << layout->bits) - 1) << shift);
+  zbody_set_word(table, index, word | ((uint64_t)value << shift));
+}
+
+// Body of a handle (the dict's or its table's), after the load barrier.
+// Call between zsafepoint_enter and zsafepoint_leave.
+static inline ZBody *zdict_body(PyObject *handle) {
+  ZObject *zobj = (ZObject *)handle;
+  if (!Z_HAS_COLOR(zobj->body, zstate->good_color)) {
+    zbarrier_fix_pointer(zobj);
+  }
+  return (ZBody *)Z_ADDRESS(zobject_get_body(zobj));
+}
+
+// Keys whose comparison runs no Python code, so it can happen inside a
+// section
+static inline bool zdict_is_plain(PyObject *key) {
+  return PyUnicode_CheckExact(key) || PyLong_CheckExact(key) ||
+         PyFloat_CheckExact(key) || PyBytes_CheckExact(key);
+}
+
+static int zdict_hash(PyObject *key, uint64_t *bits) {
+  // A handle hashes by identity, but loads may give its body another one
+  if (zobject_is_handle(key)) {
+    PyErr_Format(PyExc_TypeError, "%.100s can't be a pyzgc.Dict key",
+                 Py_TYPE(key)->tp_name);
+    return -1;
+  }
+  Py_hash_t hash = PyObject_Hash(key);
+  if (hash == -1)
+    return -1;
+  *bits = (uint64_t)hash & (UINT64_MAX >> 3);
+  return 0;
+}
+
+// Hash bits of a live entry whose key is `key`. Tables without hash words
+// only hold str keys, whose hash is cached and runs no Python code.
+static inline uint64_t zdict_entry_bits(const ZDictLayout *layout,
+                                        ZBody *table, Py_ssize_t entry,
+                                        PyObject *key) {
+  if (layout->words == 3)
+    return zbody_get_word(table, layout->entries + entry * 3) >> 3;
+  return (uint64_t)PyObject_Hash(key) & (UINT64_MAX >> 3);
+}
+
+// Smallest table that is at most half full with n entries
+static Py_ssize_t zdict_capacity_for(Py_ssize_t n) {
+  Py_ssize_t capacity = ZDICT_MIN_CAPACITY;
+  while (capacity < 2 * n)
+    capacity <<= 1;
+  return capacity;
+}
+
+// New empty table with `capacity` index slots (a power of two) and entries
+// of `words` words
+static ZArray *zdict_new_table(Py_ssize_t capacity, unsigned words) {
+  unsigned log2 = 0;
+  while (((Py_ssize_t)1 << log2) < capacity)
+    log2++;
+  if (log2 > ZDICT_MAX_LOG2) {
+    PyErr_NoMemory();
+    return NULL;
+  }
+  ZDictLayout layout;
+  zdict_layout(zdict_meta(log2, words), &layout);
+  ZArray *table = zarray_new(
+      ZARRAY_REF, layout.entries - 1 + layout.usable * (Py_ssize_t)words);
+  if (!table)
+    return NULL;
+  zsafepoint_enter();
+  zbody_set_word(zdict_body((PyObject *)table), ZDICT_META,
+                 zdict_meta(log2, words));
+  zsafepoint_leave();
+  return table;
+}
+
+// --- Handles ---
+
+static ZDict *zdict_new_handle(void) {
+  zstate_enter();
+  ZDict *self = PyObject_New(ZDict, zstate->types.dict);
+  if (self == NULL)
+    return NULL;
+  self->body = NULL;
+  self->weakreflist = NULL;
+  self->registered = 0;
+  self->table = NULL;
+  self->used = 0;
+  self->nentries = 0;
+  memset(&self->layout, 0, sizeof(self->layout));
+  self->version = 0;
+  return self;
+}
+
+PyObject *zdict_wrap_body(ZBody *body) {
+  ZDict *self = zdict_new_handle();
+  if (self == NULL)
+    return NULL;
+  self->body = (ZBody *)Z_WITH_COLOR(body, zstate->good_color);
+  self->used = (Py_ssize_t)(zbody_get_word(body, 0) >> 3);
+  self->nentries = (Py_ssize_t)(zbody_get_word(body, 2) >> 3);
+  return (PyObject *)self;
+}
+
+static ZDict *zdict_new(Py_ssize_t capacity, unsigned words) {
+  ZDict *self = zdict_new_handle();
+  if (self == NULL)
+    return NULL;
+
+  zsafepoint_enter();
+  ZBody *body = (ZBody *)zheap_alloc_inline(sizeof(ZBody));
+  if (body) {
+    ZBody *raw = (ZBody *)Z_ADDRESS(body);
+    zbody_set_word(raw, 0, ZDICT_TAG);
+    zbody_set_word(raw, 2, ZDICT_TAG);
+    raw->handle = (PyObject *)self;
+  }
+  self->body = body;
+  zsafepoint_leave();
+  if (body == NULL) {
+    Py_DECREF(self);
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  ZArray *table = zdict_new_table(capacity, words);
+  if (!table ||
+      zobject_store_ref((ZObject *)self, 1, (PyObject *)table) < 0) {
+    Py_XDECREF(table);
+    Py_DECREF(self);
+    return NULL;
+  }
+  self->table = (PyObject *)table;
+  zsafepoint_enter();
+  zdict_layout(zbody_get_word(zdict_body(self->table), ZDICT_META),
+               &self->layout);
+  zsafepoint_leave();
+  return self;
+}
+
+// A handle made for an existing body loads the table on first use
+static int zdict_ready(ZDict *self) {
+  if (self->table)
+    return 0;
+  PyObject *table = zobject_load_ref((ZObject *)self, 1);
+  if (!table)
+    return -1;
+  if (!Py_IS_TYPE(table, zstate->types.array)) {
+    Py_DECREF(table);
+    PyErr_SetString(PyExc_SystemError, "pyzgc.Dict body without a table");
+    return -1;
+  }
+  self->table = table;
+  zsafepoint_enter();
+  zdict_layout(zbody_get_word(zdict_body(table), ZDICT_META), &self->layout);
+  zsafepoint_leave();
+  return 0;
+}
+
+// Writes the counts through to the body, where new handles read them
+static void zdict_sync(ZDict *self) {
+  zsafepoint_enter();
+  ZBody *body = zdict_body((PyObject *)self);
+  zbody_set_word(body, 0, ((uint64_t)self->used << 3) | ZDICT_TAG);
+  zbody_set_word(body, 2, ((uint64_t)self->nentries << 3) | ZDICT_TAG);
+  zsafepoint_leave();
+}
+
+static PyObject *zdict_key_at(ZDict *self, Py_ssize_t entry) {
+  zsafepoint_enter();
+  PyObject *key = zbody_get_slot(zdict_body(self->table),
+                                 zdict_key_word(&self->layout, entry));
+  zsafepoint_leave();
+  return key;
+}
+
+// --- Tables ---
+
+// Finds key. Returns 1 and its entry in *pentry, 0 if it is absent, or -1
+// with an exception set.
+static int zdict_lookup(ZDict *self, PyObject *key, uint64_t bits,
+                        Py_ssize_t *pentry) {
+  if (zdict_ready(self) < 0)
+    return -1;
+
+restart:;
+  uint64_t version = self->version;
+  ZDictLayout layout = self->layout;
+  size_t mask = (size_t)layout.mask, i = bits & mask, perturb = bits;
+  for (;;) {
+    PyObject *other = NULL; // Key to compare outside the section
+    Py_ssize_t entry = 0;
+    int found = 0;
+    zsafepoint_enter();
+    ZBody *table = zdict_body(self->table);
+    for (;; perturb >>= ZDICT_PERTURB_SHIFT,
+            i = (i * 5 + perturb + 1) & mask) {
+      size_t slot = zdict_slot_get(&layout, table, i);
+      if (slot == ZDICT_EMPTY)
+        break;
+      if (slot == ZDICT_DUMMY)
+        continue;
+      entry = (Py_ssize_t)slot - 2;
+      PyObject *k = zbody_get_slot(table, zdict_key_word(&layout, entry));
+      if (k == key) {
+        found = 1;
+        break;
+      }
+      if (zdict_entry_bits(&layout, table, entry, k) != bits)
+        continue;
+      if (zdict_is_plain(k) && zdict_is_plain(key)) {
+        found = PyObject_RichCompareBool(k, key, Py_EQ);
+        if (found != 0)
+          break;
+        continue;
+      }
+      other = Py_NewRef(k);
+      break;
+    }
+    zsafepoint_leave();
+    if (found < 0)
+      return -1;
+    if (!other) {
+      *pentry = entry;
+      return found;
+    }
+
+    // __eq__ may do anything to the dict, including this entry
+    int eq = PyObject_RichCompareBool(other, key, Py_EQ);
+    bool changed =
+        self->version != version || zdict_key_at(self, entry) != other;
+    Py_DECREF(other);
+    if (eq < 0)
+      return -1;
+    if (changed)
+      goto restart;
+    if (eq) {
+      *pentry = entry;
+      return 1;
+    }
+    perturb >>= ZDICT_PERTURB_SHIFT;
+    i = (i * 5 + perturb + 1) & mask;
+  }
+}
+
+// First empty index slot on the probe sequence of bits
+static size_t zdict_find_empty(const ZDictLayout *layout, ZBody *table,
+                               uint64_t bits) {
+  size_t mask = (size_t)layout->mask, i = bits & mask, perturb = bits;
+  while (zdict_slot_get(layout, table, i) != ZDICT_EMPTY) {
+    perturb >>= ZDICT_PERTURB_SHIFT;
+    i = (i * 5 + perturb + 1) & mask;
+  }
+  return i;
+}
+
+// Index slot of a live entry, on the probe sequence of bits
+static size_t zdict_find_entry(const ZDictLayout *layout, ZBody *table,
+                               uint64_t bits, Py_ssize_t entry) {
+  size_t mask = (size_t)layout->mask, i = bits & mask, perturb = bits;
+  while (zdict_slot_get(layout, table, i) != (size_t)entry + 2) {
+    perturb >>= ZDICT_PERTURB_SHIFT;
+    i = (i * 5 + perturb + 1) & mask;
+  }
+  return i;
+}
+
+// Drops the handle of a replaced table. One with a large page of its own
+// goes back to the OS right away, unless a cycle is marking: the marker
+// works on the snapshot at mark start, and may still trace the old table.
+static void zdict_drop_table(PyObject *table) {
+  zsafepoint_enter();
+  ZBody *body = zdict_body(table);
+  Py_DECREF(table);
+  if (atomic_load(&zstate->phase) != ZGC_PHASE_MARK)
+    zheap_release_large(body);
+  zsafepoint_leave();
+}
+
+// Makes `table`, holding the live entries in a row, the dict's table
+static int zdict_swap_table(ZDict *self, ZArray *table) {
+  if (zobject_store_ref((ZObject *)self, 1, (PyObject *)table) < 0)
+    return -1;
+  PyObject *old = self->table;
+  self->table = (PyObject *)table;
+  zsafepoint_enter();
+  zdict_layout(zbody_get_word(zdict_body(self->table), ZDICT_META),
+               &self->layout);
+  zsafepoint_leave();
+  self->nentries = self->used;
+  self->version++;
+  zdict_sync(self);
+  if (old)
+    zdict_drop_table(old);
+  return 0;
+}
+
+// Moves the live entries to a new table of `capacity` index slots and
+// entries of `words` words, in order. The words are copied as they are,
+// and the new table owns the keys and values from then on; the old one is
+// never read again, except by a marker that started before the store
+// barrier logged it. The copied references get the rest of the barriers of
+// zobject_store_ref.
+static int zdict_resize(ZDict *self, Py_ssize_t capacity, unsigned words) {
+  ZArray *fresh = zdict_new_table(capacity, words);
+  if (!fresh)
+    return -1;
+
+  const ZDictLayout *from = &self->layout;
+  ZDictLayout to;
+  bool young = false;
+  zsafepoint_enter();
+  ZBody *src = zdict_body(self->table);
+  ZBody *dst = zdict_body((PyObject *)fresh);
+  zdict_layout(zbody_get_word(dst, ZDICT_META), &to);
+  ZBody *colored = zobject_get_body((ZObject *)fresh);
+  ZPage *holder = zheap_get_page(dst);
+  Py_ssize_t n = 0;
+  for (Py_ssize_t entry = 0; entry < self->nentries; entry++) {
+    PyObject *key = zbody_get_slot(src, zdict_key_word(from, entry));
+    if (!key)
+      continue;
+    uint64_t bits = zdict_entry_bits(from, src, entry, key);
+    PyObject *value = zbody_get_slot(src, zdict_value_word(from, entry));
+    if (words == 3)
+      zbody_set_word(dst, to.entries + n * 3, zdict_hash_word(bits));
+    zbody_set_word(dst, zdict_key_word(&to, n), (uint64_t)(uintptr_t)key);
+    zbody_set_word(dst, zdict_value_word(&to, n),
+                   (uint64_t)(uintptr_t)value);
+    zdict_slot_set(&to, dst, zdict_find_empty(&to, dst, bits),
+                   (size_t)n + 2);
+    if (zbody_is_ref(value)) {
+      ZPage *target = zheap_get_page(Z_ADDRESS(zbody_ref_target(value)));
+      young |= target->generation == ZGEN_YOUNG;
+      if (target->region && target->region != holder->region)
+        zregion_escape(target->region, colored, zdict_value_word(&to, n));
+    }
+    n++;
+  }
+  // Large tables are old from the start
+  if (young && holder->generation == ZGEN_OLD)
+    zremset_add(colored);
+  zsafepoint_leave();
+
+  if (zdict_swap_table(self, fresh) < 0) {
+    Py_DECREF(fresh);
+    return -1;
+  }
+  return 0;
+}
+
+// Appends key, which is absent, growing the table first if its entries
+// are used up. A key other than an exact str gives the table hash words.
+static int zdict_insert(ZDict *self, PyObject *key, uint64_t bits,
+                        PyObject *value) {
+  unsigned words = self->layout.words;
+  if (words == 2 && !PyUnicode_CheckExact(key))
+    words = 3;
+  if (words != self->layout.words ||
+      self->nentries == self->layout.usable) {
+    if (zdict_resize(self, zdict_capacity_for(self->used + 1), words) < 0)
+      return -1;
+  }
+  // The value first: its store is the one that can fail. Entries past
+  // nentries are clear, so nothing is dropped here.
+  const ZDictLayout *layout = &self->layout;
+  Py_ssize_t entry = self->nentries;
+  if (zobject_store_ref((ZObject *)self->table,
+                        zdict_value_word(layout, entry),
+                        value == Py_None ? NULL : value) < 0)
+    return -1;
+  zsafepoint_enter();
+  ZBody *table = zdict_body(self->table);
+  if (layout->words == 3)
+    zbody_set_word(table, layout->entries + entry * 3,
+                   zdict_hash_word(bits));
+  zbody_set_word(table, zdict_key_word(layout, entry),
+                 (uint64_t)(uintptr_t)Py_NewRef(key));
+  zdict_slot_set(layout, table, zdict_find_empty(layout, table, bits),
+                 (size_t)entry + 2);
+  zsafepoint_leave();
+  self->used++;
+  self->nentries++;
+  zdict_sync(self);
+  return 0;
+}
+
+// Deletes a live entry, whose key hashes to bits. The key goes to *pkey
+// (new reference) if given, and is dropped otherwise.
+static int zdict_remove_at(ZDict *self, Py_ssize_t entry, uint64_t bits,
+                           PyObject **pkey) {
+  const ZDictLayout *layout = &self->layout;
+  zsafepoint_enter();
+  ZBody *table = zdict_body(self->table);
+  zdict_slot_set(layout, table, zdict_find_entry(layout, table, bits, entry),
+                 ZDICT_DUMMY);
+  if (layout->words == 3)
+    zbody_set_word(table, layout->entries + entry * 3, 0);
+  PyObject *key = zbody_swap_slot(table, zdict_key_word(layout, entry), NULL);
+  zsafepoint_leave();
+  self->used--;
+  zdict_sync(self);
+
+  // The dict is consistent again: dropping the value and key may run code
+  int rc = zobject_store_ref((ZObject *)self->table,
+                             zdict_value_word(layout, entry), NULL);
+  if (pkey)
+    *pkey = key;
+  else
+    Py_DECREF(key);
+  return rc;
+}
+
+// The next entry at or after *pos. Returns 1 with its key (and value, if
+// pvalue is given) as new references and *pos past it, 0 at the end, -1
+// with an exception set.
+static int zdict_next(ZDict *self, Py_ssize_t *pos, PyObject **pkey,
+                      PyObject **pvalue) {
+  if (zdict_ready(self) < 0)
+    return -1;
+  Py_ssize_t entry = *pos;
+  PyObject *key = NULL;
+  zsafepoint_enter();
+  ZBody *table = zdict_body(self->table);
+  for (; entry < self->nentries; entry++) {
+    key = zbody_get_slot(table, zdict_key_word(&self->layout, entry));
+    if (key) {
+      Py_INCREF(key);
+      break;
+    }
+  }
+  zsafepoint_leave();
+  if (!key)
+    return 0;
+  if (pvalue) {
+    *pvalue = zobject_load_ref((ZObject *)self->table,
+                               zdict_value_word(&self->layout, entry));
+    if (!*pvalue) {
+      Py_DECREF(key);
+      return -1;
+    }
+  }
+  *pkey = key;
+  *pos = entry + 1;
+  return 1;
+}
+
+// --- Mapping operations ---
+
+// New reference to the value of key, or NULL: with KeyError set if
+// `missing` is, else with no exception if key is absent
+static PyObject *zdict_get(ZDict *self, PyObject *key, bool missing) {
+  uint64_t bits;
+  Py_ssize_t entry;
+  if (zdict_hash(key, &bits) < 0)
+    return NULL;
+  int found = zdict_lookup(self, key, bits, &entry);
+  if (found < 0)
+    return NULL;
+  if (!found) {
+    if (missing)
+      PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+  }
+  return zobject_load_ref((ZObject *)self->table,
+                          zdict_value_word(&self->layout, entry));
+}
+
+static int zdict_set(ZDict *self, PyObject *key, PyObject *value) {
+  uint64_t bits;
+  Py_ssize_t entry;
+  if (zdict_hash(key, &bits) < 0)
+    return -1;
+  int found = zdict_lookup(self, key, bits, &entry);
+  if (found < 0)
+    return -1;
+  if (found)
+    return zobject_store_ref((ZObject *)self->table,
+                             zdict_value_word(&self->layout, entry),
+                             value == Py_None ? NULL : value);
+  return zdict_insert(self, key, bits, value);
+}
+
+// Removes key. Its value goes to *pvalue (new reference) if given.
+// KeyError if key is absent.
+static int zdict_del(ZDict *self, PyObject *key, PyObject **pvalue) {
+  uint64_t bits;
+  Py_ssize_t entry;
+  if (zdict_hash(key, &bits) < 0)
+    return -1;
+  int found = zdict_lookup(self, key, bits, &entry);
+  if (found <= 0) {
+    if (found == 0)
+      PyErr_SetObject(PyExc_KeyError, key);
+    return -1;
+  }
+  if (pvalue) {
+    *pvalue = zobject_load_ref((ZObject *)self->table,
+                               zdict_value_word(&self->layout, entry));
+    if (!*pvalue)
+      return -1;
+  }
+  if (zdict_remove_at(self, entry, bits, NULL) < 0) {
+    if (pvalue)
+      Py_CLEAR(*pvalue);
+    return -1;
+  }
+  return 0;
+}
+
+static int zdict_clear(ZDict *self) {
+  if (zdict_ready(self) < 0)
+    return -1;
+  ZArray *fresh = zdict_new_table(ZDICT_MIN_CAPACITY, 2);
+  if (!fresh)
+    return -1;
+  PyObject *old = Py_NewRef(self->table);
+  ZDictLayout layout = self->layout;
+  Py_ssize_t used = self->used, nentries = self->nentries;
+  self->used = 0;
+  if (zdict_swap_table(self, fresh) < 0) {
+    self->used = used;
+    Py_DECREF(fresh);
+    Py_DECREF(old);
+    return -1;
+  }
+
+  // Drop the entries. Code they run sees the dict empty already.
+  int rc = 0;
+  for (Py_ssize_t entry = 0; entry < nentries; entry++) {
+    zsafepoint_enter();
+    ZBody *table = zdict_body(old);
+    PyObject *key =
+        zbody_swap_slot(table, zdict_key_word(&layout, entry), NULL);
+    zsafepoint_leave();
+    if (key) {
+      if (zobject_store_ref((ZObject *)old, zdict_value_word(&layout, entry),
+                            NULL) < 0)
+        rc = -1;
+      Py_DECREF(key);
+    }
+  }
+  zdict_drop_table(old);
+  return rc;
+}
+
+// Adds the items of a mapping, or of an iterable of pairs
+static int zdict_merge(ZDict *self, PyObject *other) {
+  int rc = 0;
+  if (PyDict_Check(other)) {
+    Py_ssize_t pos = 0;
+    PyObject *key, *value;
+    while (rc == 0 && PyDict_Next(other, &pos, &key, &value)) {
+      // Hashing and comparing may change other
+      Py_INCREF(key);
+      Py_INCREF(value);
+      rc = zdict_set(self, key, value);
+      Py_DECREF(key);
+      Py_DECREF(value);
+    }
+    return rc;
+  }
+
+  if (PyObject_HasAttrString(other, "keys")) {
+    PyObject *keys = PyMapping_Keys(other);
+    if (!keys)
+      return -1;
+    for (Py_ssize_t k = 0; rc == 0 && k < PyList_GET_SIZE(keys); k++) {
+      PyObject *key = PyList_GET_ITEM(keys, k);
+      PyObject *value = PyObject_GetItem(other, key);
+      rc = value ? zdict_set(self, key, value) : -1;
+      Py_XDECREF(value);
+    }
+    Py_DECREF(keys);
+    return rc;
+  }
+
+  PyObject *it = PyObject_GetIter(other);
+  if (!it)
+    return -1;
+  PyObject *item;
+  Py_ssize_t n = 0;
+  while (rc == 0 && (item = PyIter_Next(it))) {
+    PyObject *pair = PySequence_Fast(item, "");
+    if (!pair || PySequence_Fast_GET_SIZE(pair) != 2) {
+      if (!pair)
+        PyErr_Clear();
+      PyErr_Format(PyExc_TypeError,
+                   "pyzgc.Dict update sequence element #%zd is not a pair",
+                   n);
+      rc = -1;
+    } else {
+      rc = zdict_set(self, PySequence_Fast_GET_ITEM(pair, 0),
+                     PySequence_Fast_GET_ITEM(pair, 1));
+    }
+    Py_XDECREF(pair);
+    Py_DECREF(item);
+    n++;
+  }
+  Py_DECREF(it);
+  return rc == 0 && PyErr_Occurred() ? -1 : rc;
+}
+
+static int zdict_update(ZDict *self, PyObject *args, PyObject *kwds,
+                        const char *name) {
+  PyObject *other = NULL;
+  if (!PyArg_UnpackTuple(args, name, 0, 1, &other))
+    return -1;
+  if (other && zdict_merge(self, other) < 0)
+    return -1;
+  return kwds ? zdict_merge(self, kwds) : 0;
+}
+
+// 1 if other (a Dict or dict) has the same items, 0 if not, -1 on error
+static int zdict_equal(ZDict *self, PyObject *other) {
+  Py_ssize_t n = PyObject_Length(other);
+  if (n < 0)
+    return -1;
+  if (n != self->used)
+    return 0;
+
+  Py_ssize_t pos = 0;
+  PyObject *key, *value;
+  int rc;
+  while ((rc = zdict_next(self, &pos, &key, &value)) > 0) {
+    PyObject *theirs;
+    if (PyDict_Check(other)) {
+      theirs = Py_XNewRef(PyDict_GetItemWithError(other, key));
+    } else {
+      theirs = PyObject_GetItem(other, key);
+      if (!theirs && PyErr_ExceptionMatches(PyExc_KeyError))
+        PyErr_Clear();
+    }
+    if (theirs)
+      rc = PyObject_RichCompareBool(value, theirs, Py_EQ);
+    else
+      rc = PyErr_Occurred() ? -1 : 0;
+    Py_XDECREF(theirs);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    if (rc <= 0)
+      return rc;
+  }
+  return rc < 0 ? -1 : 1;
+}
+
+// --- Type ---
+
+// Iterator over the keys
+typedef struct {
+  PyObject_HEAD ZDict *dict; // NULL once exhausted
+  Py_ssize_t used;           // What the dict looked like at the start
+  uint64_t version;
+  Py_ssize_t pos;
+} ZDictIter;
+
+static PyObject *ZDict_new(PyTypeObject *type, PyObject *args,
+                           PyObject *kwds) {
+  return (PyObject *)zdict_new(ZDICT_MIN_CAPACITY, 2);
+}
+
+static int ZDict_init(ZDict *self, PyObject *args, PyObject *kwds) {
+  return zdict_update(self, args, kwds, "Dict");
+}
+
+static void ZDict_dealloc(ZDict *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  if (!zobject_forget_handle((ZObject *)self))
+    return;
+  if (self->weakreflist != NULL) {
+    PyObject_ClearWeakRefs((PyObject *)self);
+  }
+  Py_XDECREF(self->table);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static Py_ssize_t ZDict_length(ZDict *self) { return self->used; }
+
+static PyObject *ZDict_subscript(ZDict *self, PyObject *key) {
+  return zdict_get(self, key, true);
+}
+
+static int ZDict_ass_subscript(ZDict *self, PyObject *key, PyObject *value) {
+  if (value == NULL)
+    return zdict_del(self, key, NULL);
+  return zdict_set(self, key, value);
+}
+
+static int ZDict_contains(ZDict *self, PyObject *key) {
+  uint64_t bits;
+  Py_ssize_t entry;
+  if (zdict_hash(key, &bits) < 0)
+    return -1;
+  return zdict_lookup(self, key, bits, &entry);
+}
+
+static PyObject *ZDict_iter(ZDict *self) {
+  zstate_enter();
+  ZDictIter *it = PyObject_New(ZDictIter, zstate->types.dict_iter);
+  if (it == NULL)
+    return NULL;
+  it->dict = (ZDict *)Py_NewRef(self);
+  it->used = self->used;
+  it->version = self->version;
+  it->pos = 0;
+  return (PyObject *)it;
+}
+
+static PyObject *ZDict_richcompare(ZDict *self, PyObject *other, int op) {
+  if ((op != Py_EQ && op != Py_NE) ||
+      !(PyDict_Check(other) || Py_IS_TYPE(other, Py_TYPE(self))))
+    Py_RETURN_NOTIMPLEMENTED;
+  int eq = zdict_equal(self, other);
+  if (eq < 0)
+    return NULL;
+  return PyBool_FromLong(op == Py_EQ ? eq : !eq);
+}
+
+static PyObject *ZDict_repr(ZDict *self) {
+  int rc = Py_ReprEnter((PyObject *)self);
+  if (rc != 0)
+    return rc > 0 ? PyUnicode_FromString("pyzgc.Dict({...})") : NULL;
+
+  // Shown like a dict with the same items
+  PyObject *items = PyDict_New();
+  PyObject *result = NULL;
+  Py_ssize_t pos = 0;
+  PyObject *key, *value;
+  while (items && (rc = zdict_next(self, &pos, &key, &value)) > 0) {
+    rc = PyDict_SetItem(items, key, value);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    if (rc < 0)
+      break;
+  }
+  if (items && rc == 0)
+    result = PyUnicode_FromFormat("pyzgc.Dict(%R)", items);
+  Py_XDECREF(items);
+  Py_ReprLeave((PyObject *)self);
+  return result;
+}
+
+// --- Methods ---
+
+static PyObject *ZDict_get_method(ZDict *self, PyObject *args) {
+  PyObject *key, *fallback = Py_None;
+  if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &fallback))
+    return NULL;
+  PyObject *value = zdict_get(self, key, false);
+  if (!value && !PyErr_Occurred())
+    value = Py_NewRef(fallback);
+  return value;
+}
+
+static PyObject *ZDict_setdefault(ZDict *self, PyObject *args) {
+  PyObject *key, *fallback = Py_None;
+  if (!PyArg_UnpackTuple(args, "setdefault", 1, 2, &key, &fallback))
+    return NULL;
+  uint64_t bits;
+  Py_ssize_t entry;
+  if (zdict_hash(key, &bits) < 0)
+    return NULL;
+  int found = zdict_lookup(self, key, bits, &entry);
+  if (found < 0)
+    return NULL;
+  if (found)
+    return zobject_load_ref((ZObject *)self->table,
+                            zdict_value_word(&self->layout, entry));
+  if (zdict_insert(self, key, bits, fallback) < 0)
+    return NULL;
+  return Py_NewRef(fallback);
+}
+
+static PyObject *ZDict_pop(ZDict *self, PyObject *args) {
+  PyObject *key, *fallback = NULL, *value;
+  if (!PyArg_UnpackTuple(args, "pop", 1, 2, &key, &fallback))
+    return NULL;
+  if (zdict_del(self, key, &value) == 0)
+    return value;
+  if (fallback && PyErr_ExceptionMatches(PyExc_KeyError)) {
+    PyErr_Clear();
+    return Py_NewRef(fallback);
+  }
+  return NULL;
+}
+
+static PyObject *ZDict_popitem(ZDict *self, PyObject *Py_UNUSED(ignored)) {
+  if (self->used == 0) {
+    PyErr_SetString(PyExc_KeyError, "popitem(): pyzgc.Dict is empty");
+    return NULL;
+  }
+  if (zdict_ready(self) < 0)
+    return NULL;
+  // The last entry, like dict.popitem
+  Py_ssize_t entry = self->nentries;
+  PyObject *key = NULL;
+  uint64_t bits = 0;
+  zsafepoint_enter();
+  ZBody *table = zdict_body(self->table);
+  while (!key && entry > 0) {
+    entry--;
+    key = zbody_get_slot(table, zdict_key_word(&self->layout, entry));
+  }
+  if (key) {
+    Py_INCREF(key);
+    bits = zdict_entry_bits(&self->layout, table, entry, key);
+  }
+  zsafepoint_leave();
+  if (!key) {
+    PyErr_SetString(PyExc_SystemError, "pyzgc.Dict lost its entries");
+    return NULL;
+  }
+  PyObject *value = zobject_load_ref((ZObject *)self->table,
+                                     zdict_value_word(&self->layout, entry));
+  PyObject *item = value ? PyTuple_New(2) : NULL;
+  if (!item || zdict_remove_at(self, entry, bits, NULL) < 0) {
+    Py_XDECREF(item);
+    Py_DECREF(key);
+    Py_XDECREF(value);
+    return NULL;
+  }
+  // The next entry appended takes its place, unless dropping the value
+  // appended one already
+  if (self->nentries == entry + 1) {
+    self->nentries = entry;
+    zdict_sync(self);
+  }
+  PyTuple_SET_ITEM(item, 0, key);
+  PyTuple_SET_ITEM(item, 1, value);
+  return item;
+}
+
+static PyObject *ZDict_update_method(ZDict *self, PyObject *args,
+                                     PyObject *kwds) {
+  if (zdict_update(self, args, kwds, "update") < 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject *ZDict_clear_method(ZDict *self,
+                                    PyObject *Py_UNUSED(ignored)) {
+  if (zdict_clear(self) < 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject *ZDict_copy(ZDict *self, PyObject *Py_UNUSED(ignored)) {
+  if (zdict_ready(self) < 0)
+    return NULL;
+  ZDict *copy =
+      zdict_new(zdict_capacity_for(self->used), self->layout.words);
+  if (!copy)
+    return NULL;
+  Py_ssize_t pos = 0;
+  PyObject *key, *value;
+  int rc;
+  while ((rc = zdict_next(self, &pos, &key, &value)) > 0) {
+    rc = zdict_set(copy, key, value);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    if (rc < 0)
+      break;
+  }
+  if (rc < 0) {
+    Py_DECREF(copy);
+    return NULL;
+  }
+  return (PyObject *)copy;
+}
+
+// keys(), values() and items() are the collections.abc views
+static PyObject *zdict_view(ZDict *self, const char *name) {
+  PyObject *abc = PyImport_ImportModule("collections.abc");
+  if (!abc)
+    return NULL;
+  PyObject *view = PyObject_CallMethod(abc, name, "O", self);
+  Py_DECREF(abc);
+  return view;
+}
+
+static PyObject *ZDict_keys(ZDict *self, PyObject *Py_UNUSED(ignored)) {
+  return zdict_view(self, "KeysView");
+}
+
+static PyObject *ZDict_values(ZDict *self, PyObject *Py_UNUSED(ignored)) {
+  return zdict_view(self, "ValuesView");
+}
+
+static PyObject *ZDict_items(ZDict *self, PyObject *Py_UNUSED(ignored)) {
+  return zdict_view(self, "ItemsView");
+}
+
+static PyObject *ZDict_get_capacity(ZDict *self, void *closure) {
+  if (zdict_ready(self) < 0)
+    return NULL;
+  return PyLong_FromSsize_t(self->layout.mask + 1);
+}
+
+static PyMethodDef ZDict_methods[] = {
+    {"get", (PyCFunction)ZDict_get_method, METH_VARARGS,
+     "get(key, default=None): the value of key if present, else default."},
+    {"setdefault", (PyCFunction)ZDict_setdefault, METH_VARARGS,
+     "setdefault(key, default=None): the value of key, inserting default "
+     "first if key is absent."},
+    {"pop", (PyCFunction)ZDict_pop, METH_VARARGS,
+     "pop(key[, default]): remove key and return its value, or default if "
+     "given and key is absent."},
+    {"popitem", (PyCFunction)ZDict_popitem, METH_NOARGS,
+     "Remove and return the last inserted (key, value) pair."},
+    {"update", (PyCFunction)(void (*)(void))ZDict_update_method,
+     METH_VARARGS | METH_KEYWORDS,
+     "update([other], **kw): add the items of a mapping or of an iterable "
+     "of pairs, then kw."},
+    {"clear", (PyCFunction)ZDict_clear_method, METH_NOARGS,
+     "Remove all items."},
+    {"copy", (PyCFunction)ZDict_copy, METH_NOARGS,
+     "Return a new Dict with the same items."},
+    {"keys", (PyCFunction)ZDict_keys, METH_NOARGS, "A view of the keys."},
+    {"values", (PyCFunction)ZDict_values, METH_NOARGS,
+     "A view of the values."},
+    {"items", (PyCFunction)ZDict_items, METH_NOARGS,
+     "A view of the (key, value) pairs."},
+    {NULL}};
+
+static PyGetSetDef ZDict_getset[] = {
+    {"capacity", (getter)ZDict_get_capacity, NULL,
+     "Index slots of the current table, which holds 2/3 as many entries.",
+     NULL},
+    {NULL}};
+
+static PyMemberDef ZDict_members[] = {
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(ZDict, weakreflist),
+     READONLY},
+    {NULL}};
+
+static PyType_Slot ZDict_slots[] = {
+    {Py_tp_doc, "Dict(other=(), /, **kw): a mapping whose hash table is "
+                "stored in the ZGC heap"},
+    {Py_tp_new, ZDict_new},
+    {Py_tp_init, ZDict_init},
+    {Py_tp_dealloc, ZDict_dealloc},
+    {Py_tp_repr, ZDict_repr},
+    {Py_tp_richcompare, ZDict_richcompare},
+    {Py_tp_iter, ZDict_iter},
+    {Py_tp_hash, PyObject_HashNotImplemented},
+    {Py_sq_contains, ZDict_contains},
+    {Py_mp_length, ZDict_length},
+    {Py_mp_subscript, ZDict_subscript},
+    {Py_mp_ass_subscript, ZDict_ass_subscript},
+    {Py_tp_methods, ZDict_methods},
+    {Py_tp_getset, ZDict_getset},
+    {Py_tp_members, ZDict_members},
+    {0, NULL}};
+
+PyType_Spec ZDictSpec = {
+    .name = "pyzgc.Dict",
+    .basicsize = sizeof(ZDict),
+    .flags = ZTYPE_FLAGS,
+    .slots = ZDict_slots,
+};
+
+// --- Iterator ---
+
+static void ZDictIter_dealloc(ZDictIter *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  Py_XDECREF(self->dict);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static PyObject *ZDictIter_next(ZDictIter *self) {
+  ZDict *dict = self->dict;
+  if (!dict)
+    return NULL;
+  if (dict->used != self->used || dict->version != self->version) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "pyzgc.Dict changed size during iteration");
+    // Keep failing
+    self->used = -1;
+    return NULL;
+  }
+  PyObject *key;
+  int rc = zdict_next(dict, &self->pos, &key, NULL);
+  if (rc > 0)
+    return key;
+  if (rc == 0)
+    Py_CLEAR(self->dict);
+  return NULL;
+}
+
+static PyType_Slot ZDictIter_slots[] = {
+    {Py_tp_dealloc, ZDictIter_dealloc},
+    {Py_tp_iter, PyObject_SelfIter},
+    {Py_tp_iternext, ZDictIter_next},
+    {0, NULL}};
+
+// Made by iter(d) only
+PyType_Spec ZDictIterSpec = {
+    .name = "pyzgc.DictIterator",
+    .basicsize = sizeof(ZDictIter),
+    .flags = ZTYPE_FLAGS | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = ZDictIter_slots,
+};
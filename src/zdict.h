@@ -0,0 +1,75 @@
+#ifndef ZDICT_H
+#define ZDICT_H
+
+#include "zobject.h"
+#include <Python.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Heap-resident hash tables (pyzgc.Dict), laid out like CPython's compact
+// dicts. A dict is two bodies:
+//   the dict body, a ZBody whose
+//     slot 0   header: (used << 3) | ZDICT_TAG
+//     slot 1   direct reference to the table
+//     slot 2   (nentries << 3) | ZDICT_TAG, the entries taken so far,
+//              deleted ones included
+//   the table, a 'ref' array body (zarray.h) whose words are
+//     1        meta: (log2 of the index size << 5) | (words per entry << 3)
+//              | ZDICT_TAG
+//     2...     the open-addressing index, packed 4 slots of 15 bits (up to
+//              2^15 slots) or 2 of 30 bits per word, above a ZDICT_TAG. A
+//              slot holds 0 (empty), 1 (deleted) or 2 + an entry number.
+//     then     2/3 as many entries as index slots, in insertion order:
+//       hash   (hash << 3) | ZDICT_TAG, 0 once deleted. Only tables with
+//              keys other than str have it; str keys carry their hash.
+//       key    counted PyObject, NULL once deleted
+//       value  slot word (zobject.h): NULL for None, counted, or a direct
+//              reference
+// Header, meta, index and hash words can't be mistaken for references or
+// PyObject pointers, so the marker traces the table reference and the
+// values like any other slots, and both bodies move like any others.
+// Growing allocates a bigger table, dropping deleted entries, and swaps the
+// reference through the store barrier; a replaced table that got a large
+// page of its own goes back to the OS right away when no marking can still
+// be reading it.
+//
+// Keys are hashed and compared like dict keys, but handles (whose hash
+// follows the handle, not the body) can't be keys. Iteration follows
+// insertion order.
+
+#define ZDICT_TAG 0x6
+#define ZDICT_TAG_MASK 0x7
+#define ZDICT_MIN_CAPACITY 8
+
+// Where the parts of a table are, from its meta word
+typedef struct {
+  Py_ssize_t mask;    // Index slots - 1
+  Py_ssize_t usable;  // Entries
+  Py_ssize_t entries; // Word of entry 0
+  unsigned words;     // Words per entry: 2 (str keys only) or 3
+  unsigned shift;     // log2 of the index slots per word
+  unsigned bits;      // Bits per index slot
+} ZDictLayout;
+
+// Handle. Starts like ZObject so the barriers work on it unchanged.
+typedef struct {
+  PyObject_HEAD ZBody *body;
+  PyObject *weakreflist;
+  Py_ssize_t registered; // See ZObject
+  PyObject *table;       // Handle of the table body (a 'ref' pyzgc.Array)
+  Py_ssize_t used;       // Copies of the header counts
+  Py_ssize_t nentries;
+  ZDictLayout layout;    // Of the table
+  uint64_t version;      // Bumped whenever the table is replaced
+} ZDict;
+
+extern PyType_Spec ZDictIterSpec;
+
+static inline bool zdict_is_header(uint64_t word) {
+  return (word & ZDICT_TAG_MASK) == ZDICT_TAG;
+}
+
+// New handle for an existing dict body. New reference.
+PyObject *zdict_wrap_body(ZBody *body);
+
+#endif
@@ -0,0 +1,86 @@
+#include <Python.h>
+#include "zfork.h"
+#include "zcgroup.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zpool.h"
+#include "zprof.h"
+#include "zref.h"
+#include "zregion.h"
+#include "zsafepoint.h"
+#include "zsatb.h"
+#include "zstate.h"
+#include <pthread.h>
+
+// The per-state hooks, for zstate_for_each. Each stage is in the argument.
+static bool zfork_gc(void *stage) {
+  zgc_atfork(*(ZForkStage *)stage);
+  return true;
+}
+
+static bool zfork_heap(void *stage) {
+  zheap_atfork(*(ZForkStage *)stage);
+  return true;
+}
+
+static bool zfork_safepoint(void *stage) {
+  zsafepoint_atfork(*(ZForkStage *)stage);
+  return true;
+}
+
+static bool zfork_satb(void *stage) {
+  zsatb_atfork(*(ZForkStage *)stage);
+  return true;
+}
+
+static bool zfork_late(void *stage) {
+  zprof_atfork(*(ZForkStage *)stage);
+  zref_atfork(*(ZForkStage *)stage);
+  zregion_atfork(*(ZForkStage *)stage);
+  return true;
+}
+
+// Lock order: the state registry (zstate.c), cycle_lock and the mark stack
+// (zgc.c) of every state, heap_lock and remset_lock (zheap.c) of every
+// state, pop_lock (zpool.c), then threads_lock (zsafepoint.c) and
+// satb_lock (zsatb.c) of every state. Nothing takes an earlier one while
+// holding a later one.
+static void zfork_prepare(void) {
+  ZForkStage stage = ZFORK_PREPARE;
+  zstate_atfork(stage);
+  zstate_for_each(zfork_gc, &stage);
+  zstate_for_each(zfork_heap, &stage);
+  zpool_atfork(stage);
+  zstate_for_each(zfork_safepoint, &stage);
+  zstate_for_each(zfork_satb, &stage);
+}
+
+static void zfork_parent(void) {
+  ZForkStage stage = ZFORK_PARENT;
+  zstate_for_each(zfork_satb, &stage);
+  zstate_for_each(zfork_safepoint, &stage);
+  zpool_atfork(stage);
+  zstate_for_each(zfork_heap, &stage);
+  zstate_for_each(zfork_gc, &stage);
+  zstate_atfork(stage);
+}
+
+static void zfork_child(void) {
+  ZForkStage stage = ZFORK_CHILD;
+  zstate_atfork(stage);
+  zstate_for_each(zfork_satb, &stage);
+  zstate_for_each(zfork_safepoint, &stage);
+  zpool_atfork(stage);
+  zstate_for_each(zfork_heap, &stage);
+  zstate_for_each(zfork_gc, &stage);
+  zcgroup_atfork(stage);
+  zstate_for_each(zfork_late, &stage);
+}
+
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+static void zfork_register(void) {
+  pthread_atfork(zfork_prepare, zfork_parent, zfork_child);
+}
+
+void zfork_init(void) { pthread_once(&fork_once, zfork_register); }
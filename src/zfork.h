@@ -0,0 +1,24 @@
+#ifndef ZFORK_H
+#define ZFORK_H
+
+// fork() support (pthread_atfork).
+//
+// Before a fork, the collector finishes the cycle step in progress and the
+// locks guarding the heap's lists (pages, remembered set, page pool, mark
+// stack, SATB queues, threads) are taken, so the child copies them in a
+// consistent state. Afterwards the parent lets go, and the child
+// initializes every lock of the module afresh: the threads that may have
+// held the others don't exist there. Each module with locks has a
+// z<module>_atfork(stage) hook; zfork.c calls them in lock order, once
+// for each interpreter's state (zstate.h) where the module has one.
+//
+// The child is left with the forking thread alone: the GC thread and the
+// pool filler are gone, as are the other threads' TLABs. os.fork() restarts
+// the GC thread in the child if it was running (pyzgcmodule.c).
+
+typedef enum { ZFORK_PREPARE, ZFORK_PARENT, ZFORK_CHILD } ZForkStage;
+
+// Registers the handlers, once
+void zfork_init(void);
+
+#endif
@@ -1,30 +1,182 @@
 #define PY_SSIZE_T_CLEAN
+#include <Python.h>
 #include "zgc.h"
+#include "zarray.h"
 #include "zbarrier.h"
+#include "zcard.h"
 #include "zheap.h"
 #include "zmarkstack.h"
 #include "zobject.h"
-#include <Python.h>
+#include "zpool.h"
+#include "zprobe.h"
+#include "zprof.h"
+#include "zsafepoint.h"
+#include "zref.h"
+#include "zsatb.h"
+#include "zstruct.h"
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-static pthread_t gc_thread;
-static atomic_bool gc_running = false;
-static ZMarkStack mark_stack;
+// Per-state part (zstate.h)
+typedef struct ZGCState {
+  pthread_t thread;
+  atomic_bool running;
+  ZMarkStack mark_stack;
+
+  // One cycle at a time (background thread vs. pyzgc.gc())
+  pthread_mutex_t cycle_lock;
+
+  // Color used by the current/last marking (alternates Marked0/Marked1).
+  // During relocation the good color is Remapped|mark color, so it differs
+  // from the previous cycle's relocation color as well.
+  uintptr_t mark_color;
+
+  // Updated under cycle_lock, read by zgc_get_stats
+  pthread_mutex_t stats_lock;
+  ZGCStats stats;
+
+  // The cycle in progress. Only touched with cycle_lock held.
+  struct {
+    bool minor_gc;
+    bool freeze;           // Evacuates into the permanent generation
+    bool mark_region;      // Sweeps old pages in place (ZGC_OLD_GEN_*)
+    uint64_t cpu_ns;       // Accumulated over the steps
+    uint64_t wall_start;   // CLOCK_MONOTONIC at the first step
+    size_t relocate_pages; // Relocation set, for the probes
+    size_t relocate_live;  // Live bytes in it
+    size_t defrag_pages;   // Old pages in it, in mark-region cycles
+    size_t swept_pages;
+    size_t swept_free_bytes;
+    ZPage *handle_scan;    // Next page zgc_scan_handles walks
+    ZPage *relocate_page;  // Page a budgeted step stopped copying in
+    size_t relocate_from;  // Its mark bitmap byte to resume at
+  } cycle;
+
+  // Set while a mark-region cycle marks, so that marking records the lines
+  // of old bodies as well
+  atomic_bool mark_lines;
+  // Set while a cycle marks, so that what handles hold is kept
+  // (zgc_note_handle)
+  atomic_bool keep_handles;
+
+  // Set from relocate start until the end of a freezing cycle: copies go
+  // to the permanent generation instead of the old one
+  atomic_bool relocate_frozen;
+
+  // CLOCK_MONOTONIC at the end of the last cycle, whoever ran it
+  _Atomic uint64_t last_cycle_end;
+
+  // Set in a child forked in the middle of a cycle step (see zgc_atfork)
+  bool disabled;
+
+  ZGCConfig config; // Under config_lock
+  pthread_mutex_t config_lock;
+
+  pthread_mutex_t memory_lock;
+  ZGCMemory memory; // Last check, under memory_lock
+
+  // The GC thread's sleep (zgc_wait)
+  pthread_mutex_t wake_lock;
+  pthread_cond_t wake_cond;
+  bool cycle_requested;
+
+  // When an event loop last asked for idle work (zgc_idle_due_ns)
+  _Atomic uint64_t last_idle_poll;
+
+  // fork() (see zgc_before_fork)
+  bool fork_held;    // zgc_before_fork took cycle_lock
+  bool fork_locked;  // The prepare handler took it
+  bool fork_quiet;   // No cycle step was running at the fork
+  bool fork_restart; // The GC thread was running at the fork
+} ZGCState;
+
+static void zgc_wake_init(ZGCState *gc);
+
+bool zgc_state_init(ZState *state) {
+  ZGCState *gc = (ZGCState *)calloc(1, sizeof(ZGCState));
+  if (!gc)
+    return false;
+  zmarkstack_init(&gc->mark_stack);
+  pthread_mutex_init(&gc->cycle_lock, NULL);
+  pthread_mutex_init(&gc->stats_lock, NULL);
+  pthread_mutex_init(&gc->config_lock, NULL);
+  pthread_mutex_init(&gc->memory_lock, NULL);
+  pthread_mutex_init(&gc->wake_lock, NULL);
+  zgc_wake_init(gc);
+  gc->mark_color = ZPOINTER_MARKED0_BIT;
+  gc->config = (ZGCConfig){
+      .assist_ratio = 1.0,
+      .assist_max_ns = 100 * 1000,
+      .memory_pressure = 10.0,
+  };
+  state->gc = gc;
+  return true;
+}
+
+void zgc_state_close(ZState *state) {
+  ZGCState *gc = state->gc;
+  atomic_store(&state->phase, ZGC_PHASE_IDLE);
+  while (zmarkstack_pop(&gc->mark_stack))
+    ;
+}
+
+static uint64_t zgc_clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void zgc_get_stats(ZGCStats *out) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->stats_lock);
+  *out = gc->stats;
+  pthread_mutex_unlock(&gc->stats_lock);
+}
+
+// --- Safepoints ---
+// Short STW sections (mark start, mark end, relocate start). See zsafepoint.c
+// for how mutators are brought to a stop.
+void zgc_safepoint_begin(void) { zsafepoint_begin(); }
+
+void zgc_safepoint_end(void) { zsafepoint_end(); }
+
+// Handshake: drop the mutator's TLAB so that nothing more is allocated in
+// pages that are about to be evacuated. Region pages never are, and their
+// TLAB top is the only record of how far they are filled (zregion.h): it
+// stays, and the page's top catches up so that what is below counts as
+// allocated before the cycle.
+static void zgc_retire_tlab(ZThread *thread, void *arg) {
+  uintptr_t end = thread->tlab->end;
+  ZPage *page = end ? zheap_get_page((void *)(end - 1)) : NULL;
+  if (page && page->region) {
+    page->top = thread->tlab->top;
+    return;
+  }
+  thread->tlab->top = 0;
+  thread->tlab->end = 0;
+}
 
 // Testing helpers
 void zgc_add_root(void *obj) {
+  ZGCState *gc = zstate->gc;
   // Always allow adding roots, even if GC not running (for manual cycle)
   ZObject *zobj = (ZObject *)obj;
   if (zobj && zobj->body) {
-    zmarkstack_push(&mark_stack, zobj->body);
+    zmarkstack_push(&gc->mark_stack, zobj->body);
   }
 }
 
+void zgc_for_each_root(void (*fn)(void **root, void *arg), void *arg) {
+  ZGCState *gc = zstate->gc;
+  zmarkstack_for_each(&gc->mark_stack, fn, arg);
+}
+
 bool zgc_check_marked(void *obj) {
   ZObject *zobj = (ZObject *)obj;
   if (!zobj || !zobj->body)
@@ -33,60 +185,293 @@ bool zgc_check_marked(void *obj) {
   ZPage *page = zheap_get_page(zobj->body);
   if (!page)
     return false;
-  return zpage_is_marked(page, zobj->body);
+  // Frozen bodies are never marked, and never die
+  return page->is_frozen || zpage_is_marked(page, zobj->body);
 }
 
-static void zgc_mark(void) {
-  while (!zmarkstack_is_empty(&mark_stack)) {
-    ZBody *body = (ZBody *)zmarkstack_pop(&mark_stack);
-    if (!body)
-      continue;
+void *zgc_remap(void *body) {
+  void *raw_body = Z_ADDRESS(body);
+  // Evacuated pages keep their forwarding tables, so follow them for as
+  // long as the body was moved
+  for (;;) {
+    ZPage *page = zheap_get_page(raw_body);
+    void *new_body = page && page->is_evacuating
+                         ? zpage_resolve_forwarding(page, raw_body)
+                         : NULL;
+    if (!new_body)
+      return raw_body;
+    raw_body = new_body;
+  }
+}
 
-    ZPage *page = zheap_get_page(body);
-    if (!page)
-      continue;
+// Calls fn on the words of a body that may hold references. Returns true
+// if fn did for any of them.
+static bool zgc_for_each_ref(ZBody *body,
+                             bool (*fn)(ZBody *body, size_t index, void *arg),
+                             void *arg) {
+  bool any = false;
+  uint64_t header = zbody_get_word(body, 0);
+  if (zarray_is_header(header)) {
+    if (zarray_header_dtype(header) == ZARRAY_REF) {
+      uint64_t length = zarray_header_length(header);
+      for (uint64_t i = 0; i < length; i++)
+        any |= fn(body, 1 + i, arg);
+    }
+    return any;
+  }
 
-    if (zpage_is_marked(page, body)) {
-      continue;
+  // Typed struct bodies only hold references in some slots
+  uint32_t ref_map = zstruct_ref_map(body);
+  for (int i = 0; i < 32 && ref_map >> i; i++) {
+    if (ref_map & (1u << i))
+      any |= fn(body, i, arg);
+  }
+  return any;
+}
+
+// Bodies that cycles don't mark: shared image bodies and frozen ones
+static bool zgc_is_unmarked_page(ZPage *page) {
+  return !page || page->is_frozen || page->generation == ZGEN_SHARED;
+}
+
+// Pushes the body a slot refers to, if any, and returns true if it did.
+// Only direct references (see zobject.h) lead to bodies, so other words are
+// skipped without being dereferenced. `arg` is 0 or
+// ZPOINTER_FINALIZABLE_BIT, passed on from the parent's entry.
+static bool zgc_mark_child(ZBody *body, size_t index, void *arg) {
+  ZGCState *gc = zstate->gc;
+  uintptr_t finalizable = (uintptr_t)arg;
+  PyObject *slot = zbody_get_slot(body, index);
+  if (!zbody_is_ref(slot))
+    return false;
+  ZBody *child_body = zbody_ref_target(slot);
+
+  // Heal the slot ONLY if it points to a relocated object (Forwarding). Do
+  // NOT fix color if it's just a color mismatch, because the object might
+  // move later in this cycle.
+  if (!Z_HAS_COLOR(child_body, zstate->good_color)) {
+    void *raw_body = Z_ADDRESS(child_body);
+    void *new_body = zgc_remap(raw_body);
+    if (new_body != raw_body) {
+      ZBody *healed = (ZBody *)Z_WITH_COLOR(new_body, zstate->good_color);
+      // A mutator's load may have healed it first; either way the slot now
+      // holds the forwarded body (unless it was overwritten, in which case
+      // the old value went through SATB anyway)
+      zbody_heal_slot(body, index, slot, zbody_make_ref(healed));
+      child_body = healed;
     }
+  }
+  if (zgc_is_unmarked_page(zheap_get_page(Z_ADDRESS(child_body))))
+    return false;
+  zmarkstack_push(&gc->mark_stack,
+                  (void *)((uintptr_t)child_body | finalizable));
+  // printf("[ZGC] Pushed child %p\n", child_body);
+  return true;
+}
 
-    zpage_mark_object(page, body);
-    // printf("[ZGC] Marked %p (Gen: %d)\n", body, page->generation);
-
-    for (int i = 0; i < ZOBJECT_SLOTS; i++) {
-      PyObject *child = body->slots[i];
-      if (child && Py_TYPE(child) == &ZObjectType) {
-        ZObject *zchild = (ZObject *)child;
-        if (zchild->body) {
-          // Fix pointer ONLY if it points to a relocated object (Forwarding)
-          // Do NOT fix color if it's just a color mismatch, because the object
-          // might move later in this cycle.
-          if (!Z_HAS_COLOR(zchild->body, zgc_good_color)) {
-            void *raw_body = Z_ADDRESS(zchild->body);
-            ZPage *page = zheap_get_page(raw_body);
-            if (page && page->is_evacuating) {
-              void *new_body = zpage_resolve_forwarding(page, raw_body);
-              if (new_body) {
-                zchild->body = (ZBody *)Z_WITH_COLOR(new_body, zgc_good_color);
-              }
-            }
-          }
-          zmarkstack_push(&mark_stack, zchild->body);
-          // printf("[ZGC] Pushed child %p\n", zchild->body);
-        }
-      }
+// Pushes the children of a body that is not marked itself (frozen bodies
+// in dirty cards). Returns true if it refers to a mutable body.
+static bool zgc_mark_frozen(ZBody *body, void *arg) {
+  return zgc_for_each_ref(body, zgc_mark_child, NULL);
+}
+
+// Reference arrays are traced in chunks of this many elements, so that a
+// budgeted step or an assist stops within a large one. A chunk's entry is
+// the address of its first element, tagged ZGC_MARK_CHUNK_TAG (bodies are
+// 8-byte aligned).
+#define ZGC_MARK_CHUNK 1024
+#define ZGC_MARK_CHUNK_TAG 0x1
+
+// Pushes an entry per full chunk of a large reference array and marks the
+// rest of its elements
+static void zgc_mark_array(ZBody *body, uint64_t length, uintptr_t arg) {
+  ZGCState *gc = zstate->gc;
+  uint64_t tail = length - length % ZGC_MARK_CHUNK;
+  for (uint64_t i = 0; i < tail; i += ZGC_MARK_CHUNK)
+    zmarkstack_push(&gc->mark_stack,
+                    (void *)((uintptr_t)((PyObject **)body + 1 + i) |
+                             ZGC_MARK_CHUNK_TAG | arg));
+  for (uint64_t i = tail; i < length; i++)
+    zgc_mark_child(body, 1 + i, (void *)arg);
+}
+
+// The elements of a chunk entry are slots 1..ZGC_MARK_CHUNK of a body that
+// would start a word before the first one
+static size_t zgc_mark_chunk(void *popped) {
+  uintptr_t finalizable = (uintptr_t)popped & ZPOINTER_FINALIZABLE_BIT;
+  ZBody *base = (ZBody *)(((uintptr_t)popped & ~(finalizable |
+                                                  ZGC_MARK_CHUNK_TAG)) -
+                          sizeof(PyObject *));
+  for (size_t i = 1; i <= ZGC_MARK_CHUNK; i++)
+    zgc_mark_child(base, i, (void *)finalizable);
+  return ZGC_MARK_CHUNK * sizeof(PyObject *);
+}
+
+// Marks one mark stack entry and pushes its children. Returns the bytes
+// marked (or traced, for array chunks), 0 if there was nothing to do. The
+// GC thread and assisting mutators call this concurrently.
+static size_t zgc_mark_entry(void *popped) {
+  if ((uintptr_t)popped & ZGC_MARK_CHUNK_TAG)
+    return zgc_mark_chunk(popped);
+
+  // Roots and SATB entries may still point at an old copy
+  ZBody *body = (ZBody *)zgc_remap(popped);
+
+  ZPage *page = zheap_get_page(body);
+  if (!page)
+    return 0;
+
+  // Shared image bodies are immortal and hold nothing but encoded
+  // references; leave their pages alone. Frozen ones are immortal too, and
+  // the card scan at mark start pushed what they refer to.
+  if (zgc_is_unmarked_page(page))
+    return 0;
+
+  // Entries tagged FINALIZABLE come from finalizer referents (see
+  // zref.h). Their marks go to a separate bitmap so that reference
+  // processing can tell them from strongly reachable objects; a strong
+  // mark later on still traces the object again.
+  size_t size = zbody_size(body);
+  uintptr_t finalizable = (uintptr_t)popped & ZPOINTER_FINALIZABLE_BIT;
+  if (finalizable) {
+    if (zpage_is_marked(page, body) || !zpage_mark_finalizable(page, body))
+      return 0;
+    page->live_bytes += size;
+  } else {
+    if (!zpage_mark_object(page, body))
+      return 0;
+    if (!zpage_is_finalizable(page, body))
+      page->live_bytes += size;
+  }
+  if (atomic_load_explicit(&zstate->gc->mark_lines, memory_order_relaxed) &&
+      page->generation == ZGEN_OLD && !page->is_large)
+    zpage_mark_lines(page, body, size);
+  // printf("[ZGC] Marked %p (Gen: %d)\n", body, page->generation);
+
+  uint64_t header = zbody_get_word(body, 0);
+  if (zarray_is_header(header) &&
+      zarray_header_dtype(header) == ZARRAY_REF &&
+      zarray_header_length(header) > ZGC_MARK_CHUNK)
+    zgc_mark_array(body, zarray_header_length(header), finalizable);
+  else
+    zgc_for_each_ref(body, zgc_mark_child, (void *)finalizable);
+  return size;
+}
+
+// --- Work budgets ---
+// Incremental steps (pyzgc.gc(budget_us=...)) and mutator assists stop
+// once either limit is reached. Zero means no limit.
+
+typedef struct {
+  size_t bytes;         // Marked or relocated bytes
+  uint64_t deadline_ns; // CLOCK_MONOTONIC
+  size_t done;          // Bytes of work so far
+  unsigned checks;      // Only read the clock every few objects...
+  size_t clocked;       // ...or bytes (done at the last read)
+} ZGCBudget;
+
+#define ZGC_BUDGET_CLOCK_BYTES (64 * 1024)
+
+static bool zgc_budget_spent(ZGCBudget *budget, size_t bytes) {
+  if (!budget)
+    return false;
+  budget->done += bytes;
+  if (budget->bytes && budget->done >= budget->bytes)
+    return true;
+  if (!budget->deadline_ns ||
+      (++budget->checks % 32 != 0 &&
+       budget->done - budget->clocked < ZGC_BUDGET_CLOCK_BYTES))
+    return false;
+  budget->clocked = budget->done;
+  return zgc_clock_ns(CLOCK_MONOTONIC) >= budget->deadline_ns;
+}
+
+// Drains the mark stack and the SATB buffers. Returns false if the budget
+// ran out first; the remaining work stays on the stack.
+static bool zgc_mark_budget(ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  do {
+    while (!zmarkstack_is_empty(&gc->mark_stack)) {
+      void *popped = zmarkstack_pop(&gc->mark_stack);
+      if (popped && zgc_budget_spent(budget, zgc_mark_entry(popped)))
+        return false;
+    }
+    // Pick up references overwritten by mutators since marking started
+  } while (zsatb_drain(&gc->mark_stack) > 0);
+  return true;
+}
+
+void zgc_mark(void) { zgc_mark_budget(NULL); }
+
+void *zgc_relocate_object(ZPage *page, void *obj) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&page->relocate_lock);
+
+  // Whoever gets here first (GC thread or a mutator's barrier) copies
+  void *new_addr = zpage_resolve_forwarding(page, obj);
+  if (!new_addr && zpage_is_live(page, obj)) {
+    // 1. Allocate new space
+    // Always promote to Old Gen during relocation for now.
+    // (In real ZGC, we might keep in Young if it's the first survival)
+    size_t obj_size = zbody_size(Z_ADDRESS(obj));
+    void *colored = atomic_load(&gc->relocate_frozen)
+                        ? zheap_alloc_frozen(obj_size)
+                        : zheap_alloc(obj_size, ZGEN_OLD);
+    if (colored) {
+      new_addr = Z_ADDRESS(colored);
+
+      // 2. Copy content
+      memcpy(new_addr, Z_ADDRESS(obj), obj_size);
+      ZPROBE3(relocate__object, Z_ADDRESS(obj), new_addr, obj_size);
+
+      // 3. The live handle follows at once, so it never points at a
+      // stale copy: handles aren't traced, and one left alone for two
+      // cycles would carry the good color again. It can't die meanwhile:
+      // its color is bad, so its dealloc goes through the barrier and
+      // waits for relocate_lock.
+      PyObject *handle =
+          __atomic_load_n(zbody_handle_slot(new_addr), __ATOMIC_ACQUIRE);
+      if (handle)
+        __atomic_store_n(&((ZObject *)handle)->body,
+                         (ZBody *)Z_WITH_COLOR(new_addr, zstate->good_color),
+                         __ATOMIC_RELEASE);
+
+      // 4. Add forwarding entry
+      zpage_add_forwarding(page, obj, new_addr);
+      // printf("[ZGC] Relocated %p -> %p\n", obj, new_addr);
+    } else {
+      // Out of memory: the object stays on the evacuated page
+      atomic_store(&page->relocate_failed, true);
     }
   }
+
+  pthread_mutex_unlock(&page->relocate_lock);
+  return new_addr;
 }
 
-static void zgc_relocate(bool minor_gc) {
-  // Iterate all pages
+// Relocate start (STW): choose the relocation set and flip to the Remapped
+// color so that every handle goes through the barrier before touching a body.
+// A freezing cycle evacuates into frozen pages, and freezes live large
+// bodies where they are.
+static void zgc_relocate_start(bool minor_gc, bool freeze) {
+  ZGCState *gc = zstate->gc;
   ZPage *page = zheap_get_head_page();
+  gc->cycle.relocate_pages = gc->cycle.relocate_live = 0;
+  gc->cycle.defrag_pages = 0;
   ZPage *current_alloc_page = zheap_get_current_page();
+  ZPage *current_old_page = zheap_get_current_old_page();
 
   while (page) {
-    // Skip the current allocation page
-    if (page == current_alloc_page) {
+    if (freeze && page->is_large && !page->is_frozen && page->live_bytes &&
+        !page->is_immortal && !page->region)
+      zheap_freeze_large(page);
+
+    // Skip the current allocation pages, heap image pages, large pages,
+    // region pages, frozen pages and pages with raw pointers held outside
+    // the heap
+    if (page == current_alloc_page || page == current_old_page ||
+        page->is_immortal || page->is_large || page->region ||
+        page->is_frozen || atomic_load(&page->pin_count) > 0) {
       page = page->next;
       continue;
     }
@@ -97,143 +482,835 @@ static void zgc_relocate(bool minor_gc) {
       continue;
     }
 
-    // Start evacuation
+    // Allocated into while marking: the new bodies have no marks to be
+    // copied by
+    if (page->top > page->mark_top) {
+      page = page->next;
+      continue;
+    }
+
+    // Mark-region cycles leave old pages in place to be swept, but for the
+    // sparsest. Evacuated pages keep their forwarding tables, so their
+    // memory is never reused.
+    if (gc->cycle.mark_region && page->generation == ZGEN_OLD &&
+        !page->is_evacuating) {
+      if (page->live_bytes >= ZGC_DEFRAG_LIVE_BYTES) {
+        atomic_store(&page->sweep_pending, true);
+        page = page->next;
+        continue;
+      }
+      gc->cycle.defrag_pages++;
+    }
+
     zpage_start_evacuation(page);
+    gc->cycle.relocate_pages++;
+    gc->cycle.relocate_live += page->live_bytes;
+    atomic_store(&page->relocate_claimed, false);
+    atomic_store(&page->is_relocating, true);
+    page = page->next;
+  }
+
+  atomic_store(&gc->relocate_frozen, freeze);
+  zstate->good_color = ZPOINTER_REMAPPED_BIT | gc->mark_color;
+}
 
-    // Scan the bitmap to find live objects
-    uintptr_t page_start = page->start;
-    // Skip metadata
-    uintptr_t obj_start = (page_start + sizeof(ZPage) + 7) & ~7;
-
-    for (uintptr_t addr = obj_start; addr < page->top;
-         addr += 8) { // Assuming 8-byte alignment
-      // Check if marked
-      void *obj = (void *)addr;
-      if (zpage_is_marked(page, obj)) {
-        // It's live! Move it.
-        // 1. Allocate new space
-        // If Minor GC, promote to Old Gen.
-        // If Full GC, keep in same gen? Or promote?
-        // For simplicity, always promote to Old Gen during relocation for now.
-        // (In real ZGC, we might keep in Young if it's the first survival)
-        size_t obj_size = sizeof(ZBody);
-        void *new_addr = zheap_alloc(obj_size, ZGEN_OLD);
-
-        if (!new_addr) {
-          break;
+// Copies the live bodies of a page from mark bitmap byte `from` on, until
+// the budget runs out. Returns the byte to resume at, or ZBITMAP_SIZE once
+// the page is done, and no longer relocating.
+static size_t zgc_relocate_from(ZPage *page, size_t from,
+                                ZGCBudget *budget) {
+  // Scan the bitmaps to find live objects (1 bit per 8 bytes)
+  const uint8_t *finalizable = page->finalizable_bitmap;
+  for (size_t byte = from; byte < ZBITMAP_SIZE; byte++) {
+    uint8_t bits =
+        page->mark_bitmap[byte] | (finalizable ? finalizable[byte] : 0);
+    if (!bits)
+      continue;
+    size_t copied = 0;
+    for (int bit = 0; bit < 8; bit++) {
+      if (bits & (1 << bit)) {
+        void *obj = (void *)(page->start + (byte * 8 + bit) * 8);
+        if (!zgc_relocate_object(page, obj)) {
+          break; // Out of memory: leave the rest in place
         }
+        copied += zbody_size((ZBody *)obj);
+      }
+    }
+    if (zgc_budget_spent(budget, copied) && byte + 1 < ZBITMAP_SIZE)
+      return byte + 1;
+  }
+
+  atomic_store(&page->is_relocating, false);
+  return ZBITMAP_SIZE;
+}
 
-        // 2. Copy content
-        memcpy(new_addr, obj, obj_size);
+void zgc_relocate_page(ZPage *page) { zgc_relocate_from(page, 0, NULL); }
 
-        // 3. Add forwarding entry
-        zpage_add_forwarding(page, obj, new_addr);
-        // printf("[ZGC] Relocated %p -> %p\n", obj, new_addr);
-      }
+// Sweeps the old pages mark-region cycles leave in place. Runs before
+// relocation copies anything, so that promoted bodies fill their holes.
+// Returns false if the budget ran out first.
+static bool zgc_sweep_budget(ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  for (ZPage *page = zheap_get_head_page(); page; page = page->next) {
+    if (!atomic_load(&page->sweep_pending) ||
+        !atomic_exchange(&page->sweep_pending, false))
+      continue;
+    gc->cycle.swept_pages++;
+    gc->cycle.swept_free_bytes += zheap_sweep_page(page);
+    if (zgc_budget_spent(budget, page->top - page->start))
+      return false;
+  }
+  return true;
+}
+
+// Released evacuated pages and sweeps reuse the memory of dead bodies,
+// which a handle may still read, along with what they refer to. So cycles
+// keep every body that has a handle at some point while they mark: this
+// pushes those below mark_top as roots, and zgc_note_handle the ones that
+// get or lose a handle meanwhile. A handle that Python holds is a strong
+// root; one that only WeakRefs and finalizers hold is a finalizable one,
+// which they don't count as reachable. Minor cycles only scan young pages,
+// so that no handle is left reading an evacuated page, which the next full
+// cycle releases.
+// Returns false if the budget ran out first.
+static void zgc_scan_handle(void *body, void *arg) {
+  ZPage *page = (ZPage *)arg;
+  if (zpage_is_marked(page, body) ||
+      !__atomic_load_n(zbody_handle_slot((ZBody *)body), __ATOMIC_ACQUIRE))
+    return;
+  if (zobject_handle_is_held((ZBody *)body))
+    zmarkstack_push(&zstate->gc->mark_stack, body);
+  else if (!zpage_is_finalizable(page, body))
+    zmarkstack_push(&zstate->gc->mark_stack,
+                    (void *)((uintptr_t)body | ZPOINTER_FINALIZABLE_BIT));
+}
+
+static bool zgc_scan_handles(ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  while (gc->cycle.handle_scan) {
+    ZPage *page = gc->cycle.handle_scan;
+    gc->cycle.handle_scan = page->next;
+    // Frozen and image bodies are never reused, and the cycles that
+    // evacuated a page kept what handles read on it
+    if (page->is_immortal || page->is_frozen || page->is_evacuating ||
+        (gc->cycle.minor_gc && page->generation == ZGEN_OLD))
+      continue;
+    zheap_for_each_body(page, page->mark_top, zgc_scan_handle, page);
+    if (zgc_budget_spent(budget, page->mark_top - page->start))
+      return false;
+  }
+  return true;
+}
+
+void zgc_note_handle(void *body, bool held) {
+  if (atomic_load_explicit(&zstate->gc->keep_handles, memory_order_relaxed))
+    zsatb_enqueue((void *)((uintptr_t)Z_ADDRESS(body) |
+                           (held ? 0 : ZPOINTER_FINALIZABLE_BIT)));
+}
+
+// Claims a page of the relocation set that nobody has claimed yet
+static ZPage *zgc_claim_relocation(void) {
+  for (ZPage *page = zheap_get_head_page(); page; page = page->next) {
+    if (atomic_load(&page->is_relocating) &&
+        !atomic_exchange(&page->relocate_claimed, true))
+      return page;
+  }
+  return NULL;
+}
+
+// Copies the pages of the relocation set that nobody has claimed yet,
+// whole ones: mutators racing with us relocate single objects through
+// zgc_relocate_object, or whole pages when they assist. Returns false if
+// the budget ran out first.
+static bool zgc_relocate_budget(ZGCBudget *budget) {
+  ZPage *page;
+  while ((page = zgc_claim_relocation()) != NULL) {
+    zgc_relocate_page(page);
+    if (zgc_budget_spent(budget, page->live_bytes))
+      return false;
+  }
+  return true;
+}
+
+// The GC's part of relocation, which stops within a page when the budget
+// runs out and resumes there at the next step
+static bool zgc_relocate_step(ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  for (;;) {
+    ZPage *page = gc->cycle.relocate_page;
+    if (!page) {
+      page = zgc_claim_relocation();
+      if (!page)
+        return true;
+      gc->cycle.relocate_from = 0;
     }
+    gc->cycle.relocate_from =
+        zgc_relocate_from(page, gc->cycle.relocate_from, budget);
+    if (gc->cycle.relocate_from < ZBITMAP_SIZE) {
+      gc->cycle.relocate_page = page;
+      return false;
+    }
+    gc->cycle.relocate_page = NULL;
+  }
+}
 
-    page = page->next;
+// Waits for pages that assisting mutators are still copying. They copy at
+// most one page each, so this is short.
+static void zgc_relocate_wait(void) {
+  for (ZPage *page = zheap_get_head_page(); page; page = page->next) {
+    while (atomic_load(&page->is_relocating))
+      sched_yield();
   }
 }
 
-void zgc_run_cycle(void) {
-  // Full GC Cycle
+// --- Cycle ---
+// A cycle runs in phases so that pyzgc.gc(budget_us=...) can stop between
+// steps and resume later; cycle_lock is only held while a step runs. The
+// phase changes inside pauses (and back to idle once relocation is over),
+// which is what lets mutators assist without further synchronization.
 
-  // 0. Flip Good Color
-  if (zgc_good_color == ZPOINTER_MARKED0_BIT) {
-    zgc_good_color = ZPOINTER_MARKED1_BIT;
-  } else {
-    zgc_good_color = ZPOINTER_MARKED0_BIT;
+static void zgc_cycle_begin(bool minor_gc, bool freeze) {
+  ZGCState *gc = zstate->gc;
+  gc->cycle.minor_gc = minor_gc;
+  gc->cycle.freeze = freeze;
+  pthread_mutex_lock(&gc->config_lock);
+  gc->cycle.mark_region = !freeze && !minor_gc &&
+                          gc->config.old_gen == ZGC_OLD_GEN_MARK_REGION;
+  pthread_mutex_unlock(&gc->config_lock);
+  // The handle scan doesn't walk evacuated pages, which only hold stale
+  // copies and bodies no handle reaches. Pages that can't be released
+  // (pinned, relocation ran out of memory, huge pages) make the cycle copy.
+  if (gc->cycle.mark_region) {
+    size_t released;
+    gc->cycle.mark_region = zheap_release_evacuated(&released);
+    pthread_mutex_lock(&gc->stats_lock);
+    gc->stats.released_bytes += released;
+    pthread_mutex_unlock(&gc->stats_lock);
   }
-  // printf("[ZGC] Full Cycle Start. Good Color: %s\n",
-  //        (zgc_good_color == ZPOINTER_MARKED0_BIT) ? "Marked0" : "Marked1");
+  gc->cycle.swept_pages = gc->cycle.swept_free_bytes = 0;
+  gc->cycle.cpu_ns = 0;
+  gc->cycle.wall_start = zgc_clock_ns(CLOCK_MONOTONIC);
+  ZPROBE1(cycle__begin, minor_gc);
 
-  // 0.5 Clear Bitmaps (from previous cycle)
+  // 0. Clear Bitmaps (from previous cycle). Nothing reads them between
+  // cycles, so this does not need a pause.
+  // For Minor GC we also clear Old pages: tracing goes through them and
+  // they are not candidates for collection anyway. Frozen pages are left
+  // untouched, so that forked children keep sharing them.
   ZPage *p = zheap_get_head_page();
   while (p) {
-    zpage_clear_bitmap(p);
+    if (!p->is_frozen)
+      zpage_clear_bitmap(p);
     p = p->next;
   }
 
-  // 1. Mark Phase
-  zgc_mark();
+  // 1. Mark Start (STW): flip the Good Color and start SATB logging
+  zgc_safepoint_begin();
+  gc->mark_color = (gc->mark_color == ZPOINTER_MARKED0_BIT)
+                       ? ZPOINTER_MARKED1_BIT
+                       : ZPOINTER_MARKED0_BIT;
+  zstate->good_color = gc->mark_color;
 
-  // 2. Relocate Phase (Full)
-  zgc_relocate(false);
+  size_t remset_entries = 0;
+  if (minor_gc) {
+    // Add Remembered Set to Mark Stack
+    while (!zremset_is_empty()) {
+      void *obj = zremset_pop();
+      if (obj) {
+        zmarkstack_push(&gc->mark_stack, obj);
+        remset_entries++;
+      }
+    }
+  }
+  // Frozen bodies given references to mutable ones are roots of every
+  // cycle. Freezing also moves allocation off the current pages, whose
+  // bodies are then evacuated like the others.
+  size_t cards = zcard_scan(false, true, zgc_mark_frozen, NULL);
+  // Bodies allocated from here on are not in the snapshot. They go to new
+  // TLABs, above each page's mark_top, and count as live.
+  zsafepoint_handshake(zgc_retire_tlab, NULL);
+  if (!minor_gc)
+    zheap_drop_holes(gc->cycle.mark_region);
+  if (freeze)
+    zheap_retire_current_pages();
+  for (ZPage *page = zheap_get_head_page(); page; page = page->next)
+    page->mark_top = page->top;
+  ZPROBE2(mark__begin, minor_gc, remset_entries);
+  zsatb_begin_marking();
+  zref_push_finalizable(&gc->mark_stack);
+  zprof_mark_start();
+  atomic_store(&gc->mark_lines, gc->cycle.mark_region);
+  atomic_store(&gc->keep_handles, true);
+  gc->cycle.handle_scan = zheap_get_head_page();
+  atomic_store(&zstate->phase, ZGC_PHASE_MARK);
+  zgc_safepoint_end();
+
+  pthread_mutex_lock(&gc->stats_lock);
+  gc->stats.cards_scanned += cards;
+  pthread_mutex_unlock(&gc->stats_lock);
+}
+
+// Returns false if the budget ran out before marking was done: the pause
+// ends and marking goes on concurrently, to try again at the next step.
+static bool zgc_mark_end(ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  bool minor_gc = gc->cycle.minor_gc;
+
+  // 3. Mark End (STW): drain what mutators logged but did not hand off
+  zgc_safepoint_begin();
+  zsatb_flush_all();
+  if (!zgc_mark_budget(budget)) {
+    zgc_safepoint_end();
+    return false;
+  }
+  zsatb_end_marking();
+
+  // Reference processing needs the final marks and no mutator reading a
+  // WeakRef meanwhile: one pass over the registries, callbacks run later
+  size_t weak_cleared, finalizers_queued;
+  zref_process(minor_gc, &weak_cleared, &finalizers_queued);
+  zprof_mark_end(minor_gc);
+  // Sweeps are about to reuse what dead bodies leave
+  atomic_store(&gc->mark_lines, false);
+  atomic_store(&gc->keep_handles, false);
+  if (gc->cycle.mark_region)
+    zremset_drop_dead();
+  ZPROBE3(mark__end, minor_gc, weak_cleared, finalizers_queued);
+
+  // 4. Relocate Start (STW)
+  zsafepoint_handshake(zgc_retire_tlab, NULL);
+  zgc_relocate_start(minor_gc, gc->cycle.freeze);
+  ZPROBE3(relocate__begin, minor_gc, gc->cycle.relocate_pages,
+          gc->cycle.relocate_live);
+  atomic_store(&zstate->phase, ZGC_PHASE_RELOCATE);
+  zgc_safepoint_end();
+
+  pthread_mutex_lock(&gc->stats_lock);
+  gc->stats.weak_cleared += weak_cleared;
+  gc->stats.finalizers_queued += finalizers_queued;
+  pthread_mutex_unlock(&gc->stats_lock);
+  return true;
+}
+
+// Heals a slot of a frozen body. Returns true if it refers to a mutable
+// body.
+static bool zgc_settle_child(ZBody *body, size_t index, void *arg) {
+  PyObject *slot = zbody_get_slot(body, index);
+  if (!zbody_is_ref(slot))
+    return false;
+  void *raw = zgc_remap(zbody_ref_target(slot));
+  PyObject *healed =
+      zbody_make_ref((ZBody *)Z_WITH_COLOR(raw, zstate->good_color));
+  if (healed != slot)
+    zbody_heal_slot(body, index, slot, healed);
+  return !zgc_is_unmarked_page(zheap_get_page(raw));
+}
+
+// Bodies copied into frozen pages still refer to where their children
+// were. Heal them all now, before any child forks, and dirty the cards of
+// those referring to mutable bodies.
+static bool zgc_settle_frozen(ZBody *body, void *arg) {
+  return zgc_for_each_ref(body, zgc_settle_child, NULL);
+}
+
+static void zgc_cycle_end(void) {
+  ZGCState *gc = zstate->gc;
+  zgc_relocate_wait();
+  if (gc->cycle.freeze) {
+    zcard_scan(true, false, zgc_settle_frozen, NULL);
+    atomic_store(&gc->relocate_frozen, false);
+  }
+  atomic_store(&zstate->phase, ZGC_PHASE_IDLE);
+  uint64_t end = zgc_clock_ns(CLOCK_MONOTONIC);
+  atomic_store(&gc->last_cycle_end, end);
+  uint64_t wall_ns = end - gc->cycle.wall_start;
+  ZPROBE3(relocate__end, gc->cycle.minor_gc, gc->cycle.relocate_pages,
+          gc->cycle.relocate_live);
+  ZPROBE3(cycle__end, gc->cycle.minor_gc, wall_ns, gc->cycle.cpu_ns);
+
+  pthread_mutex_lock(&gc->stats_lock);
+  gc->stats.cycles++;
+  if (gc->cycle.minor_gc)
+    gc->stats.minor_cycles++;
+  if (gc->cycle.freeze)
+    gc->stats.freezes++;
+  gc->stats.swept_pages += gc->cycle.swept_pages;
+  gc->stats.swept_free_bytes += gc->cycle.swept_free_bytes;
+  gc->stats.defrag_pages += gc->cycle.defrag_pages;
+  gc->stats.cpu_ns += gc->cycle.cpu_ns;
+  gc->stats.wall_ns += wall_ns;
+  pthread_mutex_unlock(&gc->stats_lock);
+
+  // Under memory pressure, give the pool and evacuated pages back right
+  // away
+  if (zgc_update_memory()) {
+    size_t released = zpool_drain() + zheap_release_pages();
+    pthread_mutex_lock(&gc->stats_lock);
+    gc->stats.pressure_cycles++;
+    gc->stats.released_bytes += released;
+    pthread_mutex_unlock(&gc->stats_lock);
+  }
+}
+
+// Runs the cycle in progress, or a new one, until it ends or the budget
+// runs out. Returns true if the cycle ended. Called with cycle_lock held.
+static bool zgc_step_locked(bool minor_gc, bool freeze, ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  if (gc->disabled)
+    return true;
+  uint64_t cpu_start = zgc_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+  if (atomic_load(&zstate->phase) == ZGC_PHASE_IDLE)
+    zgc_cycle_begin(minor_gc, freeze);
+
+  bool done = false;
+  if (atomic_load(&zstate->phase) == ZGC_PHASE_MARK) {
+    // 2. Concurrent Mark
+    // Roots are added manually via zgc_add_root, so we assume they are
+    // already in the mark stack.
+    if (!zgc_mark_budget(budget) || !zgc_scan_handles(budget) ||
+        !zgc_mark_budget(budget) || !zgc_mark_end(budget))
+      goto out;
+  }
+
+  // 5. Concurrent Sweep (mark-region cycles) and Relocate
+  done = zgc_sweep_budget(budget) && zgc_relocate_step(budget);
+
+out:
+  gc->cycle.cpu_ns += zgc_clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+  if (done)
+    zgc_cycle_end();
+  return done;
+}
+
+static bool zgc_step(bool minor_gc, ZGCBudget *budget) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->cycle_lock);
+  bool done = zgc_step_locked(minor_gc, false, budget);
+  pthread_mutex_unlock(&gc->cycle_lock);
+  return done;
+}
+
+// Finishes the cycle a budgeted step left open, if any
+static void zgc_finish_cycle(void) {
+  ZGCState *gc = zstate->gc;
+  if (atomic_load(&zstate->phase) != ZGC_PHASE_IDLE)
+    zgc_step_locked(gc->cycle.minor_gc, gc->cycle.freeze, NULL);
+}
+
+void zgc_run_cycle(void) {
+  // Full GC Cycle (or the rest of one started by zgc_run_cycle_step)
+  zgc_step(false, NULL);
 }
 
 void zgc_minor_cycle(void) {
-  // Minor GC Cycle
+  // Minor GC Cycle (Relocate Young pages only)
+  zgc_step(true, NULL);
+}
+
+bool zgc_run_cycle_step(uint64_t budget_ns) {
+  ZGCBudget budget = {0};
+  budget.deadline_ns = zgc_clock_ns(CLOCK_MONOTONIC) + budget_ns;
+  return zgc_step(false, &budget);
+}
+
+void zgc_freeze(void) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->cycle_lock);
+  zgc_finish_cycle();
+  zgc_step_locked(false, true, NULL);
+  pthread_mutex_unlock(&gc->cycle_lock);
+}
+
+// Hands a thawed body referring to young bodies to minor cycles
+static bool zgc_thaw_child(ZBody *body, size_t index, void *arg) {
+  PyObject *slot = zbody_get_slot(body, index);
+  return zbody_is_ref(slot) &&
+         zheap_is_young(zgc_remap(zbody_ref_target(slot)));
+}
+
+static bool zgc_thaw_body(ZBody *body, void *arg) {
+  if (zgc_for_each_ref(body, zgc_thaw_child, NULL))
+    zremset_add(Z_WITH_COLOR(body, zstate->good_color));
+  return false;
+}
+
+void zgc_unfreeze(void) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->cycle_lock);
+  zgc_finish_cycle();
+  zgc_safepoint_begin();
+  zcard_scan(false, false, zgc_thaw_body, NULL);
+  zheap_thaw();
+  zgc_safepoint_end();
+  pthread_mutex_unlock(&gc->cycle_lock);
+}
+
+void zgc_pause(void (*fn)(void *arg), void *arg) {
+  ZGCState *gc = zstate->gc;
+  // Steps take pauses of their own, which need the GIL
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&gc->cycle_lock);
+  Py_END_ALLOW_THREADS
+  zgc_safepoint_begin();
+  fn(arg);
+  zgc_safepoint_end();
+  pthread_mutex_unlock(&gc->cycle_lock);
+}
+
+// --- Mutator assists ---
+
+// The page pool is shared by every state
+static atomic_size_t pool_pages = ZPOOL_DEFAULT_PAGES;
+static atomic_bool pool_populate = false;
+
+void zgc_get_config(ZGCConfig *out) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->config_lock);
+  *out = gc->config;
+  pthread_mutex_unlock(&gc->config_lock);
+  out->page_pool = atomic_load(&pool_pages);
+  out->page_pool_populate = atomic_load(&pool_populate);
+}
 
-  // 0. Flip Good Color
-  if (zgc_good_color == ZPOINTER_MARKED0_BIT) {
-    zgc_good_color = ZPOINTER_MARKED1_BIT;
+void zgc_set_config(const ZGCConfig *in) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->config_lock);
+  gc->config = *in;
+  pthread_mutex_unlock(&gc->config_lock);
+  atomic_store(&pool_pages, in->page_pool);
+  atomic_store(&pool_populate, in->page_pool_populate);
+  zgc_update_memory();
+  zpool_configure(in->page_pool, in->page_pool_populate);
+}
+
+void zgc_assist(size_t alloc_bytes) {
+  ZGCState *gc = zstate->gc;
+  ZGCConfig cfg;
+  zgc_get_config(&cfg);
+  if (cfg.assist_ratio <= 0.0)
+    return;
+
+  uint64_t start = zgc_clock_ns(CLOCK_MONOTONIC);
+  ZGCBudget budget = {0};
+  budget.bytes = (size_t)((double)alloc_bytes * cfg.assist_ratio);
+  if (budget.bytes == 0)
+    budget.bytes = 1;
+  budget.deadline_ns = cfg.assist_max_ns ? start + cfg.assist_max_ns : 0;
+
+  // The phase can't move on while we work: with the GIL the pauses need it,
+  // and free-threaded mutators assist inside a safepoint section. Assists
+  // never drain SATB buffers or end a phase; the GC thread does that.
+  int phase = atomic_load(&zstate->phase);
+  if (phase == ZGC_PHASE_MARK) {
+    void *popped;
+    while ((popped = zmarkstack_pop(&gc->mark_stack)) != NULL) {
+      if (zgc_budget_spent(&budget, zgc_mark_entry(popped)))
+        break;
+    }
+  } else if (phase == ZGC_PHASE_RELOCATE) {
+    zgc_relocate_budget(&budget);
   } else {
-    zgc_good_color = ZPOINTER_MARKED0_BIT;
-  }
-  // printf("[ZGC] Minor Cycle Start. Good Color: %s\n",
-  //        (zgc_good_color == ZPOINTER_MARKED0_BIT) ? "Marked0" : "Marked1");
-
-  // 0.5 Clear Bitmaps (Only Young pages need clearing? Or all?)
-  // We need to mark Young objects.
-  // If we clear all bitmaps, we lose Old object marks.
-  // But Old objects are not candidates for collection in Minor GC.
-  // So we only care about marking Young objects.
-  // But tracing might go through Old objects.
-  // If Old objects are not marked, we might re-mark them?
-  // For simplicity, let's clear all bitmaps.
-  ZPage *p = zheap_get_head_page();
-  while (p) {
-    zpage_clear_bitmap(p);
-    p = p->next;
+    return;
   }
 
-  // 1. Mark Phase
-  // Add Remembered Set to Mark Stack
-  while (!zremset_is_empty()) {
-    void *obj = zremset_pop();
-    if (obj) {
-      zmarkstack_push(&mark_stack, obj);
-    }
+  uint64_t elapsed = zgc_clock_ns(CLOCK_MONOTONIC) - start;
+  pthread_mutex_lock(&gc->stats_lock);
+  gc->stats.assists++;
+  gc->stats.assist_ns += elapsed;
+  gc->stats.assist_bytes += budget.done;
+  if (elapsed > gc->stats.assist_max_ns)
+    gc->stats.assist_max_ns = elapsed;
+  pthread_mutex_unlock(&gc->stats_lock);
+}
+
+// --- Memory limits ---
+
+// Within this share of a cgroup limit counts as pressure
+#define ZGC_CGROUP_HEADROOM 0.9
+
+static size_t zgc_derive_limit(size_t configured, uint64_t limit,
+                               double share) {
+  if (configured || limit == ZCGROUP_UNLIMITED)
+    return configured;
+  size_t derived = (size_t)((double)limit * share);
+  return derived ? derived : 1;
+}
+
+bool zgc_update_memory(void) {
+  ZGCState *gc = zstate->gc;
+  ZGCConfig cfg;
+  zgc_get_config(&cfg);
+  ZGCMemory m = {0};
+  m.has_cgroup = zcgroup_read(&m.cgroup);
+  uint64_t cg_max = m.has_cgroup ? m.cgroup.max : ZCGROUP_UNLIMITED;
+  uint64_t cg_high = m.has_cgroup ? m.cgroup.high : ZCGROUP_UNLIMITED;
+
+  m.max_heap_bytes = zgc_derive_limit(cfg.max_heap_bytes, cg_max, 0.75);
+  m.soft_max_heap_bytes =
+      cg_high != ZCGROUP_UNLIMITED
+          ? zgc_derive_limit(cfg.soft_max_heap_bytes, cg_high, 0.75)
+          : zgc_derive_limit(cfg.soft_max_heap_bytes, cg_max, 0.5);
+  if (m.max_heap_bytes && m.soft_max_heap_bytes > m.max_heap_bytes)
+    m.soft_max_heap_bytes = m.max_heap_bytes;
+  atomic_store(&zstate->max_bytes, m.max_heap_bytes);
+  atomic_store(&zstate->soft_max_bytes, m.soft_max_heap_bytes);
+
+  m.committed_bytes = zheap_footprint();
+  uint64_t cg_limit = cg_high < cg_max ? cg_high : cg_max;
+  m.pressure =
+      (m.soft_max_heap_bytes && m.committed_bytes > m.soft_max_heap_bytes) ||
+      (cg_limit != ZCGROUP_UNLIMITED &&
+       (double)m.cgroup.current >= (double)cg_limit * ZGC_CGROUP_HEADROOM) ||
+      (m.has_cgroup && cfg.memory_pressure > 0.0 &&
+       m.cgroup.pressure >= cfg.memory_pressure);
+
+  pthread_mutex_lock(&gc->memory_lock);
+  gc->memory = m;
+  pthread_mutex_unlock(&gc->memory_lock);
+  return m.pressure;
+}
+
+void zgc_get_memory(ZGCMemory *out) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->memory_lock);
+  *out = gc->memory;
+  pthread_mutex_unlock(&gc->memory_lock);
+  out->committed_bytes = zheap_footprint();
+}
+
+// --- GC thread ---
+
+// Sleep between background cycles, and under memory pressure
+#define ZGC_INTERVAL_NS (100 * 1000 * 1000)
+#define ZGC_PRESSURE_INTERVAL_NS (10 * 1000 * 1000)
+
+// Time between background cycles. Under memory pressure, collect again
+// after a short break for the mutators.
+static uint64_t zgc_interval_ns(void) {
+  ZGCMemory m;
+  zgc_get_memory(&m);
+  return m.pressure ? ZGC_PRESSURE_INTERVAL_NS : ZGC_INTERVAL_NS;
+}
+
+static void zgc_wake_init(ZGCState *gc) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&gc->wake_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+void zgc_request_cycle(void) {
+  ZGCState *gc = zstate->gc;
+  pthread_mutex_lock(&gc->wake_lock);
+  gc->cycle_requested = true;
+  pthread_cond_signal(&gc->wake_cond);
+  pthread_mutex_unlock(&gc->wake_lock);
+}
+
+// Time until a cycle is due: one was requested, or the last one ended an
+// interval ago. Zero while one is open.
+uint64_t zgc_idle_due_ns(void) {
+  ZGCState *gc = zstate->gc;
+  if (gc->disabled)
+    return UINT64_MAX;
+  uint64_t now = zgc_clock_ns(CLOCK_MONOTONIC);
+  atomic_store(&gc->last_idle_poll, now);
+  if (atomic_load(&zstate->phase) != ZGC_PHASE_IDLE)
+    return 0;
+  pthread_mutex_lock(&gc->wake_lock);
+  bool requested = gc->cycle_requested;
+  pthread_mutex_unlock(&gc->wake_lock);
+  uint64_t since = now - atomic_load(&gc->last_cycle_end);
+  uint64_t interval = zgc_interval_ns();
+  return requested || since >= interval ? 0 : interval - since;
+}
+
+bool zgc_idle_step(uint64_t budget_ns) {
+  ZGCState *gc = zstate->gc;
+  // The GC thread holds the lock for a whole cycle; leave it to that
+  if (pthread_mutex_trylock(&gc->cycle_lock) != 0)
+    return false;
+  if (zgc_idle_due_ns() > 0) {
+    pthread_mutex_unlock(&gc->cycle_lock);
+    return false;
+  }
+  uint64_t start = zgc_clock_ns(CLOCK_MONOTONIC);
+  if (atomic_load(&zstate->phase) == ZGC_PHASE_IDLE) {
+    // Taking the request over from the GC thread
+    pthread_mutex_lock(&gc->wake_lock);
+    gc->cycle_requested = false;
+    pthread_mutex_unlock(&gc->wake_lock);
   }
+  ZGCBudget budget = {0};
+  budget.deadline_ns = start + budget_ns;
+  bool done = zgc_step_locked(false, false, &budget);
+  // Evacuated pages only hold dead bodies and forwarding tables: give
+  // their memory back while there is time
+  size_t released = done ? zheap_release_pages() : 0;
+  pthread_mutex_unlock(&gc->cycle_lock);
 
-  // Mark (Roots are already added by zgc_add_root or similar mechanism?
-  // In this prototype, roots are added manually via zgc_add_root.
-  // So we assume roots are in mark stack.)
-  zgc_mark();
+  pthread_mutex_lock(&gc->stats_lock);
+  gc->stats.idle_steps++;
+  gc->stats.idle_ns += zgc_clock_ns(CLOCK_MONOTONIC) - start;
+  if (done)
+    gc->stats.idle_cycles++;
+  gc->stats.released_bytes += released;
+  pthread_mutex_unlock(&gc->stats_lock);
+  return true;
+}
 
-  // 2. Relocate Phase (Minor only)
-  zgc_relocate(true);
+// Sleeps for up to timeout_ns, or until zgc_request_cycle or
+// zgc_stop_thread. Returns true if a cycle was requested.
+static bool zgc_wait(uint64_t timeout_ns) {
+  ZGCState *gc = zstate->gc;
+  uint64_t deadline = zgc_clock_ns(CLOCK_MONOTONIC) + timeout_ns;
+  struct timespec ts = {.tv_sec = (time_t)(deadline / 1000000000),
+                        .tv_nsec = (long)(deadline % 1000000000)};
+  pthread_mutex_lock(&gc->wake_lock);
+  while (!gc->cycle_requested && atomic_load(&gc->running)) {
+    if (pthread_cond_timedwait(&gc->wake_cond, &gc->wake_lock, &ts) != 0)
+      break;
+  }
+  bool requested = gc->cycle_requested;
+  gc->cycle_requested = false;
+  pthread_mutex_unlock(&gc->wake_lock);
+  return requested;
 }
 
 static void *zgc_thread_func(void *arg) {
-  zmarkstack_init(&mark_stack);
-
+  // Collects the heap of the state it was started for; pauses take that
+  // interpreter's GIL (zsafepoint_begin)
+  zstate = (ZState *)arg;
+  zstate_hold();
+  ZGCState *gc = zstate->gc;
   printf("[ZGC] Background Thread Started\n");
-  while (atomic_load(&gc_running)) {
-    zgc_run_cycle();
-
-    // Sleep
-    for (int i = 0; i < 1; i++) {
-      if (!atomic_load(&gc_running))
-        break;
-      usleep(100000); // 100ms sleep
+  bool requested = true;
+  while (atomic_load(&gc->running)) {
+    // Idle-time steps (zgc_idle_step) may have run the cycle that was due;
+    // then wait for the next one. While an event loop looks for idle time,
+    // it gets another interval to run the due cycle in, and we only step
+    // in when it stays busy.
+    uint64_t now = zgc_clock_ns(CLOCK_MONOTONIC);
+    uint64_t since = now - atomic_load(&gc->last_cycle_end);
+    uint64_t interval = zgc_interval_ns();
+    if (now - atomic_load(&gc->last_idle_poll) < interval)
+      interval *= 2;
+    if (requested || since >= interval) {
+      zgc_run_cycle();
+      since = 0;
+      interval = zgc_interval_ns();
     }
+    requested = zgc_wait(interval - since);
   }
   printf("[ZGC] Background Thread Stopped\n");
   return NULL;
 }
 
 void zgc_start_thread(void) {
-  if (atomic_load(&gc_running))
+  ZGCState *gc = zstate->gc;
+  if (atomic_load(&gc->running))
     return;
-  atomic_store(&gc_running, true);
-  pthread_create(&gc_thread, NULL, zgc_thread_func, NULL);
+  atomic_store(&gc->running, true);
+  pthread_create(&gc->thread, NULL, zgc_thread_func, zstate);
 }
 
 void zgc_stop_thread(void) {
-  if (!atomic_load(&gc_running))
+  ZGCState *gc = zstate->gc;
+  if (!atomic_load(&gc->running))
+    return;
+  atomic_store(&gc->running, false);
+  zgc_request_cycle();
+  pthread_join(gc->thread, NULL);
+}
+
+// --- fork() ---
+// os.fork() calls zgc_before_fork first (pyzgcmodule.c), which waits for
+// the cycle step in progress with the GIL let go: the GC thread may need it
+// for a pause. Forks that bypass os.fork() only get the pthread_atfork
+// handlers, which hold the GIL if the forking thread does and so can only
+// try for cycle_lock.
+//
+// Every module object registers the os.fork() hooks, so they may run more
+// than once per fork: only the first call takes the lock.
+
+void zgc_before_fork(void) {
+  ZGCState *gc = zstate->gc;
+  if (gc->fork_held)
     return;
-  atomic_store(&gc_running, false);
-  pthread_join(gc_thread, NULL);
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&gc->cycle_lock);
+  Py_END_ALLOW_THREADS
+  gc->fork_held = true;
+}
+
+void zgc_after_fork(bool child) {
+  ZGCState *gc = zstate->gc;
+  if (child) {
+    if (gc->fork_restart && !gc->disabled)
+      zgc_start_thread();
+    gc->fork_restart = false;
+  } else if (gc->fork_held) {
+    gc->fork_held = false;
+    pthread_mutex_unlock(&gc->cycle_lock);
+  }
+}
+
+void zgc_atfork(ZForkStage stage) {
+  ZGCState *gc = zstate->gc;
+  switch (stage) {
+  case ZFORK_PREPARE:
+    gc->fork_locked = false;
+    if (!gc->fork_held) {
+      if (!zstate_tstate()) {
+        pthread_mutex_lock(&gc->cycle_lock);
+        gc->fork_locked = true;
+      } else {
+        gc->fork_locked = pthread_mutex_trylock(&gc->cycle_lock) == 0;
+      }
+    }
+    gc->fork_quiet = gc->fork_held || gc->fork_locked;
+    pthread_mutex_lock(&gc->mark_stack.lock);
+    break;
+  case ZFORK_PARENT:
+    pthread_mutex_unlock(&gc->mark_stack.lock);
+    if (gc->fork_locked)
+      pthread_mutex_unlock(&gc->cycle_lock);
+    break;
+  case ZFORK_CHILD:
+    pthread_mutex_init(&gc->cycle_lock, NULL);
+    pthread_mutex_init(&gc->stats_lock, NULL);
+    pthread_mutex_init(&gc->config_lock, NULL);
+    pthread_mutex_init(&gc->memory_lock, NULL);
+    pthread_mutex_init(&gc->wake_lock, NULL);
+    pthread_mutex_init(&gc->mark_stack.lock, NULL);
+    zgc_wake_init(gc);
+    gc->cycle_requested = false;
+    gc->fork_held = false;
+    gc->fork_restart = atomic_load(&gc->running);
+    atomic_store(&gc->running, false);
+
+    // Pages being copied by threads that are gone are copied again, by
+    // whoever gets to them first. Objects they had copied without
+    // forwarding yet just leave a dead copy behind.
+    if (atomic_load(&zstate->phase) == ZGC_PHASE_RELOCATE) {
+      gc->cycle.relocate_page = NULL;
+      for (ZPage *page = zheap_get_head_page(); page; page = page->next) {
+        if (!atomic_load(&page->is_relocating))
+          continue;
+        pthread_mutex_init(&page->relocate_lock, NULL);
+        atomic_store(&page->relocate_claimed, false);
+      }
+    }
+
+    // A step was running: its marks and mark stack may be half done. Such
+    // a child keeps allocating, and moves bodies still waiting to be
+    // relocated when they are loaded, but never collects.
+    if (!gc->fork_quiet) {
+      gc->disabled = true;
+      zsatb_end_marking();
+      atomic_store(&zstate->phase, ZGC_PHASE_IDLE);
+    }
+    break;
+  }
 }
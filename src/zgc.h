@@ -1,13 +1,191 @@
 #ifndef ZGC_H
 #define ZGC_H
 
+#include "zcgroup.h"
+#include "zheap.h"
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+// A GC thread per state (zstate.h), which only collects that state's heap.
+// zgc_stop_thread joins it, so the caller must not hold the GIL.
 void zgc_start_thread(void);
 void zgc_stop_thread(void);
+
+bool zgc_state_init(ZState *state);
+// Drops the roots and the cycle left open (the GC thread has stopped)
+void zgc_state_close(ZState *state);
 void zgc_add_root(void *obj);
 bool zgc_check_marked(void *obj);
+
+// Cycles take short safepoints that need the GIL, so callers must NOT hold it.
+// Both finish a cycle that zgc_run_cycle_step left open instead of starting
+// a new one.
 void zgc_run_cycle(void);   // Manual Full GC cycle
 void zgc_minor_cycle(void); // Manual Minor GC cycle
+// Advances the open cycle, or starts a full one, for about budget_ns of
+// work. Returns true once the cycle has ended.
+bool zgc_run_cycle_step(uint64_t budget_ns);
+
+// Permanent generation (pyzgc.freeze). zgc_freeze runs a full cycle that
+// evacuates every live body into frozen pages, which later cycles neither
+// mark, trace through nor relocate, so that forked children keep sharing
+// them copy-on-write. Frozen bodies referring to mutable ones are found
+// through card tables (zcard.h). zgc_unfreeze turns frozen pages back into
+// old ones. Both finish an open cycle first, and are called without the
+// GIL like zgc_run_cycle.
+void zgc_freeze(void);
+void zgc_unfreeze(void);
+
+// Runs fn(arg) in a pause of its own, between cycle steps, so the phase
+// stays put meanwhile. Called with the GIL held (attached, on free-threaded
+// builds) and outside safepoint sections; the GIL is let go while a step
+// finishes.
+void zgc_pause(void (*fn)(void *arg), void *arg);
+
+// Calls fn on every root pushed for the next cycle (pyzgc.add_root), which
+// it may rewrite. Only in a pause while the collector is idle.
+void zgc_for_each_root(void (*fn)(void **root, void *arg), void *arg);
+
+// What the cycle in progress is doing (zstate->phase). Changes inside
+// pauses (except back to idle), so a mutator that sees MARK or RELOCATE
+// can help with it.
+enum { ZGC_PHASE_IDLE, ZGC_PHASE_MARK, ZGC_PHASE_RELOCATE };
+
+// Allocation-paced assists: a mutator refilling its TLAB while a cycle is
+// running marks or relocates about alloc_bytes * assist_ratio bytes, and
+// stops after assist_max_ns at the latest.
+void zgc_assist(size_t alloc_bytes);
+
+static inline void zgc_assist_poll(size_t alloc_bytes) {
+  if (atomic_load_explicit(&zstate->phase, memory_order_relaxed) !=
+      ZGC_PHASE_IDLE) {
+    zgc_assist(alloc_bytes);
+  }
+}
+
+// Old generation collectors (ZGCConfig.old_gen). Copying evacuates every
+// old page a full cycle can; mark-region only evacuates the sparsest
+// (ZGC_DEFRAG_LIVE_BYTES) and sweeps the others in place (zheap.h). Under
+// mark-region, minor cycles also keep what handles hold (zgc_scan_handles);
+// freezing cycles copy under both.
+enum { ZGC_OLD_GEN_COPYING, ZGC_OLD_GEN_MARK_REGION };
+
+// Old pages with less live data are evacuated by mark-region cycles
+#define ZGC_DEFRAG_LIVE_BYTES (ZPAGE_SIZE / 8)
+
+// Tunables (pyzgc.configure), per state but for the page pool, which is
+// shared
+//
+// Heap limits left at 0 come from the cgroup (zcgroup.h): max_heap_bytes is
+// 3/4 of memory.max, and soft_max_heap_bytes 3/4 of memory.high, or 1/2 of
+// memory.max without one. The rest stays for the interpreter and other
+// native memory. Without cgroup limits, the heap is unlimited.
+typedef struct {
+  double assist_ratio;        // Work bytes per allocated byte; 0 disables
+  uint64_t assist_max_ns;     // Time cap per assist; 0 for none
+  size_t max_heap_bytes;      // See zstate->max_bytes; 0 derives it
+  size_t soft_max_heap_bytes; // See zstate->soft_max_bytes; 0 derives it
+  double memory_pressure;     // PSI "some avg10" (%) that is pressure; 0 off
+  size_t page_pool;           // Ready pages to keep (zpool.h); 0 is off
+  bool page_pool_populate;    // Pre-fault pool pages with MAP_POPULATE
+  int old_gen;                // ZGC_OLD_GEN_*, from the next cycle on
+} ZGCConfig;
+
+void zgc_get_config(ZGCConfig *out);
+// Also recomputes the heap limits
+void zgc_set_config(const ZGCConfig *in);
+
+// Memory pressure: the heap is past its soft max, the cgroup is within 10%
+// of memory.high or memory.max, or PSI is at memory_pressure. The end of
+// every cycle checks for it; under pressure, evacuated pages are released
+// (zheap_release_pages) and the GC thread collects again right away.
+typedef struct {
+  size_t committed_bytes;     // zheap_footprint
+  size_t max_heap_bytes;      // In effect; 0 for none
+  size_t soft_max_heap_bytes; // In effect; 0 for none
+  bool pressure;              // As of the last check
+  bool has_cgroup;            // cgroup holds the last reading
+  ZCgroupMemory cgroup;
+} ZGCMemory;
+
+// Reads the cgroup, recomputes the limits and checks for pressure
+// (returned)
+bool zgc_update_memory(void);
+void zgc_get_memory(ZGCMemory *out);
+
+// Wakes the GC thread for a cycle now instead of after its sleep
+void zgc_request_cycle(void);
+
+// Idle-time collection (pyzgc.asyncio). zgc_idle_due_ns is how long until
+// a cycle is due (requested, or the GC thread's interval since the last
+// one is over), 0 while one is open. zgc_idle_step then advances it for
+// about budget_ns, and gives evacuated pages back once it ends. It returns
+// false at once if the GC thread is running a step or nothing is due. The
+// GC thread skips the cycles idle steps have run, and while a loop polls
+// for idle work, waits another interval before it takes a due cycle over.
+// Called without the GIL, like zgc_run_cycle.
+uint64_t zgc_idle_due_ns(void);
+bool zgc_idle_step(uint64_t budget_ns);
+
+// Collector totals since startup
+typedef struct {
+  uint64_t cycles;       // Completed cycles (full + minor)
+  uint64_t minor_cycles; // Completed minor cycles
+  uint64_t cpu_ns;       // CPU time spent in cycles (GC thread or caller)
+  uint64_t wall_ns;      // Wall time from cycle start to end
+  uint64_t weak_cleared; // pyzgc.WeakRefs cleared (see zref.h)
+  uint64_t finalizers_queued; // pyzgc.finalize callbacks queued
+  uint64_t assists;       // Mutator assists (see zgc_assist)
+  uint64_t assist_ns;     // Time mutators spent assisting
+  uint64_t assist_max_ns; // Longest single assist
+  uint64_t assist_bytes;  // Bytes marked or relocated by assists
+  uint64_t pressure_cycles; // Cycles that ended under memory pressure
+  uint64_t released_bytes;  // Page memory given back to the OS
+  uint64_t freezes;         // zgc_freeze cycles
+  uint64_t cards_scanned;   // Dirty cards visited at mark start
+  uint64_t idle_steps;      // zgc_idle_step calls that did work
+  uint64_t idle_cycles;     // Cycles that ended in an idle step
+  uint64_t idle_ns;         // Time spent in idle steps
+  uint64_t swept_pages;     // Old pages swept by mark-region cycles
+  uint64_t swept_free_bytes; // Room they had for old bodies afterwards
+  uint64_t defrag_pages;    // Old pages mark-region cycles evacuated
+} ZGCStats;
+
+void zgc_get_stats(ZGCStats *out);
+
+// Stop-the-world section. Returns once every mutator is stopped.
+void zgc_safepoint_begin(void);
+void zgc_safepoint_end(void);
+
+// Current (uncolored) location of a body that may have been relocated by
+// an earlier cycle.
+void *zgc_remap(void *body);
+
+// Called when a body gets a new handle or loses its last one, inside a
+// safepoint section, so that marking keeps it (see zgc_scan_handles). A new
+// handle is held by its caller, so the body is kept strongly.
+void zgc_note_handle(void *body, bool held);
+
+// Relocation slow path shared by the GC thread and the load barrier.
+// Returns the new (uncolored) address, or NULL if obj stays in place.
+void *zgc_relocate_object(ZPage *page, void *obj);
+
+// os.fork() hooks, with the GIL held, run for each state in turn.
+// zgc_before_fork waits for the cycle step in progress and keeps the next
+// from starting until zgc_after_fork; in the child, that restarts the GC
+// thread if it was running.
+void zgc_before_fork(void);
+void zgc_after_fork(bool child);
+// cycle_lock and the mark stack across fork() (zfork.h). A child forked
+// while a step was running (bypassing os.fork) never collects.
+void zgc_atfork(ZForkStage stage);
+
+// Cycle kernels, exposed for the C microbenchmarks (benchmarks/zbench.c).
+// Only call them while no cycle is running.
+// Drains the mark stack (and SATB buffers) marking everything reachable.
+void zgc_mark(void);
+// Copies every marked object of a page that is in the relocation set.
+void zgc_relocate_page(ZPage *page);
 
 #endif
@@ -1,17 +1,52 @@
+#include <Python.h>
 #include "zheap.h"
+#include "zarray.h"
+#include "zcard.h"
+#include "zgc.h"
+#include "zpool.h"
+#include "zprobe.h"
+#include "zprof.h"
+#include "zregion.h"
+#include "zsafepoint.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
-static ZPage *current_young_page = NULL;
-static ZPage *current_old_page = NULL;
-static ZPage *head_page = NULL;
-static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+// Per-interpreter part (zstate.h)
+typedef struct ZHeapState {
+  ZPage *current_young_page;
+  ZPage *current_old_page;
+  ZPage *current_frozen_page;
+  ZPage *head_page;
+  pthread_mutex_t heap_lock;
+
+  // Mark-region old generation: swept pages with room, and the hole of
+  // current_old_page being filled (empty when hole_top == hole_end)
+  ZPage *recyclable;
+  uintptr_t hole_top;
+  uintptr_t hole_end;
+
+  // Remembered Set
+  ZRememberedSet remset;
+  pthread_mutex_t remset_lock;
+} ZHeapState;
 
-// Global Good Color (starts as Marked0)
-uintptr_t zgc_good_color = ZPOINTER_MARKED0_BIT;
+bool zheap_state_init(ZState *state) {
+  ZHeapState *heap = (ZHeapState *)calloc(1, sizeof(ZHeapState));
+  if (!heap)
+    return false;
+  pthread_mutex_init(&heap->heap_lock, NULL);
+  pthread_mutex_init(&heap->remset_lock, NULL);
+  state->heap = heap;
+  return true;
+}
 
 // NUMA Helper (Stub)
 // In a real implementation, this would use getcpu() or libnuma.
@@ -19,37 +54,108 @@ int zos_get_current_numa_node(void) {
   return 0; // Default to node 0
 }
 
-// Thread-Local Allocation Buffer (Only for Young Gen)
+// Thread-Local Allocation Buffer (Only for Young Gen), of the state the
+// thread is attached to
 __thread ZTLAB zheap_tlab = {0, 0};
 
-// Remembered Set
-static ZRememberedSet remset = {NULL, 0, 0};
-static pthread_mutex_t remset_lock = PTHREAD_MUTEX_INITIALIZER;
+ZRegion *zheap_current_region(void) {
+  return zthread ? zthread->region : NULL;
+}
 
-static ZPage *zpage_create(uint8_t generation) {
+// Allocation sampling (zprof.h). zheap_tlab.end is pulled in to the next
+// sample point; the thread's tlab_limit is where the TLAB really ends.
+// sample_left counts the bytes from sample_base (a TLAB top) to that
+// point, and is SIZE_MAX while the profiler is off.
+static void zheap_set_sample_point(ZThread *thread) {
+  thread->sample_base = zheap_tlab.top;
+  zheap_tlab.end = thread->sample_left < thread->tlab_limit -
+                                             thread->sample_base
+                       ? thread->sample_base + thread->sample_left
+                       : thread->tlab_limit;
+}
+
+static size_t zheap_release_pages_locked(void);
+
+size_t zheap_footprint(void) {
+  return atomic_load(&zstate->committed_bytes) + zpool_bytes();
+}
+
+bool zheap_charge(size_t bytes, bool limited) {
+  size_t committed =
+      atomic_fetch_add(&zstate->committed_bytes, bytes) + bytes +
+      zpool_bytes();
+  size_t soft_max = atomic_load(&zstate->soft_max_bytes);
+  if (soft_max && committed > soft_max && committed - bytes <= soft_max)
+    zgc_request_cycle();
+
+  size_t max = atomic_load(&zstate->max_bytes);
+  if (!limited || !max || committed <= max)
+    return true;
+  zpool_drain();
+  zheap_release_pages_locked();
+  if (zheap_footprint() <= max)
+    return true;
+  atomic_fetch_sub(&zstate->committed_bytes, bytes);
+  zgc_request_cycle();
+  return false;
+}
+
+static ZPage *zpage_init(void *mem, uint8_t generation);
+
+ZPage *zpage_map(bool populate) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
 // Try Huge Pages first (Linux specific, usually 2MB)
 #ifdef MAP_HUGETLB
-  void *raw_mem = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE,
-                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
-  if (raw_mem == MAP_FAILED) {
+  char *raw = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE,
+                   flags | MAP_HUGETLB, -1, 0);
+  if (raw == MAP_FAILED) {
     // Fallback to standard pages
-    raw_mem = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    raw = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
   }
 #else
-  void *raw_mem = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  char *raw = mmap(NULL, 2 * ZPAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
 #endif
 
-  if (raw_mem == MAP_FAILED) {
+  if (raw == MAP_FAILED) {
     perror("mmap failed");
     return NULL;
   }
 
-  uintptr_t aligned_addr =
-      ((uintptr_t)raw_mem + ZPAGE_SIZE - 1) & ~(ZPAGE_SIZE - 1);
-  void *mem = (void *)aligned_addr;
+  // Give the slack around the aligned page back, so that the page can be
+  // unmapped on its own (zpool_drain)
+  char *mem = (char *)(((uintptr_t)raw + ZPAGE_SIZE - 1) &
+                       ~(uintptr_t)(ZPAGE_SIZE - 1));
+  if (mem > raw)
+    munmap(raw, mem - raw);
+  if (raw + ZPAGE_SIZE > mem)
+    munmap(mem + ZPAGE_SIZE, (raw + ZPAGE_SIZE) - mem);
+
+  return zpage_init(mem, ZGEN_YOUNG);
+}
 
+static ZPage *zpage_create(uint8_t generation) {
+  // A pool page already counted towards the limits. It is charged before
+  // it leaves the pool, so that the footprint never dips below the heap's
+  // for the filler to fill in.
+  zheap_charge(ZPAGE_SIZE, false);
+  ZPage *page = zpool_take();
+  if (!page) {
+    atomic_fetch_sub(&zstate->committed_bytes, ZPAGE_SIZE);
+    if (!zheap_charge(ZPAGE_SIZE, generation == ZGEN_YOUNG))
+      return NULL;
+    page = zpage_map(false);
+    if (!page) {
+      atomic_fetch_sub(&zstate->committed_bytes, ZPAGE_SIZE);
+      return NULL;
+    }
+  }
+  page->generation = generation;
+  page->numa_node = zos_get_current_numa_node();
+  ZPROBE4(page__create, page, ZPAGE_SIZE, generation, page->numa_node);
+  return page;
+}
+
+static ZPage *zpage_init(void *mem, uint8_t generation) {
   // Embed ZPage metadata at the start of the page
   ZPage *page = (ZPage *)mem;
 
@@ -59,64 +165,619 @@ static ZPage *zpage_create(uint8_t generation) {
   page->end = page->start + ZPAGE_SIZE;
   page->next = NULL;
   page->live_bytes = 0;
+  page->mark_top = page->top;
   memset(page->mark_bitmap, 0, ZBITMAP_SIZE);
+  page->finalizable_bitmap = NULL;
 
   page->is_evacuating = false;
+  atomic_init(&page->is_relocating, false);
+  atomic_init(&page->relocate_claimed, false);
+  pthread_mutex_init(&page->relocate_lock, NULL);
   page->generation = generation;
   page->forwarding_table.entries = NULL;
   page->forwarding_table.count = 0;
   page->forwarding_table.capacity = 0;
 
   page->numa_node = zos_get_current_numa_node();
+  page->is_immortal = false;
+  page->image = NULL;
+  page->is_large = false;
+  atomic_init(&page->pin_count, 0);
+  atomic_init(&page->relocate_failed, false);
+  atomic_init(&page->is_released, false);
+  page->region = NULL;
+  page->is_frozen = false;
+  page->ncards = 0;
+  page->cards = NULL;
+  page->card_first = NULL;
+  atomic_init(&page->cards_dirty, false);
+  memset(page->line_bitmap, 0, ZLINE_BITMAP_SIZE);
+  atomic_init(&page->sweep_pending, false);
+  page->holes = 0;
+  page->next_recyclable = NULL;
+  page->ntlabs = 0;
 
   return page;
 }
 
+void *zheap_alloc_large(size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  size_t header = (sizeof(ZPage) + 7) & ~(size_t)7;
+  size_t span = (header + size + ZPAGE_SIZE - 1) & ~(size_t)(ZPAGE_SIZE - 1);
+
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  bool charged = zheap_charge(span, true);
+  pthread_mutex_unlock(&heap->heap_lock);
+  if (!charged)
+    return NULL;
+
+  // Over-map by one page for alignment, then give the slack back
+  char *raw = mmap(NULL, span + ZPAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    atomic_fetch_sub(&zstate->committed_bytes, span);
+    return NULL;
+  }
+  char *mem = (char *)(((uintptr_t)raw + ZPAGE_SIZE - 1) &
+                       ~(uintptr_t)(ZPAGE_SIZE - 1));
+  if (mem > raw)
+    munmap(raw, mem - raw);
+  if (raw + ZPAGE_SIZE > mem)
+    munmap(mem + span, (raw + ZPAGE_SIZE) - mem);
+
+  ZPage *page = zpage_init(mem, ZGEN_OLD);
+  page->end = page->start + span;
+  page->is_large = true;
+  ZPROBE4(page__create, page, span, page->generation, page->numa_node);
+  void *obj = (void *)page->top;
+  page->top += size;
+
+  pthread_mutex_lock(&heap->heap_lock);
+  page->next = heap->head_page;
+  heap->head_page = page;
+  pthread_mutex_unlock(&heap->heap_lock);
+  return Z_WITH_COLOR(obj, zstate->good_color);
+}
+
+// Region pages are unlinked when their region ends, so this walks the list
+// under heap_lock (which zheap_charge already holds). Cycles keep what
+// handles hold, so an evacuated page only has bodies nothing reads, unless
+// a raw pointer into it is still out.
+static size_t zheap_release_pages_locked(void) {
+  ZHeapState *heap = zstate->heap;
+  uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  size_t released = 0;
+  for (ZPage *page = heap->head_page; page; page = page->next) {
+    if (!page->is_evacuating || atomic_load(&page->is_relocating) ||
+        atomic_load(&page->relocate_failed) ||
+        atomic_load(&page->pin_count) > 0 || page->is_immortal ||
+        page->is_large || page == heap->current_young_page ||
+        page == heap->current_old_page || atomic_load(&page->is_released))
+      continue;
+    if (atomic_exchange(&page->is_released, true))
+      continue;
+    uintptr_t from = (page->start + sizeof(ZPage) + os_page - 1) &
+                     ~(os_page - 1);
+    // Fails on huge pages, which can't be released in part
+    if (madvise((void *)from, page->end - from, MADV_DONTNEED) != 0) {
+      atomic_store(&page->is_released, false);
+      continue;
+    }
+    atomic_fetch_sub(&zstate->committed_bytes, page->end - from);
+    released += page->end - from;
+  }
+  return released;
+}
+
+size_t zheap_release_large(void *body) {
+  ZPage *page = zheap_get_page(Z_ADDRESS(body));
+  if (!page || !page->is_large || page->is_frozen ||
+      atomic_load(&page->pin_count) > 0 ||
+      atomic_exchange(&page->is_released, true))
+    return 0;
+  uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t from = (page->start + sizeof(ZPage) + os_page - 1) &
+                   ~(os_page - 1);
+  if (madvise((void *)from, page->end - from, MADV_DONTNEED) != 0) {
+    atomic_store(&page->is_released, false);
+    return 0;
+  }
+  atomic_fetch_sub(&zstate->committed_bytes, page->end - from);
+  return page->end - from;
+}
+
+size_t zheap_release_pages(void) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  size_t released = zheap_release_pages_locked();
+  pthread_mutex_unlock(&heap->heap_lock);
+  return released;
+}
+
+bool zheap_release_evacuated(size_t *released) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  *released = zheap_release_pages_locked();
+  bool all = true;
+  for (ZPage *page = heap->head_page; page && all; page = page->next)
+    all = !page->is_evacuating || atomic_load(&page->is_released);
+  pthread_mutex_unlock(&heap->heap_lock);
+  return all;
+}
+
+void zheap_enter_region(ZRegion *region) {
+  zheap_tlab.top = zheap_tlab.end = 0;
+  zsafepoint_register_thread()->region = region;
+}
+
+void zheap_leave_region(void) {
+  ZRegion *region = zheap_current_region();
+  if (!region)
+    return;
+  if (region->npages && zheap_tlab.end != 0)
+    region->pages[region->npages - 1]->top = zheap_tlab.top;
+  zheap_tlab.top = zheap_tlab.end = 0;
+  zthread->region = NULL;
+}
+
+void zheap_unlink_region(ZRegion *region) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  ZPage **link = &heap->head_page;
+  while (*link) {
+    if ((*link)->region == region)
+      *link = (*link)->next;
+    else
+      link = &(*link)->next;
+  }
+  pthread_mutex_unlock(&heap->heap_lock);
+}
+
+void zpage_recycle(ZPage *page) {
+  free(page->forwarding_table.entries);
+  free(page->finalizable_bitmap);
+  pthread_mutex_destroy(&page->relocate_lock);
+  // Allocation relies on fresh pages reading as zeros
+  uintptr_t from = (page->start + sizeof(ZPage) + 7) & ~(uintptr_t)7;
+  memset((void *)from, 0, page->top - from);
+  zpage_init(page, ZGEN_YOUNG);
+  // Pooled, the page counts towards the limits of every heap instead
+  atomic_fetch_sub(&zstate->committed_bytes, ZPAGE_SIZE);
+  if (!zpool_put(page))
+    munmap(page, ZPAGE_SIZE);
+}
+
+void *zheap_alloc_frozen(size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  ZPage *page = heap->current_frozen_page;
+  if (!page || page->top + size > page->end) {
+    // Unlimited like the old generation, so that freezing can finish
+    page = zpage_create(ZGEN_OLD);
+    if (page && !zcard_init(page, page->end)) {
+      zpage_recycle(page);
+      page = NULL;
+    }
+    if (!page) {
+      pthread_mutex_unlock(&heap->heap_lock);
+      return NULL;
+    }
+    page->is_frozen = true;
+    page->next = heap->head_page;
+    heap->head_page = page;
+    heap->current_frozen_page = page;
+  }
+  void *ptr = (void *)page->top;
+  page->top += size;
+  zcard_record(page, ptr);
+  pthread_mutex_unlock(&heap->heap_lock);
+  atomic_fetch_add(&zstate->frozen_bytes, size);
+  return Z_WITH_COLOR(ptr, zstate->good_color);
+}
+
+void zheap_retire_current_pages(void) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  ZPage *young = heap->current_young_page;
+  ZPage *page = young ? zpage_create(ZGEN_YOUNG) : NULL;
+  if (page) {
+    page->next = young->next;
+    young->next = page;
+    heap->current_young_page = page;
+  }
+  heap->current_old_page = NULL;
+  heap->hole_top = heap->hole_end = 0;
+  pthread_mutex_unlock(&heap->heap_lock);
+}
+
+bool zheap_freeze_large(ZPage *page) {
+  uintptr_t body = (page->start + sizeof(ZPage) + 7) & ~(uintptr_t)7;
+  if (!zcard_init(page, body + 1))
+    return false;
+  zcard_record(page, (void *)body);
+  page->is_frozen = true;
+  atomic_fetch_add(&zstate->frozen_bytes, page->top - body);
+  return true;
+}
+
+void zheap_thaw(void) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  for (ZPage *page = heap->head_page; page; page = page->next) {
+    if (!page->is_frozen)
+      continue;
+    zcard_free(page);
+    page->is_frozen = false;
+  }
+  heap->current_frozen_page = NULL;
+  atomic_store(&zstate->frozen_bytes, 0);
+  pthread_mutex_unlock(&heap->heap_lock);
+}
+
+void zpage_pin(ZPage *page) {
+  atomic_fetch_add(&page->pin_count, 1);
+}
+
+void zpage_unpin(ZPage *page) {
+  atomic_fetch_sub(&page->pin_count, 1);
+}
+
+ZPage *zheap_adopt_page(void *mem, uintptr_t top, struct ZImage *image,
+                        uint8_t generation) {
+  ZPage *page = zpage_init(mem, generation);
+  page->top = top;
+  page->is_immortal = true;
+  page->image = image;
+
+  // Prepend like old pages so the young allocation page stays last
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  page->next = heap->head_page;
+  heap->head_page = page;
+  pthread_mutex_unlock(&heap->heap_lock);
+  return page;
+}
+
 void zheap_init(void) {
-  pthread_mutex_lock(&heap_lock);
-  if (!current_young_page) {
-    current_young_page = zpage_create(ZGEN_YOUNG);
-    head_page = current_young_page;
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  if (!heap->current_young_page) {
+    heap->current_young_page = zpage_create(ZGEN_YOUNG);
+    heap->head_page = heap->current_young_page;
+  }
+  pthread_mutex_unlock(&heap->heap_lock);
+}
+
+void zheap_state_close(ZState *state) {
+  ZHeapState *heap = state->heap;
+  uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  pthread_mutex_lock(&heap->heap_lock);
+  for (ZPage *page = heap->head_page; page; page = page->next) {
+    if (page->is_immortal || atomic_exchange(&page->is_released, true))
+      continue;
+    uintptr_t from = (page->start + sizeof(ZPage) + os_page - 1) &
+                     ~(os_page - 1);
+    madvise((void *)from, page->end - from, MADV_DONTNEED);
+  }
+  heap->current_young_page = NULL;
+  heap->current_old_page = NULL;
+  heap->current_frozen_page = NULL;
+  heap->recyclable = NULL;
+  heap->hole_top = heap->hole_end = 0;
+  atomic_store(&state->committed_bytes, 0);
+  atomic_store(&state->frozen_bytes, 0);
+  pthread_mutex_unlock(&heap->heap_lock);
+
+  pthread_mutex_lock(&heap->remset_lock);
+  free(heap->remset.items);
+  heap->remset = (ZRememberedSet){NULL, 0, 0};
+  pthread_mutex_unlock(&heap->remset_lock);
+}
+
+// The current young page, or a new one if alloc_size doesn't fit. Called
+// with heap_lock held.
+static ZPage *zheap_young_page(size_t alloc_size) {
+  ZHeapState *heap = zstate->heap;
+  if (!heap->current_young_page) {
+    heap->current_young_page = zpage_create(ZGEN_YOUNG);
+    heap->head_page = heap->current_young_page;
+    if (!heap->current_young_page)
+      return NULL;
   }
-  pthread_mutex_unlock(&heap_lock);
+
+  ZPage *page = heap->current_young_page;
+  if (page->top + alloc_size > page->end) {
+    ZPage *new_page = zpage_create(ZGEN_YOUNG);
+    if (!new_page)
+      return NULL;
+    // Append to list
+    page->next = new_page;
+    heap->current_young_page = new_page;
+  }
+  return heap->current_young_page;
+}
+
+// A region TLAB runs from the top of the region's last page to its end,
+// and the page's top only catches up with it at the next refill (or
+// zheap_leave_region). So bodies follow one another without gaps up to the
+// top of every region page, and the region can walk them when it ends.
+// Called with heap_lock held.
+static ZPage *zheap_region_page(ZRegion *region, size_t alloc_size) {
+  ZPage *page = region->npages ? region->pages[region->npages - 1] : NULL;
+  // The TLAB is on this page unless the region has just been entered
+  // (handshakes leave region TLABs alone)
+  if (page && zheap_tlab.end != 0)
+    page->top = zheap_tlab.top;
+  if (page && page->top + alloc_size <= page->end)
+    return page;
+
+  if (region->npages == region->capacity) {
+    size_t capacity = region->capacity ? region->capacity * 2 : 8;
+    ZPage **pages =
+        (ZPage **)realloc(region->pages, capacity * sizeof(ZPage *));
+    if (!pages)
+      return NULL;
+    region->pages = pages;
+    region->capacity = capacity;
+  }
+  page = zpage_create(ZGEN_YOUNG);
+  if (!page)
+    return NULL;
+  page->region = region;
+  // Prepend like old pages so the young allocation page stays last
+  page->next = zstate->heap->head_page;
+  zstate->heap->head_page = page;
+  region->pages[region->npages++] = page;
+  return page;
 }
 
 // Refill TLAB from global heap (Young Gen)
 static bool zheap_refill_tlab(size_t size) {
-  pthread_mutex_lock(&heap_lock);
+  // The heap of a closed state gave its memory back
+  if (zstate->closed)
+    return false;
+  // A TLAB holding it would run past the end of its page
+  if (size > ZPAGE_CAPACITY)
+    return false;
+  // Safepoint poll: we hold no body pointers here
+  ZThread *thread = zsafepoint_register_thread();
+  zsafepoint_poll();
 
-  if (!current_young_page) {
-    current_young_page = zpage_create(ZGEN_YOUNG);
-    head_page = current_young_page;
-    if (!current_young_page) {
-      pthread_mutex_unlock(&heap_lock);
-      return false;
-    }
-  }
+  // Pay for the new TLAB with GC work while a cycle is running, so a fast
+  // allocator can't outrun the collector. Not under heap_lock: relocation
+  // allocates.
+  size_t tlab_size = size > ZTLAB_SIZE ? size : ZTLAB_SIZE;
+  zgc_assist_poll(tlab_size);
 
   size_t alloc_size = (size > ZTLAB_SIZE) ? size : ZTLAB_SIZE;
   alloc_size = (alloc_size + 7) & ~7;
 
-  if (current_young_page->top + alloc_size > current_young_page->end) {
-    ZPage *new_page = zpage_create(ZGEN_YOUNG);
-    if (!new_page) {
-      pthread_mutex_unlock(&heap_lock);
-      return false;
-    }
-    // Append to list
-    current_young_page->next = new_page;
-    current_young_page = new_page;
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+
+  ZPage *page;
+  uintptr_t limit;
+  if (thread->region) {
+    page = zheap_region_page(thread->region, alloc_size);
+    limit = page ? page->end : 0;
+  } else {
+    page = zheap_young_page(alloc_size);
+    limit = page ? page->top + alloc_size : 0;
   }
+  if (!page) {
+    pthread_mutex_unlock(&heap->heap_lock);
+    return false;
+  }
+
+  // Carry the distance to the next sample point over. A TLAB retired by a
+  // handshake (end == 0) lost count; the point then moves a little.
+  if (zheap_tlab.end != 0 && thread->sample_left != SIZE_MAX)
+    thread->sample_left -= zheap_tlab.top - thread->sample_base;
+  if (thread->sample_left == SIZE_MAX)
+    thread->sample_left = zprof_next_interval();
 
-  zheap_tlab.top = current_young_page->top;
-  zheap_tlab.end = current_young_page->top + alloc_size;
+  zheap_tlab.top = page->top;
+  thread->tlab_limit = limit;
+  zheap_set_sample_point(thread);
 
-  current_young_page->top += alloc_size;
+  // Region pages are filled up to the TLAB top (see zheap_region_page)
+  if (!thread->region) {
+    page->tlab_starts[page->ntlabs++] = (uint32_t)(page->top - page->start);
+    page->top = limit;
+  }
+  ZPROBE2(tlab__refill, limit - zheap_tlab.top, page);
 
-  pthread_mutex_unlock(&heap_lock);
+  pthread_mutex_unlock(&heap->heap_lock);
   return true;
 }
 
+// Allocates across the sample point the TLAB end was pulled in to, or
+// returns NULL if the allocation does not fit in the TLAB at all
+static void *zheap_alloc_sampled(size_t size) {
+  ZThread *thread = zthread;
+  if (!thread || zheap_tlab.end == 0 ||
+      zheap_tlab.end == thread->tlab_limit ||
+      zheap_tlab.top + size > thread->tlab_limit)
+    return NULL;
+  void *ptr = (void *)zheap_tlab.top;
+  zheap_tlab.top += size;
+  thread->sample_left = zprof_next_interval();
+  zheap_set_sample_point(thread);
+  zprof_sample(ptr, size);
+  return Z_WITH_COLOR(ptr, zstate->good_color);
+}
+
+// Dead bodies covering [from, to), at least ZFILLER_MIN_SIZE bytes: a U8
+// array with no handle
+#define ZFILLER_MIN_SIZE (ZARRAY_HEADER_SIZE + sizeof(PyObject *))
+
+static void zheap_fill(uintptr_t from, uintptr_t to) {
+  // Fills never cross into the next page (large pages get none)
+  uintptr_t page_end = (from & ~(uintptr_t)(ZPAGE_SIZE - 1)) + ZPAGE_SIZE;
+  if (to > page_end || to - from < ZFILLER_MIN_SIZE)
+    return;
+  uint64_t length = to - from - ZFILLER_MIN_SIZE;
+  *(uint64_t *)from = (length << 8) | (ZARRAY_U8 << 3) | ZARRAY_TAG;
+  *(PyObject **)(to - sizeof(PyObject *)) = NULL;
+}
+
+// Fills what is left of the current hole and moves on to the next one of
+// current_old_page, if any. Called with heap_lock held.
+static void zheap_next_hole(void) {
+  ZHeapState *heap = zstate->heap;
+  if (heap->hole_top < heap->hole_end)
+    zheap_fill(heap->hole_top, heap->hole_end);
+  heap->hole_top = heap->hole_end = 0;
+  ZPage *page = heap->current_old_page;
+  if (page && page->holes) {
+    uintptr_t hole = page->holes;
+    page->holes = ((uintptr_t *)hole)[1];
+    heap->hole_top = hole;
+    heap->hole_end = hole + zbody_size((ZBody *)hole);
+  }
+}
+
+// Old bodies go into the holes of the current old page, then after its
+// top, then on to the next recyclable page or a fresh one. Called with
+// heap_lock held.
+static void *zheap_alloc_old(size_t size) {
+  ZHeapState *heap = zstate->heap;
+  for (;;) {
+    ZPage *page = heap->current_old_page;
+    if (heap->hole_top < heap->hole_end) {
+      // Never leave a gap too small for a filler
+      size_t left = heap->hole_end - heap->hole_top;
+      if (size == left || size + ZFILLER_MIN_SIZE <= left) {
+        void *ptr = (void *)heap->hole_top;
+        heap->hole_top += size;
+        return ptr;
+      }
+      zheap_next_hole();
+      continue;
+    }
+    // The last hole was filled exactly
+    if (page && page->holes) {
+      zheap_next_hole();
+      continue;
+    }
+    if (page && page->top + size <= page->end) {
+      void *ptr = (void *)page->top;
+      page->top += size;
+      return ptr;
+    }
+
+    if (heap->recyclable) {
+      page = heap->recyclable;
+      heap->recyclable = page->next_recyclable;
+      page->next_recyclable = NULL;
+      heap->current_old_page = page;
+      zheap_next_hole();
+      continue;
+    }
+    page = zpage_create(ZGEN_OLD);
+    if (!page)
+      return NULL;
+    // Prepended, so the young allocation page stays last
+    page->next = heap->head_page;
+    heap->head_page = page;
+    heap->current_old_page = page;
+    if (page->top + size > page->end)
+      return NULL; // Larger than a page
+  }
+}
+
+size_t zheap_sweep_page(ZPage *page) {
+  // Fully marked lines leave no room for a hole: only the end of the page
+  // may be free
+  uintptr_t first = (page->start + sizeof(ZPage) + 7) & ~(uintptr_t)7;
+  size_t line = (first - page->start) / ZLINE_SIZE;
+  size_t top_line = (page->top - page->start + ZLINE_SIZE - 1) / ZLINE_SIZE;
+  bool any_free = false;
+  for (; line < top_line && !any_free; line++)
+    any_free = !(page->line_bitmap[line / 8] & (1 << (line % 8)));
+
+  size_t free_bytes = 0;
+  uintptr_t *link = &page->holes;
+  *link = 0;
+  uintptr_t run = 0; // Start of the dead run being walked
+  for (uintptr_t addr = first; any_free && addr < page->top;) {
+    ZBody *body = (ZBody *)addr;
+    size_t size = zbody_size(body);
+    bool live = zpage_is_live(page, body);
+    if (live && run) {
+      // A hole needs a whole line no live body touches
+      uintptr_t line = (run + ZLINE_SIZE - 1) & ~(uintptr_t)(ZLINE_SIZE - 1);
+      if (line + ZLINE_SIZE <= addr) {
+        zheap_fill(run, addr);
+        ((uintptr_t *)run)[1] = 0;
+        *link = run;
+        link = &((uintptr_t *)run)[1];
+        free_bytes += addr - run;
+      }
+      run = 0;
+    } else if (!live && !run) {
+      run = addr;
+    }
+    addr += size;
+  }
+  if (run)
+    page->top = run;
+  free_bytes += page->end - page->top;
+
+  if (page->holes || page->end - page->top >= ZLINE_SIZE) {
+    ZHeapState *heap = zstate->heap;
+    pthread_mutex_lock(&heap->heap_lock);
+    page->next_recyclable = heap->recyclable;
+    heap->recyclable = page;
+    pthread_mutex_unlock(&heap->heap_lock);
+  }
+  return free_bytes;
+}
+
+void zheap_for_each_body(ZPage *page, uintptr_t limit,
+                         void (*fn)(void *body, void *arg), void *arg) {
+  uintptr_t first = (page->start + sizeof(ZPage) + 7) & ~(uintptr_t)7;
+  size_t runs = page->ntlabs ? page->ntlabs : 1;
+  for (size_t i = 0; i < runs; i++) {
+    uintptr_t addr = page->ntlabs ? page->start + page->tlab_starts[i] : first;
+    uintptr_t end = i + 1 < runs ? page->start + page->tlab_starts[i + 1]
+                                 : limit;
+    if (end > limit)
+      end = limit;
+    while (addr < end) {
+      void *body = (void *)addr;
+      addr += zbody_size((ZBody *)body);
+      // Past the last body of a retired TLAB, zeros read as bodies that
+      // may run over its end
+      if (addr > end)
+        break;
+      fn(body, arg);
+    }
+  }
+}
+
+void zheap_drop_holes(bool retire_page) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+  ZPage *page = heap->current_old_page;
+  if (heap->hole_top < heap->hole_end)
+    zheap_fill(heap->hole_top, heap->hole_end);
+  heap->hole_top = heap->hole_end = 0;
+  if (page)
+    page->holes = 0;
+  while (heap->recyclable) {
+    page = heap->recyclable;
+    heap->recyclable = page->next_recyclable;
+    page->next_recyclable = NULL;
+    page->holes = 0;
+  }
+  if (retire_page)
+    heap->current_old_page = NULL;
+  pthread_mutex_unlock(&heap->heap_lock);
+}
+
 void *zheap_alloc(size_t size, uint8_t generation) {
   // Align size to 8 bytes
   size = (size + 7) & ~7;
@@ -126,80 +787,126 @@ void *zheap_alloc(size_t size, uint8_t generation) {
     if (zheap_tlab.top + size <= zheap_tlab.end) {
       void *ptr = (void *)zheap_tlab.top;
       zheap_tlab.top += size;
-      return Z_WITH_COLOR(ptr, zgc_good_color);
+      return Z_WITH_COLOR(ptr, zstate->good_color);
     }
 
+    void *sampled = zheap_alloc_sampled(size);
+    if (sampled)
+      return sampled;
+
     if (zheap_refill_tlab(size)) {
       if (zheap_tlab.top + size <= zheap_tlab.end) {
         void *ptr = (void *)zheap_tlab.top;
         zheap_tlab.top += size;
-        return Z_WITH_COLOR(ptr, zgc_good_color);
+        return Z_WITH_COLOR(ptr, zstate->good_color);
       }
+      // The new TLAB's sample point falls inside this allocation
+      return zheap_alloc_sampled(size);
     }
     return NULL;
   } else {
     // Old Generation Allocation (Directly in Old Page)
-    pthread_mutex_lock(&heap_lock);
-
-    if (!current_old_page) {
-      current_old_page = zpage_create(ZGEN_OLD);
-      // Link into global list
-      if (head_page) {
-        // We need to insert it somewhere.
-        // For simplicity, let's just append to head_page?
-        // No, we need to traverse to find end?
-        // Or just prepend to head_page?
-        current_old_page->next = head_page;
-        head_page = current_old_page;
-      } else {
-        head_page = current_old_page;
-      }
-    }
-
-    if (current_old_page->top + size > current_old_page->end) {
-      ZPage *new_page = zpage_create(ZGEN_OLD);
-      if (!new_page) {
-        pthread_mutex_unlock(&heap_lock);
-        return NULL;
-      }
-      new_page->next = head_page;
-      head_page = new_page;
-      current_old_page = new_page;
-    }
-
-    void *ptr = (void *)current_old_page->top;
-    current_old_page->top += size;
-
-    pthread_mutex_unlock(&heap_lock);
-    return Z_WITH_COLOR(ptr, zgc_good_color);
+    ZHeapState *heap = zstate->heap;
+    pthread_mutex_lock(&heap->heap_lock);
+    void *ptr = zheap_alloc_old(size);
+    pthread_mutex_unlock(&heap->heap_lock);
+    return ptr ? Z_WITH_COLOR(ptr, zstate->good_color) : NULL;
   }
 }
 
+void *zheap_alloc_raw(size_t size) {
+  if (size > ZPAGE_CAPACITY - ZFILLER_MIN_SIZE)
+    return NULL;
+  size = (size + 7) & ~(size_t)7;
+  void *colored = zheap_alloc(size + ZFILLER_MIN_SIZE, ZGEN_YOUNG);
+  if (!colored)
+    return NULL;
+  uintptr_t from = (uintptr_t)Z_ADDRESS(colored);
+  zheap_fill(from, from + size + ZFILLER_MIN_SIZE);
+  return (char *)colored + ZARRAY_HEADER_SIZE;
+}
+
 void zheap_free(void *ptr) {
   // No-op
 }
 
-ZPage *zheap_get_current_page(void) { return current_young_page; }
+ZPage *zheap_get_current_page(void) {
+  return zstate->heap->current_young_page;
+}
+
+ZPage *zheap_get_head_page(void) { return zstate->heap->head_page; }
 
-ZPage *zheap_get_head_page(void) { return head_page; }
+ZPage *zheap_get_current_old_page(void) {
+  return zstate->heap->current_old_page;
+}
 
 // Marking Helpers
 
+ZPageInfo *zheap_page_info(size_t *count) {
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->heap_lock);
+
+  size_t n = 0;
+  for (ZPage *page = heap->head_page; page; page = page->next)
+    n++;
+
+  ZPageInfo *infos = (ZPageInfo *)calloc(n ? n : 1, sizeof(ZPageInfo));
+  if (!infos) {
+    pthread_mutex_unlock(&heap->heap_lock);
+    return NULL;
+  }
+
+  size_t i = 0;
+  for (ZPage *page = heap->head_page; page; page = page->next, i++) {
+    ZPageInfo *info = &infos[i];
+    info->start = page->start;
+    info->size_bytes = page->end - page->start;
+    info->used_bytes = page->top - page->start;
+    info->header_bytes = ((page->start + sizeof(ZPage) + 7) & ~7) - page->start;
+    // Written by the marker without the heap lock; a torn read is harmless
+    info->live_bytes = page->live_bytes;
+    info->marked_bytes = page->mark_top - page->start - info->header_bytes;
+    info->forwarding_entries = page->forwarding_table.count;
+    info->is_evacuating = page->is_evacuating;
+    info->is_relocating = atomic_load(&page->is_relocating);
+    info->is_current = page == heap->current_young_page ||
+                       page == heap->current_old_page ||
+                       page == heap->current_frozen_page;
+    info->is_immortal = page->is_immortal;
+    info->is_large = page->is_large;
+    info->is_released = atomic_load(&page->is_released);
+    info->is_region = page->region != NULL;
+    info->is_frozen = page->is_frozen;
+    info->dirty_cards = page->is_frozen ? zcard_count_dirty(page) : 0;
+    info->pin_count = atomic_load(&page->pin_count);
+    info->generation = page->generation;
+    info->numa_node = page->numa_node;
+  }
+
+  pthread_mutex_unlock(&heap->heap_lock);
+  *count = n;
+  return infos;
+}
+
 ZPage *zheap_get_page(void *obj) {
   uintptr_t addr = (uintptr_t)Z_ADDRESS(obj);
   uintptr_t page_start = addr & ~(ZPAGE_SIZE - 1);
   return (ZPage *)page_start;
 }
 
-void zpage_mark_object(ZPage *page, void *obj) {
+bool zpage_mark_object(ZPage *page, void *obj) {
   uintptr_t offset = (uintptr_t)Z_ADDRESS(obj) - page->start;
   size_t bit_index = offset / 8;
   size_t byte_index = bit_index / 8;
   size_t bit_offset = bit_index % 8;
 
   if (byte_index < ZBITMAP_SIZE) {
-    page->mark_bitmap[byte_index] |= (1 << bit_offset);
+    uint8_t bit = 1 << bit_offset;
+    uint8_t old = atomic_fetch_or(
+        (_Atomic uint8_t *)&page->mark_bitmap[byte_index], bit);
+    return (old & bit) == 0;
   }
+  return false;
 }
 
 bool zpage_is_marked(ZPage *page, void *obj) {
@@ -214,55 +921,141 @@ bool zpage_is_marked(ZPage *page, void *obj) {
   return false;
 }
 
+bool zpage_mark_finalizable(ZPage *page, void *obj) {
+  size_t bit_index = ((uintptr_t)Z_ADDRESS(obj) - page->start) / 8;
+  if (bit_index / 8 >= ZBITMAP_SIZE)
+    return false;
+  _Atomic(uint8_t *) *slot = (_Atomic(uint8_t *) *)&page->finalizable_bitmap;
+  uint8_t *bitmap = atomic_load(slot);
+  if (!bitmap) {
+    // Marking threads race to install it; losers free theirs
+    uint8_t *fresh = (uint8_t *)calloc(1, ZBITMAP_SIZE);
+    if (!fresh)
+      return false;
+    if (atomic_compare_exchange_strong(slot, &bitmap, fresh)) {
+      bitmap = fresh;
+    } else {
+      free(fresh);
+    }
+  }
+  uint8_t bit = 1 << (bit_index % 8);
+  uint8_t old = atomic_fetch_or((_Atomic uint8_t *)&bitmap[bit_index / 8], bit);
+  return (old & bit) == 0;
+}
+
+bool zpage_is_finalizable(ZPage *page, void *obj) {
+  size_t bit_index = ((uintptr_t)Z_ADDRESS(obj) - page->start) / 8;
+  if (!page->finalizable_bitmap || bit_index / 8 >= ZBITMAP_SIZE)
+    return false;
+  return (page->finalizable_bitmap[bit_index / 8] &
+          (1 << (bit_index % 8))) != 0;
+}
+
 void zpage_clear_bitmap(ZPage *page) {
   memset(page->mark_bitmap, 0, ZBITMAP_SIZE);
+  memset(page->line_bitmap, 0, ZLINE_BITMAP_SIZE);
+  if (page->finalizable_bitmap)
+    memset(page->finalizable_bitmap, 0, ZBITMAP_SIZE);
   page->live_bytes = 0;
 }
 
+void zpage_mark_lines(ZPage *page, void *obj, size_t size) {
+  uintptr_t offset = (uintptr_t)Z_ADDRESS(obj) - page->start;
+  size_t last = (offset + size - 1) / ZLINE_SIZE;
+  for (size_t line = offset / ZLINE_SIZE; line <= last; line++) {
+    uint8_t bit = 1 << (line % 8);
+    _Atomic uint8_t *byte = (_Atomic uint8_t *)&page->line_bitmap[line / 8];
+    if (!(atomic_load_explicit(byte, memory_order_relaxed) & bit))
+      atomic_fetch_or(byte, bit);
+  }
+}
+
 // Relocation Helpers
 
+static inline size_t zforwarding_hash(uintptr_t offset, size_t capacity) {
+  return (size_t)(((offset >> 3) * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (capacity - 1);
+}
+
+static void zforwarding_insert(ZForwardingTable *table, uintptr_t offset,
+                               uintptr_t to_addr) {
+  size_t i = zforwarding_hash(offset, table->capacity);
+  while (table->entries[i].to_addr != 0) {
+    if (table->entries[i].from_offset == offset) {
+      table->entries[i].to_addr = to_addr;
+      return;
+    }
+    i = (i + 1) & (table->capacity - 1);
+  }
+  table->entries[i].from_offset = offset;
+  table->entries[i].to_addr = to_addr;
+  table->count++;
+}
+
+static void zforwarding_grow(ZForwardingTable *table, size_t capacity) {
+  ZForwardingEntry *old_entries = table->entries;
+  size_t old_capacity = table->capacity;
+
+  table->entries =
+      (ZForwardingEntry *)calloc(capacity, sizeof(ZForwardingEntry));
+  table->capacity = capacity;
+  table->count = 0;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_entries[i].to_addr != 0) {
+      zforwarding_insert(table, old_entries[i].from_offset,
+                         old_entries[i].to_addr);
+    }
+  }
+  free(old_entries);
+}
+
 void zpage_start_evacuation(ZPage *page) {
-  page->is_evacuating = true;
-  if (page->forwarding_table.entries) {
-    free(page->forwarding_table.entries);
+  // Size for the live objects found by marking (~2x for a low load factor)
+  size_t capacity = 128; // Initial capacity
+  while (capacity < page->live_bytes / 32) {
+    capacity *= 2;
   }
-  page->forwarding_table.capacity = 128; // Initial capacity
-  page->forwarding_table.entries = (ZForwardingEntry *)malloc(
-      sizeof(ZForwardingEntry) * page->forwarding_table.capacity);
-  page->forwarding_table.count = 0;
+
+  if (!page->is_evacuating) {
+    page->forwarding_table.entries =
+        (ZForwardingEntry *)calloc(capacity, sizeof(ZForwardingEntry));
+    page->forwarding_table.capacity = capacity;
+    page->forwarding_table.count = 0;
+  } else if (page->forwarding_table.capacity < capacity) {
+    // Evacuated before: keep existing entries for handles not yet remapped
+    zforwarding_grow(&page->forwarding_table, capacity);
+  }
+  page->is_evacuating = true;
 }
 
 void zpage_add_forwarding(ZPage *page, void *from, void *to) {
   if (!page->is_evacuating)
     return;
 
-  if (page->forwarding_table.count >= page->forwarding_table.capacity) {
-    page->forwarding_table.capacity *= 2;
-    page->forwarding_table.entries = (ZForwardingEntry *)realloc(
-        page->forwarding_table.entries,
-        sizeof(ZForwardingEntry) * page->forwarding_table.capacity);
+  ZForwardingTable *table = &page->forwarding_table;
+  if ((table->count + 1) * 2 > table->capacity) {
+    zforwarding_grow(table, table->capacity * 2);
   }
 
   // Store raw offsets
   uintptr_t offset = (uintptr_t)Z_ADDRESS(from) - page->start;
-  page->forwarding_table.entries[page->forwarding_table.count].from_offset =
-      offset;
-  page->forwarding_table.entries[page->forwarding_table.count].to_addr =
-      (uintptr_t)Z_ADDRESS(to);
-  page->forwarding_table.count++;
+  zforwarding_insert(table, offset, (uintptr_t)Z_ADDRESS(to));
 }
 
 void *zpage_resolve_forwarding(ZPage *page, void *from) {
   if (!page->is_evacuating)
     return NULL;
 
+  ZForwardingTable *table = &page->forwarding_table;
   uintptr_t offset = (uintptr_t)Z_ADDRESS(from) - page->start;
 
-  // Linear search for prototype
-  for (size_t i = 0; i < page->forwarding_table.count; i++) {
-    if (page->forwarding_table.entries[i].from_offset == offset) {
-      return (void *)page->forwarding_table.entries[i].to_addr;
+  size_t i = zforwarding_hash(offset, table->capacity);
+  while (table->entries[i].to_addr != 0) {
+    if (table->entries[i].from_offset == offset) {
+      return (void *)table->entries[i].to_addr;
     }
+    i = (i + 1) & (table->capacity - 1);
   }
   return NULL;
 }
@@ -283,26 +1076,73 @@ bool zheap_is_young(void *obj) {
   return page->generation == ZGEN_YOUNG;
 }
 
+bool zheap_is_shared(void *obj) {
+  ZPage *page = zheap_get_page(obj);
+  if (!page)
+    return false;
+  return page->generation == ZGEN_SHARED;
+}
+
 void zremset_add(void *obj) {
-  pthread_mutex_lock(&remset_lock);
-  if (remset.count >= remset.capacity) {
-    remset.capacity = (remset.capacity == 0) ? 128 : remset.capacity * 2;
-    remset.items =
-        (void **)realloc(remset.items, sizeof(void *) * remset.capacity);
+  ZPROBE1(remset__add, Z_ADDRESS(obj));
+  ZHeapState *heap = zstate->heap;
+  ZRememberedSet *remset = &heap->remset;
+  pthread_mutex_lock(&heap->remset_lock);
+  if (remset->count >= remset->capacity) {
+    remset->capacity = (remset->capacity == 0) ? 128 : remset->capacity * 2;
+    remset->items =
+        (void **)realloc(remset->items, sizeof(void *) * remset->capacity);
   }
   // Check if already exists? (Linear scan is slow, but fine for prototype)
   // For now, just add duplicates (GC will handle it)
-  remset.items[remset.count++] = obj;
-  pthread_mutex_unlock(&remset_lock);
+  remset->items[remset->count++] = obj;
+  pthread_mutex_unlock(&heap->remset_lock);
 }
 
 void *zremset_pop(void) {
-  pthread_mutex_lock(&remset_lock);
-  if (remset.count > 0) {
-    return remset.items[--remset.count];
+  ZHeapState *heap = zstate->heap;
+  pthread_mutex_lock(&heap->remset_lock);
+  if (heap->remset.count > 0) {
+    void *obj = heap->remset.items[--heap->remset.count];
+    pthread_mutex_unlock(&heap->remset_lock);
+    return obj;
   }
-  pthread_mutex_unlock(&remset_lock);
+  pthread_mutex_unlock(&heap->remset_lock);
   return NULL;
 }
 
-bool zremset_is_empty(void) { return remset.count == 0; }
+bool zremset_is_empty(void) { return zstate->heap->remset.count == 0; }
+
+void zremset_drop_dead(void) {
+  ZHeapState *heap = zstate->heap;
+  ZRememberedSet *remset = &heap->remset;
+  pthread_mutex_lock(&heap->remset_lock);
+  size_t kept = 0;
+  for (size_t i = 0; i < remset->count; i++) {
+    void *raw = zgc_remap(remset->items[i]);
+    ZPage *page = zheap_get_page(raw);
+    if (page->is_frozen || page->generation == ZGEN_SHARED ||
+        zpage_is_live(page, raw))
+      remset->items[kept++] = remset->items[i];
+  }
+  remset->count = kept;
+  pthread_mutex_unlock(&heap->remset_lock);
+}
+
+void zheap_atfork(ZForkStage stage) {
+  ZHeapState *heap = zstate->heap;
+  switch (stage) {
+  case ZFORK_PREPARE:
+    pthread_mutex_lock(&heap->heap_lock);
+    pthread_mutex_lock(&heap->remset_lock);
+    break;
+  case ZFORK_PARENT:
+    pthread_mutex_unlock(&heap->remset_lock);
+    pthread_mutex_unlock(&heap->heap_lock);
+    break;
+  case ZFORK_CHILD:
+    pthread_mutex_init(&heap->heap_lock, NULL);
+    pthread_mutex_init(&heap->remset_lock, NULL);
+    break;
+  }
+}
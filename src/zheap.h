@@ -1,6 +1,10 @@
 #ifndef ZHEAP_H
 #define ZHEAP_H
 
+#include "zfork.h"
+#include "zstate.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -10,12 +14,23 @@
 // Bitmap size: 2MB / 8 bytes (min object size) / 8 bits per byte = 32KB
 #define ZBITMAP_SIZE (ZPAGE_SIZE / 8 / 8)
 
+// Lines of the mark-region old generation (ZGCConfig.old_gen): 256 bytes,
+// so 8192 per page and a 1KB line bitmap
+#define ZLINE_SIZE 256
+#define ZLINE_BITMAP_SIZE (ZPAGE_SIZE / ZLINE_SIZE / 8)
+
 // TLAB Size: 32KB
 #define ZTLAB_SIZE (32 * 1024)
 
+// Objects above this size get a dedicated (large) page of their own
+#define ZLARGE_OBJECT_SIZE (ZPAGE_SIZE / 8)
+
 // Generations
 #define ZGEN_YOUNG 0
 #define ZGEN_OLD 1
+// Immortal pages of a heap image mapped read-only from shared memory
+// (pyzgc.attach_image). Never marked, relocated or written to.
+#define ZGEN_SHARED 2
 
 // --- Colored Pointers ---
 #define ZPOINTER_MARK_SHIFT 60
@@ -35,8 +50,7 @@
 #define Z_HAS_COLOR(ptr, color) (Z_COLOR(ptr) == (color))
 #define Z_WITH_COLOR(ptr, color) ((void *)((uintptr_t)Z_ADDRESS(ptr) | (color)))
 
-// Global state for the "Good Color"
-extern uintptr_t zgc_good_color;
+// The "Good Color" of the current heap is zstate->good_color
 
 // Forwarding Table Entry
 typedef struct {
@@ -44,7 +58,8 @@ typedef struct {
   uintptr_t to_addr;     // New address
 } ZForwardingEntry;
 
-// Simple Forwarding Table
+// Forwarding Table: open-addressing hash keyed by from_offset.
+// capacity is a power of two; an entry with to_addr == 0 is empty.
 typedef struct {
   ZForwardingEntry *entries;
   size_t count;
@@ -60,13 +75,35 @@ typedef struct ZPage {
   // Mark Bitmap: 1 bit per 8 bytes of memory
   uint8_t mark_bitmap[ZBITMAP_SIZE];
 
-  // Live bytes count (for evacuation heuristics)
-  size_t live_bytes;
+  // Objects only reachable through a finalizer (see zref.h), same layout
+  // as mark_bitmap. Allocated by the marker the first time it needs one.
+  uint8_t *finalizable_bitmap;
+
+  // Lines some marked body covers, set by the marker in mark-region
+  // cycles (zpage_mark_lines)
+  uint8_t line_bitmap[ZLINE_BITMAP_SIZE];
 
-  // Evacuation flag
+  // Live bytes count (for evacuation heuristics). Mutators assisting the
+  // marker add to it as well.
+  atomic_size_t live_bytes;
+
+  // Top when the current marking started. Bodies above it were allocated
+  // since: they are not in its snapshot, so they count as live, and the
+  // page stays out of the relocation set.
+  uintptr_t mark_top;
+
+  // Evacuation flag. Stays set once a page has been evacuated so that stale
+  // handles can still be remapped through the forwarding table.
   bool is_evacuating;
 
-  // Generation (0=Young, 1=Old)
+  // Set from relocate start until the GC has copied every live object.
+  // While set, the forwarding table may only be touched under relocate_lock.
+  atomic_bool is_relocating;
+  // Taken by whoever copies the page: the GC or an assisting mutator
+  atomic_bool relocate_claimed;
+  pthread_mutex_t relocate_lock;
+
+  // Generation (0=Young, 1=Old, 2=Shared)
   uint8_t generation;
 
   // Forwarding Table (only valid if is_evacuating is true)
@@ -74,20 +111,78 @@ typedef struct ZPage {
 
   // NUMA Node ID (for NUMA-aware allocation)
   int numa_node;
+
+  // Mapped from a heap image (see zimage.h): never relocated, and slots may
+  // hold encoded references that resolve through `image`.
+  bool is_immortal;
+  struct ZImage *image;
+
+  // Holds a single object larger than ZLARGE_OBJECT_SIZE; spans
+  // end - start bytes (a multiple of ZPAGE_SIZE). Never relocated.
+  bool is_large;
+
+  // Raw pointers into the page are held outside the heap (buffer exports,
+  // pyzgc.pin): never chosen for relocation while non-zero.
+  atomic_int pin_count;
+
+  // Relocation ran out of memory and left live objects on the evacuated
+  // page, so its memory can't be released
+  atomic_bool relocate_failed;
+  // The memory after the header went back to the OS (zheap_release_pages)
+  atomic_bool is_released;
+
+  // Allocation region the page belongs to (zregion.h), NULL for heap
+  // pages. Region pages are never relocated; the region hands them back
+  // to the pool when it ends.
+  struct ZRegion *region;
+
+  // Permanent generation (pyzgc.freeze): an old page that cycles neither
+  // clear, mark, trace through nor relocate. Its bodies that refer to
+  // mutable ones are found through the card table instead (zcard.h).
+  bool is_frozen;
+  size_t ncards;
+  uint8_t *cards;       // One byte per card, non-zero when dirty
+  uint16_t *card_first; // Where the first body starting in a card is
+  atomic_bool cards_dirty; // Some card may be dirty
+
+  // Mark-region old generation (see zheap_sweep_page): chosen at relocate
+  // start to be swept in place, and once swept, the first of its holes
+  // and the next page that has some
+  atomic_bool sweep_pending;
+  uintptr_t holes;
+  struct ZPage *next_recyclable;
+
+  // Where each TLAB carved from a young page starts, in bytes from start.
+  // A retired TLAB leaves zeros up to the next one (zheap_for_each_body).
+  uint32_t tlab_starts[ZPAGE_SIZE / ZTLAB_SIZE];
+  uint8_t ntlabs;
 } ZPage;
 
+// Bytes a page other than a large one can hold after its header
+#define ZPAGE_CAPACITY (ZPAGE_SIZE - ((sizeof(ZPage) + 7) & ~(size_t)7))
+
 // Thread-Local Allocation Buffer
 typedef struct {
   uintptr_t top;
   uintptr_t end;
 } ZTLAB;
 
-// Exposed TLAB for inline allocation
+// Exposed TLAB for inline allocation, in the heap of the state the thread
+// is attached to (zstate_attach parks the others)
 extern __thread ZTLAB zheap_tlab;
 
+// Region the calling thread allocates young bodies in, if any. Its TLABs
+// run to the end of the region's last page (see zheap_enter_region).
+struct ZRegion *zheap_current_region(void);
+
 // Allocator
 void *zheap_alloc(size_t size, uint8_t generation);
 
+// Raw young memory (pyzgc.allocate), wrapped in a dead body so that its
+// page can still be walked. Returns the colored address of `size` bytes,
+// or NULL, always for sizes the wrapper can't fit on a page.
+void *zheap_alloc_raw(size_t size);
+
 // Inline Fast-Path Allocator
 static inline void *zheap_alloc_inline(size_t size) {
   // Align size
@@ -97,7 +192,7 @@ static inline void *zheap_alloc_inline(size_t size) {
   if (zheap_tlab.top + size <= zheap_tlab.end) {
     void *ptr = (void *)zheap_tlab.top;
     zheap_tlab.top += size;
-    return Z_WITH_COLOR(ptr, zgc_good_color);
+    return Z_WITH_COLOR(ptr, zstate->good_color);
   }
 
   // Slow path
@@ -120,20 +215,193 @@ ZPage *zheap_get_head_page(void);    // To iterate all pages
 
 // Marking helpers
 ZPage *zheap_get_page(void *obj);
-void zpage_mark_object(ZPage *page, void *obj);
+// Atomic, so several threads can mark. Returns false if already marked.
+bool zpage_mark_object(ZPage *page, void *obj);
 bool zpage_is_marked(ZPage *page, void *obj);
+// Finalizable marks. Returns false if already marked, or when out of memory;
+// in that case the object stays unmarked and is treated as garbage.
+bool zpage_mark_finalizable(ZPage *page, void *obj);
+bool zpage_is_finalizable(ZPage *page, void *obj);
+// Allocated since the current marking started (see mark_top)
+static inline bool zpage_is_new(ZPage *page, void *obj) {
+  return (uintptr_t)Z_ADDRESS(obj) >= page->mark_top;
+}
+// Marked strongly or finalizably, or new: the object survives the cycle
+static inline bool zpage_is_live(ZPage *page, void *obj) {
+  return zpage_is_marked(page, obj) || zpage_is_finalizable(page, obj) ||
+         zpage_is_new(page, obj);
+}
 void zpage_clear_bitmap(ZPage *page);
+// Marks the lines [obj, obj + size) spans. Atomic like zpage_mark_object.
+void zpage_mark_lines(ZPage *page, void *obj, size_t size);
 
 // Relocation helpers
+// Forwarding entries are kept if the page was evacuated before.
 void zpage_start_evacuation(ZPage *page);
 void zpage_add_forwarding(ZPage *page, void *from, void *to);
 void *zpage_resolve_forwarding(ZPage *page, void *from);
+ZPage *zheap_get_current_old_page(void);
+
+// Mark-region old generation (ZGCConfig.old_gen): instead of evacuating
+// every old page, a full cycle leaves most of them in place and sweeps
+// them. A sweep walks the bodies below mark_top and turns each run of dead
+// ones that covers a whole free line into a hole: a filler body (a U8
+// array without a handle) whose second word links the page's next hole,
+// so the page stays walkable. A dead run reaching top just lowers it.
+// Bodies that had a handle while marking ran were marked finalizable
+// (zgc.c), so they keep their lines along with what they refer to. Swept
+// pages with room are queued, and old allocation (promotion included)
+// fills their holes, then the space after their top, before taking fresh
+// pages. Old bodies are not zeroed then; every caller copies a whole body
+// in.
+//
+// Sweeps one page off the heap lock, while nothing allocates in it, and
+// queues it if it has room. Returns the free bytes found.
+size_t zheap_sweep_page(ZPage *page);
+// Calls fn for each body on the page below `limit`, which is at most
+// mark_top. Young pages are walked TLAB by TLAB, skipping the zeros a
+// retired one leaves, so they need whole bodies only (as regions do).
+void zheap_for_each_body(ZPage *page, uintptr_t limit,
+                         void (*fn)(void *body, void *arg), void *arg);
+// Gives the memory of evacuated pages back like zheap_release_pages, and
+// returns whether none is left holding dead bodies: handles may still read
+// those, and what they refer to, which the next sweep must not reuse.
+bool zheap_release_evacuated(size_t *released);
+// Stops allocating in holes and forgets the queued pages, filling the rest
+// of the current hole; with retire_page, also moves old allocation off the
+// current old page so that it can be swept too. In the mark start pause of
+// every full cycle, so that no hole is on a page the cycle relocates.
+void zheap_drop_holes(bool retire_page);
+
+// Allocates a dedicated old-generation page for one object of `size` bytes
+// (zeroed). Returns the colored object address, or NULL.
+void *zheap_alloc_large(size_t size);
+
+// Keep a page out of relocation sets (see ZPage.pin_count). Pin from inside
+// a safepoint section, after the load barrier, so the object can't be on a
+// page that is being relocated.
+void zpage_pin(ZPage *page);
+void zpage_unpin(ZPage *page);
+
+// Allocates `size` bytes in the permanent generation (relocation while
+// freezing, see zgc_freeze). Frozen pages are filled body after body, and
+// each body is entered in the page's card table. Returns the colored
+// address, or NULL.
+void *zheap_alloc_frozen(size_t size);
+
+// Moves allocation on to a fresh young page and old page, so that the
+// current ones can be evacuated too. Call in a pause, after retiring the
+// TLABs.
+void zheap_retire_current_pages(void);
+
+// Freezes a large page in place. False when out of memory.
+bool zheap_freeze_large(ZPage *page);
+
+// Gives the memory of a large body nothing can reach any more back to the
+// OS, as zheap_release_pages does for evacuated pages. The caller makes
+// sure no marking can still read it. Frozen and pinned pages are left
+// alone. Returns the bytes released.
+size_t zheap_release_large(void *body);
+
+// Turns every frozen page back into an ordinary old page (pyzgc.unfreeze).
+// Only in a pause between cycles.
+void zheap_thaw(void);
+
+// Bytes of bodies in frozen pages are counted in zstate->frozen_bytes
+
+// Turns ZPAGE_SIZE bytes of already mapped, ZPAGE_SIZE-aligned memory into
+// an immortal page of `generation` (ZGEN_OLD or ZGEN_SHARED) with objects up
+// to `top`, and links it into the heap. The page header must be writable.
+ZPage *zheap_adopt_page(void *mem, uintptr_t top, struct ZImage *image,
+                        uint8_t generation);
+
+// Heap size. zstate->committed_bytes counts the anonymous memory of the
+// heap's pages (images excluded) minus what was released. The footprint
+// adds the ready pages of the page pool, which is shared by every heap and
+// counts towards each one's limits. New young pages and large bodies fail
+// once the footprint would exceed zstate->max_bytes, and crossing
+// zstate->soft_max_bytes wakes the GC thread (zgc_request_cycle). Old
+// pages are exempt so that relocation can always finish. 0 means no limit;
+// the collector sets both (see ZGCConfig).
+size_t zheap_footprint(void);
+
+// Counts `bytes` of new page memory. Limited requests fail past
+// zstate->max_bytes, after draining the page pool and releasing evacuated
+// pages; only zheap.c makes them, with the heap lock held. The caller
+// subtracts the bytes again if it doesn't map them.
+bool zheap_charge(size_t bytes, bool limited);
+
+// Maps one ZPAGE_SIZE-aligned page and initializes its header as a young
+// page, without charging it. NULL when out of memory.
+ZPage *zpage_map(bool populate);
+
+// Gives the memory of evacuated pages back to the OS, keeping the header
+// (and so the forwarding table) mapped. Every live object, and every one a
+// handle holds, has moved out by then; pinned pages are skipped. Returns
+// the bytes released.
+size_t zheap_release_pages(void);
+
+// Points the calling thread's young allocation at `region` (zregion.h).
+// Region TLABs end where the region's last page ends, so bodies follow one
+// another without gaps up to each page's top. Both drop the current TLAB;
+// leaving stores its top back into the page. Call inside a safepoint
+// section, or a pause.
+void zheap_enter_region(struct ZRegion *region);
+void zheap_leave_region(void);
+
+// Takes every page of `region` off the heap list. Only in a pause between
+// cycles: the collector walks the list without the heap lock.
+void zheap_unlink_region(struct ZRegion *region);
+
+bool zheap_state_init(ZState *state);
+// Gives the memory of every page but images back to the OS (zstate_close)
+void zheap_state_close(ZState *state);
+
+// Empties an unlinked page that holds nothing live any more (zeroing what
+// was allocated) and hands it to the page pool, or unmaps it if the pool
+// is off or full.
+void zpage_recycle(ZPage *page);
+
+// Point-in-time copy of a page's bookkeeping (pyzgc.heap_info)
+typedef struct {
+  uintptr_t start;
+  size_t size_bytes;   // end - start
+  size_t used_bytes;   // top - start, page header included
+  size_t header_bytes; // ZPage metadata at the start of the page
+  size_t live_bytes;   // From the last (or the running) mark
+  size_t marked_bytes; // Object bytes below mark_top, which that mark judged
+  size_t forwarding_entries;
+  bool is_evacuating;
+  bool is_relocating;
+  bool is_current; // Current young, old or frozen allocation page
+  bool is_immortal;
+  bool is_large;
+  bool is_released;
+  bool is_region; // Belongs to an active pyzgc.region
+  bool is_frozen;
+  size_t dirty_cards;
+  int pin_count;
+  uint8_t generation;
+  int numa_node;
+} ZPageInfo;
+
+// Copies the info of every page while holding the heap lock, so it is safe
+// against concurrent allocation and the GC thread. Returns a malloc'd array
+// of *count entries (caller frees), or NULL when out of memory.
+ZPageInfo *zheap_page_info(size_t *count);
 
 // Generation Helpers
 bool zheap_is_old(void *obj);
 bool zheap_is_young(void *obj);
+bool zheap_is_shared(void *obj);
 void zremset_add(void *obj);
 void *zremset_pop(void); // For processing
 bool zremset_is_empty(void);
+// Drops the entries of bodies the last full marking found dead, before a
+// sweep reuses their memory. In the mark end pause.
+void zremset_drop_dead(void);
+
+// heap_lock and remset_lock across fork() (zfork.h)
+void zheap_atfork(ZForkStage stage);
 
 #endif
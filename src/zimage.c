@@ -0,0 +1,597 @@
+#define PY_SSIZE_T_CLEAN
+// First, so the GNU extensions it enables reach memfd_create and file seals
+#include <Python.h>
+#include "zimage.h"
+#include "zheap.h"
+#include "zobject.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout (all offsets in bytes from the start of the file):
+//   0                  ZImageHeader
+//   pages_offset       npages heap pages of ZPAGE_SIZE; each one is a zeroed
+//                      ZIMAGE_HEADER_REGION followed by encoded bodies
+//   prim_index_offset  nprims uint64_t offsets into the primitive section
+//   prims_offset       primitives: ZImagePrim + payload, 8-byte aligned
+#define ZIMAGE_MAGIC "PYZGCIMG"
+#define ZIMAGE_VERSION 3
+#define ZIMAGE_PAGES_OFFSET 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_region; // Must match the reader's ZPage layout
+  uint64_t page_size;
+  uint64_t body_size;
+  uint64_t nbodies;
+  uint64_t npages;
+  uint64_t pages_offset;
+  uint64_t nprims;
+  uint64_t prim_index_offset;
+  uint64_t prims_offset;
+  uint64_t prims_size;
+  uint64_t file_size;
+} ZImageHeader;
+
+enum {
+  ZIMAGE_PRIM_INT = 1,    // int64 payload
+  ZIMAGE_PRIM_BIGINT = 2, // Decimal text
+  ZIMAGE_PRIM_FLOAT = 3,  // double payload
+  ZIMAGE_PRIM_STR = 4,    // UTF-8
+  ZIMAGE_PRIM_BYTES = 5,
+  ZIMAGE_PRIM_BOOL = 6,   // One byte, 0 or 1
+};
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t length;
+} ZImagePrim;
+
+static inline ZBody *zimage_body(ZImage *img, uint64_t index) {
+  return (ZBody *)(img->pages +
+                   (index / ZIMAGE_BODIES_PER_PAGE) * ZPAGE_SIZE +
+                   ZIMAGE_HEADER_REGION +
+                   (index % ZIMAGE_BODIES_PER_PAGE) * sizeof(ZBody));
+}
+
+// --- Load ---
+
+static PyObject *zimage_decode_prim(ZImage *img, uint64_t index) {
+  uint64_t offset = img->prim_index[index];
+  const ZImagePrim *prim = (const ZImagePrim *)(img->prims + offset);
+  if (offset % 8 != 0 || offset + sizeof(ZImagePrim) > img->prims_size ||
+      prim->length > img->prims_size - offset - sizeof(ZImagePrim)) {
+    PyErr_SetString(PyExc_ValueError, "corrupt heap image primitive");
+    return NULL;
+  }
+  const char *data = (const char *)(prim + 1);
+  int64_t i64;
+  double f64;
+
+  // Fixed-size payloads must be whole
+  if ((prim->type == ZIMAGE_PRIM_INT && prim->length != sizeof(i64)) ||
+      (prim->type == ZIMAGE_PRIM_FLOAT && prim->length != sizeof(f64)) ||
+      (prim->type == ZIMAGE_PRIM_BOOL && prim->length != 1)) {
+    PyErr_SetString(PyExc_ValueError, "corrupt heap image primitive");
+    return NULL;
+  }
+
+  switch (prim->type) {
+  case ZIMAGE_PRIM_INT:
+    memcpy(&i64, data, sizeof(i64));
+    return PyLong_FromLongLong(i64);
+  case ZIMAGE_PRIM_BIGINT: {
+    PyObject *text = PyUnicode_DecodeASCII(data, prim->length, NULL);
+    if (!text)
+      return NULL;
+    PyObject *value = PyLong_FromUnicodeObject(text, 10);
+    Py_DECREF(text);
+    return value;
+  }
+  case ZIMAGE_PRIM_FLOAT:
+    memcpy(&f64, data, sizeof(f64));
+    return PyFloat_FromDouble(f64);
+  case ZIMAGE_PRIM_STR:
+    return PyUnicode_DecodeUTF8(data, prim->length, NULL);
+  case ZIMAGE_PRIM_BYTES:
+    return PyBytes_FromStringAndSize(data, prim->length);
+  case ZIMAGE_PRIM_BOOL:
+    return PyBool_FromLong(data[0] != 0);
+  }
+  PyErr_Format(PyExc_ValueError, "corrupt heap image: primitive type %u",
+               prim->type);
+  return NULL;
+}
+
+// Returns table[index], filling it with make(img, index) on first use
+static PyObject *zimage_lookup(ZImage *img, PyObject **table, uint64_t index,
+                               PyObject *(*make)(ZImage *, uint64_t)) {
+  PyObject *value = __atomic_load_n(&table[index], __ATOMIC_ACQUIRE);
+  if (!value) {
+    pthread_mutex_lock(&img->lock);
+    value = table[index];
+    if (!value) {
+      value = make(img, index);
+      if (value)
+        __atomic_store_n(&table[index], value, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&img->lock);
+    if (!value)
+      return NULL;
+  }
+  Py_INCREF(value);
+  return value;
+}
+
+static PyObject *zimage_make_handle(ZImage *img, uint64_t index) {
+  return zobject_wrap_body(zstate->types.object, zimage_body(img, index));
+}
+
+PyObject *zimage_handle(ZBody *body) {
+  ZPage *page = zheap_get_page(body);
+  ZImage *img = page->image;
+  uint64_t index =
+      ((char *)page - img->pages) / ZPAGE_SIZE * ZIMAGE_BODIES_PER_PAGE +
+      ((char *)body - (char *)page - ZIMAGE_HEADER_REGION) / sizeof(ZBody);
+  return zimage_lookup(img, img->handles, index, zimage_make_handle);
+}
+
+PyObject *zimage_resolve(ZBody *body, PyObject *encoded) {
+  ZImage *img = zheap_get_page(body)->image;
+  uintptr_t word = (uintptr_t)encoded;
+  uint64_t index = word >> 3;
+
+  if (img) {
+    switch (word & ZIMAGE_TAG_MASK) {
+    case ZIMAGE_TAG_BODY:
+      if (index < img->nbodies)
+        return zimage_lookup(img, img->handles, index, zimage_make_handle);
+      break;
+    case ZIMAGE_TAG_PRIM:
+      if (index < img->nprims)
+        return zimage_lookup(img, img->values, index, zimage_decode_prim);
+      break;
+    }
+  }
+  PyErr_Format(PyExc_ValueError, "corrupt heap image reference %p", encoded);
+  return NULL;
+}
+
+// Maps the image in fd and adopts its pages. `name` only labels errors.
+// Private images are copy-on-write; shared ones map the bodies read-only and
+// MAP_SHARED, with a private anonymous page header on top of each page.
+static PyObject *zimage_map(int fd, const char *name, bool shared) {
+  ZImageHeader header;
+  struct stat st;
+  errno = 0;
+  if (fstat(fd, &st) < 0 ||
+      pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    errno = errno ? errno : EINVAL;
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+  }
+
+  if (memcmp(header.magic, ZIMAGE_MAGIC, 8) != 0 ||
+      header.version != ZIMAGE_VERSION) {
+    PyErr_Format(PyExc_ValueError, "%s is not a pyzgc heap image", name);
+    return NULL;
+  }
+  uint64_t pages_end = header.pages_offset + header.npages * ZPAGE_SIZE;
+  if (header.header_region != ZIMAGE_HEADER_REGION ||
+      header.page_size != ZPAGE_SIZE || header.body_size != sizeof(ZBody)) {
+    PyErr_Format(PyExc_ValueError,
+                 "%s was written by an incompatible pyzgc build", name);
+    return NULL;
+  }
+  if (header.file_size != (uint64_t)st.st_size || header.nbodies == 0 ||
+      header.pages_offset % 4096 != 0 ||
+      header.npages != (header.nbodies + ZIMAGE_BODIES_PER_PAGE - 1) /
+                           ZIMAGE_BODIES_PER_PAGE ||
+      header.prim_index_offset < pages_end ||
+      header.prim_index_offset + header.nprims * sizeof(uint64_t) >
+          header.prims_offset ||
+      header.prims_offset + header.prims_size > header.file_size) {
+    PyErr_Format(PyExc_ValueError, "corrupt heap image %s", name);
+    return NULL;
+  }
+
+  // Reserve enough address space to put the first page on a ZPAGE_SIZE
+  // boundary, then map the file over it. Nothing is read yet: pages fault in
+  // as bodies are touched.
+  size_t size = (header.file_size + 4095) & ~(size_t)4095;
+  size_t reserve = size + ZPAGE_SIZE;
+  char *raw = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                   0);
+  if (raw == MAP_FAILED)
+    return PyErr_SetFromErrno(PyExc_MemoryError);
+  uintptr_t pages =
+      ((uintptr_t)raw + header.pages_offset + ZPAGE_SIZE - 1) &
+      ~(uintptr_t)(ZPAGE_SIZE - 1);
+  char *base = (char *)(pages - header.pages_offset);
+  int prot = shared ? PROT_READ : PROT_READ | PROT_WRITE;
+  int flags = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+  if (mmap(base, size, prot, flags, fd, 0) == MAP_FAILED) {
+    int err = errno;
+    munmap(raw, reserve);
+    errno = err;
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+  }
+  if (base > raw)
+    munmap(raw, base - raw);
+  if (raw + reserve > base + size)
+    munmap(base + size, (raw + reserve) - (base + size));
+
+  // The collector writes page headers (mark bitmap, forwarding table), so
+  // each process gets its own. The file has zeros there.
+  for (uint64_t p = 0; shared && p < header.npages; p++) {
+    if (mmap((char *)pages + p * ZPAGE_SIZE, ZIMAGE_HEADER_REGION,
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+             -1, 0) == MAP_FAILED) {
+      munmap(base, size);
+      return PyErr_SetFromErrno(PyExc_MemoryError);
+    }
+  }
+
+  ZImage *img = (ZImage *)calloc(1, sizeof(ZImage));
+  // calloc'd tables stay untouched (zero pages) until entries are filled
+  PyObject **handles = (PyObject **)calloc(header.nbodies, sizeof(PyObject *));
+  PyObject **values =
+      (PyObject **)calloc(header.nprims ? header.nprims : 1,
+                          sizeof(PyObject *));
+  if (!img || !handles || !values) {
+    free(img);
+    free(handles);
+    free(values);
+    munmap(base, size);
+    return PyErr_NoMemory();
+  }
+  img->base = base;
+  img->size = size;
+  img->pages = (char *)pages;
+  img->nbodies = header.nbodies;
+  img->nprims = header.nprims;
+  img->prim_index = (const uint64_t *)(base + header.prim_index_offset);
+  img->prims = base + header.prims_offset;
+  img->prims_size = header.prims_size;
+  img->handles = handles;
+  img->values = values;
+  img->shared = shared;
+  pthread_mutex_init(&img->lock, NULL);
+
+  for (uint64_t p = 0; p < header.npages; p++) {
+    uint64_t first = p * ZIMAGE_BODIES_PER_PAGE;
+    uint64_t count = header.nbodies - first;
+    if (count > ZIMAGE_BODIES_PER_PAGE)
+      count = ZIMAGE_BODIES_PER_PAGE;
+    char *page = img->pages + p * ZPAGE_SIZE;
+    zheap_adopt_page(page,
+                     (uintptr_t)page + ZIMAGE_HEADER_REGION +
+                         count * sizeof(ZBody),
+                     img, shared ? ZGEN_SHARED : ZGEN_OLD);
+  }
+
+  return zimage_lookup(img, img->handles, 0, zimage_make_handle);
+}
+
+PyObject *zimage_load(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+  PyObject *root = zimage_map(fd, path, false);
+  close(fd);
+  return root;
+}
+
+PyObject *zimage_attach(int fd) {
+  char name[32];
+  snprintf(name, sizeof(name), "fd %d", fd);
+  return zimage_map(fd, name, true);
+}
+
+// --- Save ---
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} ZBuffer;
+
+static int zbuffer_append(ZBuffer *buf, const void *data, size_t size) {
+  size_t padded = (size + 7) & ~(size_t)7;
+  if (buf->size + padded > buf->capacity) {
+    size_t capacity = buf->capacity ? buf->capacity * 2 : 4096;
+    while (capacity < buf->size + padded)
+      capacity *= 2;
+    char *grown = (char *)realloc(buf->data, capacity);
+    if (!grown) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    buf->data = grown;
+    buf->capacity = capacity;
+  }
+  memcpy(buf->data + buf->size, data, size);
+  memset(buf->data + buf->size + size, 0, padded - size);
+  buf->size += padded;
+  return 0;
+}
+
+static int zimage_add_prim(ZBuffer *index, ZBuffer *prims, uint32_t type,
+                           const void *data, uint64_t length,
+                           uint64_t payload) {
+  uint64_t offset = prims->size;
+  ZImagePrim prim = {type, 0, length};
+  if (zbuffer_append(index, &offset, sizeof(offset)) < 0 ||
+      zbuffer_append(prims, &prim, sizeof(prim)) < 0)
+    return -1;
+  if (payload && zbuffer_append(prims, data, payload) < 0)
+    return -1;
+  return 0;
+}
+
+// Appends a primitive and returns its encoded slot value (0 on error)
+static uintptr_t zimage_encode_prim(PyObject *value, ZBuffer *index,
+                                    ZBuffer *prims) {
+  uint64_t n = index->size / sizeof(uint64_t);
+  int rc;
+
+  if (PyBool_Check(value)) {
+    uint8_t b = value == Py_True;
+    rc = zimage_add_prim(index, prims, ZIMAGE_PRIM_BOOL, &b, 1, 1);
+  } else if (PyLong_CheckExact(value)) {
+    int overflow;
+    long long v = PyLong_AsLongLongAndOverflow(value, &overflow);
+    if (!overflow) {
+      int64_t i64 = v;
+      rc = zimage_add_prim(index, prims, ZIMAGE_PRIM_INT, &i64, sizeof(i64),
+                           sizeof(i64));
+    } else {
+      PyObject *text = PyObject_Str(value);
+      if (!text)
+        return 0;
+      Py_ssize_t len;
+      const char *s = PyUnicode_AsUTF8AndSize(text, &len);
+      rc = s ? zimage_add_prim(index, prims, ZIMAGE_PRIM_BIGINT, s, len, len)
+             : -1;
+      Py_DECREF(text);
+    }
+  } else if (PyFloat_CheckExact(value)) {
+    double f64 = PyFloat_AS_DOUBLE(value);
+    rc = zimage_add_prim(index, prims, ZIMAGE_PRIM_FLOAT, &f64, sizeof(f64),
+                         sizeof(f64));
+  } else if (PyUnicode_CheckExact(value)) {
+    Py_ssize_t len;
+    const char *s = PyUnicode_AsUTF8AndSize(value, &len);
+    rc = s ? zimage_add_prim(index, prims, ZIMAGE_PRIM_STR, s, len, len) : -1;
+  } else if (PyBytes_CheckExact(value)) {
+    Py_ssize_t len = PyBytes_GET_SIZE(value);
+    rc = zimage_add_prim(index, prims, ZIMAGE_PRIM_BYTES,
+                         PyBytes_AS_STRING(value), len, len);
+  } else {
+    PyErr_Format(PyExc_TypeError,
+                 "cannot save %.100s in a heap image (only pyzgc.Object, "
+                 "int, float, str, bytes, bool and None)",
+                 Py_TYPE(value)->tp_name);
+    return 0;
+  }
+  return rc < 0 ? 0 : (uintptr_t)((n << 3) | ZIMAGE_TAG_PRIM);
+}
+
+static int zimage_write(int fd, const void *data, size_t size, off_t offset) {
+  const char *p = (const char *)data;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+// An image encoded in memory, ready to be written out
+typedef struct {
+  ZImageHeader header;
+  uintptr_t *bodies; // nbodies * ZBODY_WORDS encoded words
+  ZBuffer index;
+  ZBuffer prims;
+} ZImageData;
+
+static void zimage_data_free(ZImageData *data) {
+  free(data->bodies);
+  free(data->index.data);
+  free(data->prims.data);
+}
+
+static int zimage_write_fd(int fd, const ZImageData *data) {
+  const ZImageHeader *header = &data->header;
+  const uintptr_t *bodies = data->bodies;
+  const ZBuffer *index = &data->index;
+  const ZBuffer *prims = &data->prims;
+
+  int rc = zimage_write(fd, header, sizeof(*header), 0);
+  for (uint64_t p = 0; rc == 0 && p < header->npages; p++) {
+    uint64_t first = p * ZIMAGE_BODIES_PER_PAGE;
+    uint64_t count = header->nbodies - first;
+    if (count > ZIMAGE_BODIES_PER_PAGE)
+      count = ZIMAGE_BODIES_PER_PAGE;
+    rc = zimage_write(fd, bodies + first * ZBODY_WORDS,
+                      count * sizeof(ZBody),
+                      header->pages_offset + p * ZPAGE_SIZE +
+                          ZIMAGE_HEADER_REGION);
+  }
+  if (rc == 0)
+    rc = zimage_write(fd, index->data, index->size,
+                      header->prim_index_offset);
+  if (rc == 0)
+    rc = zimage_write(fd, prims->data, prims->size, header->prims_offset);
+  // Unused page tails are holes
+  if (rc == 0)
+    rc = ftruncate(fd, header->file_size);
+  return rc;
+}
+
+static int zimage_write_file(const char *path, const ZImageData *data) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return -1;
+
+  int rc = zimage_write_fd(fd, data);
+  int err = errno;
+  if (close(fd) < 0 && rc == 0)
+    return -1;
+  errno = err;
+  return rc;
+}
+
+// Numbers the graph reachable from root breadth-first and encodes it.
+// 0 on success (data must then be freed), -1 with an exception.
+static int zimage_encode(ZObject *root, ZImageData *data) {
+  // Breadth-first numbering: handle -> body index
+  PyObject *order = PyList_New(0);
+  PyObject *numbering = PyDict_New();
+  uintptr_t *bodies = NULL;
+  size_t capacity = 0;
+  ZBuffer index = {NULL, 0, 0}, prims = {NULL, 0, 0};
+  int rc = -1;
+
+  if (!order || !numbering)
+    goto done;
+  PyObject *zero = PyLong_FromLong(0);
+  if (!zero || PyDict_SetItem(numbering, (PyObject *)root, zero) < 0 ||
+      PyList_Append(order, (PyObject *)root) < 0) {
+    Py_XDECREF(zero);
+    goto done;
+  }
+  Py_DECREF(zero);
+
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(order); i++) {
+    if ((size_t)i == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      uintptr_t *grown = (uintptr_t *)realloc(
+          bodies, capacity * ZBODY_WORDS * sizeof(uintptr_t));
+      if (!grown) {
+        PyErr_NoMemory();
+        goto done;
+      }
+      bodies = grown;
+    }
+
+    ZObject *obj = (ZObject *)PyList_GET_ITEM(order, i);
+    // Handles are made on first load
+    bodies[i * ZBODY_WORDS + ZOBJECT_SLOTS] = 0;
+    for (int s = 0; s < ZOBJECT_SLOTS; s++) {
+      // Through the barriers (and image references of an earlier load)
+      PyObject *value = zobject_load_slot(obj, s);
+      if (!value)
+        goto done;
+
+      uintptr_t word = 0;
+      if (Py_TYPE(value) == zstate->types.object) {
+        PyObject *n = PyDict_GetItemWithError(numbering, value); // Borrowed
+        if (n) {
+          word = ((uintptr_t)PyLong_AsSsize_t(n) << 3) | ZIMAGE_TAG_BODY;
+        } else if (!PyErr_Occurred()) {
+          Py_ssize_t next = PyList_GET_SIZE(order);
+          PyObject *num = PyLong_FromSsize_t(next);
+          if (num && PyDict_SetItem(numbering, value, num) == 0 &&
+              PyList_Append(order, value) == 0)
+            word = ((uintptr_t)next << 3) | ZIMAGE_TAG_BODY;
+          Py_XDECREF(num);
+        }
+      } else if (value != Py_None) {
+        word = zimage_encode_prim(value, &index, &prims);
+      }
+      Py_DECREF(value);
+      if (PyErr_Occurred())
+        goto done;
+      bodies[i * ZBODY_WORDS + s] = word;
+    }
+  }
+
+  uint64_t nbodies = PyList_GET_SIZE(order);
+  ZImageHeader *header = &data->header;
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, ZIMAGE_MAGIC, 8);
+  header->version = ZIMAGE_VERSION;
+  header->header_region = ZIMAGE_HEADER_REGION;
+  header->page_size = ZPAGE_SIZE;
+  header->body_size = sizeof(ZBody);
+  header->nbodies = nbodies;
+  header->npages =
+      (nbodies + ZIMAGE_BODIES_PER_PAGE - 1) / ZIMAGE_BODIES_PER_PAGE;
+  header->pages_offset = ZIMAGE_PAGES_OFFSET;
+  header->nprims = index.size / sizeof(uint64_t);
+  header->prim_index_offset =
+      header->pages_offset + header->npages * ZPAGE_SIZE;
+  header->prims_offset = header->prim_index_offset + index.size;
+  header->prims_size = prims.size;
+  header->file_size = header->prims_offset + prims.size;
+
+  data->bodies = bodies;
+  data->index = index;
+  data->prims = prims;
+  bodies = NULL;
+  index.data = prims.data = NULL;
+  rc = 0;
+
+done:
+  Py_XDECREF(order);
+  Py_XDECREF(numbering);
+  free(bodies);
+  free(index.data);
+  free(prims.data);
+  return rc;
+}
+
+int zimage_save(ZObject *root, const char *path) {
+  ZImageData data;
+  if (zimage_encode(root, &data) < 0)
+    return -1;
+
+  // Write next to the target and rename, so a process that has the old
+  // image mapped keeps its (unlinked) file and never sees a partial one
+  int rc = -1;
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long)getpid()) >=
+      (int)sizeof(tmp)) {
+    errno = ENAMETOOLONG;
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+  } else if (zimage_write_file(tmp, &data) < 0 || rename(tmp, path) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    unlink(tmp);
+  } else {
+    rc = 0;
+  }
+  zimage_data_free(&data);
+  return rc;
+}
+
+int zimage_share(ZObject *root) {
+  ZImageData data;
+  if (zimage_encode(root, &data) < 0)
+    return -1;
+
+  // Sealed, so every process that maps it sees the same immutable bytes
+  int fd = memfd_create("pyzgc-image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0 || zimage_write_fd(fd, &data) < 0 ||
+      fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  zimage_data_free(&data);
+  return fd;
+}
@@ -0,0 +1,76 @@
+#ifndef ZIMAGE_H
+#define ZIMAGE_H
+
+#include "zheap.h"
+#include "zobject.h"
+#include <Python.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Heap images: a ZObject graph compacted into a file (pyzgc.save_image) and
+// mapped back as immortal old pages (pyzgc.load_image).
+//
+// Image bodies keep the file encoding in their slots until something else
+// is stored there. A slot is either NULL (empty / None) or an encoded
+// reference with the low bit set, which no PyObject pointer has (the
+// remaining odd tag is ZBODY_REF_TAG, see zobject.h):
+//   (index << 3) | ZIMAGE_TAG_BODY   body `index` of the same image
+//   (index << 3) | ZIMAGE_TAG_PRIM   primitive `index` of the side section
+// Loads resolve them through per-image tables that are filled on first use,
+// so each body gets exactly one handle and nothing is decoded before it is
+// read.
+
+#define ZIMAGE_TAG_MASK 0x7
+#define ZIMAGE_TAG_BODY 0x1
+#define ZIMAGE_TAG_PRIM 0x3
+
+// Every image page starts with a 4KB-aligned region for the ZPage header
+#define ZIMAGE_HEADER_REGION ((sizeof(ZPage) + 4095) & ~(size_t)4095)
+#define ZIMAGE_BODIES_PER_PAGE                                                 \
+  ((ZPAGE_SIZE - ZIMAGE_HEADER_REGION) / sizeof(ZBody))
+
+typedef struct ZImage {
+  char *base;  // Mapping of the whole file
+  size_t size; // Mapped bytes
+  char *pages; // First heap page (ZPAGE_SIZE aligned)
+  uint64_t nbodies;
+  uint64_t nprims;
+  const uint64_t *prim_index; // Offset of each primitive in prims
+  const char *prims;
+  uint64_t prims_size;
+  PyObject **handles;   // One handle per body, created on first load
+  PyObject **values;    // Decoded primitives, created on first load
+  bool shared;          // Bodies mapped read-only from shared memory
+  pthread_mutex_t lock; // Serializes filling the two tables
+} ZImage;
+
+static inline bool zimage_is_ref(PyObject *slot) {
+  uintptr_t tag = (uintptr_t)slot & ZIMAGE_TAG_MASK;
+  return tag == ZIMAGE_TAG_BODY || tag == ZIMAGE_TAG_PRIM;
+}
+
+// Resolves an encoded slot of `body` (which must live in an image page).
+// New reference, or NULL with an exception set.
+PyObject *zimage_resolve(ZBody *body, PyObject *encoded);
+
+// The handle of a body that lives in an image page. New reference, or NULL
+// with an exception set.
+PyObject *zimage_handle(ZBody *body);
+
+// Writes the graph reachable from root. 0 on success, -1 with an exception.
+int zimage_save(ZObject *root, const char *path);
+
+// Maps an image and returns its root (new reference), or NULL with an
+// exception. Images stay mapped for the lifetime of the process.
+PyObject *zimage_load(const char *path);
+
+// Shared images: the same format in a sealed memfd. zimage_share returns the
+// new descriptor (close-on-exec) or -1 with an exception. zimage_attach maps
+// an image descriptor read-only and MAP_SHARED, so every process attached to
+// it reads the same physical pages; its bodies live on ZGEN_SHARED pages and
+// reject stores. The descriptor is not consumed.
+int zimage_share(ZObject *root);
+PyObject *zimage_attach(int fd);
+
+#endif
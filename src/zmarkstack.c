@@ -47,3 +47,13 @@ int zmarkstack_is_empty(ZMarkStack *stack) {
   pthread_mutex_unlock(&stack->lock);
   return empty;
 }
+
+void zmarkstack_for_each(ZMarkStack *stack, void (*fn)(void **entry, void *arg),
+                         void *arg) {
+  pthread_mutex_lock(&stack->lock);
+  for (ZMarkStackChunk *chunk = stack->head; chunk; chunk = chunk->next) {
+    for (size_t i = 0; i < chunk->top; i++)
+      fn(&chunk->objects[i], arg);
+  }
+  pthread_mutex_unlock(&stack->lock);
+}
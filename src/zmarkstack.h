@@ -22,5 +22,8 @@ void zmarkstack_init(ZMarkStack *stack);
 void zmarkstack_push(ZMarkStack *stack, void *obj);
 void *zmarkstack_pop(ZMarkStack *stack);
 int zmarkstack_is_empty(ZMarkStack *stack);
+// Calls fn on every entry, which it may rewrite in place
+void zmarkstack_for_each(ZMarkStack *stack, void (*fn)(void **entry, void *arg),
+                         void *arg);
 
 #endif
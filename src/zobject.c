@@ -1,15 +1,135 @@
 #define PY_SSIZE_T_CLEAN
 #include "zobject.h"
+#include "zarray.h"
 #include "zbarrier.h"
+#include "zcard.h"
+#include "zdict.h"
+#include "zgc.h"
 #include "zheap.h"
+#include "zimage.h"
+#include "zregion.h"
+#include "zsafepoint.h"
+#include "zsatb.h"
+#include "zstruct.h"
 #include <Python.h>
 #include <structmember.h>
 
+// Critical sections exist from 3.13 on; they are no-ops with the GIL
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+// Handle freelist. It is per thread on purpose: on free-threaded builds
+// mutators allocate and free handles in parallel, and a shared list would
+// need a lock on every allocation. A thread may run several interpreters,
+// which may each have an allocator of their own, so the list holds the
+// handles of one state at a time.
 #define ZOBJECT_FREELIST_MAX 1024
 static __thread ZObject *zobject_freelist[ZOBJECT_FREELIST_MAX];
 static __thread int zobject_freelist_size = 0;
+static __thread ZState *zobject_freelist_state = NULL;
+
+// Body back-pointers (ZBody.handle). Every handle sets its back-pointer when
+// it is created and clears it when it dies, and loads reuse the handle while
+// it lives, so a body never has two handles. They aren't counted.
+// Relocation moves the live handle along with its body through them, since
+// the collector doesn't trace handles (zgc.c). Whoever reads the handle out
+// of a body other than its owner holds ZHANDLE_BUSY in the word meanwhile,
+// so the handle can't be freed under them. On free-threaded builds a load
+// may revive a handle whose refcount just dropped to zero; its dealloc then
+// backs off.
+#define ZHANDLE_BUSY ((uintptr_t)1)
+
+// Returns the handle with its back-pointer locked, or NULL (unlocked) if the
+// body has none. zobject_unlock_handle stores it, or another value, back.
+static PyObject *zobject_lock_handle(ZBody *body) {
+  PyObject **slot = zbody_handle_slot(body);
+  for (;;) {
+    PyObject *handle = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!handle)
+      return NULL;
+    // Held for a few instructions at most
+    if (((uintptr_t)handle & ZHANDLE_BUSY) == 0 &&
+        __atomic_compare_exchange_n(
+            slot, &handle, (PyObject *)((uintptr_t)handle | ZHANDLE_BUSY),
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return handle;
+  }
+}
+
+static void zobject_unlock_handle(ZBody *body, PyObject *handle) {
+  __atomic_store_n(zbody_handle_slot(body), handle, __ATOMIC_RELEASE);
+}
+
+// Image bodies find their handles through the image tables, and shared
+// image pages are read-only
+static inline bool zbody_has_back_pointer(ZBody *body) {
+  return zheap_get_page(body)->image == NULL;
+}
+
+bool zobject_handle_is_held(ZBody *body) {
+  PyObject *handle = zobject_lock_handle(body);
+  if (!handle)
+    return false;
+  // A dying handle (refcount 0) is not held
+  Py_ssize_t registered =
+      __atomic_load_n(&((ZObject *)handle)->registered, __ATOMIC_ACQUIRE);
+  bool held = Py_REFCNT(handle) > registered;
+  zobject_unlock_handle(body, handle);
+  return held;
+}
+
+bool zobject_forget_handle(ZObject *self) {
+  if (!zobject_get_body(self))
+    return true;
+  bool revived = false;
+  zsafepoint_enter();
+  // The interpreter dropped the module and its heap with it
+  if (zstate->closed) {
+    zsafepoint_leave();
+    return true;
+  }
+  if (!Z_HAS_COLOR(self->body, zstate->good_color))
+    zbarrier_fix_pointer(self);
+  ZBody *body = (ZBody *)Z_ADDRESS(zobject_get_body(self));
+  PyObject *handle =
+      zbody_has_back_pointer(body) ? zobject_lock_handle(body) : NULL;
+  if (handle) {
+#ifdef Py_GIL_DISABLED
+    // A concurrent load took a reference and now owns the handle
+    revived = handle == (PyObject *)self && Py_REFCNT(self) > 0;
+#endif
+    if (handle == (PyObject *)self && !revived) {
+      zgc_note_handle(body, false);
+      handle = NULL;
+    }
+    zobject_unlock_handle(body, handle);
+  }
+  zsafepoint_leave();
+  return !revived;
+}
+
+void *zobject_pin(PyObject *obj) {
+  // After the barrier, inside the section, the body is not on a page being
+  // relocated, and the next relocation start will see the pin
+  zsafepoint_enter();
+  zbarrier_load(obj);
+  void *body = Z_ADDRESS(zobject_get_body((ZObject *)obj));
+  if (body)
+    zpage_pin(zheap_get_page(body));
+  zsafepoint_leave();
+  return body;
+}
+
+void zobject_unpin(void *body) { zpage_unpin(zheap_get_page(body)); }
 
 static void ZObject_dealloc(ZObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  zstate_enter();
+  if (!zobject_forget_handle(self))
+    return;
+
   // Clear weak references
   if (self->weakreflist != NULL) {
     PyObject_ClearWeakRefs((PyObject *)self);
@@ -20,20 +140,27 @@ static void ZObject_dealloc(ZObject *self) {
   // zheap_free(self->body); // Currently no-op or unmap
 
   // Push to freelist
-  if (zobject_freelist_size < ZOBJECT_FREELIST_MAX) {
+  if (zobject_freelist_size == 0)
+    zobject_freelist_state = zstate;
+  if (zobject_freelist_state == zstate &&
+      zobject_freelist_size < ZOBJECT_FREELIST_MAX) {
     zobject_freelist[zobject_freelist_size++] = self;
   } else {
-    Py_TYPE(self)->tp_free((PyObject *)self);
+    type->tp_free((PyObject *)self);
   }
+  // Instances of heap types own a reference to their type
+  Py_DECREF(type);
 }
 
 // Removed ZObject_traverse and ZObject_clear as they are for CPython GC
 
-static PyObject *ZObject_alloc(PyTypeObject *type, Py_ssize_t nitems) {
+// Handle without a body
+static ZObject *zobject_new_handle(PyTypeObject *type) {
   ZObject *self;
+  zstate_enter();
 
   // Try freelist first
-  if (zobject_freelist_size > 0) {
+  if (zobject_freelist_size > 0 && zobject_freelist_state == zstate) {
     self = zobject_freelist[--zobject_freelist_size];
     PyObject_Init((PyObject *)self, type);
   } else {
@@ -41,15 +168,92 @@ static PyObject *ZObject_alloc(PyTypeObject *type, Py_ssize_t nitems) {
     // Use PyObject_New for non-GC object
     self = PyObject_New(ZObject, type);
     if (self == NULL) {
-      return PyErr_NoMemory();
+      PyErr_NoMemory();
+      return NULL;
     }
   }
 
   self->weakreflist = NULL; // Initialize weakreflist
+  self->registered = 0;
+  self->body = NULL;
+  return self;
+}
+
+PyObject *zobject_wrap_body(PyTypeObject *type, ZBody *body) {
+  ZObject *self = zobject_new_handle(type);
+  if (self == NULL)
+    return NULL;
+  self->body = (ZBody *)Z_WITH_COLOR(body, zstate->good_color);
+  return (PyObject *)self;
+}
+
+// New reference to the handle of a body, given its current address. Must
+// be called inside a safepoint section.
+static PyObject *zobject_handle_of(ZBody *body) {
+  if (!zbody_has_back_pointer(body))
+    return zimage_handle(body);
+
+  PyObject *handle;
+  for (;;) {
+    PyObject *existing = zobject_lock_handle(body);
+    if (existing && Py_REFCNT(existing) > 0) {
+      handle = existing;
+      Py_INCREF(handle);
+      zobject_unlock_handle(body, handle);
+      break;
+    }
+
+    // No live handle: make one of the type the body's header asks for
+    zgc_note_handle(body, true);
+    const ZLayout *layout = zstruct_body_layout(body);
+    uint64_t header = zbody_get_word(body, 0);
+    if (zarray_is_header(header))
+      handle = zarray_wrap_body(body);
+    else if (zdict_is_header(header))
+      handle = zdict_wrap_body(body);
+    else
+      handle = zobject_wrap_body(layout ? layout->type : zstate->types.object,
+                                 body);
+    if (existing) {
+      zobject_unlock_handle(body, handle);
+      break;
+    }
+    // Nobody locks an empty back-pointer, but another load may fill it
+    // first (free-threaded builds)
+    PyObject *expected = NULL;
+    if (!handle || __atomic_compare_exchange_n(zbody_handle_slot(body),
+                                               &expected, handle, false,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE))
+      break;
+    Py_DECREF(handle);
+  }
+
+  // Colors the handle good if it went unused for a while
+  return zbarrier_load(handle);
+}
+
+PyObject *zobject_alloc(PyTypeObject *type, Py_ssize_t nitems) {
+  return zobject_alloc_body(type, sizeof(ZBody), 0);
+}
+
+PyObject *zobject_alloc_body(PyTypeObject *type, size_t size,
+                             uint64_t header) {
+  ZObject *self = zobject_new_handle(type);
+  if (self == NULL)
+    return NULL;
 
   // Allocate Body from ZHeap (Inline Fast Path)
   // mmap memory is zeroed, so no need to memset if new page.
-  self->body = (ZBody *)zheap_alloc_inline(sizeof(ZBody));
+  zsafepoint_enter();
+  self->body = (ZBody *)zheap_alloc_inline(size);
+  if (self->body) {
+    ZBody *raw = (ZBody *)Z_ADDRESS(self->body);
+    // The header sizes the body (zbody_size), so it goes first
+    zbody_set_word(raw, 0, header);
+    *zbody_handle_slot(raw) = (PyObject *)self;
+  }
+  zsafepoint_leave();
   if (self->body == NULL) {
     Py_DECREF(self);
     return PyErr_NoMemory();
@@ -60,7 +264,7 @@ static PyObject *ZObject_alloc(PyTypeObject *type, Py_ssize_t nitems) {
 
 static PyObject *ZObject_new(PyTypeObject *type, PyObject *args,
                              PyObject *kwds) {
-  // tp_alloc (ZObject_alloc) already handles ZObject and ZBody allocation.
+  // tp_alloc (zobject_alloc) already handles ZObject and ZBody allocation.
   // We just need to return the allocated object.
   ZObject *self = (ZObject *)type->tp_alloc(type, 0);
   if (self == NULL) {
@@ -69,62 +273,118 @@ static PyObject *ZObject_new(PyTypeObject *type, PyObject *args,
   return (PyObject *)self;
 }
 
-static PyObject *ZObject_store(ZObject *self, PyObject *args) {
-  int index;
-  PyObject *value;
+int zobject_store_slot(ZObject *self, Py_ssize_t index, PyObject *value) {
+  if (index < 0 || index >= ZOBJECT_SLOTS) {
+    PyErr_SetString(PyExc_IndexError, "Slot index out of range");
+    return -1;
+  }
+  return zobject_store_ref(self, index, value);
+}
 
-  if (!PyArg_ParseTuple(args, "iO", &index, &value))
-    return NULL;
+int zobject_store_ref(ZObject *self, size_t index, PyObject *value) {
+  PyObject *old = NULL;
+  int ok = 0;
+  bool shared = false;
+
+  // Stores to one object are serialized (free-threaded builds); the body
+  // stays put for the GC until we leave the section.
+  zsafepoint_enter();
+  Py_BEGIN_CRITICAL_SECTION(self);
 
   // Barrier: Ensure self->body is up to date (Load Barrier for self)
-  if (!Z_HAS_COLOR(self->body, zgc_good_color)) {
+  if (!Z_HAS_COLOR(self->body, zstate->good_color)) {
     zbarrier_fix_pointer(self);
   }
 
-  if (!self->body) {
-    PyErr_SetString(PyExc_RuntimeError, "ZObject has no body");
-    return NULL;
-  }
+  ZBody *colored = zobject_get_body(self);
+  // Shared image bodies are mapped read-only
+  if (colored && zheap_is_shared(colored)) {
+    shared = true;
+  } else if (colored) {
+    // Mask pointer before access
+    ZBody *body = (ZBody *)Z_ADDRESS(colored);
+
+    // Handles are stored as direct references to their (healed) body.
+    // Anything else is counted.
+    PyObject *word = value;
+    ZBody *value_body = NULL;
+    if (value && zobject_is_handle(value)) {
+      zbarrier_load(value);
+      value_body = zobject_get_body((ZObject *)value);
+    }
+    if (value_body) {
+      word = zbody_make_ref(value_body);
+    } else {
+      Py_XINCREF(value);
+    }
 
-  // Barrier: Ensure self->body is good before writing
-  if (!Z_HAS_COLOR(self->body, zgc_good_color)) {
-    zbarrier_fix_pointer(self);
+    // Swap atomically: the marker reads slots concurrently, and the value
+    // we log below must be exactly the one we replaced
+    old = zbody_swap_slot(body, index, word);
+
+    // Pre-write barrier (SATB): while marking, log the reference we just
+    // overwrote so the marker still sees the snapshot at mark start.
+    if (old && zbody_is_ref(old))
+      zsatb_pre_write(zbody_ref_target(old));
+    // Only plain values are counted; heap image references point at
+    // immortal bodies
+    if (old && (zbody_is_ref(old) || zimage_is_ref(old)))
+      old = NULL;
+
+    // Write Barrier: If self is Old and value is Young, add to RemSet.
+    // Frozen bodies dirty their card instead, for any mutable value.
+    ZPage *holder = zheap_get_page(body);
+    if (value_body && holder->is_frozen) {
+      ZPage *target = zheap_get_page(Z_ADDRESS(value_body));
+      if (!target->is_frozen && target->generation != ZGEN_SHARED)
+        zcard_dirty(holder, body);
+    } else if (value_body && zheap_is_old(colored) &&
+               zheap_is_young(value_body)) {
+      zremset_add(colored);
+    }
+    // Escape barrier: a region body stored outside its region has to be
+    // copied out when the region ends (zregion.h)
+    if (value_body) {
+      ZRegion *region = zheap_get_page(value_body)->region;
+      if (region && zheap_get_page(colored)->region != region)
+        zregion_escape(region, colored, index);
+    }
+    ok = 1;
   }
 
-  if (index < 0 || index >= ZOBJECT_SLOTS) {
-    PyErr_SetString(PyExc_IndexError, "Slot index out of range");
-    return NULL;
-  }
+  Py_END_CRITICAL_SECTION();
+  zsafepoint_leave();
 
-  // Barrier: Ensure self->body is good before writing
-  if (!Z_HAS_COLOR(self->body, zgc_good_color)) {
-    zbarrier_fix_pointer(self);
+  if (shared) {
+    PyErr_SetString(PyExc_TypeError,
+                    "cannot store into an object of a shared heap image");
+    return -1;
   }
-
-  // Mask pointer before access
-  ZBody *body = (ZBody *)Z_ADDRESS(self->body);
-
-  PyObject *old = body->slots[index];
-  Py_INCREF(value);
-  body->slots[index] = value;
-  Py_XDECREF(old);
-
-  // Write Barrier: If self is Old and value is Young (ZObject), add to RemSet
-  if (zheap_is_old(self->body) && Py_TYPE(value) == &ZObjectType) {
-    ZObject *zval = (ZObject *)value;
-    if (zval->body && zheap_is_young(zval->body)) {
-      zremset_add(self->body);
-    }
+  if (!ok) {
+    PyErr_SetString(PyExc_RuntimeError, "ZObject has no body");
+    return -1;
   }
 
-  Py_RETURN_NONE;
+  // Dropping the old value may run arbitrary code (finalizers), so do it
+  // outside the section
+  Py_XDECREF(old);
+  return 0;
 }
 
-static PyObject *ZObject_load(ZObject *self, PyObject *args) {
+static PyObject *ZObject_store(ZObject *self, PyObject *args) {
   int index;
-  if (!PyArg_ParseTuple(args, "i", &index))
+  PyObject *value;
+
+  if (!PyArg_ParseTuple(args, "iO", &index, &value))
     return NULL;
 
+  if (zobject_store_slot(self, index, value) < 0)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+PyObject *zobject_load_slot(ZObject *self, Py_ssize_t index) {
   if (index < 0 || index >= ZOBJECT_SLOTS) {
     PyErr_SetString(PyExc_IndexError, "Slot index out of range");
     return NULL;
@@ -137,14 +397,6 @@ static PyObject *ZObject_load(ZObject *self, PyObject *args) {
   // zbarrier_load(obj) takes the PyObject* (Handle) that was loaded.
   // So we load the handle from the body.
 
-  // Mask pointer before access
-  ZBody *body = (ZBody *)Z_ADDRESS(self->body);
-
-  PyObject *obj = body->slots[index];
-  if (obj == NULL) {
-    Py_RETURN_NONE;
-  }
-
   // The barrier might need to check if 'obj' (Handle) is valid?
   // No, 'obj' is a Handle in CPython heap. It's always valid.
   // But we might want to check if the *reference* we just loaded is good?
@@ -204,7 +456,16 @@ static PyObject *ZObject_load(ZObject *self, PyObject *args) {
   // For now, let's implement the "Barrier on Self" inline or helper.
   // We need to check color.
 
-  if (!Z_HAS_COLOR(self->body, zgc_good_color)) {
+  return zobject_load_ref(self, index);
+}
+
+PyObject *zobject_load_ref(ZObject *self, size_t index) {
+  PyObject *result;
+
+  zsafepoint_enter();
+  Py_BEGIN_CRITICAL_SECTION(self);
+
+  if (!Z_HAS_COLOR(self->body, zstate->good_color)) {
     // Slow path: Fix self->body
     // We need a function for this.
     zbarrier_fix_pointer((ZObject *)self);
@@ -212,19 +473,52 @@ static PyObject *ZObject_load(ZObject *self, PyObject *args) {
 
   // Now self->body is good (or at least mapped).
   // Re-read body after fix
-  body = (ZBody *)Z_ADDRESS(self->body);
-  obj = body->slots[index];
+  ZBody *body = (ZBody *)Z_ADDRESS(zobject_get_body(self));
+  PyObject *obj = zbody_get_slot(body, index);
 
   if (obj == NULL) {
-    Py_RETURN_NONE;
+    result = Py_None;
+    Py_INCREF(result);
+  } else if (zbody_is_ref(obj)) {
+    // Load barrier on the slot itself: remap a stale body and heal the
+    // slot. Colors repeat every other cycle and minor cycles don't visit
+    // old bodies, so also check the page: evacuated pages are never reused.
+    // Frozen bodies are only healed when the target moved, so that their
+    // pages stay shared with forked children.
+    ZBody *target = zbody_ref_target(obj);
+    ZBody *raw = (ZBody *)Z_ADDRESS(target);
+    if (!Z_HAS_COLOR(target, zstate->good_color) ||
+        zheap_get_page(raw)->is_evacuating) {
+      raw = (ZBody *)zbarrier_resolve(target);
+      if (raw != Z_ADDRESS(target) || !zheap_get_page(body)->is_frozen) {
+        PyObject *healed =
+            zbody_make_ref((ZBody *)Z_WITH_COLOR(raw, zstate->good_color));
+        zbody_heal_slot(body, index, obj, healed);
+      }
+    }
+    result = zobject_handle_of(raw);
+  } else if (zimage_is_ref(obj)) {
+    // Body mapped from a heap image: handle or value created on first read
+    result = zimage_resolve(body, obj);
+  } else {
+    // Take our reference before a concurrent store can drop the slot's
+    result = obj;
+    Py_INCREF(result);
   }
 
-  // Now barrier on the result
-  PyObject *result = zbarrier_load(obj);
-  Py_INCREF(result);
+  Py_END_CRITICAL_SECTION();
+  zsafepoint_leave();
   return result;
 }
 
+static PyObject *ZObject_load(ZObject *self, PyObject *args) {
+  int index;
+  if (!PyArg_ParseTuple(args, "i", &index))
+    return NULL;
+
+  return zobject_load_slot(self, index);
+}
+
 static PyObject *ZObject_repr(ZObject *self) {
   if (!self->body) {
     return PyUnicode_FromFormat("<pyzgc.Object at %p (freed)>", self);
@@ -236,6 +530,8 @@ static PyObject *ZObject_repr(ZObject *self) {
     gen = 0;
   else if (zheap_is_old(self->body))
     gen = 1;
+  else if (zheap_is_shared(self->body))
+    gen = 2;
 
   // Check forwarding (if evacuating)
   // This is tricky without locking, but for debug repr it's fine to be racy
@@ -259,16 +555,24 @@ static PyMethodDef ZObject_methods[] = {
      "Load an object from a slot (with barrier)."},
     {NULL}};
 
-PyTypeObject ZObjectType = {
-    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "pyzgc.Object",
-    .tp_doc = "ZGC Managed Object",
-    .tp_basicsize = sizeof(ZObject),
-    .tp_itemsize = 0,
-    .tp_weaklistoffset = offsetof(ZObject, weakreflist),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
-    .tp_alloc = ZObject_alloc,
-    .tp_new = ZObject_new,
-    .tp_dealloc = (destructor)ZObject_dealloc,
-    .tp_repr = (reprfunc)ZObject_repr,
-    .tp_methods = ZObject_methods,
+static PyMemberDef ZObject_members[] = {
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(ZObject, weakreflist),
+     READONLY},
+    {NULL}};
+
+static PyType_Slot ZObject_slots[] = {
+    {Py_tp_doc, "ZGC Managed Object"},
+    {Py_tp_alloc, zobject_alloc},
+    {Py_tp_new, ZObject_new},
+    {Py_tp_dealloc, ZObject_dealloc},
+    {Py_tp_repr, ZObject_repr},
+    {Py_tp_methods, ZObject_methods},
+    {Py_tp_members, ZObject_members},
+    {0, NULL}};
+
+PyType_Spec ZObjectSpec = {
+    .name = "pyzgc.Object",
+    .basicsize = sizeof(ZObject),
+    .flags = ZTYPE_FLAGS | Py_TPFLAGS_BASETYPE,
+    .slots = ZObject_slots,
 };
@@ -1,7 +1,10 @@
 #ifndef ZOBJECT_H
 #define ZOBJECT_H
 
+#include "zstate.h"
 #include <Python.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #define ZOBJECT_SLOTS 10
 
@@ -9,18 +12,154 @@
 // It does NOT have PyObject_HEAD because it's not a Python object itself.
 typedef struct {
   PyObject *slots[ZOBJECT_SLOTS];
-  // We might add a forwarding pointer here later
-  // struct ZBody* forwarding_ptr;
+  // The live handle of this body, if any (not counted). The last word of
+  // every body, arrays included; see zbody_handle_slot in zarray.h.
+  PyObject *handle;
 } ZBody;
 
+#define ZBODY_WORDS (sizeof(ZBody) / sizeof(PyObject *))
+
+// Slot words. Besides NULL and counted PyObject pointers (8-byte aligned), a
+// slot may hold a direct reference to another body:
+//   colored body pointer | ZBODY_REF_TAG
+// Storing a handle stores its body this way, so the marker follows
+// body-to-body edges without reading the CPython heap, and the referenced
+// handle isn't kept alive by the slot. Loads turn the body back into its
+// handle (the live one if there is one, else a new one). The tag has the low
+// bit set like heap image references (zimage.h) and can't be confused with
+// the struct and array headers, which are even.
+// A reference is a full word, like the handle pointer it replaces: pages,
+// large pages and images are separate mappings, with no reserved range a
+// 32-bit offset could index. Bodies save no memory by it, and the handle
+// word makes each one a word larger.
+#define ZBODY_TAG_MASK 0x7
+#define ZBODY_REF_TAG 0x5
+
 // ZObject is the Python wrapper (Handle).
 // It lives in the CPython heap (managed by standard malloc/free or pool).
 // It points to the ZBody in the ZHeap.
 typedef struct {
   PyObject_HEAD ZBody *body;
   PyObject *weakreflist; // List of weak references to this object
+  // References held by pyzgc.WeakRef and pyzgc.finalize (zref.h); the
+  // others are Python's. Array and dict handles share this prefix.
+  Py_ssize_t registered;
 } ZObject;
 
-extern PyTypeObject ZObjectType;
+// Specs of the handle types; each interpreter makes its own types from
+// them (ZState.types)
+extern PyType_Spec ZObjectSpec;
+// Base of the typed layouts built by pyzgc.define (see zstruct.h)
+extern PyType_Spec ZStructSpec;
+// pyzgc.Array (see zarray.h)
+extern PyType_Spec ZArraySpec;
+// pyzgc.Dict (see zdict.h)
+extern PyType_Spec ZDictSpec;
+
+// Is obj a handle to a ZBody of the calling thread's interpreter? Types
+// built by pyzgc.define derive from its Struct directly and can't be
+// subclassed further.
+static inline bool zobject_is_handle(PyObject *obj) {
+  zstate_enter();
+  const ZTypes *types = &zstate->types;
+  PyTypeObject *type = Py_TYPE(obj);
+  return type == types->object || type == types->array ||
+         type == types->dict ||
+         (type->tp_base && type->tp_base == types->structure);
+}
+
+// tp_alloc of handle types: a handle plus a fresh body from the TLAB
+PyObject *zobject_alloc(PyTypeObject *type, Py_ssize_t nitems);
+// Same with a body of `size` bytes whose word 0 is `header`, in place before
+// anything can walk the body (typed struct bodies, see zstruct.h)
+PyObject *zobject_alloc_body(PyTypeObject *type, size_t size,
+                             uint64_t header);
+
+// New handle of `type` for an existing body (heap images, direct
+// references). New reference.
+PyObject *zobject_wrap_body(PyTypeObject *type, ZBody *body);
+
+// Called first by the dealloc of every handle type: forgets the body's
+// back-pointer to the handle. Returns false if the handle was revived
+// (free-threaded builds only) and must not be freed.
+bool zobject_forget_handle(ZObject *self);
+
+// Does Python hold the live handle of body, through more references than
+// the WeakRefs and finalizers registered on it? Any thread.
+bool zobject_handle_is_held(ZBody *body);
+
+// Keeps the body of a handle (any handle type) at its current address until
+// the matching zobject_unpin, by pinning its page (see ZPage.pin_count).
+// Returns the raw body pointer, or NULL if the handle has no body.
+void *zobject_pin(PyObject *obj);
+void zobject_unpin(void *body);
+
+// Slots and handle->body are read by the GC thread (and, on free-threaded
+// builds, by other mutators) while they are being written, so every access
+// goes through these atomics. Indices count words from the start of the
+// body; array bodies (zarray.h) go past ZOBJECT_SLOTS.
+static inline PyObject *zbody_get_slot(ZBody *body, size_t index) {
+  return __atomic_load_n((PyObject **)body + index, __ATOMIC_ACQUIRE);
+}
+
+static inline PyObject *zbody_swap_slot(ZBody *body, size_t index,
+                                        PyObject *value) {
+  return __atomic_exchange_n((PyObject **)body + index, value,
+                             __ATOMIC_ACQ_REL);
+}
+
+static inline bool zbody_is_ref(PyObject *slot) {
+  return ((uintptr_t)slot & ZBODY_TAG_MASK) == ZBODY_REF_TAG;
+}
+
+static inline PyObject *zbody_make_ref(ZBody *colored) {
+  return (PyObject *)((uintptr_t)colored | ZBODY_REF_TAG);
+}
+
+// Colored body pointer of a direct reference
+static inline ZBody *zbody_ref_target(PyObject *slot) {
+  return (ZBody *)((uintptr_t)slot & ~(uintptr_t)ZBODY_TAG_MASK);
+}
+
+// Heals a slot only if it still holds `expected`
+static inline bool zbody_heal_slot(ZBody *body, size_t index,
+                                   PyObject *expected, PyObject *healed) {
+  return __atomic_compare_exchange_n((PyObject **)body + index, &expected,
+                                     healed, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE);
+}
+
+static inline ZBody *zobject_get_body(ZObject *zobj) {
+  return __atomic_load_n(&zobj->body, __ATOMIC_ACQUIRE);
+}
+
+// Raw word access for headers and the unboxed fields of typed structs
+static inline uint64_t zbody_get_word(ZBody *body, size_t index) {
+  return (uint64_t)(uintptr_t)zbody_get_slot(body, index);
+}
+
+static inline void zbody_set_word(ZBody *body, size_t index, uint64_t word) {
+  __atomic_store_n((PyObject **)body + index, (PyObject *)(uintptr_t)word,
+                   __ATOMIC_RELEASE);
+}
+
+// Heal zobj->body only if nobody else changed it since we read `expected`
+static inline bool zobject_heal_body(ZObject *zobj, ZBody *expected,
+                                     ZBody *healed) {
+  return __atomic_compare_exchange_n(&zobj->body, &expected, healed, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Slot accessors with load/write barriers applied (shared by the Python
+// methods and the C-API capsule).
+// zobject_load_slot returns a new reference (None for an empty slot).
+// zobject_store_slot returns 0 on success, -1 with an exception set.
+PyObject *zobject_load_slot(ZObject *self, Py_ssize_t index);
+int zobject_store_slot(ZObject *self, Py_ssize_t index, PyObject *value);
+
+// The same without the range check, for any reference word of a body
+// (struct fields, reference array elements)
+PyObject *zobject_load_ref(ZObject *self, size_t index);
+int zobject_store_ref(ZObject *self, size_t index, PyObject *value);
 
 #endif
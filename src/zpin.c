@@ -0,0 +1,116 @@
+#define PY_SSIZE_T_CLEAN
+#include "zpin.h"
+#include "zobject.h"
+#include <Python.h>
+#include <structmember.h>
+
+static PyObject *ZPin_new(PyTypeObject *type, PyObject *args,
+                          PyObject *kwds) {
+  static char *kwlist[] = {"obj", NULL};
+  PyObject *obj;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:pin", kwlist, &obj))
+    return NULL;
+  if (!zobject_is_handle(obj)) {
+    PyErr_Format(PyExc_TypeError, "cannot pin '%.100s' object",
+                 Py_TYPE(obj)->tp_name);
+    return NULL;
+  }
+
+  ZPin *self = (ZPin *)type->tp_alloc(type, 0);
+  if (!self)
+    return NULL;
+  self->body = zobject_pin(obj);
+  if (!self->body) {
+    Py_DECREF(self);
+    PyErr_SetString(PyExc_ValueError, "object has no body");
+    return NULL;
+  }
+  self->obj = Py_NewRef(obj);
+  return (PyObject *)self;
+}
+
+// Idempotent; two threads releasing the same pin unpin the page once
+static void zpin_release(ZPin *self) {
+  void *body = __atomic_exchange_n(&self->body, NULL, __ATOMIC_ACQ_REL);
+  if (body)
+    zobject_unpin(body);
+}
+
+static void ZPin_dealloc(ZPin *self) {
+  zpin_release(self);
+  Py_XDECREF(self->obj);
+  PyTypeObject *type = Py_TYPE(self);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static PyObject *ZPin_unpin(ZPin *self, PyObject *Py_UNUSED(ignored)) {
+  zpin_release(self);
+  Py_RETURN_NONE;
+}
+
+static PyObject *ZPin_enter(ZPin *self, PyObject *Py_UNUSED(ignored)) {
+  return Py_NewRef(self);
+}
+
+static PyObject *ZPin_exit(ZPin *self, PyObject *args) {
+  zpin_release(self);
+  Py_RETURN_FALSE;
+}
+
+static PyObject *ZPin_get_address(ZPin *self, void *closure) {
+  void *body = __atomic_load_n(&self->body, __ATOMIC_ACQUIRE);
+  if (!body) {
+    PyErr_SetString(PyExc_ValueError, "object is no longer pinned");
+    return NULL;
+  }
+  return PyLong_FromVoidPtr(body);
+}
+
+static PyObject *ZPin_get_pinned(ZPin *self, void *closure) {
+  return PyBool_FromLong(__atomic_load_n(&self->body, __ATOMIC_ACQUIRE) !=
+                         NULL);
+}
+
+static PyObject *ZPin_repr(ZPin *self) {
+  void *body = __atomic_load_n(&self->body, __ATOMIC_ACQUIRE);
+  if (!body)
+    return PyUnicode_FromFormat("<pyzgc.pin at %p; released>", self);
+  return PyUnicode_FromFormat("<pyzgc.pin at %p; '%s' at %p, body=%p>", self,
+                              Py_TYPE(self->obj)->tp_name, self->obj, body);
+}
+
+static PyMethodDef ZPin_methods[] = {
+    {"unpin", (PyCFunction)ZPin_unpin, METH_NOARGS,
+     "Let the body move again. Does nothing if already unpinned."},
+    {"__enter__", (PyCFunction)ZPin_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)ZPin_exit, METH_VARARGS, NULL},
+    {NULL}};
+
+static PyMemberDef ZPin_members[] = {
+    {"obj", T_OBJECT, offsetof(ZPin, obj), READONLY, "The pinned object."},
+    {NULL}};
+
+static PyGetSetDef ZPin_getset[] = {
+    {"address", (getter)ZPin_get_address, NULL,
+     "Raw address of the body (word 0), stable while pinned.", NULL},
+    {"pinned", (getter)ZPin_get_pinned, NULL, "False once unpinned.", NULL},
+    {NULL}};
+
+static PyType_Slot ZPin_slots[] = {
+    {Py_tp_doc, "pin(obj): keep the body of a pyzgc object at its address "
+                "until unpin() or the end of a with block"},
+    {Py_tp_new, ZPin_new},
+    {Py_tp_dealloc, ZPin_dealloc},
+    {Py_tp_repr, ZPin_repr},
+    {Py_tp_methods, ZPin_methods},
+    {Py_tp_members, ZPin_members},
+    {Py_tp_getset, ZPin_getset},
+    {0, NULL}};
+
+PyType_Spec ZPinSpec = {
+    .name = "pyzgc.pin",
+    .basicsize = sizeof(ZPin),
+    .flags = ZTYPE_FLAGS,
+    .slots = ZPin_slots,
+};
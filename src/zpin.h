@@ -0,0 +1,26 @@
+#ifndef ZPIN_H
+#define ZPIN_H
+
+#include <Python.h>
+
+// Pinning: pyzgc.pin(obj) keeps obj's body at one address so that C code
+// can use a raw pointer into it (I/O, another thread, an external library)
+// without copying the data out first.
+//
+// Pins are counted per page (ZPage.pin_count, the counter buffer exports of
+// numeric arrays already use). Relocation start leaves pinned pages out of
+// the relocation set, so the body stays where it is; everything else on
+// the page stays too until the last pin is released. Objects that are
+// never pinned pay nothing: the counter is only read at relocation start.
+//
+// A pin holds a reference to its handle, not to the body: like any handle,
+// it does not make the body reachable from the roots.
+
+typedef struct {
+  PyObject_HEAD PyObject *obj; // The pinned handle
+  void *body;                  // Raw body address, NULL once unpinned
+} ZPin;
+
+extern PyType_Spec ZPinSpec;
+
+#endif
@@ -0,0 +1,261 @@
+#include <Python.h>
+#include "zpool.h"
+#include "zgc.h"
+#include "zheap.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Ready pages, linked through ZPage.next. The filler pushes with a CAS.
+// Pops (zpool_take, zpool_drain) are serialized by pop_lock, once per 2MB
+// page at most, so a popper never sees ABA or reads the header of a page
+// that someone else has just unmapped.
+static _Atomic(ZPage *) pool_head = NULL;
+static pthread_mutex_t pop_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_size_t pool_ready = 0;
+static atomic_size_t pool_filling = 0; // Being mapped by the filler
+static atomic_size_t pool_target = 0;
+static atomic_size_t pool_pages = ZPOOL_DEFAULT_PAGES; // 0 is off
+static atomic_bool pool_populate = false;
+static atomic_uint_fast64_t pool_hits = 0;
+static atomic_uint_fast64_t pool_misses = 0;
+static atomic_uint_fast64_t pool_filled = 0;
+static atomic_uint_fast64_t pool_returned = 0;
+
+// Filler thread, started by the first zpool_take with the pool on. It
+// sleeps for ZPOOL_INTERVAL_NS unless a take runs the pool low.
+#define ZPOOL_INTERVAL_NS (100 * 1000 * 1000)
+
+static pthread_mutex_t filler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filler_cond;
+static bool filler_started = false;
+static bool filler_wake = false;
+
+static uint64_t zpool_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void zpool_push(ZPage *page) {
+  ZPage *head = atomic_load(&pool_head);
+  do {
+    page->next = head;
+  } while (!atomic_compare_exchange_weak(&pool_head, &head, page));
+  atomic_fetch_add(&pool_ready, 1);
+}
+
+// Callers hold pop_lock
+static ZPage *zpool_pop(void) {
+  ZPage *head = atomic_load(&pool_head);
+  while (head &&
+         !atomic_compare_exchange_weak(&pool_head, &head, head->next)) {
+  }
+  if (head) {
+    atomic_fetch_sub(&pool_ready, 1);
+    head->next = NULL;
+  }
+  return head;
+}
+
+// Whether the page being filled keeps the heap of zstate within its soft
+// max (or its max), with no memory pressure there
+static bool zpool_state_may_grow(void *arg) {
+  (void)arg;
+  ZGCMemory memory;
+  zgc_get_memory(&memory);
+  if (memory.pressure)
+    return false;
+  size_t limit = atomic_load(&zstate->soft_max_bytes);
+  if (!limit)
+    limit = atomic_load(&zstate->max_bytes);
+  return !limit || zheap_footprint() <= limit;
+}
+
+// The pool is on and may grow by a page in every heap, since any of them
+// may take it. The page counts in the footprints from here on, so that a
+// heap charging a page meanwhile sees it.
+static bool zpool_may_grow(void) {
+  return atomic_load(&pool_pages) &&
+         zstate_for_each(zpool_state_may_grow, NULL);
+}
+
+// Maps, pre-faults and pushes one page. Returns false if it can't.
+static bool zpool_fill_one(void) {
+  atomic_fetch_add(&pool_filling, 1);
+  bool populate = atomic_load(&pool_populate);
+  ZPage *page = zpool_may_grow() ? zpage_map(populate) : NULL;
+  if (!page) {
+    atomic_fetch_sub(&pool_filling, 1);
+    return false;
+  }
+  if (!populate) {
+    // zpage_init has touched the header; fault in the rest
+    size_t os_page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t off = sizeof(ZPage); off < ZPAGE_SIZE; off += os_page)
+      ((volatile char *)page)[off] = 0;
+  }
+  zpool_push(page);
+  atomic_fetch_sub(&pool_filling, 1);
+  atomic_fetch_add(&pool_filled, 1);
+  // Turned off while the page was mapped: zpool_configure's drain may have
+  // run before the push
+  if (!atomic_load(&pool_pages)) {
+    zpool_drain();
+    return false;
+  }
+  return true;
+}
+
+static void *zpool_filler_func(void *arg) {
+  uint64_t last_ns = zpool_clock_ns();
+  uint64_t last_taken = atomic_load(&pool_hits) + atomic_load(&pool_misses);
+  double rate = 0.0; // Pages per second, smoothed
+  for (;;) {
+    // Demand over the last interval or more. Early wake-ups only top the
+    // pool up, since a few pages over a short time say little about rates.
+    uint64_t now = zpool_clock_ns();
+    if (now - last_ns >= ZPOOL_INTERVAL_NS) {
+      uint64_t taken = atomic_load(&pool_hits) + atomic_load(&pool_misses);
+      double sample =
+          (double)(taken - last_taken) * 1e9 / (double)(now - last_ns);
+      rate = 0.5 * rate + 0.5 * sample;
+      last_ns = now;
+      last_taken = taken;
+    }
+
+    size_t pages = atomic_load(&pool_pages);
+    size_t target = (size_t)(rate * ZPOOL_HORIZON_NS / 1e9 + 0.999);
+    if (target < pages)
+      target = pages;
+    if (target > pages * ZPOOL_MAX_FACTOR)
+      target = pages * ZPOOL_MAX_FACTOR;
+    atomic_store(&pool_target, target);
+    while (atomic_load(&pool_ready) < target && zpool_fill_one()) {
+    }
+    // Demand went down: give the surplus back
+    while (atomic_load(&pool_ready) > target) {
+      pthread_mutex_lock(&pop_lock);
+      ZPage *page = zpool_pop();
+      pthread_mutex_unlock(&pop_lock);
+      if (!page)
+        break;
+      munmap(page, ZPAGE_SIZE);
+    }
+
+    uint64_t deadline = zpool_clock_ns() + ZPOOL_INTERVAL_NS;
+    struct timespec ts = {.tv_sec = (time_t)(deadline / 1000000000),
+                          .tv_nsec = (long)(deadline % 1000000000)};
+    pthread_mutex_lock(&filler_lock);
+    while (!filler_wake) {
+      if (pthread_cond_timedwait(&filler_cond, &filler_lock, &ts) != 0)
+        break;
+    }
+    filler_wake = false;
+    pthread_mutex_unlock(&filler_lock);
+  }
+  return NULL;
+}
+
+static void zpool_wake_filler(void) {
+  pthread_mutex_lock(&filler_lock);
+  if (!filler_started) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&filler_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    // Holds no Python state, so it may simply die with the process
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, zpool_filler_func, NULL) == 0) {
+      pthread_detach(thread);
+      filler_started = true;
+    }
+  } else {
+    filler_wake = true;
+    pthread_cond_signal(&filler_cond);
+  }
+  pthread_mutex_unlock(&filler_lock);
+}
+
+void zpool_configure(size_t pages, bool populate) {
+  atomic_store(&pool_populate, populate);
+  atomic_store(&pool_pages, pages);
+  if (!pages)
+    zpool_drain();
+  else if (filler_started)
+    zpool_wake_filler();
+}
+
+ZPage *zpool_take(void) {
+  size_t pages = atomic_load(&pool_pages);
+  if (!pages)
+    return NULL;
+  pthread_mutex_lock(&pop_lock);
+  ZPage *page = zpool_pop();
+  pthread_mutex_unlock(&pop_lock);
+  atomic_fetch_add(page ? &pool_hits : &pool_misses, 1);
+
+  // Refill once half of the target is gone
+  size_t target = atomic_load(&pool_target);
+  if (atomic_load(&pool_ready) * 2 < (target > pages ? target : pages))
+    zpool_wake_filler();
+  return page;
+}
+
+bool zpool_put(ZPage *page) {
+  size_t pages = atomic_load(&pool_pages);
+  if (!pages || atomic_load(&pool_ready) >= pages * ZPOOL_MAX_FACTOR)
+    return false;
+  zpool_push(page);
+  atomic_fetch_add(&pool_returned, 1);
+  return true;
+}
+
+size_t zpool_drain(void) {
+  size_t bytes = 0;
+  pthread_mutex_lock(&pop_lock);
+  ZPage *page;
+  while ((page = zpool_pop()) != NULL) {
+    munmap(page, ZPAGE_SIZE);
+    bytes += ZPAGE_SIZE;
+  }
+  pthread_mutex_unlock(&pop_lock);
+  return bytes;
+}
+
+size_t zpool_bytes(void) {
+  return (atomic_load(&pool_ready) + atomic_load(&pool_filling)) * ZPAGE_SIZE;
+}
+
+void zpool_atfork(ZForkStage stage) {
+  switch (stage) {
+  case ZFORK_PREPARE:
+    pthread_mutex_lock(&pop_lock);
+    break;
+  case ZFORK_PARENT:
+    pthread_mutex_unlock(&pop_lock);
+    break;
+  case ZFORK_CHILD:
+    pthread_mutex_init(&pop_lock, NULL);
+    pthread_mutex_init(&filler_lock, NULL);
+    filler_started = false;
+    filler_wake = false;
+    // A page the parent's filler was mapping is not the child's to count
+    atomic_store(&pool_filling, 0);
+    break;
+  }
+}
+
+void zpool_get_stats(ZPoolStats *out) {
+  out->ready = atomic_load(&pool_ready);
+  out->target = atomic_load(&pool_target);
+  out->hits = atomic_load(&pool_hits);
+  out->misses = atomic_load(&pool_misses);
+  out->filled = atomic_load(&pool_filled);
+  out->returned = atomic_load(&pool_returned);
+}
@@ -0,0 +1,63 @@
+#ifndef ZPOOL_H
+#define ZPOOL_H
+
+#include "zfork.h"
+#include "zheap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pool of ready pages (pyzgc.configure(page_pool=...)).
+//
+// zpage_create runs under heap_lock in the TLAB refill, so mapping a page
+// there charges the mmap, the first-touch faults and the bitmap clearing to
+// whichever thread crosses a page boundary. A background thread instead
+// keeps pages mapped, pre-faulted and initialized (zpage_map) on a
+// lock-free stack, and zpage_create takes one from there.
+//
+// The filler keeps at least `pages` ready, or enough for about
+// ZPOOL_HORIZON_NS of the recently measured demand, up to ZPOOL_MAX_FACTOR
+// times `pages`. The pool is shared by the heaps of every interpreter
+// (zstate.h), and its pages count in the footprint of each of them
+// (zheap_footprint) until one is taken and charged to a heap. The filler
+// stops short of the soft max heap (or the max heap) of every heap, and
+// memory pressure on any of them drains the pool.
+
+#define ZPOOL_DEFAULT_PAGES 4
+#define ZPOOL_HORIZON_NS (200 * 1000 * 1000)
+#define ZPOOL_MAX_FACTOR 8
+
+// pages = 0 turns the pool off and drains it. `populate` maps with
+// MAP_POPULATE instead of touching each page from the filler.
+void zpool_configure(size_t pages, bool populate);
+
+// A ready page (ZGEN_YOUNG, not charged to the heap yet), or NULL if the
+// pool is off or empty
+ZPage *zpool_take(void);
+
+// Takes back an empty, initialized page (zpage_recycle). Returns false if
+// the pool is off or already holds ZPOOL_MAX_FACTOR times its pages; the
+// caller then unmaps the page.
+bool zpool_put(ZPage *page);
+
+// Unmaps every ready page. Returns the bytes given back.
+size_t zpool_drain(void);
+
+// Bytes of the ready pages and of the one being filled, if any
+size_t zpool_bytes(void);
+
+typedef struct {
+  size_t ready;      // Pages in the pool
+  size_t target;     // Pages the filler aims for
+  uint64_t hits;     // zpage_create calls served from the pool
+  uint64_t misses;   // ... that found it empty and mapped a page themselves
+  uint64_t filled;   // Pages mapped by the filler
+  uint64_t returned; // Pages taken back from ended regions (zpool_put)
+} ZPoolStats;
+
+void zpool_get_stats(ZPoolStats *out);
+
+// Ready pages survive a fork; the child starts a filler of its own
+void zpool_atfork(ZForkStage stage);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ZPROBE_H
+#define ZPROBE_H
+
+// USDT static tracepoints (provider "pyzgc") for bpftrace, perf and
+// SystemTap. With <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel)
+// each probe is a single NOP plus an ELF note; a tracer attached to the
+// running process patches it into a breakpoint. Without the header, or
+// with -DZPROBE_DISABLE, probes compile to nothing. Arguments must be
+// cheap to evaluate, since they are computed whether or not anyone traces.
+//
+// List them with:  readelf -n pyzgc*.so | grep -A2 pyzgc
+// Example scripts: tools/*.bt
+//
+// Probes (arguments in order):
+//   cycle__begin      minor
+//   cycle__end        minor, wall_ns, cpu_ns
+//   mark__begin       minor, remset_entries
+//   mark__end         minor, weak_cleared, finalizers_queued
+//   relocate__begin   minor, pages, live_bytes        (the relocation set)
+//   relocate__end     minor, pages, live_bytes
+//   safepoint__begin
+//   safepoint__end    time_to_safepoint_ns, pause_ns
+//   page__create      page, size, generation, numa_node
+//   tlab__refill      size, page
+//   barrier__heal     handle, body          (color only, same address)
+//   barrier__forward  handle, from, to      (the body had moved)
+//   remset__add       body
+//   relocate__object  from, to, size        (whoever copies: GC or mutator)
+
+#if !defined(ZPROBE_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ZPROBE_ENABLED 1
+#endif
+#endif
+
+#ifdef ZPROBE_ENABLED
+#define ZPROBE0(name) DTRACE_PROBE(pyzgc, name)
+#define ZPROBE1(name, a) DTRACE_PROBE1(pyzgc, name, a)
+#define ZPROBE2(name, a, b) DTRACE_PROBE2(pyzgc, name, a, b)
+#define ZPROBE3(name, a, b, c) DTRACE_PROBE3(pyzgc, name, a, b, c)
+#define ZPROBE4(name, a, b, c, d) DTRACE_PROBE4(pyzgc, name, a, b, c, d)
+#else
+// Arguments are still "used" (unevaluated) so that values computed only for
+// a probe don't trigger unused-variable warnings
+#define ZPROBE0(name) ((void)0)
+#define ZPROBE1(name, a) ((void)sizeof(a))
+#define ZPROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define ZPROBE3(name, a, b, c)                                                 \
+  ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define ZPROBE4(name, a, b, c, d)                                              \
+  ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
+
+#endif
@@ -0,0 +1,710 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "zprof.h"
+#include "zgc.h"
+#include "zheap.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ZPROF_MAX_DEPTH 64
+#define ZPROF_BUCKETS 4096
+
+typedef struct {
+  PyObject *code; // Counted
+  int line;
+} ZProfFrame;
+
+// One per distinct Python stack, kept until the profiler is stopped.
+// Values are weighted (see zprof.h).
+typedef struct ZProfStack {
+  struct ZProfStack *next; // Hash chain
+  uint64_t hash;
+  double alloc_objects;
+  double alloc_bytes;
+  double inuse_objects;
+  double inuse_bytes;
+  int depth;
+  ZProfFrame frames[]; // Leaf first
+} ZProfStack;
+
+// A sampled body that was alive when last judged
+typedef struct {
+  void *body; // Raw address, remapped at every judgement
+  ZProfStack *stack;
+  double objects;
+  double bytes;
+  uint64_t epoch; // ZProfState.epoch when sampled
+} ZProfSample;
+
+// Per-state part (zstate.h)
+typedef struct ZProfState {
+  // Mean sample interval in bytes, 0 while off
+  atomic_size_t rate;
+
+  // Guards everything below. Never held while Python code can run.
+  pthread_mutex_t lock;
+  ZProfStack *stacks[ZPROF_BUCKETS];
+  ZProfSample *samples;
+  size_t nsamples;
+  size_t capacity;
+  uint64_t epoch;    // Markings started
+  uint64_t start_ns; // CLOCK_REALTIME at start_alloc_profile
+} ZProfState;
+
+static __thread uint64_t zprof_rng;
+
+static uint64_t zprof_clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// --- Allocator side ---
+
+size_t zprof_next_interval(void) {
+  ZProfState *prof = zstate->prof;
+  size_t rate = atomic_load_explicit(&prof->rate, memory_order_relaxed);
+  if (rate == 0)
+    return SIZE_MAX;
+  if (zprof_rng == 0)
+    zprof_rng = ((uintptr_t)&zprof_rng ^ zprof_clock_ns(CLOCK_MONOTONIC)) | 1;
+  // xorshift64*, then an exponential gap with mean `rate`
+  zprof_rng ^= zprof_rng >> 12;
+  zprof_rng ^= zprof_rng << 25;
+  zprof_rng ^= zprof_rng >> 27;
+  uint64_t bits = zprof_rng * 0x2545F4914F6CDD1DULL;
+  double u = (double)((bits >> 11) + 1) * 0x1.0p-53; // (0, 1]
+  double gap = -log(u) * (double)rate;
+  if (gap < 1.0)
+    return 1;
+  return gap >= (double)(SIZE_MAX / 2) ? SIZE_MAX / 2 : (size_t)gap;
+}
+
+// Python stack of the calling thread, leaf first. Materializing frame
+// objects allocates, so CPython's cyclic GC is held off meanwhile: no
+// finalizer may run inside the allocator.
+static int zprof_capture(ZProfFrame *frames) {
+  if (!zstate_tstate())
+    return 0;
+  int gc_enabled = PyGC_Disable();
+  PyFrameObject *frame = PyThreadState_GetFrame(PyThreadState_Get());
+  int depth = 0;
+  while (frame && depth < ZPROF_MAX_DEPTH) {
+    frames[depth].code = (PyObject *)PyFrame_GetCode(frame);
+    frames[depth].line = PyFrame_GetLineNumber(frame);
+    depth++;
+    PyFrameObject *back = PyFrame_GetBack(frame);
+    Py_DECREF(frame);
+    frame = back;
+  }
+  Py_XDECREF(frame);
+  if (gc_enabled)
+    PyGC_Enable();
+  return depth;
+}
+
+static uint64_t zprof_hash(const ZProfFrame *frames, int depth) {
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a over (code, line)
+  for (int i = 0; i < depth; i++) {
+    hash = (hash ^ (uintptr_t)frames[i].code) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)frames[i].line) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool zprof_same_frames(const ZProfFrame *a, const ZProfFrame *b,
+                              int depth) {
+  for (int i = 0; i < depth; i++) {
+    if (a[i].code != b[i].code || a[i].line != b[i].line)
+      return false;
+  }
+  return true;
+}
+
+// Finds or adds the stack. Sets *taken if the new entry took over the
+// frame references. NULL when out of memory.
+static ZProfStack *zprof_intern(const ZProfFrame *frames, int depth,
+                                bool *taken) {
+  ZProfState *prof = zstate->prof;
+  uint64_t hash = zprof_hash(frames, depth);
+  ZProfStack **bucket = &prof->stacks[hash % ZPROF_BUCKETS];
+  for (ZProfStack *s = *bucket; s; s = s->next) {
+    if (s->hash == hash && s->depth == depth &&
+        zprof_same_frames(s->frames, frames, depth))
+      return s;
+  }
+  ZProfStack *s = calloc(1, sizeof(ZProfStack) + depth * sizeof(ZProfFrame));
+  if (!s)
+    return NULL;
+  s->hash = hash;
+  s->depth = depth;
+  memcpy(s->frames, frames, depth * sizeof(ZProfFrame));
+  s->next = *bucket;
+  *bucket = s;
+  *taken = true;
+  return s;
+}
+
+void zprof_sample(void *body, size_t size) {
+  ZProfState *prof = zstate->prof;
+  size_t rate = atomic_load(&prof->rate);
+  if (rate == 0)
+    return;
+  ZProfFrame frames[ZPROF_MAX_DEPTH];
+  int depth = zprof_capture(frames);
+
+  // An object of `size` bytes is sampled with probability
+  // 1 - exp(-size / rate); each sample stands for 1 / that many
+  double objects = 1.0 / -expm1(-(double)size / (double)rate);
+  bool taken = false;
+
+  pthread_mutex_lock(&prof->lock);
+  if (atomic_load(&prof->rate) != 0) { // Not stopped meanwhile
+    ZProfStack *stack = zprof_intern(frames, depth, &taken);
+    if (stack && prof->nsamples == prof->capacity) {
+      size_t capacity = prof->capacity ? prof->capacity * 2 : 256;
+      ZProfSample *grown =
+          realloc(prof->samples, capacity * sizeof(ZProfSample));
+      if (grown) {
+        prof->samples = grown;
+        prof->capacity = capacity;
+      }
+    }
+    if (stack && prof->nsamples < prof->capacity) {
+      stack->alloc_objects += objects;
+      stack->alloc_bytes += objects * size;
+      stack->inuse_objects += objects;
+      stack->inuse_bytes += objects * size;
+      prof->samples[prof->nsamples++] = (ZProfSample){
+          body, stack, objects, objects * size, prof->epoch};
+    }
+  }
+  pthread_mutex_unlock(&prof->lock);
+
+  if (!taken) {
+    for (int i = 0; i < depth; i++)
+      Py_DECREF(frames[i].code);
+  }
+}
+
+// --- Collector side ---
+
+void zprof_mark_start(void) {
+  ZProfState *prof = zstate->prof;
+  pthread_mutex_lock(&prof->lock);
+  prof->epoch++;
+  pthread_mutex_unlock(&prof->lock);
+}
+
+void zprof_mark_end(bool minor_gc) {
+  ZProfState *prof = zstate->prof;
+  pthread_mutex_lock(&prof->lock);
+  size_t i = 0;
+  while (i < prof->nsamples) {
+    ZProfSample *sample = &prof->samples[i];
+    // Allocated after this marking started: the next one judges it
+    if (sample->epoch == prof->epoch) {
+      i++;
+      continue;
+    }
+    void *raw = zgc_remap(sample->body);
+    ZPage *page = zheap_get_page(raw);
+    bool judged = page && !page->is_immortal && !page->is_frozen &&
+                  page->generation != ZGEN_SHARED &&
+                  !(minor_gc && page->generation != ZGEN_YOUNG);
+    if (!judged || zpage_is_live(page, raw)) {
+      sample->body = raw;
+      i++;
+      continue;
+    }
+    sample->stack->inuse_objects -= sample->objects;
+    sample->stack->inuse_bytes -= sample->bytes;
+    *sample = prof->samples[--prof->nsamples];
+  }
+  pthread_mutex_unlock(&prof->lock);
+}
+
+bool zprof_state_init(ZState *state) {
+  ZProfState *prof = (ZProfState *)calloc(1, sizeof(ZProfState));
+  if (!prof)
+    return false;
+  pthread_mutex_init(&prof->lock, NULL);
+  state->prof = prof;
+  return true;
+}
+
+void zprof_atfork(ZForkStage stage) {
+  ZProfState *prof = zstate->prof;
+  if (stage == ZFORK_CHILD)
+    pthread_mutex_init(&prof->lock, NULL);
+}
+
+void zprof_release_page(ZPage *page) {
+  ZProfState *prof = zstate->prof;
+  pthread_mutex_lock(&prof->lock);
+  size_t i = 0;
+  while (i < prof->nsamples) {
+    ZProfSample *sample = &prof->samples[i];
+    if (zheap_get_page(sample->body) != page) {
+      i++;
+      continue;
+    }
+    void *copy = zpage_resolve_forwarding(page, sample->body);
+    if (copy) {
+      sample->body = copy;
+      i++;
+      continue;
+    }
+    sample->stack->inuse_objects -= sample->objects;
+    sample->stack->inuse_bytes -= sample->bytes;
+    *sample = prof->samples[--prof->nsamples];
+  }
+  pthread_mutex_unlock(&prof->lock);
+}
+
+// --- Module functions ---
+
+// Drops all samples and stacks. Needs the GIL (code references).
+static void zprof_reset(void) {
+  ZProfState *prof = zstate->prof;
+  pthread_mutex_lock(&prof->lock);
+  ZProfStack *stacks = NULL;
+  for (size_t b = 0; b < ZPROF_BUCKETS; b++) {
+    ZProfStack *s = prof->stacks[b];
+    while (s) {
+      ZProfStack *next = s->next;
+      s->next = stacks;
+      stacks = s;
+      s = next;
+    }
+    prof->stacks[b] = NULL;
+  }
+  free(prof->samples);
+  prof->samples = NULL;
+  prof->nsamples = prof->capacity = 0;
+  pthread_mutex_unlock(&prof->lock);
+
+  while (stacks) {
+    ZProfStack *next = stacks->next;
+    for (int i = 0; i < stacks->depth; i++)
+      Py_DECREF(stacks->frames[i].code);
+    free(stacks);
+    stacks = next;
+  }
+}
+
+void zprof_state_close(ZState *state) {
+  atomic_store(&state->prof->rate, 0);
+  zprof_reset();
+}
+
+PyObject *zprof_start(PyObject *self, PyObject *args, PyObject *kwds) {
+  zstate_enter();
+  ZProfState *prof = zstate->prof;
+  static char *kwlist[] = {"sample_bytes", NULL};
+  Py_ssize_t sample_bytes = 512 * 1024;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n:start_alloc_profile",
+                                   kwlist, &sample_bytes))
+    return NULL;
+  if (sample_bytes <= 0) {
+    PyErr_SetString(PyExc_ValueError, "sample_bytes must be > 0");
+    return NULL;
+  }
+  atomic_store(&prof->rate, 0);
+  zprof_reset();
+  prof->start_ns = zprof_clock_ns(CLOCK_REALTIME);
+  atomic_store(&prof->rate, (size_t)sample_bytes);
+  Py_RETURN_NONE;
+}
+
+PyObject *zprof_stop(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZProfState *prof = zstate->prof;
+  atomic_store(&prof->rate, 0);
+  zprof_reset();
+  Py_RETURN_NONE;
+}
+
+// (function, filename, line) of a frame
+static PyObject *zprof_frame_tuple(const ZProfFrame *frame) {
+  PyObject *name = PyObject_GetAttrString(frame->code, "co_qualname");
+  if (!name) {
+    PyErr_Clear();
+    name = PyObject_GetAttrString(frame->code, "co_name");
+  }
+  PyObject *filename = PyObject_GetAttrString(frame->code, "co_filename");
+  PyObject *tuple = name && filename
+                        ? Py_BuildValue("(OOi)", name, filename, frame->line)
+                        : NULL;
+  Py_XDECREF(name);
+  Py_XDECREF(filename);
+  return tuple;
+}
+
+// Counters and frames of one stack, copied out under the lock
+typedef struct {
+  double values[4];
+  int depth;
+  ZProfFrame *frames; // Into the snapshot's frame pool, counted
+} ZProfRow;
+
+static PyObject *zprof_build_dict(size_t rate) {
+  ZProfState *prof = zstate->prof;
+  // Copy everything out first: building Python objects may allocate and
+  // sample, which takes the lock, and another thread may stop the profiler
+  pthread_mutex_lock(&prof->lock);
+  size_t nrows = 0, nframes = 0;
+  for (size_t b = 0; b < ZPROF_BUCKETS; b++) {
+    for (ZProfStack *s = prof->stacks[b]; s; s = s->next) {
+      nrows++;
+      nframes += s->depth;
+    }
+  }
+  ZProfRow *rows = malloc((nrows ? nrows : 1) * sizeof(ZProfRow));
+  ZProfFrame *pool = malloc((nframes ? nframes : 1) * sizeof(ZProfFrame));
+  size_t n = 0, used = 0;
+  if (rows && pool) {
+    for (size_t b = 0; b < ZPROF_BUCKETS; b++) {
+      for (ZProfStack *s = prof->stacks[b]; s; s = s->next, n++) {
+        ZProfRow *row = &rows[n];
+        row->values[0] = s->alloc_objects;
+        row->values[1] = s->alloc_bytes;
+        row->values[2] = s->inuse_objects;
+        row->values[3] = s->inuse_bytes;
+        row->depth = s->depth;
+        row->frames = pool + used;
+        for (int f = 0; f < s->depth; f++) {
+          pool[used] = s->frames[f];
+          Py_INCREF(pool[used].code);
+          used++;
+        }
+      }
+    }
+  }
+  pthread_mutex_unlock(&prof->lock);
+
+  PyObject *samples = NULL, *result = NULL;
+  if (!rows || !pool) {
+    PyErr_NoMemory();
+    goto done;
+  }
+  samples = PyList_New(0);
+  if (!samples)
+    goto done;
+  for (size_t i = 0; i < n; i++) {
+    PyObject *frames = PyList_New(rows[i].depth);
+    if (!frames)
+      goto done;
+    for (int f = 0; f < rows[i].depth; f++) {
+      PyObject *frame = zprof_frame_tuple(&rows[i].frames[f]);
+      if (!frame) {
+        Py_DECREF(frames);
+        goto done;
+      }
+      PyList_SET_ITEM(frames, f, frame);
+    }
+    const double *v = rows[i].values;
+    PyObject *sample = Py_BuildValue(
+        "{sNs[LLLL]}", "stack", frames, "values", (long long)llround(v[0]),
+        (long long)llround(v[1]), (long long)llround(v[2]),
+        (long long)llround(v[3]));
+    if (!sample || PyList_Append(samples, sample) < 0) {
+      Py_XDECREF(sample);
+      goto done;
+    }
+    Py_DECREF(sample);
+  }
+
+  result = Py_BuildValue(
+      "{s[(ss)(ss)(ss)(ss)]s(ss)snsKsO}", "sample_type", "alloc_objects",
+      "count", "alloc_space", "bytes", "inuse_objects", "count", "inuse_space",
+      "bytes", "period_type", "space", "bytes", "period", (Py_ssize_t)rate,
+      "time_nanos", (unsigned long long)prof->start_ns, "samples", samples);
+
+done:
+  for (size_t f = 0; f < used; f++)
+    Py_DECREF(pool[f].code);
+  free(rows);
+  free(pool);
+  Py_XDECREF(samples);
+  return result;
+}
+
+// --- pprof encoding ---
+// profile.proto (github.com/google/pprof/blob/main/proto/profile.proto),
+// written by hand: varints and length-delimited fields only.
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  bool failed;
+} ZBuf;
+
+static void zbuf_put(ZBuf *buf, const void *bytes, size_t len) {
+  if (buf->failed)
+    return;
+  if (buf->len + len > buf->cap) {
+    size_t cap = buf->cap ? buf->cap * 2 : 4096;
+    while (cap < buf->len + len)
+      cap *= 2;
+    char *grown = realloc(buf->data, cap);
+    if (!grown) {
+      buf->failed = true;
+      return;
+    }
+    buf->data = grown;
+    buf->cap = cap;
+  }
+  memcpy(buf->data + buf->len, bytes, len);
+  buf->len += len;
+}
+
+static void zbuf_varint(ZBuf *buf, uint64_t value) {
+  uint8_t bytes[10];
+  size_t n = 0;
+  do {
+    bytes[n++] = (uint8_t)((value & 0x7f) | (value > 0x7f ? 0x80 : 0));
+    value >>= 7;
+  } while (value);
+  zbuf_put(buf, bytes, n);
+}
+
+static void zbuf_uint_field(ZBuf *buf, int field, uint64_t value) {
+  zbuf_varint(buf, (uint64_t)field << 3); // Wire type 0
+  zbuf_varint(buf, value);
+}
+
+// Length-delimited field (wire type 2) holding an encoded message
+static void zbuf_bytes_field(ZBuf *buf, int field, const ZBuf *msg) {
+  zbuf_varint(buf, ((uint64_t)field << 3) | 2);
+  zbuf_varint(buf, msg->len);
+  zbuf_put(buf, msg->data, msg->len);
+  if (msg->failed)
+    buf->failed = true;
+}
+
+// Index of s in the string table (a dict str -> index plus a list)
+static Py_ssize_t zprof_string(PyObject *index, PyObject *table,
+                               PyObject *s) {
+  PyObject *found = PyDict_GetItemWithError(index, s);
+  if (found)
+    return PyLong_AsSsize_t(found);
+  if (PyErr_Occurred())
+    return -1;
+  Py_ssize_t id = PyList_GET_SIZE(table);
+  PyObject *key = PyLong_FromSsize_t(id);
+  if (!key || PyDict_SetItem(index, s, key) < 0 ||
+      PyList_Append(table, s) < 0) {
+    Py_XDECREF(key);
+    return -1;
+  }
+  Py_DECREF(key);
+  return id;
+}
+
+static Py_ssize_t zprof_cstring(PyObject *index, PyObject *table,
+                                const char *s) {
+  PyObject *str = PyUnicode_FromString(s);
+  if (!str)
+    return -1;
+  Py_ssize_t id = zprof_string(index, table, str);
+  Py_DECREF(str);
+  return id;
+}
+
+// Id of a key in `ids` (dict key -> id), adding the next id if new.
+// *added is set for new keys.
+static Py_ssize_t zprof_id(PyObject *ids, PyObject *key, bool *added) {
+  PyObject *found = PyDict_GetItemWithError(ids, key);
+  *added = false;
+  if (found)
+    return PyLong_AsSsize_t(found);
+  if (PyErr_Occurred())
+    return -1;
+  Py_ssize_t id = PyDict_GET_SIZE(ids) + 1; // pprof ids start at 1
+  PyObject *value = PyLong_FromSsize_t(id);
+  if (!value || PyDict_SetItem(ids, key, value) < 0) {
+    Py_XDECREF(value);
+    return -1;
+  }
+  Py_DECREF(value);
+  *added = true;
+  return id;
+}
+
+static void zbuf_value_type(ZBuf *out, int field, Py_ssize_t type,
+                            Py_ssize_t unit) {
+  ZBuf msg = {0};
+  zbuf_uint_field(&msg, 1, type);
+  zbuf_uint_field(&msg, 2, unit);
+  zbuf_bytes_field(out, field, &msg);
+  free(msg.data);
+}
+
+// Serializes the dict form as an uncompressed Profile message
+static PyObject *zprof_encode_pprof(PyObject *profile) {
+  ZBuf out = {0};
+  PyObject *strings = PyDict_New();
+  PyObject *table = PyList_New(0);
+  PyObject *functions = PyDict_New();
+  PyObject *locations = PyDict_New();
+  PyObject *result = NULL;
+  if (!strings || !table || !functions || !locations ||
+      zprof_cstring(strings, table, "") != 0)
+    goto done;
+
+  PyObject *types = PyDict_GetItemString(profile, "sample_type");
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(types); i++) {
+    PyObject *type = PyList_GET_ITEM(types, i);
+    Py_ssize_t t = zprof_string(strings, table, PyTuple_GET_ITEM(type, 0));
+    Py_ssize_t u = zprof_string(strings, table, PyTuple_GET_ITEM(type, 1));
+    if (t < 0 || u < 0)
+      goto done;
+    zbuf_value_type(&out, 1, t, u);
+  }
+
+  PyObject *samples = PyDict_GetItemString(profile, "samples");
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(samples); i++) {
+    PyObject *sample = PyList_GET_ITEM(samples, i);
+    PyObject *stack = PyDict_GetItemString(sample, "stack");
+    PyObject *values = PyDict_GetItemString(sample, "values");
+    ZBuf msg = {0}, ids = {0}, vals = {0};
+
+    for (Py_ssize_t f = 0; f < PyList_GET_SIZE(stack); f++) {
+      PyObject *frame = PyList_GET_ITEM(stack, f);
+      PyObject *func_key = PyTuple_GetSlice(frame, 0, 2); // name, file
+      bool added;
+      Py_ssize_t func = func_key ? zprof_id(functions, func_key, &added) : -1;
+      if (func >= 0 && added) {
+        Py_ssize_t name =
+            zprof_string(strings, table, PyTuple_GET_ITEM(frame, 0));
+        Py_ssize_t file =
+            zprof_string(strings, table, PyTuple_GET_ITEM(frame, 1));
+        if (name < 0 || file < 0) {
+          func = -1;
+        } else {
+          ZBuf fn = {0};
+          zbuf_uint_field(&fn, 1, func);
+          zbuf_uint_field(&fn, 2, name);
+          zbuf_uint_field(&fn, 3, name);
+          zbuf_uint_field(&fn, 4, file);
+          zbuf_bytes_field(&out, 5, &fn);
+          free(fn.data);
+        }
+      }
+      Py_XDECREF(func_key);
+      if (func < 0) {
+        free(msg.data);
+        free(ids.data);
+        free(vals.data);
+        goto done;
+      }
+
+      long line = PyLong_AsLong(PyTuple_GET_ITEM(frame, 2));
+      PyObject *loc_key = Py_BuildValue("(nl)", func, line);
+      Py_ssize_t loc = loc_key ? zprof_id(locations, loc_key, &added) : -1;
+      Py_XDECREF(loc_key);
+      if (loc < 0) {
+        free(msg.data);
+        free(ids.data);
+        free(vals.data);
+        goto done;
+      }
+      if (added) {
+        ZBuf ln = {0}, lc = {0};
+        zbuf_uint_field(&ln, 1, func);
+        zbuf_uint_field(&ln, 2, line < 0 ? 0 : (uint64_t)line);
+        zbuf_uint_field(&lc, 1, loc);
+        zbuf_bytes_field(&lc, 4, &ln);
+        zbuf_bytes_field(&out, 4, &lc);
+        free(ln.data);
+        free(lc.data);
+      }
+      zbuf_varint(&ids, loc);
+    }
+    for (Py_ssize_t v = 0; v < PyList_GET_SIZE(values); v++)
+      zbuf_varint(&vals, PyLong_AsUnsignedLongLongMask(
+                             PyList_GET_ITEM(values, v)));
+
+    // Packed repeated fields
+    zbuf_bytes_field(&msg, 1, &ids);
+    zbuf_bytes_field(&msg, 2, &vals);
+    zbuf_bytes_field(&out, 2, &msg);
+    free(msg.data);
+    free(ids.data);
+    free(vals.data);
+  }
+
+  PyObject *period_type = PyDict_GetItemString(profile, "period_type");
+  PyObject *time_nanos = PyDict_GetItemString(profile, "time_nanos");
+  PyObject *period = PyDict_GetItemString(profile, "period");
+  Py_ssize_t pt =
+      zprof_string(strings, table, PyTuple_GET_ITEM(period_type, 0));
+  Py_ssize_t pu =
+      zprof_string(strings, table, PyTuple_GET_ITEM(period_type, 1));
+  if (pt < 0 || pu < 0)
+    goto done;
+
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(table); i++) {
+    Py_ssize_t len;
+    const char *s = PyUnicode_AsUTF8AndSize(PyList_GET_ITEM(table, i), &len);
+    if (!s)
+      goto done;
+    zbuf_varint(&out, (6 << 3) | 2);
+    zbuf_varint(&out, (uint64_t)len);
+    zbuf_put(&out, s, (size_t)len);
+  }
+  zbuf_uint_field(&out, 9, PyLong_AsUnsignedLongLongMask(time_nanos));
+  zbuf_value_type(&out, 11, pt, pu);
+  zbuf_uint_field(&out, 12, PyLong_AsUnsignedLongLongMask(period));
+
+  if (out.failed)
+    PyErr_NoMemory();
+  else
+    result = PyBytes_FromStringAndSize(out.data ? out.data : "", out.len);
+
+done:
+  free(out.data);
+  Py_XDECREF(strings);
+  Py_XDECREF(table);
+  Py_XDECREF(functions);
+  Py_XDECREF(locations);
+  return result;
+}
+
+PyObject *zprof_profile(PyObject *self, PyObject *args, PyObject *kwds) {
+  zstate_enter();
+  ZProfState *prof = zstate->prof;
+  static char *kwlist[] = {"format", NULL};
+  const char *format = "dict";
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$s:alloc_profile", kwlist,
+                                   &format))
+    return NULL;
+  bool pprof = strcmp(format, "pprof") == 0;
+  if (!pprof && strcmp(format, "dict") != 0) {
+    PyErr_SetString(PyExc_ValueError, "format must be 'dict' or 'pprof'");
+    return NULL;
+  }
+
+  PyObject *profile = zprof_build_dict(atomic_load(&prof->rate));
+  if (!profile || !pprof)
+    return profile;
+
+  // gzip, as pprof writes it (it reads plain protobuf as well)
+  PyObject *raw = zprof_encode_pprof(profile);
+  Py_DECREF(profile);
+  if (!raw)
+    return NULL;
+  PyObject *gzip = PyImport_ImportModule("gzip");
+  PyObject *compressed =
+      gzip ? PyObject_CallMethod(gzip, "compress", "O", raw) : NULL;
+  Py_XDECREF(gzip);
+  Py_DECREF(raw);
+  return compressed;
+}
@@ -0,0 +1,55 @@
+#ifndef ZPROF_H
+#define ZPROF_H
+
+#include "zfork.h"
+#include "zheap.h"
+#include <Python.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Sampling allocation profiler (pyzgc.start_alloc_profile, alloc_profile).
+//
+// Young-generation allocations are sampled as a Poisson process over
+// allocated bytes: the gaps between sample points are exponential with a
+// mean of `sample_bytes`. The inline fast path is not touched. The thread's
+// TLAB end is pulled in to its next sample point (zheap.c), and the
+// allocation that crosses it takes the slow path, which calls
+// zprof_sample. Each sample records the Python stack and a weight that
+// unbiases it: an object of s bytes is sampled with probability
+// 1 - exp(-s / sample_bytes).
+//
+// Samples keep their body address. At the end of every marking, the
+// collector drops samples whose body it did not reach. In-use values per
+// stack are therefore as of the last cycle that judged them, and bodies
+// sampled during a cycle are first judged by the next one.
+
+// Bytes until the calling thread's next sample point, or SIZE_MAX while
+// the profiler is off
+size_t zprof_next_interval(void);
+
+// A young body of `size` bytes was just allocated across a sample point.
+// Needs an attached thread state for the stack; without one, the sample
+// gets an empty stack.
+void zprof_sample(void *body, size_t size);
+
+// Pauses: mark start, and mark end after marking has finished
+void zprof_mark_start(void);
+void zprof_mark_end(bool minor_gc);
+
+// A region page (zregion.h) is about to be reused: samples on it follow
+// the page's forwarding table to the bodies copied out, or are dropped
+void zprof_release_page(ZPage *page);
+
+void zprof_atfork(ZForkStage stage);
+
+// The profiler of a state (zstate.h). Close runs with the state attached
+// and the GIL held.
+bool zprof_state_init(ZState *state);
+void zprof_state_close(ZState *state);
+
+// Module functions
+PyObject *zprof_start(PyObject *self, PyObject *args, PyObject *kwds);
+PyObject *zprof_stop(PyObject *self, PyObject *args);
+PyObject *zprof_profile(PyObject *self, PyObject *args, PyObject *kwds);
+
+#endif
@@ -0,0 +1,444 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "zref.h"
+#include "zarray.h"
+#include "zdict.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zobject.h"
+#include "zsafepoint.h"
+#include "zsatb.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <structmember.h>
+
+// Callbacks run per batch, so the registry lock is never held while Python
+// code runs
+#define ZREF_BATCH 64
+
+typedef struct {
+  ZRefLink link;
+  PyObject *referent;
+  PyObject *callback;
+} ZFinalizer;
+
+// Per-state part (zstate.h)
+typedef struct ZRefState {
+  // Guards the four lists and the referent/cleared fields of registered
+  // WeakRefs. Never held across a safepoint poll or a call into Python.
+  pthread_mutex_t lock;
+  ZRefLink weak;
+  ZRefLink weak_pending;
+  ZRefLink finalizers;
+  ZRefLink finalizers_pending;
+
+  // A pending call is queued and has not started yet
+  atomic_bool scheduled;
+} ZRefState;
+
+static void zref_init_list(ZRefLink *list) { list->prev = list->next = list; }
+
+bool zref_state_init(ZState *state) {
+  ZRefState *ref = (ZRefState *)calloc(1, sizeof(ZRefState));
+  if (!ref)
+    return false;
+  pthread_mutex_init(&ref->lock, NULL);
+  zref_init_list(&ref->weak);
+  zref_init_list(&ref->weak_pending);
+  zref_init_list(&ref->finalizers);
+  zref_init_list(&ref->finalizers_pending);
+  state->ref = ref;
+  return true;
+}
+
+static void zref_link(ZRefLink *list, ZRefLink *link) {
+  link->prev = list->prev;
+  link->next = list;
+  list->prev->next = link;
+  list->prev = link;
+}
+
+static void zref_unlink(ZRefLink *link) {
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->prev = link->next = link;
+}
+
+static inline ZWeakRef *zref_weak_of(ZRefLink *link) {
+  return (ZWeakRef *)((char *)link - offsetof(ZWeakRef, link));
+}
+
+_Static_assert(offsetof(ZArray, registered) == offsetof(ZObject, registered),
+               "ZArray prefix drift");
+_Static_assert(offsetof(ZDict, registered) == offsetof(ZObject, registered),
+               "ZDict prefix drift");
+
+// Counts the references to a handle that WeakRefs and finalizers hold, so
+// the collector can tell whether Python holds it too (zobject_handle_is_held).
+// Taken after the reference and given back before it, so that a handle is
+// never counted as less held than it is.
+static void zref_register(PyObject *handle) {
+  __atomic_add_fetch(&((ZObject *)handle)->registered, 1, __ATOMIC_RELEASE);
+}
+
+static void zref_unregister(PyObject *handle) {
+  if (handle)
+    __atomic_sub_fetch(&((ZObject *)handle)->registered, 1, __ATOMIC_RELEASE);
+}
+
+// --- Collector side ---
+
+void zref_push_finalizable(ZMarkStack *stack) {
+  ZRefState *lists = zstate->ref;
+  pthread_mutex_lock(&lists->lock);
+  for (ZRefLink *l = lists->finalizers.next; l != &lists->finalizers;
+       l = l->next) {
+    ZBody *body = zobject_get_body((ZObject *)((ZFinalizer *)l)->referent);
+    if (body) {
+      zmarkstack_push(stack, (void *)((uintptr_t)body |
+                                      ZPOINTER_FINALIZABLE_BIT));
+    }
+  }
+  pthread_mutex_unlock(&lists->lock);
+}
+
+// Did this cycle's marking reach the body behind handle strongly? Bodies
+// the cycle does not judge (immortal and frozen pages, old pages in a minor
+// cycle, bodies allocated since marking started) count as reached.
+static bool zref_is_reachable(PyObject *handle, bool minor_gc) {
+  ZBody *body = zobject_get_body((ZObject *)handle);
+  if (!body)
+    return true;
+  void *raw = zgc_remap(body);
+  ZPage *page = zheap_get_page(raw);
+  if (page->is_immortal || page->is_frozen ||
+      page->generation == ZGEN_SHARED ||
+      (minor_gc && page->generation != ZGEN_YOUNG))
+    return true;
+  return zpage_is_marked(page, raw) || zpage_is_new(page, raw);
+}
+
+static int zref_pending_call(void *arg) {
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  atomic_store(&lists->scheduled, false);
+  zref_run_callbacks();
+  return 0;
+}
+
+void zref_process(bool minor_gc, size_t *cleared, size_t *finalizers) {
+  ZRefState *lists = zstate->ref;
+  *cleared = 0;
+  *finalizers = 0;
+
+  pthread_mutex_lock(&lists->lock);
+  ZRefLink *next;
+  for (ZRefLink *l = lists->weak.next; l != &lists->weak; l = next) {
+    next = l->next;
+    ZWeakRef *ref = zref_weak_of(l);
+    // Already cleared by Python's cycle collector
+    if (!ref->referent || zref_is_reachable(ref->referent, minor_gc))
+      continue;
+    // The reference moves to `cleared` until a mutator can release it
+    ref->cleared = ref->referent;
+    ref->referent = NULL;
+    zref_unlink(l);
+    zref_link(&lists->weak_pending, l);
+    (*cleared)++;
+  }
+  for (ZRefLink *l = lists->finalizers.next; l != &lists->finalizers;
+       l = next) {
+    next = l->next;
+    if (zref_is_reachable(((ZFinalizer *)l)->referent, minor_gc))
+      continue;
+    zref_unlink(l);
+    zref_link(&lists->finalizers_pending, l);
+    (*finalizers)++;
+  }
+  pthread_mutex_unlock(&lists->lock);
+
+  // Py_AddPendingCall needs neither the GIL nor a thread state. If its
+  // queue is full, the next cycle tries again. Pending calls only run in
+  // the main interpreter; other interpreters run their callbacks from the
+  // next pyzgc call that collects.
+  if ((*cleared || *finalizers) && zstate_is_main(zstate) &&
+      !atomic_exchange(&lists->scheduled, true)) {
+    if (Py_AddPendingCall(zref_pending_call, NULL) < 0)
+      atomic_store(&lists->scheduled, false);
+  }
+}
+
+// --- Mutator side ---
+
+static void zref_release_list(ZRefLink *list, bool finalizers) {
+  while (list->next != list) {
+    ZRefLink *l = list->next;
+    zref_unlink(l);
+    if (finalizers) {
+      ZFinalizer *finalizer = (ZFinalizer *)l;
+      zref_unregister(finalizer->referent);
+      Py_DECREF(finalizer->referent);
+      Py_DECREF(finalizer->callback);
+      free(finalizer);
+    }
+  }
+}
+
+void zref_state_close(ZState *state) {
+  ZRefState *lists = state->ref;
+  // WeakRefs keep their referents (and pending ones what they cleared)
+  // until they go away themselves
+  pthread_mutex_lock(&lists->lock);
+  zref_release_list(&lists->weak, false);
+  zref_release_list(&lists->weak_pending, false);
+  ZRefLink finalizers;
+  zref_init_list(&finalizers);
+  while (lists->finalizers.next != &lists->finalizers) {
+    ZRefLink *l = lists->finalizers.next;
+    zref_unlink(l);
+    zref_link(&finalizers, l);
+  }
+  while (lists->finalizers_pending.next != &lists->finalizers_pending) {
+    ZRefLink *l = lists->finalizers_pending.next;
+    zref_unlink(l);
+    zref_link(&finalizers, l);
+  }
+  pthread_mutex_unlock(&lists->lock);
+  // Their referents' deallocs may need the lock
+  zref_release_list(&finalizers, true);
+}
+
+void zref_atfork(ZForkStage stage) {
+  ZRefState *lists = zstate->ref;
+  if (stage == ZFORK_CHILD)
+    pthread_mutex_init(&lists->lock, NULL);
+}
+
+void zref_run_callbacks(void) {
+  ZRefState *lists = zstate->ref;
+  for (;;) {
+    ZWeakRef *refs[ZREF_BATCH];
+    ZFinalizer *finalizers[ZREF_BATCH];
+    int nrefs = 0, nfinalizers = 0;
+
+    pthread_mutex_lock(&lists->lock);
+    while (nrefs < ZREF_BATCH &&
+           lists->weak_pending.next != &lists->weak_pending) {
+      ZWeakRef *ref = zref_weak_of(lists->weak_pending.next);
+      zref_unlink(&ref->link); // Cleared for good: on no list from now on
+      refs[nrefs++] = (ZWeakRef *)Py_NewRef(ref);
+    }
+    while (nfinalizers < ZREF_BATCH &&
+           lists->finalizers_pending.next !=
+               &lists->finalizers_pending) {
+      ZRefLink *l = lists->finalizers_pending.next;
+      zref_unlink(l);
+      finalizers[nfinalizers++] = (ZFinalizer *)l;
+    }
+    pthread_mutex_unlock(&lists->lock);
+    if (nrefs == 0 && nfinalizers == 0)
+      return;
+
+    for (int i = 0; i < nrefs; i++) {
+      ZWeakRef *ref = refs[i];
+      zref_unregister(ref->cleared);
+      Py_CLEAR(ref->cleared);
+      if (ref->callback) {
+        PyObject *res = PyObject_CallOneArg(ref->callback, (PyObject *)ref);
+        if (!res)
+          PyErr_WriteUnraisable(ref->callback);
+        Py_XDECREF(res);
+      }
+      Py_DECREF(ref);
+    }
+    for (int i = 0; i < nfinalizers; i++) {
+      ZFinalizer *finalizer = finalizers[i];
+      PyObject *res =
+          PyObject_CallOneArg(finalizer->callback, finalizer->referent);
+      if (!res)
+        PyErr_WriteUnraisable(finalizer->callback);
+      Py_XDECREF(res);
+      zref_unregister(finalizer->referent);
+      Py_DECREF(finalizer->referent);
+      Py_DECREF(finalizer->callback);
+      free(finalizer);
+    }
+  }
+}
+
+PyObject *zref_finalize(PyObject *self, PyObject *args) {
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  PyObject *obj, *callback;
+  if (!PyArg_ParseTuple(args, "OO:finalize", &obj, &callback))
+    return NULL;
+  if (!zobject_is_handle(obj)) {
+    PyErr_Format(PyExc_TypeError, "cannot finalize '%.100s' object",
+                 Py_TYPE(obj)->tp_name);
+    return NULL;
+  }
+  if (!PyCallable_Check(callback)) {
+    PyErr_SetString(PyExc_TypeError, "finalize() callback must be callable");
+    return NULL;
+  }
+  ZFinalizer *finalizer = (ZFinalizer *)malloc(sizeof(ZFinalizer));
+  if (!finalizer)
+    return PyErr_NoMemory();
+  finalizer->referent = Py_NewRef(obj);
+  zref_register(obj);
+  finalizer->callback = Py_NewRef(callback);
+
+  pthread_mutex_lock(&lists->lock);
+  zref_link(&lists->finalizers, &finalizer->link);
+  pthread_mutex_unlock(&lists->lock);
+  Py_RETURN_NONE;
+}
+
+// --- pyzgc.WeakRef ---
+
+static PyObject *ZWeakRef_new(PyTypeObject *type, PyObject *args,
+                              PyObject *kwds) {
+  static char *kwlist[] = {"obj", "callback", NULL};
+  PyObject *obj, *callback = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:WeakRef", kwlist, &obj,
+                                   &callback))
+    return NULL;
+  if (!zobject_is_handle(obj)) {
+    PyErr_Format(PyExc_TypeError,
+                 "cannot create a pyzgc.WeakRef to '%.100s' object",
+                 Py_TYPE(obj)->tp_name);
+    return NULL;
+  }
+  if (callback != Py_None && !PyCallable_Check(callback)) {
+    PyErr_SetString(PyExc_TypeError, "WeakRef callback must be callable");
+    return NULL;
+  }
+
+  ZWeakRef *self = (ZWeakRef *)type->tp_alloc(type, 0);
+  if (!self)
+    return NULL;
+  self->referent = Py_NewRef(obj);
+  zref_register(obj);
+  self->callback = callback == Py_None ? NULL : Py_NewRef(callback);
+
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  pthread_mutex_lock(&lists->lock);
+  zref_link(&lists->weak, &self->link);
+  pthread_mutex_unlock(&lists->lock);
+  return (PyObject *)self;
+}
+
+// Returns the referent (new reference) or None
+static PyObject *ZWeakRef_call(ZWeakRef *self, PyObject *args,
+                               PyObject *kwds) {
+  static char *kwlist[] = {NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, ":WeakRef", kwlist))
+    return NULL;
+
+  // The pause that clears references can't start while we are inside the
+  // section, so the referent we read is still live when we log it
+  zsafepoint_enter();
+  ZRefState *lists = zstate->ref;
+  pthread_mutex_lock(&lists->lock);
+  PyObject *referent = Py_XNewRef(self->referent);
+  pthread_mutex_unlock(&lists->lock);
+  if (referent) {
+    // Keep-alive barrier: once loaded, the referent may be stored anywhere,
+    // so it has to survive a marking that is in progress
+    zsatb_pre_write(zobject_get_body((ZObject *)referent));
+  }
+  zsafepoint_leave();
+  return referent ? referent : Py_NewRef(Py_None);
+}
+
+static int ZWeakRef_traverse(ZWeakRef *self, visitproc visit, void *arg) {
+  Py_VISIT(Py_TYPE(self));
+  Py_VISIT(self->referent);
+  Py_VISIT(self->cleared);
+  Py_VISIT(self->callback);
+  return 0;
+}
+
+static int ZWeakRef_clear(ZWeakRef *self) {
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  pthread_mutex_lock(&lists->lock);
+  PyObject *referent = self->referent;
+  PyObject *cleared = self->cleared;
+  self->referent = self->cleared = NULL;
+  pthread_mutex_unlock(&lists->lock);
+  zref_unregister(referent);
+  zref_unregister(cleared);
+  Py_XDECREF(referent);
+  Py_XDECREF(cleared);
+  Py_CLEAR(self->callback);
+  return 0;
+}
+
+static void ZWeakRef_dealloc(ZWeakRef *self) {
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  PyObject_GC_UnTrack(self);
+  if (self->weakreflist != NULL) {
+    PyObject_ClearWeakRefs((PyObject *)self);
+  }
+  pthread_mutex_lock(&lists->lock);
+  zref_unlink(&self->link); // A pending callback is dropped with the ref
+  pthread_mutex_unlock(&lists->lock);
+  ZWeakRef_clear(self);
+  PyTypeObject *type = Py_TYPE(self);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static PyObject *ZWeakRef_repr(ZWeakRef *self) {
+  zstate_enter();
+  ZRefState *lists = zstate->ref;
+  pthread_mutex_lock(&lists->lock);
+  PyObject *referent = Py_XNewRef(self->referent);
+  pthread_mutex_unlock(&lists->lock);
+  if (!referent)
+    return PyUnicode_FromFormat("<pyzgc.WeakRef at %p; dead>", self);
+  PyObject *repr =
+      PyUnicode_FromFormat("<pyzgc.WeakRef at %p; to '%s' at %p>", self,
+                           Py_TYPE(referent)->tp_name, referent);
+  Py_DECREF(referent);
+  return repr;
+}
+
+static PyObject *ZWeakRef_get_callback(ZWeakRef *self, void *closure) {
+  return Py_NewRef(self->callback ? self->callback : Py_None);
+}
+
+static PyGetSetDef ZWeakRef_getset[] = {
+    {"__callback__", (getter)ZWeakRef_get_callback, NULL,
+     "Called with the WeakRef once the referent is cleared.", NULL},
+    {NULL}};
+
+static PyMemberDef ZWeakRef_members[] = {
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(ZWeakRef, weakreflist),
+     READONLY},
+    {NULL}};
+
+static PyType_Slot ZWeakRef_slots[] = {
+    {Py_tp_doc, "WeakRef(obj, callback=None): reference to a pyzgc object that "
+                "the collector clears once the object is unreachable from "
+                "the roots"},
+    {Py_tp_new, ZWeakRef_new},
+    {Py_tp_dealloc, ZWeakRef_dealloc},
+    {Py_tp_traverse, ZWeakRef_traverse},
+    {Py_tp_clear, ZWeakRef_clear},
+    {Py_tp_call, ZWeakRef_call},
+    {Py_tp_repr, ZWeakRef_repr},
+    {Py_tp_getset, ZWeakRef_getset},
+    {Py_tp_members, ZWeakRef_members},
+    {0, NULL}};
+
+PyType_Spec ZWeakRefSpec = {
+    .name = "pyzgc.WeakRef",
+    .basicsize = sizeof(ZWeakRef),
+    .flags = ZTYPE_FLAGS | Py_TPFLAGS_HAVE_GC,
+    .slots = ZWeakRef_slots,
+};
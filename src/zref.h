@@ -0,0 +1,70 @@
+#ifndef ZREF_H
+#define ZREF_H
+
+#include "zfork.h"
+#include "zmarkstack.h"
+#include "zstate.h"
+#include <Python.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Reference processing: weak references and finalizers that the collector
+// understands (pyzgc.WeakRef, pyzgc.finalize).
+//
+// A ZGC body is alive when marking reaches it from the roots or Python
+// holds its handle through anything but WeakRefs and finalizers (they count
+// their references in ZObject.registered). So a WeakRef holds its
+// referent's handle and lets the collector decide:
+//   mark start   finalizer referents are pushed with the FINALIZABLE bit.
+//                The marker traces them and everything they reach into the
+//                page's finalizable bitmap, so the objects survive the
+//                cycle and their finalizers can still use them.
+//   mark end     (existing pause) one pass over the registries: every weak
+//                referent not strongly marked is cleared, and so is every
+//                referent only reachable through a finalizer. Finalizers
+//                whose referent was not strongly marked are queued.
+//   later        callbacks run in batches on a mutator thread under the GIL,
+//                scheduled with Py_AddPendingCall in the main interpreter;
+//                in others, by the next pyzgc call that collects.
+// The collector only moves pointers between lists and never touches a
+// refcount. Reading a WeakRef while marking keeps the referent alive for
+// the cycle (logged like an overwritten SATB value).
+
+typedef struct ZRefLink {
+  struct ZRefLink *prev;
+  struct ZRefLink *next;
+} ZRefLink;
+
+typedef struct {
+  PyObject_HEAD ZRefLink link; // In the live or the pending list
+  PyObject *referent;          // Handle, NULL once cleared
+  PyObject *cleared;           // Former referent, released by the callback run
+  PyObject *callback;          // Called with the WeakRef once cleared
+  PyObject *weakreflist;
+} ZWeakRef;
+
+extern PyType_Spec ZWeakRefSpec;
+
+// pyzgc.finalize(obj, callback): call callback(obj) once obj is unreachable
+PyObject *zref_finalize(PyObject *self, PyObject *args);
+
+// Mark start pause: push the finalizer referents onto the mark stack
+void zref_push_finalizable(ZMarkStack *stack);
+
+// Mark end pause, after marking has finished. A minor cycle only judges
+// young referents. Returns the number of cleared references and queued
+// finalizers, and schedules the callbacks.
+void zref_process(bool minor_gc, size_t *cleared, size_t *finalizers);
+
+// Runs the queued callbacks. Needs the GIL. Exceptions raised by callbacks
+// are reported as unraisable.
+void zref_run_callbacks(void);
+
+void zref_atfork(ZForkStage stage);
+
+// The lists of a state (zstate.h). Close drops the live references and
+// the queued callbacks without running them; it needs the GIL.
+bool zref_state_init(ZState *state);
+void zref_state_close(ZState *state);
+
+#endif
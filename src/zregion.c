@@ -0,0 +1,516 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "zregion.h"
+#include "zarray.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zprof.h"
+#include "zsafepoint.h"
+#include "zstruct.h"
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <structmember.h>
+
+// Per-state part (zstate.h)
+typedef struct ZRegionState {
+  // Active regions. A region that ends in bulk fixes up the escape logs of
+  // the others, whose holders may be on its pages.
+  pthread_mutex_t region_lock;
+  ZRegion *regions;
+
+  pthread_mutex_t stats_lock;
+  ZRegionStats stats;
+} ZRegionState;
+
+bool zregion_state_init(ZState *state) {
+  ZRegionState *active = (ZRegionState *)calloc(1, sizeof(ZRegionState));
+  if (!active)
+    return false;
+  pthread_mutex_init(&active->region_lock, NULL);
+  pthread_mutex_init(&active->stats_lock, NULL);
+  state->region = active;
+  return true;
+}
+
+void zregion_atfork(ZForkStage stage) {
+  ZRegionState *active = zstate->region;
+  if (stage == ZFORK_CHILD) {
+    pthread_mutex_init(&active->region_lock, NULL);
+    pthread_mutex_init(&active->stats_lock, NULL);
+  }
+}
+
+void zregion_get_stats(ZRegionStats *out) {
+  ZRegionState *active = zstate->region;
+  pthread_mutex_lock(&active->stats_lock);
+  *out = active->stats;
+  pthread_mutex_unlock(&active->stats_lock);
+}
+
+void zregion_escape(ZRegion *region, ZBody *holder, size_t index) {
+  pthread_mutex_lock(&region->escape_lock);
+  ZRegionEscape *last =
+      region->nescapes ? &region->escapes[region->nescapes - 1] : NULL;
+  // Loops tend to store into the same slot over and over
+  if (last && Z_ADDRESS(last->holder) == Z_ADDRESS(holder) &&
+      last->index == index) {
+    pthread_mutex_unlock(&region->escape_lock);
+    return;
+  }
+  if (region->nescapes == region->escapes_capacity) {
+    size_t capacity =
+        region->escapes_capacity ? region->escapes_capacity * 2 : 64;
+    ZRegionEscape *escapes = (ZRegionEscape *)realloc(
+        region->escapes, capacity * sizeof(ZRegionEscape));
+    if (!escapes) {
+      region->escapes_lost = true;
+      pthread_mutex_unlock(&region->escape_lock);
+      return;
+    }
+    region->escapes = escapes;
+    region->escapes_capacity = capacity;
+  }
+  region->escapes[region->nescapes].holder = holder;
+  region->escapes[region->nescapes].index = index;
+  region->nescapes++;
+  pthread_mutex_unlock(&region->escape_lock);
+}
+
+// --- Bulk release ---
+
+typedef struct {
+  ZBody **items;
+  size_t count;
+  size_t capacity;
+} ZBodyList;
+
+static bool zbodylist_push(ZBodyList *list, ZBody *body) {
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 256;
+    ZBody **items = (ZBody **)realloc(list->items, capacity * sizeof(ZBody *));
+    if (!items)
+      return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->count++] = body;
+  return true;
+}
+
+typedef struct {
+  ZRegion *region;
+  ZBodyList work;   // Escaped bodies to copy (addresses in the region)
+  ZBodyList copies; // Their copies in the old generation
+  bool failed;      // Out of memory
+  size_t escaped_bytes;
+} ZRegionRelease;
+
+// The (raw) region body a slot word refers to, or NULL
+static ZBody *zregion_target(ZRegion *region, PyObject *word) {
+  if (!zbody_is_ref(word))
+    return NULL;
+  ZBody *raw = (ZBody *)Z_ADDRESS(zbody_ref_target(word));
+  return zheap_get_page(raw)->region == region ? raw : NULL;
+}
+
+static void zregion_push(ZRegionRelease *rel, ZBody *raw) {
+  if (!zbodylist_push(&rel->work, raw))
+    rel->failed = true;
+}
+
+// The words of a body that may hold references, as the marker sees them
+static void zregion_for_each_ref(ZBody *body,
+                                 void (*fn)(ZBody *body, size_t index,
+                                            void *arg),
+                                 void *arg) {
+  uint64_t header = zbody_get_word(body, 0);
+  if (zarray_is_header(header)) {
+    if (zarray_header_dtype(header) == ZARRAY_REF) {
+      uint64_t length = zarray_header_length(header);
+      for (uint64_t i = 0; i < length; i++)
+        fn(body, 1 + i, arg);
+    }
+    return;
+  }
+  uint32_t ref_map = zstruct_ref_map(body);
+  for (int i = 0; i < 32 && ref_map >> i; i++) {
+    if (ref_map & (1u << i))
+      fn(body, i, arg);
+  }
+}
+
+static void zregion_push_child(ZBody *body, size_t index, void *arg) {
+  ZRegionRelease *rel = (ZRegionRelease *)arg;
+  ZBody *target = zregion_target(rel->region, zbody_get_slot(body, index));
+  if (target)
+    zregion_push(rel, target);
+}
+
+static void zregion_push_root(void **root, void *arg) {
+  ZRegionRelease *rel = (ZRegionRelease *)arg;
+  ZBody *raw = (ZBody *)Z_ADDRESS(*root);
+  if (zheap_get_page(raw)->region == rel->region)
+    zregion_push(rel, raw);
+}
+
+// Where a region body was copied to, colored
+static ZBody *zregion_forward(ZBody *raw) {
+  void *copy = zpage_resolve_forwarding(zheap_get_page(raw), raw);
+  return (ZBody *)Z_WITH_COLOR(copy, zstate->good_color);
+}
+
+// Escapes: bodies with a live handle, bodies in logged slots that still
+// hold them, and roots
+static void zregion_find_escapes(ZRegionRelease *rel) {
+  ZRegion *region = rel->region;
+  for (size_t i = 0; i < region->npages; i++) {
+    ZPage *page = region->pages[i];
+    uintptr_t addr = (page->start + sizeof(ZPage) + 7) & ~(uintptr_t)7;
+    while (addr < page->top) {
+      ZBody *body = (ZBody *)addr;
+      if (*zbody_handle_slot(body))
+        zregion_push(rel, body);
+      addr += zbody_size(body);
+    }
+  }
+  for (size_t i = 0; i < region->nescapes; i++) {
+    ZRegionEscape *escape = &region->escapes[i];
+    ZBody *holder = (ZBody *)zgc_remap(escape->holder);
+    ZBody *target =
+        zregion_target(region, zbody_get_slot(holder, escape->index));
+    if (target)
+      zregion_push(rel, target);
+  }
+  zgc_for_each_root(zregion_push_root, rel);
+}
+
+// Copies what escaped, and all it reaches in the region, to the old
+// generation. Nothing outside the region refers to the copies yet, so on
+// failure they are merely garbage.
+static void zregion_copy(ZRegionRelease *rel) {
+  while (rel->work.count && !rel->failed) {
+    ZBody *body = rel->work.items[--rel->work.count];
+    ZPage *page = zheap_get_page(body);
+    if (zpage_resolve_forwarding(page, body))
+      continue;
+    size_t size = zbody_size(body);
+    void *colored = zheap_alloc(size, ZGEN_OLD);
+    if (!colored || !zbodylist_push(&rel->copies, Z_ADDRESS(colored))) {
+      rel->failed = true;
+      break;
+    }
+    memcpy(Z_ADDRESS(colored), body, size);
+    zpage_add_forwarding(page, body, Z_ADDRESS(colored));
+    rel->escaped_bytes += size;
+    zregion_for_each_ref(body, zregion_push_child, rel);
+  }
+}
+
+typedef struct {
+  ZRegion *region;
+  bool young; // The copy refers to a young body
+} ZRegionFixup;
+
+static void zregion_fix_child(ZBody *copy, size_t index, void *arg) {
+  ZRegionFixup *fixup = (ZRegionFixup *)arg;
+  PyObject *word = zbody_get_slot(copy, index);
+  if (!zbody_is_ref(word))
+    return;
+  ZBody *target = zregion_target(fixup->region, word);
+  if (target) {
+    PyObject *ref = zbody_make_ref(zregion_forward(target));
+    zbody_set_word(copy, index, (uint64_t)(uintptr_t)ref);
+  } else if (zheap_is_young(zbody_ref_target(word)))
+    fixup->young = true;
+}
+
+static void zregion_fix_root(void **root, void *arg) {
+  ZRegion *region = (ZRegion *)arg;
+  ZBody *raw = (ZBody *)Z_ADDRESS(*root);
+  if (zheap_get_page(raw)->region == region)
+    *root = zregion_forward(raw);
+}
+
+// Points everything at the copies
+static void zregion_fix_references(ZRegionRelease *rel) {
+  ZRegion *region = rel->region;
+  for (size_t i = 0; i < rel->copies.count; i++) {
+    ZBody *copy = rel->copies.items[i];
+    ZRegionFixup fixup = {region, false};
+    zregion_for_each_ref(copy, zregion_fix_child, &fixup);
+    // Old copies referring to young bodies are roots of minor cycles
+    if (fixup.young)
+      zremset_add(Z_WITH_COLOR(copy, zstate->good_color));
+    PyObject *handle = *zbody_handle_slot(copy);
+    if (handle)
+      __atomic_store_n(&((ZObject *)handle)->body,
+                       (ZBody *)Z_WITH_COLOR(copy, zstate->good_color),
+                       __ATOMIC_RELEASE);
+  }
+
+  for (size_t i = 0; i < region->nescapes; i++) {
+    ZRegionEscape *escape = &region->escapes[i];
+    ZBody *holder = (ZBody *)zgc_remap(escape->holder);
+    PyObject *word = zbody_get_slot(holder, escape->index);
+    ZBody *target = zregion_target(region, word);
+    if (target)
+      zbody_heal_slot(holder, escape->index, word,
+                      zbody_make_ref(zregion_forward(target)));
+  }
+  zgc_for_each_root(zregion_fix_root, region);
+
+  // Holders logged by other regions may be on our pages
+  ZRegionState *active = zstate->region;
+  pthread_mutex_lock(&active->region_lock);
+  for (ZRegion *other = active->regions; other; other = other->next) {
+    if (other == region)
+      continue;
+    pthread_mutex_lock(&other->escape_lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < other->nescapes; i++) {
+      ZRegionEscape escape = other->escapes[i];
+      ZBody *raw = (ZBody *)Z_ADDRESS(escape.holder);
+      ZPage *page = zheap_get_page(raw);
+      if (page->region == region) {
+        // A holder that didn't escape is gone, and so is its slot
+        if (!zpage_resolve_forwarding(page, raw))
+          continue;
+        escape.holder = zregion_forward(raw);
+      }
+      other->escapes[kept++] = escape;
+    }
+    other->nescapes = kept;
+    pthread_mutex_unlock(&other->escape_lock);
+  }
+  pthread_mutex_unlock(&active->region_lock);
+}
+
+// Returns false, having changed nothing but the forwarding tables, if it
+// runs out of memory
+static bool zregion_release(ZRegion *region, ZRegionResult *result) {
+  ZRegionRelease rel = {0};
+  rel.region = region;
+  for (size_t i = 0; i < region->npages; i++)
+    zpage_start_evacuation(region->pages[i]);
+
+  zregion_find_escapes(&rel);
+  zregion_copy(&rel);
+  if (!rel.failed) {
+    zregion_fix_references(&rel);
+    for (size_t i = 0; i < region->npages; i++)
+      zprof_release_page(region->pages[i]);
+    zheap_unlink_region(region);
+    for (size_t i = 0; i < region->npages; i++)
+      zpage_recycle(region->pages[i]);
+    result->released_bytes = region->npages * ZPAGE_SIZE;
+    result->escaped = rel.copies.count;
+    result->escaped_bytes = rel.escaped_bytes;
+  } else {
+    for (size_t i = 0; i < region->npages; i++) {
+      ZPage *page = region->pages[i];
+      free(page->forwarding_table.entries);
+      page->forwarding_table.entries = NULL;
+      page->forwarding_table.count = page->forwarding_table.capacity = 0;
+      page->is_evacuating = false;
+    }
+  }
+  free(rel.work.items);
+  free(rel.copies.items);
+  return !rel.failed;
+}
+
+typedef struct {
+  ZRegion *region;
+  ZRegionResult *result;
+} ZRegionEnd;
+
+// Runs in a pause on the owner thread
+static void zregion_end(void *arg) {
+  ZRegionEnd *end = (ZRegionEnd *)arg;
+  ZRegion *region = end->region;
+  ZRegionResult *result = end->result;
+  zheap_leave_region();
+
+  // The page walk and the copying need the collector idle and nothing but
+  // bodies in the pages, and pinned bodies can't move
+  bool pinned = false;
+  for (size_t i = 0; i < region->npages; i++)
+    pinned |= atomic_load(&region->pages[i]->pin_count) > 0;
+  result->pages = region->npages;
+  result->released = atomic_load(&zstate->phase) == ZGC_PHASE_IDLE && !pinned &&
+                     !region->escapes_lost && !region->raw_memory &&
+                     zregion_release(region, result);
+  if (!result->released) {
+    // Ordinary young pages from now on
+    for (size_t i = 0; i < region->npages; i++)
+      region->pages[i]->region = NULL;
+  }
+
+  ZRegionState *active = zstate->region;
+  pthread_mutex_lock(&active->region_lock);
+  if (region->prev)
+    region->prev->next = region->next;
+  else
+    active->regions = region->next;
+  if (region->next)
+    region->next->prev = region->prev;
+  pthread_mutex_unlock(&active->region_lock);
+
+  ZRegionStats *stats = &active->stats;
+  pthread_mutex_lock(&active->stats_lock);
+  stats->regions++;
+  if (!result->released)
+    stats->fallbacks++;
+  stats->pages += result->pages;
+  stats->released_bytes += result->released_bytes;
+  stats->escaped += result->escaped;
+  stats->escaped_bytes += result->escaped_bytes;
+  pthread_mutex_unlock(&active->stats_lock);
+}
+
+static void zregion_free(ZRegion *region) {
+  pthread_mutex_destroy(&region->escape_lock);
+  free(region->escapes);
+  free(region->pages);
+  free(region);
+}
+
+// --- pyzgc.region ---
+
+static PyObject *ZRegion_new(PyTypeObject *type, PyObject *args,
+                             PyObject *kwds) {
+  static char *kwlist[] = {NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, ":region", kwlist))
+    return NULL;
+  return type->tp_alloc(type, 0);
+}
+
+static void zregion_exit(ZRegionObject *self) {
+  ZRegionEnd end = {self->region, &self->result};
+  // The heap of a closed state is gone, and the region with it
+  zstate_enter();
+  if (!zstate->closed)
+    zgc_pause(zregion_end, &end);
+  zregion_free(self->region);
+  self->region = NULL;
+}
+
+static void ZRegion_dealloc(ZRegionObject *self) {
+  // Entered but never exited. Only the owner can end it; on another
+  // thread the region stays active (and leaks) along with the owner's
+  // allocation.
+  if (self->region && pthread_equal(self->region->owner, pthread_self()))
+    zregion_exit(self);
+  PyTypeObject *type = Py_TYPE(self);
+  type->tp_free((PyObject *)self);
+  Py_DECREF(type);
+}
+
+static PyObject *ZRegion_enter(ZRegionObject *self,
+                               PyObject *Py_UNUSED(ignored)) {
+  if (self->used) {
+    PyErr_SetString(PyExc_RuntimeError, "a region can only be entered once");
+    return NULL;
+  }
+  zstate_enter();
+  if (zheap_current_region()) {
+    PyErr_SetString(PyExc_RuntimeError, "regions do not nest");
+    return NULL;
+  }
+  ZRegion *region = (ZRegion *)calloc(1, sizeof(ZRegion));
+  if (!region)
+    return PyErr_NoMemory();
+  region->owner = pthread_self();
+  pthread_mutex_init(&region->escape_lock, NULL);
+
+  ZRegionState *active = zstate->region;
+  pthread_mutex_lock(&active->region_lock);
+  region->next = active->regions;
+  if (active->regions)
+    active->regions->prev = region;
+  active->regions = region;
+  pthread_mutex_unlock(&active->region_lock);
+
+  self->used = true;
+  self->region = region;
+  // The GC may retire the TLAB meanwhile
+  zsafepoint_enter();
+  zheap_enter_region(region);
+  zsafepoint_leave();
+  return Py_NewRef(self);
+}
+
+static PyObject *ZRegion_exit(ZRegionObject *self, PyObject *args) {
+  if (!self->region) {
+    PyErr_SetString(PyExc_RuntimeError, "region is not active");
+    return NULL;
+  }
+  if (!pthread_equal(self->region->owner, pthread_self())) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "region was entered by another thread");
+    return NULL;
+  }
+  zregion_exit(self);
+  Py_RETURN_FALSE;
+}
+
+static PyObject *ZRegion_get_active(ZRegionObject *self, void *closure) {
+  return PyBool_FromLong(self->region != NULL);
+}
+
+static PyObject *ZRegion_repr(ZRegionObject *self) {
+  if (self->region)
+    return PyUnicode_FromFormat("<pyzgc.region at %p; active>", self);
+  if (!self->used)
+    return PyUnicode_FromFormat("<pyzgc.region at %p; not entered>", self);
+  return PyUnicode_FromFormat(
+      "<pyzgc.region at %p; %zu pages %s, %zu bodies escaped>", self,
+      self->result.pages, self->result.released ? "released" : "left to GC",
+      self->result.escaped);
+}
+
+static PyMethodDef ZRegion_methods[] = {
+    {"__enter__", (PyCFunction)ZRegion_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)ZRegion_exit, METH_VARARGS, NULL},
+    {NULL}};
+
+static PyMemberDef ZRegion_members[] = {
+    {"released", T_BOOL, offsetof(ZRegionObject, result.released), READONLY,
+     "True if the pages were released in bulk at the end."},
+    {"pages", T_PYSSIZET, offsetof(ZRegionObject, result.pages), READONLY,
+     "Pages the region allocated in (set at the end)."},
+    {"released_bytes", T_PYSSIZET,
+     offsetof(ZRegionObject, result.released_bytes), READONLY,
+     "Page memory returned to the pool or the OS at the end."},
+    {"escaped", T_PYSSIZET, offsetof(ZRegionObject, result.escaped), READONLY,
+     "Bodies copied out of the region at the end."},
+    {"escaped_bytes", T_PYSSIZET,
+     offsetof(ZRegionObject, result.escaped_bytes), READONLY,
+     "Bytes copied out of the region at the end."},
+    {NULL}};
+
+static PyGetSetDef ZRegion_getset[] = {
+    {"active", (getter)ZRegion_get_active, NULL,
+     "True inside the with block.", NULL},
+    {NULL}};
+
+static PyType_Slot ZRegion_slots[] = {
+    {Py_tp_doc, "region(): allocate the thread's objects on pages of their "
+                "own inside a with block, and release those pages in bulk "
+                "at its end. Objects still referenced from outside are "
+                "copied out."},
+    {Py_tp_new, ZRegion_new},
+    {Py_tp_dealloc, ZRegion_dealloc},
+    {Py_tp_repr, ZRegion_repr},
+    {Py_tp_methods, ZRegion_methods},
+    {Py_tp_members, ZRegion_members},
+    {Py_tp_getset, ZRegion_getset},
+    {0, NULL}};
+
+PyType_Spec ZRegionSpec = {
+    .name = "pyzgc.region",
+    .basicsize = sizeof(ZRegionObject),
+    .flags = ZTYPE_FLAGS,
+    .slots = ZRegion_slots,
+};
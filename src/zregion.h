@@ -0,0 +1,100 @@
+#ifndef ZREGION_H
+#define ZREGION_H
+
+#include "zfork.h"
+#include "zheap.h"
+#include "zobject.h"
+#include <Python.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Scoped allocation regions (`with pyzgc.region():`).
+//
+// While a region is active, the thread's young bodies go to pages of the
+// region's own (zheap_enter_region). They are linked into the heap like
+// any young page, so a cycle running meanwhile marks through them, but
+// relocation leaves them alone. Most bodies of a region die with it, and
+// its end releases them in bulk, without marking:
+//   - escapes are found: bodies with a live handle (returned, or still
+//     referenced from Python), bodies stored into an object outside the
+//     region (logged by the escape barrier in zobject_store_ref), and roots
+//     pushed with pyzgc.add_root
+//   - those bodies and everything they reach in the region are copied to
+//     the old generation, and their handles, the logged slots and the roots
+//     are pointed at the copies
+//   - the pages go back to the page pool (zpool.h)
+// This needs the collector idle, nothing pinned, and nothing but bodies in
+// the pages. While an incremental cycle is open (pyzgc.gc(budget_us=...)),
+// a region page is pinned, or raw memory (pyzgc.allocate) was allocated,
+// the pages instead become ordinary young pages for the collector.
+//
+// Regions don't nest: a thread has one at a time.
+
+// Slot of a body outside the region that was given a region body
+typedef struct {
+  ZBody *holder; // Colored; remapped at the end in case it moved
+  size_t index;
+} ZRegionEscape;
+
+typedef struct ZRegion {
+  struct ZRegion *next; // Active regions, under region_lock (zregion.c)
+  struct ZRegion *prev;
+  pthread_t owner;
+
+  ZPage **pages; // In allocation order: the last one holds the TLAB
+  size_t npages;
+  size_t capacity;
+
+  // Appended by whichever thread stores a region body outside
+  pthread_mutex_t escape_lock;
+  ZRegionEscape *escapes;
+  size_t nescapes;
+  size_t escapes_capacity;
+  bool escapes_lost; // Out of memory for the log: the end falls back
+  // Raw memory (pyzgc.allocate) was allocated in the region, so its pages
+  // can't be walked body by body: the end falls back
+  bool raw_memory;
+} ZRegion;
+
+// Escape barrier: `holder` (not on a page of `region`) was just given a
+// reference to a body of the region in word `index`
+void zregion_escape(ZRegion *region, ZBody *holder, size_t index);
+
+// What the end of a region did
+typedef struct {
+  bool released;         // Bulk release (false: pages left to the collector)
+  size_t pages;          // Region pages
+  size_t released_bytes; // Page memory returned to the pool or the OS
+  size_t escaped;        // Bodies copied out
+  size_t escaped_bytes;
+} ZRegionResult;
+
+// Totals since startup
+typedef struct {
+  uint64_t regions;        // Regions ended
+  uint64_t fallbacks;      // ... that left their pages to the collector
+  uint64_t pages;          // Region pages allocated
+  uint64_t released_bytes; // Released in bulk
+  uint64_t escaped;        // Bodies copied out
+  uint64_t escaped_bytes;
+} ZRegionStats;
+
+void zregion_get_stats(ZRegionStats *out);
+
+// Regions of threads that don't exist in a child stay active there, like
+// regions whose object outlives its thread
+bool zregion_state_init(ZState *state);
+
+void zregion_atfork(ZForkStage stage);
+
+typedef struct {
+  PyObject_HEAD ZRegion *region; // NULL before enter and after exit
+  bool used;                     // Entered once already
+  ZRegionResult result;
+} ZRegionObject;
+
+extern PyType_Spec ZRegionSpec;
+
+#endif
@@ -0,0 +1,412 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "zsafepoint.h"
+#include "zprobe.h"
+#include "zsatb.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Per-state part (zstate.h)
+typedef struct ZSafepointState {
+  // Mutators parked in zsafepoint_block wait for the epoch to move on
+  pthread_mutex_t poll_lock;
+  pthread_cond_t poll_cond;
+  uint64_t safepoint_epoch;
+
+  // One safepoint at a time; held from begin to end
+  pthread_mutex_t safepoint_lock;
+#ifndef Py_GIL_DISABLED
+  PyGILState_STATE safepoint_gil;
+  bool safepoint_ensured;          // begin took the GIL itself
+  PyThreadState *safepoint_tstate; // Made for the pause, if it took it so
+#endif
+  uint64_t safepoint_requested_at;
+  uint64_t safepoint_reached_at;
+
+  // Registered mutators
+  pthread_mutex_t threads_lock;
+  ZThread *threads;
+
+  pthread_mutex_t stats_lock;
+  ZSafepointStats stats;
+} ZSafepointState;
+
+// The calling thread's records, one per state, and the key whose
+// destructor frees them when it exits
+static __thread ZThread *thread_records = NULL;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static uint64_t zsafepoint_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void zsafepoint_init_locks(ZSafepointState *sp) {
+  pthread_mutex_init(&sp->poll_lock, NULL);
+  pthread_cond_init(&sp->poll_cond, NULL);
+  pthread_mutex_init(&sp->safepoint_lock, NULL);
+  pthread_mutex_init(&sp->threads_lock, NULL);
+  pthread_mutex_init(&sp->stats_lock, NULL);
+}
+
+bool zsafepoint_state_init(ZState *state) {
+  ZSafepointState *sp =
+      (ZSafepointState *)calloc(1, sizeof(ZSafepointState));
+  if (!sp)
+    return false;
+  zsafepoint_init_locks(sp);
+  state->safepoint = sp;
+  return true;
+}
+
+// --- Thread registry ---
+
+// Requires the state's threads_lock
+static void zsafepoint_unlink(ZThread *thread) {
+  ZSafepointState *sp = thread->state->safepoint;
+  if (thread->prev)
+    thread->prev->next = thread->next;
+  else
+    sp->threads = thread->next;
+  if (thread->next)
+    thread->next->prev = thread->prev;
+  thread->next = thread->prev = NULL;
+  thread->detached = true;
+}
+
+// Thread exit: hand off what is left in the SATB buffers and unregister.
+// States are never freed, so the records' locks are still there.
+static void zsafepoint_thread_exit(void *arg) {
+  ZThread *thread = (ZThread *)arg;
+  while (thread) {
+    ZThread *next = thread->next_of_thread;
+    ZSafepointState *sp = thread->state->safepoint;
+    pthread_mutex_lock(&sp->threads_lock);
+    if (!thread->detached) {
+      zsatb_release_thread(thread);
+      zsafepoint_unlink(thread);
+    }
+    pthread_mutex_unlock(&sp->threads_lock);
+    free(thread);
+    thread = next;
+  }
+}
+
+static void zsafepoint_make_key(void) {
+  pthread_key_create(&thread_key, zsafepoint_thread_exit);
+}
+
+ZThread *zsafepoint_register_thread(void) {
+  if (zthread)
+    return zthread;
+
+  pthread_once(&thread_key_once, zsafepoint_make_key);
+  ZThread *thread = (ZThread *)calloc(1, sizeof(ZThread));
+  if (!thread)
+    abort(); // An unregistered thread could run through a safepoint
+  thread->state = zstate;
+  thread->owner = pthread_self();
+  thread->tlab = &zheap_tlab;
+  thread->sample_left = SIZE_MAX;
+  atomic_init(&thread->in_heap, false);
+
+  ZSafepointState *sp = zstate->safepoint;
+  pthread_mutex_lock(&sp->threads_lock);
+  thread->next = sp->threads;
+  if (sp->threads)
+    sp->threads->prev = thread;
+  sp->threads = thread;
+  pthread_mutex_unlock(&sp->threads_lock);
+
+  thread->next_of_thread = thread_records;
+  thread_records = thread;
+  pthread_setspecific(thread_key, thread);
+  zthread = thread;
+  return thread;
+}
+
+void zsafepoint_switch_thread(ZState *state) {
+  // Under the states' threads_lock: a handshake may retire the TLAB
+  ZThread *from = zthread;
+  if (from) {
+    ZSafepointState *sp = from->state->safepoint;
+    pthread_mutex_lock(&sp->threads_lock);
+    from->parked_tlab = zheap_tlab;
+    from->tlab = &from->parked_tlab;
+    pthread_mutex_unlock(&sp->threads_lock);
+  }
+  zheap_tlab.top = zheap_tlab.end = 0;
+
+  ZThread *thread = thread_records;
+  while (thread && thread->state != state)
+    thread = thread->next_of_thread;
+  if (thread) {
+    ZSafepointState *sp = state->safepoint;
+    pthread_mutex_lock(&sp->threads_lock);
+    zheap_tlab = thread->parked_tlab;
+    thread->tlab = &zheap_tlab;
+    pthread_mutex_unlock(&sp->threads_lock);
+  }
+  zthread = thread;
+}
+
+void zsafepoint_state_close(ZState *state) {
+  ZSafepointState *sp = state->safepoint;
+  pthread_mutex_lock(&sp->threads_lock);
+  while (sp->threads) {
+    ZThread *thread = sp->threads;
+    zsatb_release_thread(thread);
+    thread->parked_tlab.top = thread->parked_tlab.end = 0;
+    thread->tlab->top = thread->tlab->end = 0;
+    zsafepoint_unlink(thread);
+  }
+  pthread_mutex_unlock(&sp->threads_lock);
+}
+
+// --- Mutator side ---
+
+// Park until the safepoint that was pending at `epoch` is over
+static void zsafepoint_wait(ZSafepointState *sp, uint64_t epoch) {
+  pthread_mutex_lock(&sp->poll_lock);
+  while (atomic_load(&zstate->safepoint_requested) &&
+         sp->safepoint_epoch == epoch) {
+    pthread_cond_wait(&sp->poll_cond, &sp->poll_lock);
+  }
+  pthread_mutex_unlock(&sp->poll_lock);
+}
+
+static uint64_t zsafepoint_current_epoch(ZSafepointState *sp) {
+  pthread_mutex_lock(&sp->poll_lock);
+  uint64_t epoch = sp->safepoint_epoch;
+  pthread_mutex_unlock(&sp->poll_lock);
+  return epoch;
+}
+
+void zsafepoint_block(void) {
+  // Only a mutator holding the GIL (attached, on free-threaded builds) can
+  // be what the GC is waiting for
+  if (!zstate_tstate())
+    return;
+  ZSafepointState *sp = zstate->safepoint;
+
+#ifdef Py_GIL_DISABLED
+  // Outside a body access section we are not holding up the GC
+  ZThread *thread = zthread;
+  if (!thread || thread->depth == 0)
+    return;
+  // Step out of the section while parked
+  atomic_store(&thread->in_heap, false);
+#endif
+
+  uint64_t epoch = zsafepoint_current_epoch(sp);
+
+  // Hand the GIL to the GC thread right away instead of waiting for the
+  // interpreter's switch interval (and detach, on free-threaded builds, so
+  // CPython's own stop-the-world is not held up), and stay parked until the
+  // pause is over.
+  Py_BEGIN_ALLOW_THREADS
+  zsafepoint_wait(sp, epoch);
+  Py_END_ALLOW_THREADS
+
+#ifdef Py_GIL_DISABLED
+  atomic_store(&thread->in_heap, true);
+  // A new safepoint may have started while we were waking up
+  while (atomic_load(&zstate->safepoint_requested)) {
+    atomic_store(&thread->in_heap, false);
+    epoch = zsafepoint_current_epoch(sp);
+    Py_BEGIN_ALLOW_THREADS
+    zsafepoint_wait(sp, epoch);
+    Py_END_ALLOW_THREADS
+    atomic_store(&thread->in_heap, true);
+  }
+#endif
+}
+
+void zsafepoint_enter_slow(void) {
+  ZThread *thread = zsafepoint_register_thread();
+  ZSafepointState *sp = zstate->safepoint;
+  thread->depth = 1;
+  atomic_store(&thread->in_heap, true);
+  // Pairs with the requested-then-scan order in zsafepoint_begin
+  while (atomic_load(&zstate->safepoint_requested)) {
+    atomic_store(&thread->in_heap, false);
+    uint64_t epoch = zsafepoint_current_epoch(sp);
+    Py_BEGIN_ALLOW_THREADS
+    zsafepoint_wait(sp, epoch);
+    Py_END_ALLOW_THREADS
+    atomic_store(&thread->in_heap, true);
+  }
+}
+
+void zsafepoint_leave_slow(void) {
+  atomic_store(&zthread->in_heap, false);
+}
+
+#ifndef Py_GIL_DISABLED
+// Runs on the main thread at the next bytecode boundary
+static int zsafepoint_pending_call(void *arg) {
+  zstate_enter();
+  zsafepoint_poll();
+  return 0;
+}
+
+// Takes the GIL of the state's interpreter for a thread with no thread
+// state attached (the GC thread, idle steps). PyGILState_Ensure only knows
+// the main interpreter, and from 3.12 others may have a GIL of their own,
+// so those get a thread state for the length of the pause.
+static void zsafepoint_take_gil(ZSafepointState *sp) {
+  sp->safepoint_tstate = NULL;
+#if PY_VERSION_HEX >= 0x030C0000
+  if (!zstate_is_main(zstate))
+    sp->safepoint_tstate = PyThreadState_New(zstate->interp);
+  if (sp->safepoint_tstate) {
+    PyEval_RestoreThread(sp->safepoint_tstate);
+    return;
+  }
+#endif
+  sp->safepoint_gil = PyGILState_Ensure();
+}
+
+static void zsafepoint_drop_gil(ZSafepointState *sp) {
+  if (sp->safepoint_tstate) {
+    PyThreadState_Clear(sp->safepoint_tstate);
+    PyThreadState_DeleteCurrent();
+    sp->safepoint_tstate = NULL;
+  } else {
+    PyGILState_Release(sp->safepoint_gil);
+  }
+}
+#endif
+
+// --- GC side ---
+
+void zsafepoint_begin(void) {
+  ZSafepointState *sp = zstate->safepoint;
+  pthread_mutex_lock(&sp->safepoint_lock);
+  zstate_hold();
+  ZPROBE0(safepoint__begin);
+
+  sp->safepoint_requested_at = zsafepoint_now_ns();
+  atomic_store(&zstate->safepoint_requested, true);
+
+#ifdef Py_GIL_DISABLED
+  // No GIL to take: wait for every mutator to leave its body access section.
+  // We stay detached so CPython's own stop-the-world can still make progress.
+  for (;;) {
+    bool busy = false;
+    pthread_mutex_lock(&sp->threads_lock);
+    for (ZThread *thread = sp->threads; thread; thread = thread->next) {
+      if (atomic_load(&thread->in_heap)) {
+        busy = true;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&sp->threads_lock);
+    if (!busy)
+      break;
+    sched_yield();
+  }
+#else
+  // Mutators holding the GIL stop at their next poll (or pending-call
+  // check); everything else is parked on the GIL. Pending calls only run
+  // on the main interpreter's main thread. A caller running Python code
+  // already holds the GIL of its interpreter, whose state this is.
+  if (zstate_is_main(zstate))
+    Py_AddPendingCall(zsafepoint_pending_call, NULL);
+  sp->safepoint_ensured = zstate_tstate() == NULL;
+  if (sp->safepoint_ensured)
+    zsafepoint_take_gil(sp);
+#endif
+
+  sp->safepoint_reached_at = zsafepoint_now_ns();
+}
+
+void zsafepoint_end(void) {
+  ZSafepointState *sp = zstate->safepoint;
+  uint64_t now = zsafepoint_now_ns();
+  uint64_t requested_at = sp->safepoint_requested_at;
+  uint64_t reached_at = sp->safepoint_reached_at;
+  ZPROBE2(safepoint__end, reached_at - requested_at, now - reached_at);
+
+  pthread_mutex_lock(&sp->stats_lock);
+  zhistogram_record(&sp->stats.time_to_safepoint, reached_at - requested_at);
+  zhistogram_record(&sp->stats.pause, now - reached_at);
+  pthread_mutex_unlock(&sp->stats_lock);
+
+  pthread_mutex_lock(&sp->poll_lock);
+  atomic_store(&zstate->safepoint_requested, false);
+  sp->safepoint_epoch++;
+  pthread_cond_broadcast(&sp->poll_cond);
+  pthread_mutex_unlock(&sp->poll_lock);
+
+#ifndef Py_GIL_DISABLED
+  if (sp->safepoint_ensured)
+    zsafepoint_drop_gil(sp);
+#endif
+  zstate_unhold();
+  pthread_mutex_unlock(&sp->safepoint_lock);
+}
+
+void zsafepoint_handshake(ZHandshakeFn fn, void *arg) {
+  ZSafepointState *sp = zstate->safepoint;
+  pthread_mutex_lock(&sp->threads_lock);
+  for (ZThread *thread = sp->threads; thread; thread = thread->next) {
+    fn(thread, arg);
+  }
+  pthread_mutex_unlock(&sp->threads_lock);
+}
+
+void zsafepoint_atfork(ZForkStage stage) {
+  ZSafepointState *sp = zstate->safepoint;
+  switch (stage) {
+  case ZFORK_PREPARE:
+    pthread_mutex_lock(&sp->threads_lock);
+    break;
+  case ZFORK_PARENT:
+    pthread_mutex_unlock(&sp->threads_lock);
+    break;
+  case ZFORK_CHILD:
+    zsafepoint_init_locks(sp);
+    atomic_store(&zstate->safepoint_requested, false);
+    sp->safepoint_epoch++;
+    // Records of other threads are on no thread's list any more
+    ZThread *thread = sp->threads;
+    while (thread) {
+      ZThread *next = thread->next;
+      if (!pthread_equal(thread->owner, pthread_self())) {
+        zsatb_release_thread(thread);
+        zsafepoint_unlink(thread);
+        free(thread);
+      }
+      thread = next;
+    }
+    break;
+  }
+}
+
+// --- Stats ---
+
+void zhistogram_record(ZHistogram *hist, uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (us > 0 && bucket < ZHISTOGRAM_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  hist->buckets[bucket]++;
+  hist->count++;
+  hist->total_ns += ns;
+  if (ns > hist->max_ns)
+    hist->max_ns = ns;
+}
+
+void zsafepoint_get_stats(ZSafepointStats *out) {
+  ZSafepointState *sp = zstate->safepoint;
+  pthread_mutex_lock(&sp->stats_lock);
+  *out = sp->stats;
+  pthread_mutex_unlock(&sp->stats_lock);
+}
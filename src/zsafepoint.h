@@ -0,0 +1,140 @@
+#ifndef ZSAFEPOINT_H
+#define ZSAFEPOINT_H
+
+#include "zfork.h"
+#include "zheap.h"
+#include "zstate.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Safepoints: short stop-the-world sections for the GC thread (mark start,
+// mark end, relocate start) plus per-thread handshakes.
+//
+// Each state (zstate.h) has safepoints and threads of its own: the GC
+// thread of one interpreter only waits for the mutators of that
+// interpreter's heap (with a shared GIL, the others just wait for it).
+//
+// Mutators poll zstate->safepoint_requested in the allocation slow path
+// and in barrier slow paths. A poll only happens at points where the
+// mutator holds no raw body pointer, so it may block there until the
+// safepoint is over.
+
+// With the GIL, a mutator can only touch bodies while holding it, so taking
+// the GIL stops everyone. On free-threaded builds (Py_GIL_DISABLED) mutators
+// instead bracket every body access with zsafepoint_enter/leave, and the GC
+// waits until no registered thread is inside such a section.
+
+// Record of a mutator known to the collector of one state. A thread has
+// one per state it has allocated in; zthread is the current state's.
+typedef struct ZThread {
+  struct ZThread *next; // The state's records, under its threads_lock
+  struct ZThread *prev;
+  struct ZThread *next_of_thread; // The owner's records of other states
+  ZState *state;
+  pthread_t owner;
+  bool detached;        // Unlinked by zsafepoint_state_close
+  ZTLAB *tlab;          // zheap_tlab while the owner is on the state, else
+  ZTLAB parked_tlab;    // the TLAB parked here when it switched away
+
+  // Owner thread only
+  uintptr_t tlab_limit; // Allocation sampling (zheap.c)
+  uintptr_t sample_base;
+  size_t sample_left;
+  struct ZRegion *region;           // See zheap_enter_region
+  struct ZSATBBuffer *satb_buffer;  // See zsatb.h
+
+  atomic_bool in_heap;  // Inside zsafepoint_enter/leave (free-threaded only)
+  int depth;            // Nesting of enter/leave, owner thread only
+} ZThread;
+
+// Slow part of the poll: park until the pending safepoint is over
+void zsafepoint_block(void);
+
+static inline void zsafepoint_poll(void) {
+  if (atomic_load_explicit(&zstate->safepoint_requested,
+                           memory_order_relaxed)) {
+    zsafepoint_block();
+  }
+}
+
+// The calling thread's record of the current state, registered on first
+// use. Never NULL: a thread the collector doesn't know about could run
+// through a safepoint, so running out of memory here aborts.
+ZThread *zsafepoint_register_thread(void);
+
+// zstate_attach: parks zheap_tlab in the record of the state being left and
+// loads the one parked in the record of `state`, if any
+void zsafepoint_switch_thread(ZState *state);
+
+// Body access sections. Only free-threaded builds need them; the GIL
+// already keeps mutators out of safepoints otherwise.
+void zsafepoint_enter_slow(void);
+void zsafepoint_leave_slow(void);
+
+// Both also follow the interpreter of the calling thread (zstate_enter),
+// so every body access lands on the right heap.
+#ifdef Py_GIL_DISABLED
+static inline void zsafepoint_enter(void) {
+  zstate_enter();
+  ZThread *thread = zthread;
+  if (!thread || thread->depth == 0) {
+    zsafepoint_enter_slow();
+  } else {
+    thread->depth++;
+  }
+}
+
+static inline void zsafepoint_leave(void) {
+  ZThread *thread = zthread;
+  if (--thread->depth == 0) {
+    zsafepoint_leave_slow();
+  }
+}
+#else
+static inline void zsafepoint_enter(void) { zstate_enter(); }
+static inline void zsafepoint_leave(void) {}
+#endif
+
+// GC side. begin returns once every mutator of the current state is
+// stopped. Without free threading, begin takes the GIL of the state's
+// interpreter unless the caller already holds it, and keeps the calling
+// thread on its state (zstate_hold) until end.
+void zsafepoint_begin(void);
+void zsafepoint_end(void);
+
+// Runs fn once per registered mutator of the current state. Must be called
+// inside a safepoint.
+typedef void (*ZHandshakeFn)(ZThread *thread, void *arg);
+void zsafepoint_handshake(ZHandshakeFn fn, void *arg);
+
+bool zsafepoint_state_init(ZState *state);
+// Detaches the records of a closing state; their owners keep them until
+// they exit
+void zsafepoint_state_close(ZState *state);
+
+// In a child, only the forking thread is left registered. The others'
+// TLABs are dropped half-used, and their SATB buffers handed off.
+void zsafepoint_atfork(ZForkStage stage);
+
+// --- Stats ---
+// Bucket i counts samples in [2^(i-1), 2^i) microseconds (bucket 0: < 1us)
+#define ZHISTOGRAM_BUCKETS 24
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t buckets[ZHISTOGRAM_BUCKETS];
+} ZHistogram;
+
+typedef struct {
+  ZHistogram time_to_safepoint; // Request -> all mutators stopped
+  ZHistogram pause;             // All mutators stopped -> resumed
+} ZSafepointStats;
+
+void zhistogram_record(ZHistogram *hist, uint64_t ns);
+void zsafepoint_get_stats(ZSafepointStats *out);
+
+#endif
@@ -0,0 +1,155 @@
+#include <Python.h>
+#include "zsatb.h"
+#include "zsafepoint.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Per-state part (zstate.h). Each thread's buffer hangs off its record, so
+// the final-mark pause can reach buffers of threads that are parked on the
+// GIL.
+typedef struct ZSATBState {
+  pthread_mutex_t satb_lock;
+  ZSATBBuffer *completed;   // Handed off, waiting for the marker
+  ZSATBBuffer *free_buffers;
+} ZSATBState;
+
+bool zsatb_state_init(ZState *state) {
+  ZSATBState *satb = (ZSATBState *)calloc(1, sizeof(ZSATBState));
+  if (!satb)
+    return false;
+  pthread_mutex_init(&satb->satb_lock, NULL);
+  state->satb = satb;
+  return true;
+}
+
+// Requires satb_lock
+static void zsatb_hand_off(ZSATBState *satb, ZSATBBuffer *buffer) {
+  if (buffer->count == 0) {
+    buffer->next = satb->free_buffers;
+    satb->free_buffers = buffer;
+  } else {
+    buffer->next = satb->completed;
+    satb->completed = buffer;
+  }
+}
+
+// Requires satb_lock
+static ZSATBBuffer *zsatb_new_buffer(ZSATBState *satb) {
+  ZSATBBuffer *buffer = satb->free_buffers;
+  if (buffer) {
+    satb->free_buffers = buffer->next;
+  } else {
+    buffer = (ZSATBBuffer *)malloc(sizeof(ZSATBBuffer));
+    if (!buffer)
+      return NULL;
+  }
+  buffer->next = NULL;
+  buffer->count = 0;
+  return buffer;
+}
+
+void zsatb_release_thread(ZThread *thread) {
+  ZSATBState *satb = thread->state->satb;
+  if (!thread->satb_buffer)
+    return;
+  pthread_mutex_lock(&satb->satb_lock);
+  zsatb_hand_off(satb, thread->satb_buffer);
+  pthread_mutex_unlock(&satb->satb_lock);
+  thread->satb_buffer = NULL;
+}
+
+void zsatb_enqueue(void *body) {
+  // Losing an SATB entry would corrupt the heap, so this aborts when out of
+  // memory
+  ZThread *thread = zsafepoint_register_thread();
+
+  ZSATBBuffer *buffer = thread->satb_buffer;
+  if (!buffer || buffer->count == ZSATB_BUFFER_SIZE) {
+    // Slow path: publish the full buffer, grab a fresh one
+    ZSATBState *satb = zstate->satb;
+    pthread_mutex_lock(&satb->satb_lock);
+    if (buffer)
+      zsatb_hand_off(satb, buffer);
+    buffer = zsatb_new_buffer(satb);
+    pthread_mutex_unlock(&satb->satb_lock);
+    if (!buffer)
+      abort();
+    thread->satb_buffer = buffer;
+  }
+
+  buffer->entries[buffer->count++] = body;
+}
+
+size_t zsatb_drain(ZMarkStack *stack) {
+  ZSATBState *satb = zstate->satb;
+  pthread_mutex_lock(&satb->satb_lock);
+  ZSATBBuffer *list = satb->completed;
+  satb->completed = NULL;
+  pthread_mutex_unlock(&satb->satb_lock);
+
+  size_t pushed = 0;
+  while (list) {
+    ZSATBBuffer *next = list->next;
+    for (size_t i = 0; i < list->count; i++) {
+      zmarkstack_push(stack, list->entries[i]);
+    }
+    pushed += list->count;
+    list->count = 0;
+
+    pthread_mutex_lock(&satb->satb_lock);
+    zsatb_hand_off(satb, list);
+    pthread_mutex_unlock(&satb->satb_lock);
+    list = next;
+  }
+  return pushed;
+}
+
+static void zsatb_flush_thread(ZThread *thread, void *arg) {
+  if (thread->satb_buffer && thread->satb_buffer->count > 0)
+    zsatb_release_thread(thread);
+}
+
+void zsatb_flush_all(void) {
+  zsafepoint_handshake(zsatb_flush_thread, NULL);
+}
+
+static void zsatb_free_list(ZSATBBuffer *buffer) {
+  while (buffer) {
+    ZSATBBuffer *next = buffer->next;
+    free(buffer);
+    buffer = next;
+  }
+}
+
+void zsatb_state_close(ZState *state) {
+  ZSATBState *satb = state->satb;
+  atomic_store(&state->satb_active, false);
+  pthread_mutex_lock(&satb->satb_lock);
+  zsatb_free_list(satb->completed);
+  zsatb_free_list(satb->free_buffers);
+  satb->completed = satb->free_buffers = NULL;
+  pthread_mutex_unlock(&satb->satb_lock);
+}
+
+void zsatb_atfork(ZForkStage stage) {
+  ZSATBState *satb = zstate->satb;
+  switch (stage) {
+  case ZFORK_PREPARE:
+    pthread_mutex_lock(&satb->satb_lock);
+    break;
+  case ZFORK_PARENT:
+    pthread_mutex_unlock(&satb->satb_lock);
+    break;
+  case ZFORK_CHILD:
+    pthread_mutex_init(&satb->satb_lock, NULL);
+    break;
+  }
+}
+
+void zsatb_begin_marking(void) {
+  atomic_store(&zstate->satb_active, true);
+}
+
+void zsatb_end_marking(void) {
+  atomic_store(&zstate->satb_active, false);
+}
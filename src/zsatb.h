@@ -0,0 +1,65 @@
+#ifndef ZSATB_H
+#define ZSATB_H
+
+#include "zfork.h"
+#include "zmarkstack.h"
+#include "zstate.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Snapshot-At-The-Beginning (SATB) queues for concurrent marking.
+//
+// While marking is active, every store that overwrites a ZObject reference
+// logs the old body into a per-thread buffer (pre-write barrier), kept in
+// the thread's record of the state (zthread). Full buffers are handed off
+// to the state's list that the marker drains; partially filled buffers are
+// flushed during the final-mark pause.
+
+#define ZSATB_BUFFER_SIZE 256
+
+typedef struct ZSATBBuffer {
+  struct ZSATBBuffer *next;
+  size_t count;
+  void *entries[ZSATB_BUFFER_SIZE];
+} ZSATBBuffer;
+
+struct ZThread;
+
+// zstate->satb_active is true between mark start and mark end.
+
+// Pre-write barrier slow path: log an overwritten body.
+void zsatb_enqueue(void *body);
+
+// Marker side: move all completed buffers onto the mark stack.
+// Returns the number of entries pushed.
+size_t zsatb_drain(ZMarkStack *stack);
+
+// Final mark (mutators stopped): hand off every thread's partial buffer.
+void zsatb_flush_all(void);
+
+// Start/stop logging. Stopping discards nothing; call zsatb_drain after.
+void zsatb_begin_marking(void);
+void zsatb_end_marking(void);
+
+// Hands off the buffer of a record going away (thread exit, fork child,
+// closed state). Called with the state's threads_lock held.
+void zsatb_release_thread(struct ZThread *thread);
+
+bool zsatb_state_init(ZState *state);
+void zsatb_state_close(ZState *state);
+
+// Buffers of threads that don't exist in a child are handed off
+// (zsafepoint_atfork): marking in progress at the fork still finds their
+// entries
+void zsatb_atfork(ZForkStage stage);
+
+// Pre-write barrier fast path (see ZObject_store).
+static inline void zsatb_pre_write(void *old_body) {
+  if (atomic_load_explicit(&zstate->satb_active, memory_order_relaxed) &&
+      old_body) {
+    zsatb_enqueue(old_body);
+  }
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "zstate.h"
+#include "zgc.h"
+#include "zheap.h"
+#include "zprof.h"
+#include "zref.h"
+#include "zregion.h"
+#include "zsafepoint.h"
+#include "zsatb.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Registry of every state ever created, newest first
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static ZState *states = NULL;
+// Held by the forking thread from prepare to parent or child
+static __thread bool registry_held = false;
+
+// The first state is static, so that zstate always points somewhere
+static ZState first_state;
+
+__thread ZState *zstate = &first_state;
+__thread struct ZThread *zthread = NULL;
+
+__thread PyInterpreterState *zstate_interp = NULL;
+__thread uint64_t zstate_seen = 0;
+atomic_uint_fast64_t zstate_generation = 1;
+static __thread int holds = 0;
+
+void zstate_enter_slow(PyInterpreterState *interp) {
+  if (holds)
+    return;
+  pthread_mutex_lock(&registry_lock);
+  uint64_t generation = atomic_load(&zstate_generation);
+  // A closed state still takes the deallocs of its interpreter's handles
+  ZState *found = NULL;
+  for (ZState *state = states; state; state = state->next) {
+    if (state->interp == interp && (!found || found->closed))
+      found = state;
+  }
+  if (found)
+    zstate_attach(found);
+  pthread_mutex_unlock(&registry_lock);
+  zstate_interp = interp;
+  zstate_seen = generation;
+}
+
+void zstate_attach(ZState *state) {
+  if (state == zstate)
+    return;
+  zsafepoint_switch_thread(state);
+  zstate = state;
+}
+
+void zstate_hold(void) { holds++; }
+
+void zstate_unhold(void) { holds--; }
+
+static bool zstate_init(ZState *state, PyInterpreterState *interp) {
+  state->good_color = ZPOINTER_MARKED0_BIT;
+  atomic_init(&state->phase, ZGC_PHASE_IDLE);
+  atomic_init(&state->safepoint_requested, false);
+  atomic_init(&state->satb_active, false);
+  atomic_init(&state->committed_bytes, 0);
+  atomic_init(&state->max_bytes, 0);
+  atomic_init(&state->soft_max_bytes, 0);
+  atomic_init(&state->frozen_bytes, 0);
+  state->interp = interp;
+  state->modules = 0;
+  state->closed = false;
+  if (zheap_state_init(state) && zgc_state_init(state) &&
+      zsafepoint_state_init(state) && zsatb_state_init(state) &&
+      zref_state_init(state) && zregion_state_init(state) &&
+      zprof_state_init(state))
+    return true;
+  // Nothing else is allocated yet
+  free(state->heap);
+  free(state->gc);
+  free(state->safepoint);
+  free(state->satb);
+  free(state->ref);
+  free(state->region);
+  free(state->prof);
+  return false;
+}
+
+ZState *zstate_get(PyInterpreterState *interp) {
+  pthread_mutex_lock(&registry_lock);
+  ZState *state;
+  for (state = states; state; state = state->next) {
+    if (state->interp == interp && !state->closed)
+      break;
+  }
+  if (!state) {
+    bool first = first_state.interp == NULL;
+    state = first ? &first_state : (ZState *)calloc(1, sizeof(ZState));
+    if (state && zstate_init(state, interp)) {
+      state->next = states;
+      states = state;
+      atomic_fetch_add(&zstate_generation, 1);
+    } else {
+      if (first)
+        first_state = (ZState){0};
+      else
+        free(state);
+      state = NULL;
+    }
+  }
+  pthread_mutex_unlock(&registry_lock);
+  return state;
+}
+
+void zstate_close(ZState *state) {
+  ZState *saved = zstate;
+  zstate_attach(state);
+  // Callbacks and profiles hold objects of the interpreter
+  zref_state_close(state);
+  zprof_state_close(state);
+  zsafepoint_state_close(state);
+  zsatb_state_close(state);
+  zgc_state_close(state);
+  zheap_state_close(state);
+
+  pthread_mutex_lock(&registry_lock);
+  state->closed = true;
+  atomic_fetch_add(&zstate_generation, 1);
+  pthread_mutex_unlock(&registry_lock);
+  if (saved != state)
+    zstate_attach(saved);
+}
+
+bool zstate_for_each(bool (*fn)(void *arg), void *arg) {
+  // States are only ever prepended and never freed, so the list can be
+  // walked from a snapshot of its head. fn may wait for the GIL, which a
+  // thread blocked on the registry lock could hold.
+  if (!registry_held)
+    pthread_mutex_lock(&registry_lock);
+  ZState *head = states;
+  if (!registry_held)
+    pthread_mutex_unlock(&registry_lock);
+  ZState *saved = zstate;
+  struct ZThread *saved_thread = zthread;
+  bool all = true;
+  for (ZState *state = head; state && all; state = state->next) {
+    if (state->closed)
+      continue;
+    // Not attached: fn must not allocate young bodies
+    zstate = state;
+    zthread = NULL;
+    all = fn(arg);
+  }
+  zstate = saved;
+  zthread = saved_thread;
+  return all;
+}
+
+bool zstate_is_main(ZState *state) {
+  return state->interp == PyInterpreterState_Main();
+}
+
+void zstate_atfork(ZForkStage stage) {
+  switch (stage) {
+  case ZFORK_PREPARE:
+    pthread_mutex_lock(&registry_lock);
+    registry_held = true;
+    break;
+  case ZFORK_PARENT:
+    registry_held = false;
+    pthread_mutex_unlock(&registry_lock);
+    break;
+  case ZFORK_CHILD:
+    registry_held = false;
+    pthread_mutex_init(&registry_lock, NULL);
+    break;
+  }
+}
@@ -0,0 +1,163 @@
+#ifndef ZSTATE_H
+#define ZSTATE_H
+
+#include "zfork.h"
+#include <Python.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-interpreter collector state.
+//
+// Every interpreter that imports pyzgc gets a heap of its own: pages,
+// remembered set, good color, mark stack, safepoints, SATB queues,
+// reference lists, regions, profiler and GC thread all hang off a ZState.
+// Only the page pool (zpool.h) and the cgroup reader (zcgroup.h) are
+// shared by the process.
+//
+// Code reaches the state through the thread-local `zstate`. Entry points
+// from Python (module functions, type slots, the C-API) call zstate_enter,
+// which follows the interpreter the calling thread is running; collector
+// threads stay on the state they were started for. A thread has one
+// record (ZThread, zsafepoint.h) per state it has allocated in, and
+// `zthread` is the one of the current state, NULL before the first
+// allocation there.
+//
+// Interpreters may share the GIL or have one each: nothing Python is
+// shared between states, the types included. A state is closed when its
+// interpreter drops the module: the GC thread stops and the page memory
+// goes back to the OS, but the state itself is never freed, since stale
+// handles may still be deallocated.
+
+struct ZThread;
+struct ZHeapState;
+struct ZGCState;
+struct ZSafepointState;
+struct ZSATBState;
+struct ZRefState;
+struct ZRegionState;
+struct ZProfState;
+
+// The interpreter's pyzgc types, heap types made from the specs of their
+// .c files when its first module is executed (pyzgcmodule.c). The state
+// owns them until it is closed; every instance owns its type as well.
+typedef struct ZTypes {
+  PyTypeObject *object;
+  PyTypeObject *structure; // Base of the pyzgc.define types
+  PyTypeObject *array;
+  PyTypeObject *dict;
+  PyTypeObject *dict_iter;
+  PyTypeObject *weakref;
+  PyTypeObject *pin;
+  PyTypeObject *region;
+  PyTypeObject *idle_selector;
+} ZTypes;
+
+// Flags of the pyzgc types: immutable like the static types they were
+#define ZTYPE_FLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE)
+
+typedef struct ZState {
+  // Read by the barriers and the allocation fast path
+  uintptr_t good_color;            // See zheap.h
+  atomic_int phase;                // ZGC_PHASE_* (zgc.h)
+  atomic_bool safepoint_requested; // See zsafepoint.h
+  atomic_bool satb_active;         // See zsatb.h
+
+  // Heap size (zheap.h)
+  atomic_size_t committed_bytes;
+  atomic_size_t max_bytes;
+  atomic_size_t soft_max_bytes;
+  atomic_size_t frozen_bytes;
+
+  // The rest of each module's state, private to its .c file
+  struct ZHeapState *heap;
+  struct ZGCState *gc;
+  struct ZSafepointState *safepoint;
+  struct ZSATBState *satb;
+  struct ZRefState *ref;
+  struct ZRegionState *region;
+  struct ZProfState *prof;
+
+  ZTypes types;
+  PyInterpreterState *interp;
+  int modules;         // Module objects using the state (pyzgcmodule.c)
+  bool closed;         // See zstate_close
+  struct ZState *next; // Every state ever created, under the registry lock
+} ZState;
+
+extern __thread ZState *zstate;
+extern __thread struct ZThread *zthread;
+
+// The calling thread's thread state while it holds the GIL (is attached,
+// on free-threaded builds), else NULL
+static inline PyThreadState *zstate_tstate(void) {
+#if PY_VERSION_HEX >= 0x030D0000
+  return PyThreadState_GetUnchecked();
+#elif PY_VERSION_HEX >= 0x030C0000
+  return _PyThreadState_UncheckedGet();
+#else
+  // Before 3.12 this is the GIL holder's, whichever thread that is
+  PyThreadState *tstate = _PyThreadState_UncheckedGet();
+  return tstate && tstate->thread_id == PyThread_get_thread_ident() ? tstate
+                                                                     : NULL;
+#endif
+}
+
+// Interpreter zstate belongs to, as last looked up by this thread, and the
+// registry generation at that time (bumped whenever a state is created or
+// closed)
+extern __thread PyInterpreterState *zstate_interp;
+extern __thread uint64_t zstate_seen;
+extern atomic_uint_fast64_t zstate_generation;
+
+void zstate_enter_slow(PyInterpreterState *interp);
+
+// Makes zstate the state of the interpreter the calling thread runs. Call
+// at every entry point from Python, with the GIL held; a no-op otherwise.
+static inline void zstate_enter(void) {
+  PyThreadState *tstate = zstate_tstate();
+  if (!tstate)
+    return;
+  PyInterpreterState *interp = PyThreadState_GetInterpreter(tstate);
+  if (interp != zstate_interp ||
+      atomic_load_explicit(&zstate_generation, memory_order_relaxed) !=
+          zstate_seen)
+    zstate_enter_slow(interp);
+}
+
+// Switches the calling thread to `state`, parking its TLAB in the record
+// of the state it leaves
+void zstate_attach(ZState *state);
+
+// Keeps the calling thread on its current state: zstate_enter does nothing
+// until the matching zstate_unhold. Collector threads hold for good, and
+// pauses hold while they run (their thread state may be another
+// interpreter's, see zsafepoint_begin).
+void zstate_hold(void);
+void zstate_unhold(void);
+
+// The open state of `interp`, or a new one (not attached). A new state has
+// an empty heap; the caller runs zheap_init with it attached. NULL when
+// out of memory.
+ZState *zstate_get(PyInterpreterState *interp);
+
+// Stops using a state whose interpreter is going away: the caller has
+// stopped its GC thread. Frees what the modules hold and gives the page
+// memory back to the OS, keeping the page headers mapped for late handle
+// deallocs.
+void zstate_close(ZState *state);
+
+// Calls fn with zstate set to each open state in turn (zthread NULL).
+// Stops early and returns false once fn does.
+bool zstate_for_each(bool (*fn)(void *arg), void *arg);
+
+// Whether the state belongs to the main interpreter, the only one whose
+// thread runs Py_AddPendingCall callbacks
+bool zstate_is_main(ZState *state);
+
+// The registry lock across fork() (zfork.h), taken before every other.
+// zstate_for_each in the forking thread then runs without it.
+void zstate_atfork(ZForkStage stage);
+
+#endif
@@ -0,0 +1,339 @@
+#define PY_SSIZE_T_CLEAN
+#include "zstruct.h"
+#include "zbarrier.h"
+#include "zheap.h"
+#include "zobject.h"
+#include "zsafepoint.h"
+#include <Python.h>
+#include <stdlib.h>
+#include <structmember.h>
+#include <string.h>
+
+// Type dict key holding the layout capsule of a defined struct
+#define ZSTRUCT_LAYOUT_KEY "__pyzgc_layout__"
+#define ZSTRUCT_CAPSULE_NAME "pyzgc.layout"
+
+static ZLayout *zstruct_layout(PyTypeObject *type) {
+  PyObject *capsule =
+      PyDict_GetItemString(type->tp_dict, ZSTRUCT_LAYOUT_KEY); // Borrowed
+  if (!capsule) {
+    PyErr_Format(PyExc_TypeError,
+                 "%.100s has no layout; create struct types with "
+                 "pyzgc.define()",
+                 type->tp_name);
+    return NULL;
+  }
+  return (ZLayout *)PyCapsule_GetPointer(capsule, ZSTRUCT_CAPSULE_NAME);
+}
+
+// Current (uncolored) body of self, after the load barrier. Call between
+// zsafepoint_enter and zsafepoint_leave.
+static inline ZBody *zstruct_body(ZObject *self) {
+  if (!Z_HAS_COLOR(self->body, zstate->good_color)) {
+    zbarrier_fix_pointer(self);
+  }
+  return (ZBody *)Z_ADDRESS(zobject_get_body(self));
+}
+
+// --- Field access ---
+
+static PyObject *zstruct_get(PyObject *self, void *closure) {
+  const ZField *field = (const ZField *)closure;
+  if (field->kind == ZFIELD_REF)
+    return zobject_load_ref((ZObject *)self, field->slot);
+
+  zsafepoint_enter();
+  uint64_t word = zbody_get_word(zstruct_body((ZObject *)self), field->slot);
+  zsafepoint_leave();
+
+  if (field->kind == ZFIELD_I64)
+    return PyLong_FromLongLong((int64_t)word);
+  double f64;
+  memcpy(&f64, &word, sizeof(f64));
+  return PyFloat_FromDouble(f64);
+}
+
+static int zstruct_set(PyObject *self, PyObject *value, void *closure) {
+  const ZField *field = (const ZField *)closure;
+  if (value == NULL) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete a struct field");
+    return -1;
+  }
+
+  uint64_t word;
+  if (field->kind == ZFIELD_REF) {
+    // Counted reference through the usual barriers; None is an empty slot
+    return zobject_store_ref((ZObject *)self, field->slot,
+                             value == Py_None ? NULL : value);
+  } else if (field->kind == ZFIELD_I64) {
+    long long i64 = PyLong_AsLongLong(value);
+    if (i64 == -1 && PyErr_Occurred())
+      return -1;
+    word = (uint64_t)i64;
+  } else {
+    double f64 = PyFloat_AsDouble(value);
+    if (f64 == -1.0 && PyErr_Occurred())
+      return -1;
+    memcpy(&word, &f64, sizeof(word));
+  }
+
+  // Numbers are stored unboxed: nothing to count, log or remember
+  zsafepoint_enter();
+  zbody_set_word(zstruct_body((ZObject *)self), field->slot, word);
+  zsafepoint_leave();
+  return 0;
+}
+
+// --- pyzgc.Struct ---
+
+static PyObject *ZStruct_new(PyTypeObject *type, PyObject *args,
+                             PyObject *kwds) {
+  ZLayout *layout = zstruct_layout(type);
+  if (!layout)
+    return NULL;
+  Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+  if (nargs > layout->nfields) {
+    PyErr_Format(PyExc_TypeError,
+                 "%.100s takes at most %d arguments (%zd given)",
+                 type->tp_name, layout->nfields, nargs);
+    return NULL;
+  }
+
+  // Fresh bodies are zeroed: 0, 0.0 and None
+  PyObject *self = zobject_alloc_body(type, zstruct_body_size(layout),
+                                      (uintptr_t)layout | ZSTRUCT_TAG);
+  if (self == NULL)
+    return NULL;
+
+  for (Py_ssize_t i = 0; i < nargs; i++) {
+    if (zstruct_set(self, PyTuple_GET_ITEM(args, i), &layout->fields[i]) < 0)
+      goto error;
+  }
+  if (kwds) {
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(kwds, &pos, &key, &value)) {
+      int i = 0;
+      while (i < layout->nfields &&
+             PyUnicode_CompareWithASCIIString(key, layout->getset[i].name))
+        i++;
+      if (i == layout->nfields) {
+        PyErr_Format(PyExc_TypeError, "%.100s has no field %R",
+                     type->tp_name, key);
+        goto error;
+      }
+      if (i < nargs) {
+        PyErr_Format(PyExc_TypeError, "%.100s got multiple values for %R",
+                     type->tp_name, key);
+        goto error;
+      }
+      if (zstruct_set(self, value, &layout->fields[i]) < 0)
+        goto error;
+    }
+  }
+  return self;
+
+error:
+  Py_DECREF(self);
+  return NULL;
+}
+
+static void ZStruct_dealloc(ZObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  if (!zobject_forget_handle(self))
+    return;
+  if (self->weakreflist != NULL) {
+    PyObject_ClearWeakRefs((PyObject *)self);
+  }
+  type->tp_free((PyObject *)self);
+  // Instances of heap types own a reference to their type
+  Py_DECREF(type);
+}
+
+static PyObject *ZStruct_repr(PyObject *self) {
+  ZLayout *layout = zstruct_layout(Py_TYPE(self));
+  if (!layout)
+    return NULL;
+  int rc = Py_ReprEnter(self);
+  if (rc != 0)
+    return rc > 0 ? PyUnicode_FromFormat("%s(...)", Py_TYPE(self)->tp_name)
+                  : NULL;
+
+  PyObject *parts = PyList_New(0);
+  PyObject *result = NULL;
+  if (!parts)
+    goto done;
+  for (int i = 0; i < layout->nfields; i++) {
+    PyObject *value = zstruct_get(self, &layout->fields[i]);
+    PyObject *part =
+        value ? PyUnicode_FromFormat("%s=%R", layout->getset[i].name, value)
+              : NULL;
+    Py_XDECREF(value);
+    if (!part || PyList_Append(parts, part) < 0) {
+      Py_XDECREF(part);
+      goto done;
+    }
+    Py_DECREF(part);
+  }
+  PyObject *sep = PyUnicode_FromString(", ");
+  PyObject *joined = sep ? PyUnicode_Join(sep, parts) : NULL;
+  Py_XDECREF(sep);
+  if (joined) {
+    result = PyUnicode_FromFormat("%s(%U)", Py_TYPE(self)->tp_name, joined);
+    Py_DECREF(joined);
+  }
+
+done:
+  Py_XDECREF(parts);
+  Py_ReprLeave(self);
+  return result;
+}
+
+static PyMemberDef ZStruct_members[] = {
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(ZObject, weakreflist),
+     READONLY},
+    {NULL}};
+
+static PyType_Slot ZStruct_slots[] = {
+    {Py_tp_doc, "Base of the typed ZGC objects built by pyzgc.define()"},
+    {Py_tp_alloc, zobject_alloc},
+    {Py_tp_new, ZStruct_new},
+    {Py_tp_dealloc, ZStruct_dealloc},
+    {Py_tp_repr, ZStruct_repr},
+    {Py_tp_members, ZStruct_members},
+    {0, NULL}};
+
+PyType_Spec ZStructSpec = {
+    .name = "pyzgc.Struct",
+    .basicsize = sizeof(ZObject),
+    // BASETYPE only so that pyzgc.define can derive from it
+    .flags = ZTYPE_FLAGS | Py_TPFLAGS_BASETYPE,
+    .slots = ZStruct_slots,
+};
+
+// --- pyzgc.define ---
+
+static int zstruct_parse_kind(PyObject *name, PyObject *spec,
+                              ZFieldKind *kind) {
+  if (PyUnicode_Check(spec)) {
+    if (PyUnicode_CompareWithASCIIString(spec, "i64") == 0) {
+      *kind = ZFIELD_I64;
+      return 0;
+    }
+    if (PyUnicode_CompareWithASCIIString(spec, "f64") == 0) {
+      *kind = ZFIELD_F64;
+      return 0;
+    }
+    if (PyUnicode_CompareWithASCIIString(spec, "ref") == 0) {
+      *kind = ZFIELD_REF;
+      return 0;
+    }
+  }
+  PyErr_Format(PyExc_ValueError,
+               "field %R: type must be 'i64', 'f64' or 'ref', not %R", name,
+               spec);
+  return -1;
+}
+
+PyObject *zstruct_define(PyObject *self, PyObject *args, PyObject *kwargs) {
+  const char *name = "Struct";
+  if (!PyArg_ParseTuple(args, "|s:define", &name))
+    return NULL;
+  Py_ssize_t nfields = kwargs ? PyDict_GET_SIZE(kwargs) : 0;
+  if (nfields == 0 || nfields > ZSTRUCT_MAX_FIELDS) {
+    PyErr_Format(PyExc_TypeError, "define() takes 1 to %d fields, got %zd",
+                 ZSTRUCT_MAX_FIELDS, nfields);
+    return NULL;
+  }
+
+  // Bodies point at their layout, and a body can outlive every handle to
+  // it until the next cycle, so layouts are never freed.
+  ZLayout *layout = (ZLayout *)calloc(1, sizeof(ZLayout));
+  char *qualname = (char *)malloc(strlen(name) + sizeof("pyzgc."));
+  if (!layout || !qualname) {
+    free(layout);
+    free(qualname);
+    return PyErr_NoMemory();
+  }
+  strcpy(qualname, "pyzgc.");
+  strcat(qualname, name);
+
+  PyObject *key, *spec;
+  Py_ssize_t pos = 0;
+  int i = 0;
+  while (PyDict_Next(kwargs, &pos, &key, &spec)) {
+    ZField *field = &layout->fields[i];
+    const char *field_name = PyUnicode_AsUTF8(key);
+    if (!field_name || zstruct_parse_kind(key, spec, &field->kind) < 0)
+      goto error;
+    if (field_name[0] == '_') {
+      PyErr_Format(PyExc_ValueError,
+                   "field names cannot start with an underscore: %R", key);
+      goto error;
+    }
+    field->slot = i + 1; // Slot 0 is the header
+    if (field->kind == ZFIELD_REF)
+      layout->ref_map |= 1u << field->slot;
+
+    PyGetSetDef *def = &layout->getset[i];
+    def->name = strdup(field_name);
+    if (!def->name) {
+      PyErr_NoMemory();
+      goto error;
+    }
+    def->get = zstruct_get;
+    def->set = zstruct_set;
+    def->closure = field;
+    i++;
+  }
+  layout->nfields = i;
+
+  // An explicit dealloc, or the type would get subtype_dealloc and lose a
+  // second reference to itself on top of ZStruct_dealloc's
+  PyType_Slot slots[] = {{Py_tp_getset, layout->getset},
+                         {Py_tp_dealloc, ZStruct_dealloc},
+                         {0, NULL}};
+  PyType_Spec type_spec = {
+      .name = qualname,
+      .basicsize = sizeof(ZObject),
+      .flags = Py_TPFLAGS_DEFAULT,
+      .slots = slots,
+  };
+  zstate_enter();
+  PyObject *type = PyType_FromSpecWithBases(
+      &type_spec, (PyObject *)zstate->types.structure);
+  if (!type)
+    goto error;
+
+  PyObject *capsule = PyCapsule_New(layout, ZSTRUCT_CAPSULE_NAME, NULL);
+  PyObject *fields = PyTuple_New(layout->nfields);
+  int rc = capsule && fields ? 0 : -1;
+  for (int f = 0; rc == 0 && f < layout->nfields; f++) {
+    PyObject *field_name = PyUnicode_FromString(layout->getset[f].name);
+    if (!field_name)
+      rc = -1;
+    else
+      PyTuple_SET_ITEM(fields, f, field_name);
+  }
+  if (rc == 0)
+    rc = PyObject_SetAttrString(type, ZSTRUCT_LAYOUT_KEY, capsule);
+  if (rc == 0)
+    rc = PyObject_SetAttrString(type, "_fields", fields);
+  Py_XDECREF(capsule);
+  Py_XDECREF(fields);
+  if (rc < 0) {
+    // The layout may already be referenced from the capsule; leak it
+    Py_DECREF(type);
+    return NULL;
+  }
+  Py_INCREF(type);
+  layout->type = (PyTypeObject *)type;
+  return type;
+
+error:
+  for (int f = 0; f < ZSTRUCT_MAX_FIELDS; f++)
+    free((char *)layout->getset[f].name);
+  free(layout);
+  free(qualname);
+  return NULL;
+}
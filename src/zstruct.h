@@ -0,0 +1,63 @@
+#ifndef ZSTRUCT_H
+#define ZSTRUCT_H
+
+#include "zobject.h"
+#include <Python.h>
+#include <stdint.h>
+
+// Typed struct layouts (pyzgc.define). A struct body is sized to its
+// layout, like an array body (zarray.h), and its words are typed:
+//   slot 0       header: the (never freed) ZLayout pointer | ZSTRUCT_TAG
+//   slots 1..n   one field each: an unboxed int64, an unboxed double, or a
+//                reference (a slot word, see zobject.h)
+//   last         the handle back-pointer every body ends with
+// The header tag can't be mistaken for anything a plain body holds: those
+// slots are NULL, 8-byte aligned PyObject pointers, or odd encoded
+// references (see zobject.h and zimage.h).
+
+#define ZSTRUCT_TAG 0x4
+#define ZSTRUCT_TAG_MASK 0x7
+// The ref map has a bit per slot, header included
+#define ZSTRUCT_MAX_FIELDS 31
+// Every slot of a plain body may hold a reference
+#define ZSTRUCT_ALL_REFS ((1u << ZOBJECT_SLOTS) - 1)
+
+typedef enum { ZFIELD_I64, ZFIELD_F64, ZFIELD_REF } ZFieldKind;
+
+typedef struct {
+  ZFieldKind kind;
+  int slot;
+} ZField;
+
+typedef struct {
+  int nfields;
+  uint32_t ref_map; // Bit i set: slot i holds a reference
+  // The struct type. Loads make handles of it for bodies that have none,
+  // and bodies may outlive every handle, so the layout owns a reference.
+  PyTypeObject *type;
+  ZField fields[ZSTRUCT_MAX_FIELDS];
+  PyGetSetDef getset[ZSTRUCT_MAX_FIELDS + 1];
+} ZLayout;
+
+static inline const ZLayout *zstruct_body_layout(ZBody *body) {
+  uintptr_t header = (uintptr_t)zbody_get_slot(body, 0);
+  if ((header & ZSTRUCT_TAG_MASK) != ZSTRUCT_TAG)
+    return NULL;
+  return (const ZLayout *)(header & ~(uintptr_t)ZSTRUCT_TAG_MASK);
+}
+
+// Header, fields and handle back-pointer
+static inline size_t zstruct_body_size(const ZLayout *layout) {
+  return (size_t)(layout->nfields + 2) * sizeof(PyObject *);
+}
+
+// Which slots of body the marker has to trace
+static inline uint32_t zstruct_ref_map(ZBody *body) {
+  const ZLayout *layout = zstruct_body_layout(body);
+  return layout ? layout->ref_map : ZSTRUCT_ALL_REFS;
+}
+
+// pyzgc.define(name=None, /, **fields): a new pyzgc.Struct subtype
+PyObject *zstruct_define(PyObject *self, PyObject *args, PyObject *kwargs);
+
+#endif
@@ -0,0 +1,138 @@
+// Test extension built against pyzgc_capi.h only (see tests/test_capi.py).
+#define PY_SSIZE_T_CLEAN
+#include "pyzgc_capi.h"
+#include <Python.h>
+
+static PyObject *zt_version(PyObject *self, PyObject *args) {
+  return PyLong_FromUnsignedLong(PyZGC_API->version);
+}
+
+static PyObject *zt_good_color(PyObject *self, PyObject *args) {
+  return PyLong_FromUnsignedLongLong(*PyZGC_GoodColor);
+}
+
+// Sum all int slots of obj by reading the body directly (no Python calls).
+static PyObject *zt_sum_slots(PyObject *self, PyObject *obj) {
+  if (!PyZGC_Check(obj)) {
+    PyErr_SetString(PyExc_TypeError, "expected pyzgc.Object");
+    return NULL;
+  }
+  PyZGC_API->enter();
+  PyObject **slots = PyZGC_Slots(obj);
+  long long total = 0;
+  for (Py_ssize_t i = 0; i < PyZGC_API->nslots; i++) {
+    if (slots[i] && PyLong_Check(slots[i])) {
+      total += PyLong_AsLongLong(slots[i]);
+    }
+  }
+  PyZGC_API->leave();
+  return PyLong_FromLongLong(total);
+}
+
+// Store value into every slot of obj through the capsule.
+static PyObject *zt_fill(PyObject *self, PyObject *args) {
+  PyObject *obj, *value;
+  if (!PyArg_ParseTuple(args, "OO", &obj, &value))
+    return NULL;
+  for (Py_ssize_t i = 0; i < PyZGC_API->nslots; i++) {
+    if (PyZGC_API->store_slot(obj, i, value) < 0)
+      return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *zt_load(PyObject *self, PyObject *args) {
+  PyObject *obj;
+  Py_ssize_t index;
+  if (!PyArg_ParseTuple(args, "On", &obj, &index))
+    return NULL;
+  return PyZGC_API->load_slot(obj, index);
+}
+
+static PyObject *zt_store(PyObject *self, PyObject *args) {
+  PyObject *obj, *value;
+  Py_ssize_t index;
+  if (!PyArg_ParseTuple(args, "OnO", &obj, &index, &value))
+    return NULL;
+  if (PyZGC_API->store_slot(obj, index, value) < 0)
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+// Build a linked chain of n objects through slot 0; returns the head.
+static PyObject *zt_make_chain(PyObject *self, PyObject *args) {
+  Py_ssize_t n;
+  if (!PyArg_ParseTuple(args, "n", &n))
+    return NULL;
+  PyObject *head = PyZGC_API->new_object();
+  if (!head)
+    return NULL;
+  PyObject *cur = head;
+  Py_INCREF(cur);
+  for (Py_ssize_t i = 1; i < n; i++) {
+    PyObject *next = PyZGC_API->new_object();
+    if (!next || PyZGC_API->store_slot(cur, 0, next) < 0) {
+      Py_XDECREF(next);
+      Py_DECREF(cur);
+      Py_DECREF(head);
+      return NULL;
+    }
+    Py_DECREF(cur);
+    cur = next;
+  }
+  Py_DECREF(cur);
+  return head;
+}
+
+// Allocate n raw bodies through the inline fast path; returns how many came
+// back with the good color.
+static PyObject *zt_alloc_inline(PyObject *self, PyObject *args) {
+  Py_ssize_t n;
+  if (!PyArg_ParseTuple(args, "n", &n))
+    return NULL;
+  PyZGC_TLAB *tlab = PyZGC_API->current_tlab();
+  Py_ssize_t good = 0;
+  for (Py_ssize_t i = 0; i < n; i++) {
+    void *ptr = PyZGC_AllocInline(tlab, PyZGC_API->body_size);
+    if (!ptr)
+      return PyErr_NoMemory();
+    good += PyZGC_IsGood((uintptr_t)ptr);
+  }
+  return PyLong_FromSsize_t(good);
+}
+
+// Pin obj and return its raw body address; unpin takes the address back.
+static PyObject *zt_pin(PyObject *self, PyObject *obj) {
+  void *body = PyZGC_API->pin(obj);
+  return body ? PyLong_FromVoidPtr(body) : NULL;
+}
+
+static PyObject *zt_unpin(PyObject *self, PyObject *address) {
+  void *body = PyLong_AsVoidPtr(address);
+  if (!body)
+    return NULL;
+  PyZGC_API->unpin(body);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef zt_methods[] = {
+    {"version", zt_version, METH_NOARGS, NULL},
+    {"good_color", zt_good_color, METH_NOARGS, NULL},
+    {"sum_slots", zt_sum_slots, METH_O, NULL},
+    {"fill", zt_fill, METH_VARARGS, NULL},
+    {"load", zt_load, METH_VARARGS, NULL},
+    {"store", zt_store, METH_VARARGS, NULL},
+    {"make_chain", zt_make_chain, METH_VARARGS, NULL},
+    {"alloc_inline", zt_alloc_inline, METH_VARARGS, NULL},
+    {"pin", zt_pin, METH_O, NULL},
+    {"unpin", zt_unpin, METH_O, NULL},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef zt_module = {PyModuleDef_HEAD_INIT, "zcapi_test",
+                                       NULL, -1, zt_methods};
+
+PyMODINIT_FUNC PyInit_zcapi_test(void) {
+  if (PyZGC_ImportAPI() < 0)
+    return NULL;
+  return PyModule_Create(&zt_module);
+}
@@ -1,25 +1,37 @@
+import unittest
 import pyzgc
-import sys
+from zgc_helpers import PAGE
 
-print("Testing pyzgc allocation...")
-try:
-    # Allocate 1KB
-    addr = pyzgc.allocate(1024)
-    print(f"Allocated 1KB at: {hex(addr)}")
-    
-    # Allocate 1MB
-    addr2 = pyzgc.allocate(1024 * 1024)
-    print(f"Allocated 1MB at: {hex(addr2)}")
-    
-    # Allocate another 1MB (should trigger new page if page size is 2MB and we used >1MB already)
-    # Actually, 1KB + 1MB fits in 2MB page.
-    # Let's allocate 2MB (should fail or trigger new page if we implement large pages, but for now it might just fit or fail depending on logic)
-    # Our allocator aligns to 8 bytes.
-    
-    addr3 = pyzgc.allocate(1024 * 1024)
-    print(f"Allocated 1MB at: {hex(addr3)}")
 
-    print("Allocation test passed!")
-except Exception as e:
-    print(f"Test failed: {e}")
-    sys.exit(1)
+class TestAllocate(unittest.TestCase):
+    def test_allocate(self):
+        print("\nTesting pyzgc allocation...")
+        addr = pyzgc.allocate(1024)
+        print(f"Allocated 1KB at: {hex(addr)}")
+        # 1KB + 1MB fit in one 2MB page; the second 1MB needs a new one
+        addr2 = pyzgc.allocate(1024 * 1024)
+        print(f"Allocated 1MB at: {hex(addr2)}")
+        addr3 = pyzgc.allocate(1024 * 1024)
+        print(f"Allocated 1MB at: {hex(addr3)}")
+        self.assertEqual(len({addr, addr2, addr3}), 3)
+
+    def test_negative_size(self):
+        with self.assertRaises(ValueError):
+            pyzgc.allocate(-1)
+
+    def test_larger_than_a_page(self):
+        for size in (PAGE, 1 << 40, (1 << 63) - 1):
+            with self.assertRaises(MemoryError):
+                pyzgc.allocate(size)
+        # The heap is still usable, and walkable by a cycle
+        self.assertTrue(pyzgc.allocate(1024))
+        pyzgc.gc()
+
+    def test_nearly_a_page(self):
+        addr = pyzgc.allocate(PAGE - 64 * 1024)
+        self.assertTrue(addr)
+        pyzgc.gc()
+
+
+if __name__ == '__main__':
+    unittest.main()
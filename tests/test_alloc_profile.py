@@ -0,0 +1,97 @@
+import gzip
+import unittest
+import pyzgc
+
+
+def allocate_kept(head, n):
+    for _ in range(n):
+        obj = pyzgc.Object()
+        obj.store(0, head)
+        head = obj
+    return head
+
+
+def allocate_garbage(n):
+    for _ in range(n):
+        pyzgc.Object()
+
+
+def stack_values(profile, name):
+    values = [0, 0, 0, 0]
+    for sample in profile["samples"]:
+        if sample["stack"] and sample["stack"][0][0] == name:
+            values = [a + b for a, b in zip(values, sample["values"])]
+    return values
+
+
+class TestAllocProfile(unittest.TestCase):
+    def tearDown(self):
+        pyzgc.stop_alloc_profile()
+
+    def test_stacks_and_estimates(self):
+        print("\nTesting allocation profile...")
+        pyzgc.start_alloc_profile(sample_bytes=4096)
+        head = allocate_kept(pyzgc.Object(), 20000)
+        allocate_garbage(20000)
+        profile = pyzgc.alloc_profile()
+        self.assertEqual(profile["period"], 4096)
+        self.assertEqual(profile["period_type"], ("space", "bytes"))
+        self.assertEqual([t for t, _ in profile["sample_type"]],
+                         ["alloc_objects", "alloc_space",
+                          "inuse_objects", "inuse_space"])
+
+        kept = stack_values(profile, "allocate_kept")
+        garbage = stack_values(profile, "allocate_garbage")
+        # Unbiased estimates of 20000 objects each
+        for values in (kept, garbage):
+            self.assertGreater(values[0], 10000)
+            self.assertLess(values[0], 40000)
+            self.assertGreater(values[1], values[0])
+        frame = next(s["stack"] for s in profile["samples"]
+                     if s["stack"][0][0] == "allocate_kept")
+        self.assertTrue(frame[0][1].endswith("test_alloc_profile.py"))
+        self.assertEqual(frame[1][0],
+                         "TestAllocProfile.test_stacks_and_estimates")
+
+        # Marking drops the garbage from the in-use values only
+        for _ in range(2):
+            pyzgc.add_root(head)
+            pyzgc.gc()
+        profile = pyzgc.alloc_profile()
+        kept_after = stack_values(profile, "allocate_kept")
+        garbage_after = stack_values(profile, "allocate_garbage")
+        self.assertEqual(kept_after, kept)
+        self.assertEqual(garbage_after[:2], garbage[:2])
+        self.assertEqual(garbage_after[2:], [0, 0])
+
+    def test_pprof(self):
+        pyzgc.start_alloc_profile(sample_bytes=4096)
+        allocate_garbage(5000)
+        data = pyzgc.alloc_profile(format="pprof")
+        self.assertEqual(data[:2], b"\x1f\x8b")
+        raw = gzip.decompress(data)
+        self.assertIn(b"allocate_garbage", raw)
+        self.assertIn(b"inuse_space", raw)
+
+    def test_off_and_restart(self):
+        self.assertEqual(pyzgc.alloc_profile()["samples"], [])
+        allocate_garbage(5000)
+        self.assertEqual(pyzgc.alloc_profile()["samples"], [])
+        pyzgc.start_alloc_profile(sample_bytes=4096)
+        allocate_garbage(5000)
+        self.assertTrue(pyzgc.alloc_profile()["samples"])
+        pyzgc.start_alloc_profile()  # Discards the earlier profile
+        self.assertEqual(pyzgc.alloc_profile()["samples"], [])
+        self.assertEqual(pyzgc.alloc_profile()["period"], 524288)
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            pyzgc.start_alloc_profile(sample_bytes=0)
+        with self.assertRaises(ValueError):
+            pyzgc.alloc_profile(format="svg")
+        with self.assertRaises(TypeError):
+            pyzgc.alloc_profile("dict")
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,152 @@
+import array
+import unittest
+import pyzgc
+from zgc_helpers import address, retire_current_page
+
+
+class TestArray(unittest.TestCase):
+    def test_elements(self):
+        print("\nTesting heap-resident typed arrays...")
+        a = pyzgc.Array('f64', 5)
+        self.assertEqual(len(a), 5)
+        self.assertEqual(list(a), [0.0] * 5)
+        a[0] = 1.5
+        a[-1] = 2      # ints convert to f64
+        self.assertEqual(a[0], 1.5)
+        self.assertEqual(a[4], 2.0)
+        self.assertEqual((a.dtype, a.itemsize, a.nbytes), ('f64', 8, 40))
+        self.assertEqual(repr(a), "pyzgc.Array('f64', 5)")
+
+        b = pyzgc.Array('u8', 10)
+        b[:] = range(10)
+        self.assertEqual(list(b[2:8:2]), [2, 4, 6])
+        b[::3] = [9, 9, 9, 9]
+        self.assertEqual(list(b), [9, 1, 2, 9, 4, 5, 9, 7, 8, 9])
+        b.fill(7, 1, 4)
+        self.assertEqual(list(b[:5]), [9, 7, 7, 7, 4])
+        b.fill(0)
+        self.assertEqual(bytes(b), bytes(10))
+
+        c = pyzgc.Array('i32', 3)
+        c[:] = [-1, 2 ** 31 - 1, -2 ** 31]
+        d = c.copy()
+        c[0] = 5
+        self.assertEqual(list(d), [-1, 2 ** 31 - 1, -2 ** 31])
+
+        e = pyzgc.Array('i64', 4)
+        e[:] = array.array('q', [1, 2, 3, 4])   # Bulk copy from a buffer
+        e[1:3] = e[0:2]                         # Overlapping
+        self.assertEqual(list(e), [1, 1, 2, 4])
+
+    def test_errors(self):
+        a = pyzgc.Array('i32', 2)
+        with self.assertRaises(IndexError):
+            a[2]
+        with self.assertRaises(IndexError):
+            a[-3] = 1
+        with self.assertRaises(OverflowError):
+            a[0] = 2 ** 31
+        with self.assertRaises(OverflowError):
+            pyzgc.Array('u8', 1)[0] = -1
+        with self.assertRaises(TypeError):
+            a[0] = "1"
+        with self.assertRaises(TypeError):
+            del a[0]
+        with self.assertRaises(ValueError):
+            a[:] = [1, 2, 3]
+        with self.assertRaises(ValueError):
+            pyzgc.Array('i16', 2)
+        with self.assertRaises(ValueError):
+            pyzgc.Array('i64', -1)
+        with self.assertRaises(BufferError):
+            memoryview(pyzgc.Array('ref', 2))
+
+    def test_buffer_is_zero_copy(self):
+        a = pyzgc.Array('i64', 4)
+        m = memoryview(a)
+        self.assertEqual((m.format, m.itemsize, m.shape), ('q', 8, (4,)))
+        self.assertFalse(m.readonly)
+        m[2] = 42
+        self.assertEqual(a[2], 42)
+        a[3] = -7
+        self.assertEqual(m[3], -7)
+        m.release()
+        self.assertEqual(bytes(pyzgc.Array('u8', 3)), b"\0\0\0")
+
+    def test_export_pins_the_array(self):
+        holder = pyzgc.Object()
+        a = pyzgc.Array('f64', 1000)
+        holder.store(0, a)
+        m = memoryview(a)
+        retire_current_page()
+        before = address(a)
+        pinned = [p for p in pyzgc.heap_info()["pages"] if p["pins"]]
+        self.assertEqual(len(pinned), 1)
+
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertEqual(address(a), before)
+        m[999] = 1.25
+        self.assertEqual(a[999], 1.25)
+
+        # Once released, the array moves with the rest of its page
+        m.release()
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertEqual(a[999], 1.25)   # Heals the handle
+        self.assertNotEqual(address(a), before)
+        self.assertIs(holder.load(0), a)
+
+    def test_large_array(self):
+        n = 1 << 20
+        a = pyzgc.Array('f64', n)
+        a[n - 1] = 3.0
+        info = pyzgc.heap_info()
+        start = address(a) & ~(info["page_size"] - 1)
+        page = next(p for p in info["pages"] if p["address"] == start)
+        self.assertTrue(page["large"])
+        self.assertGreaterEqual(page["size_bytes"], n * 8)
+        self.assertGreaterEqual(info["totals"]["committed_bytes"],
+                                page["size_bytes"])
+
+        # Large pages are never relocated
+        holder = pyzgc.Object()
+        holder.store(0, a)
+        before = address(a)
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertEqual(address(a), before)
+        self.assertEqual(a[n - 1], 3.0)
+        self.assertEqual(memoryview(a).nbytes, n * 8)
+
+    def test_ref_array_is_traced(self):
+        holder = pyzgc.Object()
+        a = pyzgc.Array('ref', 100)
+        for i in range(100):
+            o = pyzgc.Object()
+            o.store(0, i)
+            a[i] = o
+        a[50] = "plain"
+        a[51] = None
+        holder.store(0, a)
+        retire_current_page()
+        first = address(a[0])
+
+        pyzgc.add_root(holder)
+        pyzgc.minor_gc()
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+
+        self.assertNotEqual(address(a[0]), first)
+        for i in range(100):
+            if i == 50:
+                self.assertEqual(a[i], "plain")
+            elif i == 51:
+                self.assertIsNone(a[i])
+            else:
+                self.assertEqual(a[i].load(0), i)
+        self.assertEqual([o.load(0) for o in a[:3]], [0, 1, 2])
+
+
+if __name__ == '__main__':
+    unittest.main()
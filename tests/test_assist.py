@@ -0,0 +1,142 @@
+import unittest
+import pyzgc
+from zgc_helpers import page_of
+
+
+def build_list(n):
+    root = pyzgc.Object()
+    head = None
+    for i in range(n):
+        node = pyzgc.Object()
+        node.store(0, head)
+        node.store(1, i)
+        head = node
+    root.store(0, head)
+    return root
+
+
+def check_list(testcase, root, n):
+    node, expected = root.load(0), n - 1
+    while node is not None:
+        testcase.assertEqual(node.load(1), expected)
+        node, expected = node.load(0), expected - 1
+    testcase.assertEqual(expected, -1)
+
+
+class TestAssist(unittest.TestCase):
+    def tearDown(self):
+        pyzgc.configure(assist_ratio=1.0, assist_max_us=100)
+
+    def test_incremental_gc(self):
+        print("\nTesting incremental cycles and mutator assists...")
+        root = build_list(100000)
+        cycles = pyzgc.stats()["cycles"]
+        pyzgc.add_root(root)
+        steps = 1
+        while not pyzgc.gc(budget_us=20):
+            steps += 1
+            self.assertLess(steps, 100000)
+        self.assertGreater(steps, 1)
+        self.assertEqual(pyzgc.stats()["cycles"], cycles + 1)
+        check_list(self, root, 100000)
+
+    def test_allocation_pays_for_gc_work(self):
+        root = build_list(100000)
+        before = pyzgc.stats()
+        pyzgc.add_root(root)
+        # Start a cycle and leave it open
+        self.assertFalse(pyzgc.gc(budget_us=0))
+        # TLAB refills now mark on the allocating thread
+        garbage = [pyzgc.Object() for _ in range(50000)]
+        mid = pyzgc.stats()
+        self.assertGreater(mid["assists"], before["assists"])
+        self.assertGreater(mid["assist_bytes"], before["assist_bytes"])
+        self.assertEqual(mid["cycles"], before["cycles"])
+
+        # A full gc() finishes the open cycle
+        self.assertTrue(pyzgc.gc())
+        self.assertEqual(pyzgc.stats()["cycles"], before["cycles"] + 1)
+        check_list(self, root, 100000)
+        del garbage
+
+    def test_allocated_during_marking(self):
+        root = build_list(100000)
+        pyzgc.add_root(root)
+        pyzgc.configure(assist_ratio=0)
+        self.assertFalse(pyzgc.gc(budget_us=0))
+        self.assertFalse(pyzgc.gc(budget_us=50))
+        # Not in the snapshot, and stored where the marker has been
+        # already: unmarked, but live as allocated since marking started,
+        # so relocation must not leave it behind
+        young = build_list(30000)
+        root.store(2, young)
+        self.assertTrue(pyzgc.gc())
+        evacuated = {page["address"] for page in pyzgc.heap_info()["pages"]
+                     if page["evacuated"]}
+        node = young.load(0)
+        while node is not None:
+            self.assertNotIn(page_of(node), evacuated)
+            node = node.load(0)
+        check_list(self, young, 30000)
+        check_list(self, root, 100000)
+
+    def test_large_array_in_steps(self):
+        n = 100000
+        table = pyzgc.Array('ref', n)
+        for i in range(n):
+            node = pyzgc.Object()
+            node.store(0, i)
+            table[i] = node
+        pyzgc.configure(assist_ratio=0)
+        pyzgc.add_root(table)
+        # Steps stop within the array's marking and within pages being
+        # copied, so that the mutator runs in between
+        steps = 0
+        while not pyzgc.gc(budget_us=0):
+            i = steps * 7919 % n
+            node = pyzgc.Object()
+            node.store(0, i)
+            table[i] = node
+            steps += 1
+        self.assertGreater(steps, 20)
+        for i in range(n):
+            self.assertEqual(table[i].load(0), i)
+
+    def test_assist_caps(self):
+        root = build_list(50000)
+        pyzgc.configure(assist_ratio=0)
+        before = pyzgc.stats()["assists"]
+        pyzgc.add_root(root)
+        self.assertFalse(pyzgc.gc(budget_us=0))
+        garbage = [pyzgc.Object() for _ in range(20000)]
+        self.assertEqual(pyzgc.stats()["assists"], before)
+
+        # A tiny time cap still makes progress and stays short
+        settings = pyzgc.configure(assist_ratio=1000, assist_max_us=50)
+        self.assertEqual(settings["assist_max_us"], 50.0)
+        garbage += [pyzgc.Object() for _ in range(20000)]
+        stats = pyzgc.stats()
+        self.assertGreater(stats["assists"], before)
+        # Generous bound: the cap is checked every few objects or pages
+        self.assertLess(stats["assist_max_ns"], 50 * 1000 * 1000)
+        pyzgc.gc()
+        check_list(self, root, 50000)
+
+    def test_configure_errors(self):
+        with self.assertRaises(ValueError):
+            pyzgc.configure(assist_ratio=-1)
+        with self.assertRaises(TypeError):
+            pyzgc.configure(no_such_setting=1)
+        with self.assertRaises(TypeError):
+            pyzgc.configure(1.0)
+        with self.assertRaises(ValueError):
+            pyzgc.gc(budget_us=-5)
+        self.assertEqual(set(pyzgc.configure()),
+                         {"assist_ratio", "assist_max_us", "max_heap_bytes",
+                          "soft_max_heap_bytes", "memory_pressure",
+                          "cgroup_path", "page_pool",
+                          "page_pool_populate", "old_gen"})
+
+
+if __name__ == '__main__':
+    unittest.main()
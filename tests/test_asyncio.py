@@ -0,0 +1,100 @@
+import asyncio
+import socket
+import unittest
+import pyzgc
+import pyzgc.asyncio
+from zgc_helpers import build_list, list_values
+
+
+async def keep_rooted(head, seconds):
+    # Roots are explicit: add the live set again before the next cycle
+    loop = asyncio.get_running_loop()
+    end = loop.time() + seconds
+    while loop.time() < end:
+        pyzgc.add_root(head)
+        await asyncio.sleep(0.005)
+
+
+class TestAsyncio(unittest.TestCase):
+    def setUp(self):
+        self.loop = asyncio.new_event_loop()
+
+    def tearDown(self):
+        self.loop.close()
+
+    def test_install(self):
+        print("\nTesting idle-time collection for asyncio...")
+        selector = self.loop._selector
+        idle = pyzgc.asyncio.install(self.loop, slice_us=500)
+        self.assertIsInstance(idle, pyzgc.asyncio.IdleSelector)
+        self.assertIs(self.loop._selector, idle)
+        self.assertIs(idle.selector, selector)
+        self.assertEqual(idle.slice_us, 500)
+        # Everything but select() is the selector's
+        self.assertEqual(idle.get_map(), selector.get_map())
+
+        self.assertIs(pyzgc.asyncio.install(self.loop, slice_us=200), idle)
+        self.assertEqual(idle.slice_us, 200)
+        pyzgc.asyncio.uninstall(self.loop)
+        self.assertIs(self.loop._selector, selector)
+        pyzgc.asyncio.uninstall(self.loop)
+
+        with self.assertRaises(TypeError):
+            pyzgc.asyncio.install(object())
+        # The private attribute alone is not enough
+        fake = type("Loop", (), {"_selector": selector})()
+        with self.assertRaises(TypeError):
+            pyzgc.asyncio.install(fake)
+        self.loop._selector = object()
+        try:
+            with self.assertRaises(TypeError):
+                pyzgc.asyncio.install(self.loop)
+        finally:
+            self.loop._selector = selector
+        with self.assertRaises(ValueError):
+            pyzgc.asyncio.install(self.loop, slice_us=0)
+
+    def test_collects_while_idle(self):
+        head = build_list(20000)
+        idle = pyzgc.asyncio.install(self.loop)
+        before = pyzgc.stats()
+        self.loop.run_until_complete(keep_rooted(head, 0.35))
+
+        after = pyzgc.stats()
+        self.assertGreater(idle.steps, 0)
+        self.assertGreater(idle.idle_ns, 0)
+        self.assertGreater(after["idle_cycles"], before["idle_cycles"])
+        self.assertGreaterEqual(after["idle_steps"] - before["idle_steps"],
+                                idle.steps)
+        self.assertIn("steps", repr(idle))
+        self.assertEqual(list_values(head), list(range(19999, -1, -1)))
+
+    def test_io_while_collecting(self):
+        head = build_list(20000)
+        idle = pyzgc.asyncio.install(self.loop, slice_us=100)
+        pyzgc.start_gc()
+        a, b = socket.socketpair()
+        a.setblocking(False)
+        b.setblocking(False)
+
+        async def echo():
+            for i in range(50):
+                pyzgc.add_root(head)
+                await self.loop.sock_sendall(a, bytes([i]))
+                data = await self.loop.sock_recv(b, 1)
+                self.assertEqual(data, bytes([i]))
+                await asyncio.sleep(0.005)
+
+        try:
+            self.loop.run_until_complete(echo())
+        finally:
+            pyzgc.stop_gc()
+            a.close()
+            b.close()
+        pyzgc.add_root(head)
+        pyzgc.gc()
+        self.assertEqual(list_values(head), list(range(19999, -1, -1)))
+
+
+if __name__ == '__main__':
+    unittest.main()
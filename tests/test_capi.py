@@ -0,0 +1,140 @@
+import ctypes
+import gc
+import importlib
+import importlib.util
+import os
+import sys
+import tempfile
+import unittest
+
+import pyzgc
+from zgc_helpers import address, retire_current_page
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(os.path.dirname(HERE), "src")
+
+
+def build_test_extension():
+    # Build tests/capi_ext/zcapi_test.c against src/pyzgc_capi.h only.
+    from setuptools import Distribution, Extension
+    from setuptools.command.build_ext import build_ext
+
+    tmp = tempfile.mkdtemp(prefix="zcapi_")
+    ext = Extension(
+        "zcapi_test",
+        sources=[os.path.join(HERE, "capi_ext", "zcapi_test.c")],
+        include_dirs=[SRC],
+    )
+    dist = Distribution({"name": "zcapi_test", "ext_modules": [ext]})
+    cmd = build_ext(dist)
+    cmd.build_lib = tmp
+    cmd.build_temp = tmp
+    cmd.ensure_finalized()
+    cmd.run()
+
+    path = cmd.get_ext_fullpath("zcapi_test")
+    spec = importlib.util.spec_from_file_location("zcapi_test", path)
+    mod = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(mod)
+    return mod
+
+
+class TestCAPI(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.ext = build_test_extension()
+
+    def test_capsule_exported(self):
+        self.assertEqual(type(pyzgc._C_API).__name__, "PyCapsule")
+        self.assertIn("pyzgc._C_API", repr(pyzgc._C_API))
+        self.assertEqual(self.ext.version(), 3)
+
+    def test_good_color_matches_bodies(self):
+        obj = pyzgc.Object()
+        obj.load(0)  # heal
+        color_mask = 0xF << 60
+        self.assertEqual(pyzgc.get_body_address(obj) & color_mask,
+                         self.ext.good_color())
+
+    def test_read_slots_from_c(self):
+        obj = pyzgc.Object()
+        for i in range(10):
+            obj.store(i, i * 3)
+        self.assertEqual(self.ext.sum_slots(obj), sum(i * 3 for i in range(10)))
+
+    def test_write_slots_from_c(self):
+        obj = pyzgc.Object()
+        child = pyzgc.Object()
+        self.ext.fill(obj, child)
+        for i in range(10):
+            self.assertIs(obj.load(i), child)
+        self.assertIs(self.ext.load(obj, 4), child)
+
+    def test_errors(self):
+        obj = pyzgc.Object()
+        with self.assertRaises(IndexError):
+            self.ext.load(obj, 10)
+        # Not truncated to an int
+        with self.assertRaises(IndexError):
+            self.ext.load(obj, 1 << 32)
+        with self.assertRaises(IndexError):
+            self.ext.store(obj, (1 << 32) + 1, 5)
+        self.assertIsNone(obj.load(1))
+        with self.assertRaises(TypeError):
+            self.ext.load(object(), 0)
+        with self.assertRaises(TypeError):
+            self.ext.sum_slots(object())
+
+    def test_table_outlives_module(self):
+        # A consumer keeps the table it imported; importing pyzgc again
+        # must not leave it pointing at a dropped module's state
+        get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+        get_pointer.restype = ctypes.c_void_p
+        get_pointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+        before = get_pointer(pyzgc._C_API, b"pyzgc._C_API")
+        saved = sys.modules.pop("pyzgc")
+        try:
+            again = importlib.import_module("pyzgc")
+            self.assertIsNot(again, saved)
+            self.assertEqual(get_pointer(again._C_API, b"pyzgc._C_API"),
+                             before)
+            del again
+            gc.collect()
+        finally:
+            sys.modules["pyzgc"] = saved
+        obj = pyzgc.Object()
+        self.ext.fill(obj, 2)
+        self.assertEqual(self.ext.sum_slots(obj), 2 * 10)
+
+    def test_chain_built_in_c(self):
+        head = self.ext.make_chain(100)
+        n = 0
+        node = head
+        while isinstance(node, pyzgc.Object):
+            n += 1
+            node = node.load(0)
+        self.assertEqual(n, 100)
+
+    def test_alloc_fast_path(self):
+        n = 10000  # spans several TLAB refills
+        self.assertEqual(self.ext.alloc_inline(n), n)
+
+    def test_pin_from_c(self):
+        holder = pyzgc.Object()
+        obj = pyzgc.Object()
+        obj.store(0, 7)
+        holder.store(0, obj)
+        pinned = self.ext.pin(obj)
+        retire_current_page()
+        for _ in range(2):
+            pyzgc.add_root(holder)
+            pyzgc.gc()
+        self.assertEqual(address(obj), pinned)
+        self.ext.unpin(pinned)
+        self.assertEqual(holder.load(0).load(0), 7)
+        with self.assertRaises(TypeError):
+            self.ext.pin(object())
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,171 @@
+import os
+import tempfile
+import unittest
+import pyzgc
+
+MB = 1024 * 1024
+PAGE = 2 * MB
+
+
+def write_cgroup(path, max="max", high="max", current=0, avg10=0.0):
+    files = {
+        "memory.max": "%s\n" % max,
+        "memory.high": "%s\n" % high,
+        "memory.current": "%d\n" % current,
+        "memory.pressure":
+            "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+            "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n" % avg10,
+    }
+    for name, text in files.items():
+        with open(os.path.join(path, name), "w") as f:
+            f.write(text)
+
+
+def memory():
+    return pyzgc.heap_info()["memory"]
+
+
+def collect():
+    root = pyzgc.Object()
+    for _ in range(2):
+        pyzgc.add_root(root)
+        pyzgc.gc()
+
+
+class TestCgroup(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.path = self.tmp.name
+
+    def tearDown(self):
+        pyzgc.configure(max_heap_bytes=0, soft_max_heap_bytes=0,
+                        memory_pressure=10.0, cgroup_path=None)
+        self.tmp.cleanup()
+
+    def test_derived_limits(self):
+        print("\nTesting cgroup-derived heap limits...")
+        write_cgroup(self.path, max=400 * MB, current=10 * MB)
+        settings = pyzgc.configure(cgroup_path=self.path)
+        self.assertEqual(settings["cgroup_path"], self.path)
+        self.assertEqual(settings["max_heap_bytes"], 0)  # Derived
+        m = memory()
+        self.assertEqual(m["max_heap_bytes"], 300 * MB)
+        self.assertEqual(m["soft_max_heap_bytes"], 200 * MB)
+        self.assertEqual(m["cgroup"]["max"], 400 * MB)
+        self.assertIsNone(m["cgroup"]["high"])
+        self.assertEqual(m["cgroup"]["current"], 10 * MB)
+        self.assertFalse(m["pressure"])
+
+        # Limits are read again at the end of every cycle
+        write_cgroup(self.path, max=400 * MB, high=200 * MB, current=10 * MB)
+        collect()
+        self.assertEqual(memory()["soft_max_heap_bytes"], 150 * MB)
+
+        # Explicit settings win
+        pyzgc.configure(max_heap_bytes=100 * MB)
+        m = memory()
+        self.assertEqual(m["max_heap_bytes"], 100 * MB)
+        self.assertEqual(m["soft_max_heap_bytes"], 100 * MB)
+
+    def test_no_cgroup(self):
+        settings = pyzgc.configure(cgroup_path=self.path)  # No files
+        self.assertIsNone(settings["cgroup_path"])
+        m = memory()
+        self.assertIsNone(m["cgroup"])
+        self.assertEqual(m["max_heap_bytes"], 0)
+        self.assertGreater(m["heap_bytes"], 0)
+
+    def test_pressure(self):
+        write_cgroup(self.path, max=400 * MB, current=10 * MB)
+        pyzgc.configure(cgroup_path=self.path)
+        cycles = pyzgc.stats()["pressure_cycles"]
+        collect()
+        self.assertEqual(pyzgc.stats()["pressure_cycles"], cycles)
+
+        # Close to memory.max
+        write_cgroup(self.path, max=400 * MB, current=390 * MB)
+        collect()
+        self.assertTrue(memory()["pressure"])
+        self.assertGreater(pyzgc.stats()["pressure_cycles"], cycles)
+
+        # PSI stall time above the threshold, unless that is turned off
+        write_cgroup(self.path, max=400 * MB, current=10 * MB, avg10=25.0)
+        collect()
+        self.assertTrue(memory()["pressure"])
+        pyzgc.configure(memory_pressure=0)
+        collect()
+        self.assertFalse(memory()["pressure"])
+
+    def test_release_pages(self):
+        collect()
+        released = pyzgc.stats()["released_bytes"]
+        for _ in range(100000):
+            pyzgc.Object()
+        pyzgc.configure(soft_max_heap_bytes=1)  # Always under pressure
+        collect()
+        self.assertGreater(pyzgc.stats()["released_bytes"], released)
+        pages = [p for p in pyzgc.heap_info()["pages"] if p["released"]]
+        self.assertTrue(pages)
+        self.assertTrue(all(p["evacuated"] for p in pages))
+
+    def test_release_keeps_what_handles_read(self):
+        collect()
+        # Reachable from no root: only handles and an export hold them
+        parent = pyzgc.Object()
+        child = pyzgc.Object()
+        child.store(0, "child")
+        parent.store(0, child)
+        parent.store(1, 7)
+        del child
+        for _ in range(100000):
+            pyzgc.Object()
+        array = pyzgc.Array('i64', 100)
+        array[99] = -3
+        view = memoryview(array)
+        for _ in range(100000):
+            pyzgc.Object()
+        pyzgc.configure(soft_max_heap_bytes=1)
+        collect()
+        self.assertTrue(any(p["released"] for p in pyzgc.heap_info()["pages"]))
+        self.assertEqual(parent.load(1), 7)
+        self.assertEqual(parent.load(0).load(0), "child")
+        self.assertEqual(view[99], -3)
+        view[0] = 5
+        self.assertEqual(array[0], 5)
+        view.release()
+
+    def test_max_heap(self):
+        collect()
+        limit = memory()["heap_bytes"] + 8 * PAGE
+        pyzgc.configure(max_heap_bytes=limit)
+        holder = pyzgc.Object()
+        # Held by their handles, so that no cycle can make room
+        kept = []
+        with self.assertRaises(MemoryError):
+            for _ in range(1000000):
+                kept.append(pyzgc.Object())
+        self.assertLessEqual(memory()["heap_bytes"], limit)
+        del kept
+
+        # The collector still gets its pages; the garbage pages are given
+        # back at the next young page
+        holder.store(0, "kept")
+        for _ in range(2):
+            pyzgc.add_root(holder)
+            pyzgc.gc()
+        for _ in range(100000):
+            pyzgc.Object()
+        self.assertLessEqual(memory()["heap_bytes"], limit)
+        self.assertEqual(holder.load(0), "kept")
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            pyzgc.configure(max_heap_bytes=-1)
+        with self.assertRaises(ValueError):
+            pyzgc.configure(memory_pressure=-1.0)
+        with self.assertRaises(TypeError):
+            pyzgc.configure(cgroup_path=42)
+
+
+if __name__ == '__main__':
+    unittest.main()
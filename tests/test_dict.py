@@ -0,0 +1,247 @@
+import collections.abc
+import random
+import unittest
+import weakref
+import pyzgc
+from zgc_helpers import address, retire_current_page
+
+
+def large_pages():
+    return [p for p in pyzgc.heap_info()["pages"]
+            if p["large"] and not p["released"]]
+
+
+class Key:
+    """Compared with Python code, which may change the dict meanwhile."""
+
+    def __init__(self, n, on_eq=None):
+        self.n = n
+        self.on_eq = on_eq
+
+    def __hash__(self):
+        return self.n % 4
+
+    def __eq__(self, other):
+        if self.on_eq:
+            self.on_eq()
+        return isinstance(other, Key) and other.n == self.n
+
+
+class TestDict(unittest.TestCase):
+    def test_mapping(self):
+        print("\nTesting heap-resident dicts...")
+        d = pyzgc.Dict({"a": 1}, b=2)
+        self.assertIsInstance(d, collections.abc.MutableMapping)
+        self.assertEqual(len(d), 2)
+        self.assertEqual((d["a"], d["b"]), (1, 2))
+        self.assertIn("a", d)
+        self.assertNotIn("c", d)
+        d["c"] = None
+        self.assertIsNone(d["c"])
+        self.assertEqual(d.get("x"), None)
+        self.assertEqual(d.get("x", 5), 5)
+        self.assertEqual(d.setdefault("x", 6), 6)
+        self.assertEqual(d.setdefault("x", 7), 6)
+        self.assertEqual(d.pop("x"), 6)
+        self.assertEqual(d.pop("x", 8), 8)
+        del d["c"]
+        self.assertEqual(d, {"a": 1, "b": 2})
+        self.assertNotEqual(d, {"a": 1, "b": 3})
+        self.assertEqual(d, pyzgc.Dict([("b", 2), ("a", 1)]))
+        self.assertEqual(sorted(d), ["a", "b"])
+        self.assertEqual(sorted(d.keys()), ["a", "b"])
+        self.assertEqual(sorted(d.values()), [1, 2])
+        self.assertEqual(sorted(d.items()), [("a", 1), ("b", 2)])
+        self.assertEqual(repr(pyzgc.Dict(k=1)), "pyzgc.Dict({'k': 1})")
+
+        e = d.copy()
+        e.update({"c": 3}, d=4)
+        e.update([("e", 5)])
+        self.assertEqual(len(d), 2)
+        self.assertEqual(dict(e), {"a": 1, "b": 2, "c": 3, "d": 4, "e": 5})
+        items = []
+        while e:
+            items.append(e.popitem())
+        self.assertEqual(sorted(items), sorted(dict(d, c=3, d=4,
+                                                   e=5).items()))
+        e.update(d)
+        e.clear()
+        self.assertEqual((len(e), e.capacity), (0, 8))
+
+        ref = weakref.ref(d)
+        self.assertIs(ref(), d)
+
+    def test_errors(self):
+        d = pyzgc.Dict()
+        with self.assertRaises(KeyError):
+            d["missing"]
+        with self.assertRaises(KeyError):
+            del d["missing"]
+        with self.assertRaises(KeyError):
+            d.popitem()
+        with self.assertRaises(TypeError):
+            d[[1]] = 1
+        with self.assertRaises(TypeError):
+            d[pyzgc.Object()] = 1
+        with self.assertRaises(TypeError):
+            pyzgc.Dict([1, 2])
+        with self.assertRaises(TypeError):
+            hash(d)
+
+        d.update(a=1, b=2)
+        with self.assertRaises(RuntimeError):
+            for key in d:
+                d[key + "!"] = 0
+
+    def test_growth_and_deletes(self):
+        d, ref = pyzgc.Dict(), {}
+        for i in range(20000):
+            d[i] = ref[i] = str(i)
+        self.assertGreaterEqual(d.capacity * 2, len(d) * 3)
+        for i in range(0, 20000, 3):
+            del d[i]
+            del ref[i]
+        for i in range(20000, 25000):
+            d[-i] = ref[-i] = i
+        self.assertEqual(len(d), len(ref))
+        self.assertEqual(d, ref)
+        self.assertNotIn(3, d)
+        # Equal keys of other types find the same entry, like in a dict
+        self.assertEqual(d[4.0], "4")
+        self.assertTrue(d == pyzgc.Dict(ref))
+
+    def test_insertion_order(self):
+        d, ref = pyzgc.Dict(), {}
+        for i in range(300):
+            d["k%d" % i] = ref["k%d" % i] = i
+        for i in range(0, 300, 7):
+            del d["k%d" % i]
+            del ref["k%d" % i]
+        d["k0"] = ref["k0"] = -1
+        self.assertEqual(list(d), list(ref))
+        self.assertEqual(list(d.items()), list(ref.items()))
+        # popitem takes the last entry, like a dict
+        self.assertEqual(d.popitem(), ("k0", -1))
+        self.assertEqual(d.popitem(), ("k299", 299))
+        d["new"] = 1
+        self.assertEqual(list(d)[-2:], ["k298", "new"])
+
+    def test_mixed_keys(self):
+        # str keys alone share a table without hash words; the first other
+        # key moves the entries to one with them
+        d = pyzgc.Dict(("s%d" % i, i) for i in range(50))
+        d[1.5] = "float"
+        d[(1, 2)] = "tuple"
+        d[b"b"] = "bytes"
+        self.assertEqual([d["s%d" % i] for i in range(50)], list(range(50)))
+        self.assertEqual((d[1.5], d[(1, 2)], d[b"b"]),
+                         ("float", "tuple", "bytes"))
+        self.assertEqual(list(d)[-3:], [1.5, (1, 2), b"b"])
+        d.clear()
+        d["a"] = 1
+        self.assertEqual(d, {"a": 1})
+
+    def test_matches_dict(self):
+        rng = random.Random(5)
+        d, ref = pyzgc.Dict(), {}
+        keys = ["s%d" % i for i in range(200)] + list(range(200))
+        for step in range(20000):
+            key = rng.choice(keys[:200] if step < 5000 else keys)
+            op = rng.random()
+            if op < 0.5:
+                d[key] = ref[key] = step
+            elif op < 0.8:
+                self.assertEqual(d.pop(key, None), ref.pop(key, None))
+            elif op < 0.85 and ref:
+                self.assertEqual(d.popitem(), ref.popitem())
+            else:
+                self.assertEqual(d.get(key), ref.get(key))
+        self.assertEqual(list(d.items()), list(ref.items()))
+        self.assertEqual(len(d), len(ref))
+
+    def test_keys_compared_in_python(self):
+        d = pyzgc.Dict()
+        keys = [Key(n) for n in range(16)]   # Four per hash
+        for k in keys:
+            d[k] = k.n
+        self.assertEqual([d[Key(n)] for n in range(16)], list(range(16)))
+
+        # A comparison that grows the dict restarts the lookup
+        keys[5].on_eq = lambda: d.update((i, i) for i in range(100, 200))
+        self.assertEqual(d[Key(5)], 5)
+        keys[5].on_eq = None
+        self.assertEqual(len(d), 116)
+        # One that deletes the entry being compared
+        keys[9].on_eq = lambda: d.pop(keys[9], None)
+        self.assertNotIn(Key(9), d)
+        self.assertEqual(len(d), 115)
+
+    def test_values_survive_relocation(self):
+        holder = pyzgc.Object()
+        d = pyzgc.Dict()
+        holder.store(0, d)
+        for i in range(1000):
+            o = pyzgc.Object()
+            o.store(0, i)
+            d["k%d" % i] = o
+        d["plain"] = [1, 2]
+        retire_current_page()
+        first = address(d["k0"])
+
+        pyzgc.add_root(holder)
+        pyzgc.minor_gc()
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertNotEqual(address(d["k0"]), first)
+        self.assertEqual([d["k%d" % i].load(0) for i in range(1000)],
+                         list(range(1000)))
+
+        # A new handle finds the table and the counts in the body
+        del d
+        retire_current_page()
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        d = holder.load(0)
+        self.assertIsInstance(d, pyzgc.Dict)
+        self.assertEqual(len(d), 1001)
+        self.assertEqual(d["plain"], [1, 2])
+        self.assertEqual(d["k999"].load(0), 999)
+        d["new"] = 1
+        self.assertEqual(len(holder.load(0)), 1002)
+
+    def test_growth_during_marking(self):
+        holder = pyzgc.Object()
+        d = pyzgc.Dict()
+        holder.store(0, d)
+        for i in range(100):
+            d[i] = pyzgc.Object()
+            d[i].store(0, i)
+        pyzgc.add_root(holder)
+        self.assertFalse(pyzgc.gc(budget_us=0))
+        # Every table the dict grows into is allocated while marking
+        for i in range(100, 5000):
+            d[i] = pyzgc.Object()
+            d[i].store(0, i)
+        while not pyzgc.gc(budget_us=50):
+            pass
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertEqual([d[i].load(0) for i in range(5000)],
+                         list(range(5000)))
+
+    def test_replaced_large_tables_are_released(self):
+        before = len(large_pages())
+        d = pyzgc.Dict()
+        for i in range(100000):
+            d[i] = i
+        # Tables past the large object size got pages of their own, and
+        # only the current one keeps its memory
+        self.assertEqual(len(large_pages()), before + 1)
+        self.assertEqual(sum(d[i] for i in range(100000)),
+                         100000 * 99999 // 2)
+        d.clear()
+        self.assertEqual(len(large_pages()), before)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,109 @@
+import os
+import sys
+import tempfile
+import unittest
+import weakref
+import pyzgc
+from zgc_helpers import address, retire_current_page
+
+
+class TestDirectRefs(unittest.TestCase):
+    def test_handles_are_not_held_by_slots(self):
+        print("\nTesting body-to-body references...")
+        parent = pyzgc.Object()
+        child = pyzgc.Object()
+        child.store(0, "payload")
+        refs = sys.getrefcount(child)
+        parent.store(0, child)
+        self.assertEqual(sys.getrefcount(child), refs)
+        # One handle per body while it lives
+        self.assertIs(parent.load(0), child)
+        self.assertIs(parent.load(0), parent.load(0))
+
+        probe = weakref.ref(child)
+        del child
+        self.assertIsNone(probe())
+        # A new handle for the same body
+        again = parent.load(0)
+        self.assertEqual(again.load(0), "payload")
+        self.assertIs(parent.load(0), again)
+
+    def test_overwrite_and_self_reference(self):
+        obj = pyzgc.Object()
+        obj.store(0, obj)
+        self.assertIs(obj.load(0), obj)
+        obj.store(0, 42)
+        self.assertEqual(obj.load(0), 42)
+        obj.store(0, None)
+        self.assertIsNone(obj.load(0))
+
+    def test_typed_handles_are_rebuilt(self):
+        Point = pyzgc.define("Point", x="i64", next="ref")
+        holder = pyzgc.Object()
+        holder.store(0, Point(1, Point(2)))
+        holder.store(1, pyzgc.Array('f64', 3))
+        holder.load(1)[2] = 0.5
+
+        point = holder.load(0)
+        self.assertIs(type(point), Point)
+        self.assertEqual((point.x, point.next.x), (1, 2))
+        array = holder.load(1)
+        self.assertIsInstance(array, pyzgc.Array)
+        self.assertEqual((array.dtype, len(array)), ('f64', 3))
+        self.assertEqual(array[2], 0.5)
+
+    def test_graph_without_handles_survives_cycles(self):
+        root = pyzgc.Object()
+        head = None
+        for i in range(10000):
+            node = pyzgc.Object()
+            node.store(0, head)
+            node.store(1, i)
+            head = node
+        root.store(0, head)
+        del head, node
+        retire_current_page()
+
+        # Alternate minor and full cycles so that colors come around again
+        for collect in (pyzgc.minor_gc, pyzgc.gc, pyzgc.minor_gc, pyzgc.gc):
+            pyzgc.add_root(root)
+            collect()
+
+        node, expected = root.load(0), 9999
+        while node is not None:
+            self.assertEqual(node.load(1), expected)
+            node, expected = node.load(0), expected - 1
+        self.assertEqual(expected, -1)
+
+    def test_idle_handle_follows_its_body(self):
+        holder = pyzgc.Object()
+        obj = pyzgc.Object()
+        holder.store(0, obj)
+        retire_current_page()
+        before = address(obj)
+        for collect in (pyzgc.minor_gc, pyzgc.gc, pyzgc.minor_gc, pyzgc.gc):
+            pyzgc.add_root(holder)
+            collect()
+        # obj was not touched while its body moved
+        self.assertNotEqual(address(obj), before)
+        obj.store(1, "late write")
+        self.assertEqual(holder.load(0).load(1), "late write")
+
+    def test_image_handles(self):
+        root = pyzgc.Object()
+        root.store(0, "image")
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "refs.zimg")
+            pyzgc.save_image(root, path)
+            loaded = pyzgc.load_image(path)
+        holder = pyzgc.Object()
+        holder.store(0, loaded)
+        self.assertIs(holder.load(0), loaded)
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertIs(holder.load(0), loaded)
+        self.assertEqual(holder.load(0).load(0), "image")
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,151 @@
+import importlib
+import os
+import sys
+import unittest
+import pyzgc
+from zgc_helpers import address, build_list, list_values, page_of, scratch
+
+
+def frozen_pages():
+    return {page["address"] for page in pyzgc.heap_info()["pages"]
+            if page["frozen"]}
+
+
+class TestFreeze(unittest.TestCase):
+    def tearDown(self):
+        pyzgc.unfreeze()
+        self.assertFalse(frozen_pages())
+        self.assertEqual(pyzgc.stats()["frozen_bytes"], 0)
+
+    def test_freeze_moves_live_objects(self):
+        print("\nTesting the permanent generation...")
+        head = build_list(1000)
+        before = pyzgc.stats()
+        pyzgc.add_root(head)
+        pyzgc.freeze()
+
+        pages = frozen_pages()
+        self.assertTrue(pages)
+        self.assertIn(page_of(head), pages)
+        after = pyzgc.stats()
+        self.assertEqual(after["freezes"] - before["freezes"], 1)
+        self.assertEqual(after["cycles"] - before["cycles"], 1)
+        self.assertGreater(after["frozen_bytes"], 0)
+        totals = pyzgc.heap_info()["totals"]
+        self.assertEqual(totals["frozen_pages"], len(pages))
+        self.assertGreater(totals["frozen_used_bytes"], 0)
+
+        # Later cycles leave frozen objects where they are, unmarked, but
+        # never collect them
+        before = address(head)
+        scratch(20000)
+        pyzgc.gc()
+        pyzgc.minor_gc()
+        self.assertEqual(address(head), before)
+        self.assertTrue(pyzgc.is_marked(head))
+        self.assertEqual(list_values(head), list(range(999, -1, -1)))
+        for page in pyzgc.heap_info()["pages"]:
+            if page["frozen"]:
+                self.assertEqual(page["live_bytes"], 0)
+                self.assertFalse(page["evacuated"])
+
+    def test_young_object_stored_into_frozen(self):
+        holder = pyzgc.Object()
+        pyzgc.add_root(holder)
+        pyzgc.freeze()
+        self.assertIn(page_of(holder), frozen_pages())
+        cards = pyzgc.stats()["cards_scanned"]
+
+        # Only the card keeps the young list alive: no root reaches it
+        holder.store(0, build_list(100))
+        dirty = [page["dirty_cards"] for page in pyzgc.heap_info()["pages"]
+                 if page["frozen"]]
+        self.assertEqual(sum(dirty), 1)
+        scratch(20000)
+        pyzgc.minor_gc()
+        self.assertEqual(list_values(holder.load(0)),
+                         list(range(99, -1, -1)))
+        pyzgc.gc()
+        self.assertEqual(list_values(holder.load(0)),
+                         list(range(99, -1, -1)))
+        self.assertGreater(pyzgc.stats()["cards_scanned"], cards)
+
+        # Once the reference is gone the card is cleaned, and the list dies
+        weak = pyzgc.WeakRef(holder.load(0))
+        holder.store(0, None)
+        pyzgc.gc()
+        self.assertIsNone(weak())
+        self.assertEqual(sum(page["dirty_cards"]
+                             for page in pyzgc.heap_info()["pages"]
+                             if page["frozen"]), 0)
+
+    def test_frozen_weakrefs_survive(self):
+        obj = pyzgc.Object()
+        pyzgc.add_root(obj)
+        pyzgc.freeze()
+        weak = pyzgc.WeakRef(obj)
+        pyzgc.gc()
+        self.assertIs(weak(), obj)
+
+    def test_unfreeze(self):
+        head = build_list(200)
+        pyzgc.add_root(head)
+        pyzgc.freeze()
+        head.load(1).store(1, build_list(3))
+        pyzgc.unfreeze()
+        self.assertFalse(frozen_pages())
+
+        # Thawed objects are ordinary old ones again: only what is still
+        # reachable survives, and minor cycles find their young referents
+        pyzgc.minor_gc()
+        self.assertEqual(list_values(head), [199, 198, 2, 1, 0])
+        pyzgc.add_root(head)
+        pyzgc.gc()
+        self.assertEqual(list_values(head), [199, 198, 2, 1, 0])
+
+    def test_fork_with_gc_thread(self):
+        head = build_list(1000)
+        pyzgc.add_root(head)
+        pyzgc.freeze()
+        pyzgc.start_gc()
+        try:
+            pid = os.fork()
+            if pid == 0:
+                # The GC thread is running again, and so are cycles
+                scratch(50000)
+                pyzgc.add_root(head)
+                pyzgc.gc()
+                ok = list_values(head) == list(range(999, -1, -1))
+                os._exit(0 if ok else 1)
+            _, status = os.waitpid(pid, 0)
+            self.assertEqual(os.waitstatus_to_exitcode(status), 0)
+        finally:
+            pyzgc.stop_gc()
+        pyzgc.add_root(head)
+        pyzgc.gc()
+        self.assertEqual(list_values(head), list(range(999, -1, -1)))
+
+    def test_fork_with_two_module_objects(self):
+        # Each module object registers the fork hooks: both run
+        saved = {name: sys.modules.pop(name) for name in list(sys.modules)
+                 if name == "pyzgc" or name.startswith("pyzgc.")}
+        try:
+            importlib.import_module("pyzgc")
+        finally:
+            sys.modules.update(saved)
+        pyzgc.start_gc()
+        try:
+            pid = os.fork()
+            if pid == 0:
+                scratch(50000)
+                pyzgc.gc()
+                os._exit(0)
+            _, status = os.waitpid(pid, 0)
+            self.assertEqual(os.waitstatus_to_exitcode(status), 0)
+        finally:
+            pyzgc.stop_gc()
+        pyzgc.gc()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,77 @@
+import unittest
+import threading
+import pyzgc
+
+
+class TestHeapInfo(unittest.TestCase):
+    def test_layout(self):
+        big = pyzgc.Array('f64', 1 << 20)  # On a large page of its own
+        info = pyzgc.heap_info()
+        self.assertEqual(info["page_size"], 2 * 1024 * 1024)
+        totals = info["totals"]
+        self.assertEqual(totals["pages"], len(info["pages"]))
+        self.assertEqual(totals["young_pages"] + totals["old_pages"] +
+                         totals["shared_pages"], totals["pages"])
+        self.assertEqual(totals["used_bytes"],
+                         sum(p["used_bytes"] for p in info["pages"]))
+        if pyzgc.stats()["cycles"] == 0:
+            # Nothing has been marked: no score rather than 100% dead
+            self.assertIsNone(totals["fragmentation"])
+        else:
+            self.assertGreaterEqual(totals["fragmentation"], 0.0)
+            self.assertLessEqual(totals["fragmentation"], 1.0)
+        for page in info["pages"]:
+            self.assertIn(page["generation"], ("young", "old", "shared"))
+            self.assertGreaterEqual(page["used_bytes"], page["header_bytes"])
+            self.assertLessEqual(page["used_bytes"], page["size_bytes"])
+            self.assertEqual(page["address"] % info["page_size"], 0)
+
+    def test_live_bytes_and_evacuation(self):
+        print("\nTesting heap_info after a cycle...")
+        root = pyzgc.Object()
+        for i in range(10):
+            root.store(i, pyzgc.Object())
+        # Push the root's page out of the allocation set
+        junk = [pyzgc.Object() for _ in range(40000)]
+        del junk
+
+        page_size = pyzgc.heap_info()["page_size"]
+        old_page = pyzgc.get_body_address(root) & ~(page_size - 1)
+        old_page &= (1 << 60) - 1  # Strip the color bits
+
+        pyzgc.add_root(root)
+        pyzgc.gc()
+
+        pages = {p["address"]: p for p in pyzgc.heap_info()["pages"]}
+        evacuated = pages[old_page]
+        self.assertTrue(evacuated["evacuated"])
+        self.assertGreaterEqual(evacuated["forwarding_entries"], 11)
+        self.assertGreaterEqual(evacuated["live_bytes"], 11 * 80)
+        totals = pyzgc.heap_info()["totals"]
+        self.assertGreater(totals["evacuated_bytes"], 0)
+        self.assertGreaterEqual(totals["fragmentation"], 0.0)
+        self.assertLessEqual(totals["fragmentation"], 1.0)
+
+    def test_safe_during_background_gc(self):
+        stop = threading.Event()
+
+        def allocate():
+            while not stop.is_set():
+                o = pyzgc.Object()
+                o.store(0, pyzgc.Object())
+
+        pyzgc.start_gc()
+        t = threading.Thread(target=allocate)
+        t.start()
+        try:
+            for _ in range(200):
+                info = pyzgc.heap_info()
+                self.assertEqual(info["totals"]["pages"], len(info["pages"]))
+        finally:
+            stop.set()
+            t.join()
+            pyzgc.stop_gc()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,163 @@
+import math
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+import pyzgc
+from zgc_helpers import address
+
+
+def build_graph():
+    root = pyzgc.Object()
+    a = pyzgc.Object()
+    b = pyzgc.Object()
+    root.store(0, a)
+    root.store(1, b)
+    a.store(0, b)
+    b.store(0, a)  # Cycle
+    b.store(1, root)
+    root.store(2, 42)
+    root.store(3, -(2 ** 100))
+    root.store(4, 3.5)
+    root.store(5, "héllo")
+    root.store(6, b"\x00\x01bytes")
+    root.store(7, True)
+    root.store(8, None)
+    # A long chain so the image spans several pages
+    head = None
+    for i in range(60000):
+        node = pyzgc.Object()
+        node.store(0, head)
+        node.store(1, i)
+        head = node
+    root.store(9, head)
+    return root
+
+
+class TestImage(unittest.TestCase):
+    def setUp(self):
+        fd, self.path = tempfile.mkstemp(suffix=".zimg")
+        os.close(fd)
+
+    def tearDown(self):
+        os.unlink(self.path)
+
+    def check_graph(self, root):
+        a = root.load(0)
+        b = root.load(1)
+        self.assertIs(a.load(0), b)
+        self.assertIs(b.load(0), a)
+        self.assertIs(b.load(1), root)
+        self.assertEqual(root.load(2), 42)
+        self.assertEqual(root.load(3), -(2 ** 100))
+        self.assertEqual(root.load(4), 3.5)
+        self.assertEqual(root.load(5), "héllo")
+        self.assertEqual(root.load(6), b"\x00\x01bytes")
+        self.assertIs(root.load(7), True)
+        self.assertIsNone(root.load(8))
+        node, expected = root.load(9), 59999
+        while node is not None:
+            self.assertEqual(node.load(1), expected)
+            node, expected = node.load(0), expected - 1
+        self.assertEqual(expected, -1)
+
+    def test_round_trip(self):
+        print("\nTesting heap image round trip...")
+        pyzgc.save_image(build_graph(), self.path)
+        root = pyzgc.load_image(self.path)
+        self.check_graph(root)
+        # One handle per body
+        self.assertIs(root.load(0), root.load(0))
+        pages = [p for p in pyzgc.heap_info()["pages"] if p["immortal"]]
+        self.assertGreaterEqual(len(pages), 3)
+        self.assertTrue(all(p["generation"] == "old" for p in pages))
+
+    def test_primitive_round_trip(self):
+        # Every primitive type; True comes last, so its record ends the
+        # primitive section
+        values = [0, -1, 2 ** 63 - 1, -(2 ** 63), 2 ** 64, -(2 ** 100),
+                  0.0, -2.5, float("inf"), "", "héllo", b"", b"\x00\xff",
+                  False, True]
+        root = pyzgc.Object()
+        node = root
+        for i in range(0, len(values), 9):
+            for j, value in enumerate(values[i:i + 9]):
+                node.store(j, value)
+            node.store(9, pyzgc.Object())
+            node = node.load(9)
+        pyzgc.save_image(root, self.path)
+        for loaded in (pyzgc.load_image(self.path), root):
+            node = loaded
+            for i in range(0, len(values), 9):
+                for j, value in enumerate(values[i:i + 9]):
+                    self.assertEqual(type(node.load(j)), type(value))
+                    self.assertEqual(node.load(j), value)
+                node = node.load(9)
+        nan = pyzgc.Object()
+        nan.store(0, float("nan"))
+        pyzgc.save_image(nan, self.path)
+        self.assertTrue(math.isnan(pyzgc.load_image(self.path).load(0)))
+
+    def test_loaded_graph_survives_gc_and_stores(self):
+        pyzgc.save_image(build_graph(), self.path)
+        root = pyzgc.load_image(self.path)
+        a = root.load(0)
+        before = address(a)
+
+        young = pyzgc.Object()
+        young.store(0, "young")
+        a.store(5, young)       # Image body -> regular heap
+        root.store(2, 43)       # Overwrite an encoded primitive
+        pyzgc.add_root(root)
+        pyzgc.gc()
+        pyzgc.add_root(root)
+        pyzgc.gc()
+
+        # Image pages are never relocated; the young object is still reachable
+        self.assertEqual(address(a), before)
+        self.assertEqual(a.load(5).load(0), "young")
+        self.assertEqual(root.load(2), 43)
+
+        # Stores are private to this process: the file is unchanged
+        other = pyzgc.load_image(self.path)
+        self.assertEqual(other.load(2), 42)
+        self.assertIsNone(other.load(0).load(5))
+
+    def test_save_loaded_image(self):
+        pyzgc.save_image(build_graph(), self.path)
+        root = pyzgc.load_image(self.path)
+        # Overwrite the file the image is mapped from
+        pyzgc.save_image(root, self.path)
+        self.check_graph(root)
+        self.check_graph(pyzgc.load_image(self.path))
+
+    def test_load_in_fresh_process(self):
+        pyzgc.save_image(build_graph(), self.path)
+        code = (
+            "import pyzgc, sys\n"
+            "r = pyzgc.load_image(sys.argv[1])\n"
+            "assert r.load(0).load(0) is r.load(1)\n"
+            "assert r.load(5) == 'héllo'\n"
+            "print('ok')\n")
+        out = subprocess.run([sys.executable, "-c", code, self.path],
+                             stdout=subprocess.PIPE, text=True, check=True)
+        self.assertEqual(out.stdout.strip(), "ok")
+
+    def test_rejects_unsupported_values(self):
+        root = pyzgc.Object()
+        root.store(0, [1, 2, 3])
+        with self.assertRaises(TypeError):
+            pyzgc.save_image(root, self.path)
+
+    def test_rejects_bad_files(self):
+        with open(self.path, "wb") as f:
+            f.write(b"not an image" * 100)
+        with self.assertRaises(ValueError):
+            pyzgc.load_image(self.path)
+        with self.assertRaises(OSError):
+            pyzgc.load_image(self.path + ".missing")
+
+
+if __name__ == '__main__':
+    unittest.main()
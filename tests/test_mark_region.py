@@ -0,0 +1,181 @@
+import unittest
+import pyzgc
+from zgc_helpers import address, list_values, page_of, scratch
+
+
+def old_pages():
+    return {page["address"] for page in pyzgc.heap_info()["pages"]
+            if page["generation"] == "old" and not page["evacuated"]}
+
+
+def old_used():
+    return sum(page["used_bytes"] for page in pyzgc.heap_info()["pages"]
+               if page["generation"] == "old")
+
+
+def build_list(n, start=0):
+    head = None
+    for i in reversed(range(start, start + n)):
+        node = pyzgc.Object()
+        node.store(0, i)
+        node.store(1, head)
+        head = node
+    return head
+
+
+def drop_runs(head, keep, drop):
+    """Unlinks `drop` nodes after every `keep` ones."""
+    node = head
+    while node is not None:
+        for _ in range(keep - 1):
+            node = node.load(1)
+            if node is None:
+                return
+        after = node.load(1)
+        for _ in range(drop):
+            if after is None:
+                break
+            after = after.load(1)
+        node.store(1, after)
+        node = after
+
+
+def collect(*roots, minor=False):
+    for root in roots:
+        pyzgc.add_root(root)
+    if minor:
+        pyzgc.minor_gc()
+    else:
+        pyzgc.gc()
+
+
+class TestMarkRegion(unittest.TestCase):
+    def setUp(self):
+        pyzgc.configure(old_gen="mark_region")
+
+    def tearDown(self):
+        pyzgc.configure(old_gen="copying")
+
+    def promoted_list(self, n):
+        head = build_list(n)
+        scratch(30000)  # Moves allocation off the list's young pages
+        collect(head)
+        self.assertIn(page_of(head), old_pages())
+        return head
+
+    def test_configure(self):
+        self.assertEqual(pyzgc.configure()["old_gen"], "mark_region")
+        self.assertEqual(pyzgc.configure(old_gen="copying")["old_gen"],
+                         "copying")
+        with self.assertRaises(ValueError):
+            pyzgc.configure(old_gen="compacting")
+        self.assertEqual(pyzgc.configure()["old_gen"], "copying")
+
+    def test_old_bodies_stay_in_place(self):
+        print("\nTesting the mark-region old generation...")
+        head = self.promoted_list(20000)
+        before = pyzgc.stats()
+        where = address(head)
+        collect(head)
+        after = pyzgc.stats()
+        self.assertEqual(address(head), where)
+        self.assertGreater(after["swept_pages"], before["swept_pages"])
+        self.assertEqual(list_values(head), list(range(20000)))
+
+        # The copying collector moves them again
+        pyzgc.configure(old_gen="copying")
+        collect(head)
+        self.assertNotEqual(address(head.load(1)), where)
+        self.assertEqual(list_values(head), list(range(20000)))
+
+    def test_free_lines_are_reused(self):
+        head = self.promoted_list(20000)
+        drop_runs(head, 8, 8)
+        kept = list_values(head)
+        self.assertEqual(len(kept), 10000)
+        before = pyzgc.stats()
+        collect(head)
+        freed = pyzgc.stats()["swept_free_bytes"] - before["swept_free_bytes"]
+        self.assertGreater(freed, 500 * 1024)
+        pages = old_pages()
+        used = old_used()
+
+        # Promoted bodies go into the holes instead of new old pages, hole
+        # after hole rather than after the pages' tops
+        young = build_list(2000, start=100000)
+        scratch(30000)
+        collect(head, young, minor=True)
+        node = young
+        while node is not None:
+            self.assertIn(page_of(node), pages)
+            node = node.load(1)
+        self.assertLess(old_used() - used, 2000 * 88 // 2)
+        self.assertEqual(list_values(young), list(range(100000, 102000)))
+        self.assertEqual(list_values(head), kept)
+
+        # Once filled, the holes are dead bodies like any other
+        collect(head, young)
+        self.assertEqual(list_values(young), list(range(100000, 102000)))
+        self.assertEqual(list_values(head), kept)
+
+    def test_sparse_pages_are_evacuated(self):
+        # Long enough to fill pages of its own, whatever else is live
+        head = self.promoted_list(60000)
+        drop_runs(head, 1, 99)
+        before = pyzgc.stats()
+        collect(head)
+        after = pyzgc.stats()
+        self.assertGreater(after["defrag_pages"], before["defrag_pages"])
+        self.assertEqual(list_values(head), list(range(0, 60000, 100)))
+
+    def test_handles_keep_dead_bodies(self):
+        # Two lists taking turns every 8 nodes, so that both span the pages
+        head = self.promoted_list(20000)
+        tails = [None, None]
+        heads = [None, None]
+        node, i = head, 0
+        while node is not None:
+            after = node.load(1)
+            which = (i // 8) % 2
+            if tails[which] is None:
+                heads[which] = node
+            else:
+                tails[which].store(1, node)
+            tails[which] = node
+            node, i = after, i + 1
+        for tail in tails:
+            tail.store(1, None)
+        rooted, held = heads
+        del head, node, tails, heads
+        expected = list_values(held)
+        ref = pyzgc.WeakRef(held)
+
+        # Only its handle keeps the second list from being swept, and a
+        # handle Python holds keeps it strongly
+        collect(rooted)
+        self.assertIs(ref(), held)
+        young = build_list(10000, start=100000)
+        scratch(30000)
+        collect(rooted, young, minor=True)
+        self.assertEqual(list_values(held), expected)
+        self.assertEqual(list_values(young), list(range(100000, 110000)))
+
+    def test_young_handles_keep_old_bodies(self):
+        # A young list whose tail is old, held by nothing but its handle
+        head = build_list(10, start=-10)
+        node = head
+        while node.load(1) is not None:
+            node = node.load(1)
+        node.store(1, self.promoted_list(20000))
+        del node
+        expected = list_values(head)
+
+        collect()
+        young = build_list(20000, start=100000)
+        scratch(30000)
+        collect(young, minor=True)
+        self.assertEqual(list_values(head), expected)
+        self.assertEqual(list_values(young), list(range(100000, 120000)))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,84 @@
+import time
+import unittest
+import pyzgc
+from zgc_helpers import PAGE
+
+
+def wait_for(predicate, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while not predicate():
+        if time.monotonic() > deadline:
+            return False
+        time.sleep(0.01)
+    return True
+
+
+def pool_pages():
+    return pyzgc.stats()["pool_pages"]
+
+
+def heap_bytes():
+    return pyzgc.heap_info()["memory"]["heap_bytes"]
+
+
+class TestPagePool(unittest.TestCase):
+    def tearDown(self):
+        pyzgc.configure(page_pool=4, page_pool_populate=False,
+                        soft_max_heap_bytes=0)
+
+    def test_ready_pages(self):
+        print("\nTesting the page pool...")
+        self.assertEqual(pyzgc.configure()["page_pool"], 4)
+        self.assertTrue(wait_for(lambda: pool_pages() >= 4))
+
+        stats = pyzgc.stats()
+        for _ in range(5):
+            for _ in range(30000):  # A bit more than a page each
+                pyzgc.Object()
+            wait_for(lambda: pool_pages() >= 4)
+        after = pyzgc.stats()
+        self.assertGreaterEqual(after["pool_hits"] - stats["pool_hits"], 5)
+        self.assertEqual(after["pool_misses"], stats["pool_misses"])
+        self.assertGreater(after["pool_filled"], stats["pool_filled"])
+
+    def test_off_and_populate(self):
+        self.assertTrue(wait_for(lambda: pool_pages() >= 4))
+        heap, ready = heap_bytes(), pool_pages()
+        pyzgc.configure(page_pool=0)
+        # The filler may be mapping a page as the pool is turned off: it
+        # gives that one back too
+        self.assertTrue(wait_for(lambda: pool_pages() == 0 and
+                                 heap_bytes() <= heap - ready * PAGE))
+
+        misses = pyzgc.stats()["pool_misses"]
+        for _ in range(30000):
+            pyzgc.Object()
+        self.assertEqual(pyzgc.stats()["pool_misses"], misses)  # Off
+
+        settings = pyzgc.configure(page_pool=2, page_pool_populate=True)
+        self.assertTrue(settings["page_pool_populate"])
+        self.assertTrue(wait_for(lambda: pool_pages() >= 2))
+
+    def test_soft_max(self):
+        pyzgc.configure(page_pool=0)
+        self.assertTrue(wait_for(lambda: pool_pages() == 0))
+        soft_max = heap_bytes() + PAGE
+        pyzgc.configure(soft_max_heap_bytes=soft_max, page_pool=4)
+        self.assertTrue(wait_for(lambda: pool_pages() >= 1))
+        # Pooled pages count in the heap, which the filler keeps within the
+        # soft max however long it runs
+        deadline = time.monotonic() + 0.3
+        while time.monotonic() < deadline:
+            self.assertTrue(pool_pages() == 0 or heap_bytes() <= soft_max)
+            time.sleep(0.01)
+        self.assertLess(pool_pages(), 4)
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            pyzgc.configure(page_pool=-1)
+        with self.assertRaises(TypeError):
+            pyzgc.configure(page_pool="4")
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,81 @@
+import ctypes
+import unittest
+import pyzgc
+from zgc_helpers import address, retire_current_page
+
+
+def page_pins(addr):
+    page_size = pyzgc.heap_info()["page_size"]
+    for page in pyzgc.heap_info()["pages"]:
+        if page["address"] == addr & ~(page_size - 1):
+            return page["pins"]
+    raise AssertionError("no page at %#x" % addr)
+
+
+def collect(root, cycles=2):
+    for _ in range(cycles):
+        pyzgc.add_root(root)
+        pyzgc.gc()
+
+
+class TestPin(unittest.TestCase):
+    def test_pinned_body_stays(self):
+        print("\nTesting pinned bodies...")
+        holder = pyzgc.Object()
+        obj = pyzgc.Object()
+        obj.store(0, "payload")
+        holder.store(0, obj)
+        pin = pyzgc.pin(obj)
+        self.assertTrue(pin.pinned)
+        self.assertIs(pin.obj, obj)
+        self.assertEqual(pin.address, address(obj))
+        self.assertGreaterEqual(page_pins(pin.address), 1)
+        retire_current_page()
+
+        collect(holder)
+        self.assertEqual(address(obj), pin.address)
+        self.assertEqual(holder.load(0).load(0), "payload")
+
+        # Released: the page may be evacuated again
+        before = pin.address
+        pin.unpin()
+        self.assertFalse(pin.pinned)
+        collect(holder)
+        self.assertNotEqual(address(obj), before)
+        self.assertEqual(holder.load(0).load(0), "payload")
+
+    def test_context_manager(self):
+        obj = pyzgc.Object()
+        with pyzgc.pin(obj) as pin:
+            pins = page_pins(pin.address)
+            with pyzgc.pin(obj) as inner:  # Pins nest
+                self.assertEqual(inner.address, pin.address)
+                self.assertEqual(page_pins(pin.address), pins + 1)
+            self.assertEqual(page_pins(pin.address), pins)
+        self.assertFalse(pin.pinned)
+        self.assertIn("released", repr(pin))
+        with self.assertRaises(ValueError):
+            pin.address
+        pin.unpin()  # Already released
+
+    def test_zero_copy_array(self):
+        holder = pyzgc.Object()
+        array = pyzgc.Array('i64', 4)
+        holder.store(0, array)
+        with pyzgc.pin(array) as pin:
+            # Elements follow the one-word header
+            data = (ctypes.c_int64 * 4).from_address(pin.address + 8)
+            retire_current_page()
+            collect(holder)
+            data[2] = 1234
+            self.assertEqual(array[2], 1234)
+
+    def test_errors(self):
+        with self.assertRaises(TypeError):
+            pyzgc.pin(42)
+        with self.assertRaises(TypeError):
+            pyzgc.pin()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,155 @@
+import sys
+import unittest
+import weakref
+import pyzgc
+from zgc_helpers import retire_current_page
+
+
+class TestRefProcessing(unittest.TestCase):
+    def test_weakref_cleared_when_unreachable(self):
+        print("\nTesting collector-driven weak references...")
+        root = pyzgc.Object()
+        kept = pyzgc.Object()
+        dropped = pyzgc.Object()
+        root.store(0, kept)
+        cleared = []
+        r_kept = pyzgc.WeakRef(kept, cleared.append)
+        r_dropped = pyzgc.WeakRef(dropped, cleared.append)
+        self.assertIs(r_dropped(), dropped)
+        self.assertEqual(r_kept.__callback__, cleared.append)
+        before = pyzgc.stats()["weak_cleared"]
+        # Only the WeakRef holds the handle now
+        probe = weakref.ref(dropped)
+        del kept, dropped
+
+        pyzgc.add_root(root)
+        pyzgc.gc()
+
+        self.assertIsNone(r_dropped())
+        self.assertIs(r_kept(), root.load(0))
+        self.assertEqual(cleared, [r_dropped])
+        self.assertIn("dead", repr(r_dropped))
+        self.assertEqual(pyzgc.stats()["weak_cleared"] - before, 1)
+        # The handle was freed once its callback ran
+        self.assertIsNone(probe())
+
+    def test_held_handle_is_strong(self):
+        calls = []
+        x = pyzgc.Object()
+        r = pyzgc.WeakRef(x, calls.append)
+        pyzgc.finalize(x, calls.append)
+        retire_current_page()
+        for _ in range(2):
+            pyzgc.gc()
+            self.assertIs(r(), x)
+            self.assertEqual(calls, [])
+
+        # Reading the WeakRef does not make the handle held for good
+        del x
+        pyzgc.gc()
+        self.assertIsNone(r())
+        self.assertEqual(len(calls), 2)
+
+    def test_cache_drains(self):
+        cache = {}
+        root = pyzgc.Object()
+        for key in range(1000):
+            value = pyzgc.Object()
+            value.store(0, key)
+            cache[key] = pyzgc.WeakRef(
+                value, lambda ref, key=key: cache.pop(key, None))
+            if key % 100 == 0:
+                root.store(key // 100, value)  # Ten entries stay reachable
+        del value
+
+        pyzgc.add_root(root)
+        pyzgc.gc()
+        self.assertEqual(sorted(cache), list(range(0, 1000, 100)))
+        for key, ref in cache.items():
+            self.assertEqual(ref().load(0), key)
+
+    def test_finalizer_sees_intact_graph(self):
+        calls = []
+
+        def finalizer(obj):
+            # Everything obj referenced survived the cycle that found it
+            calls.append(obj.load(0).load(0))
+
+        obj = pyzgc.Object()
+        child = pyzgc.Object()
+        child.store(0, "payload")
+        obj.store(0, child)
+        weak = pyzgc.WeakRef(obj)
+        pyzgc.finalize(obj, finalizer)
+        del obj, child
+        retire_current_page()
+
+        pyzgc.gc()
+        self.assertEqual(calls, ["payload"])
+        # Weak references to finalizable objects are cleared as well
+        self.assertIsNone(weak())
+
+        # Runs once
+        pyzgc.gc()
+        self.assertEqual(calls, ["payload"])
+
+    def test_reachable_finalizer_does_not_run(self):
+        calls = []
+        root = pyzgc.Object()
+        obj = pyzgc.Object()
+        root.store(0, obj)
+        pyzgc.finalize(obj, calls.append)
+        retire_current_page()
+        for _ in range(2):
+            pyzgc.add_root(root)
+            pyzgc.gc()
+        self.assertEqual(calls, [])
+        # The object moved and kept its contents
+        self.assertIs(root.load(0), obj)
+
+        del obj
+        root.store(0, None)
+        pyzgc.gc()
+        self.assertEqual(len(calls), 1)
+
+    def test_minor_gc_keeps_old_referents(self):
+        root = pyzgc.Object()
+        obj = pyzgc.Object()
+        root.store(0, obj)
+        retire_current_page()
+        pyzgc.add_root(root)
+        pyzgc.gc()  # Survivors are promoted
+        self.assertIs(root.load(0), obj)
+
+        r = pyzgc.WeakRef(obj)
+        pyzgc.minor_gc()  # Old objects are not judged by minor cycles
+        self.assertIs(r(), obj)
+
+    def test_errors(self):
+        with self.assertRaises(TypeError):
+            pyzgc.WeakRef([])
+        with self.assertRaises(TypeError):
+            pyzgc.WeakRef(pyzgc.Object(), 42)
+        with self.assertRaises(TypeError):
+            pyzgc.finalize(pyzgc.Object(), None)
+        with self.assertRaises(TypeError):
+            pyzgc.WeakRef(pyzgc.Object())(1)
+
+        def boom(ref):
+            raise RuntimeError("callback failure")
+
+        unraisable = []
+        old_hook = sys.unraisablehook
+        sys.unraisablehook = unraisable.append
+        try:
+            r = pyzgc.WeakRef(pyzgc.Object(), boom)
+            pyzgc.gc()
+        finally:
+            sys.unraisablehook = old_hook
+        self.assertIsNone(r())
+        self.assertEqual(len(unraisable), 1)
+        self.assertIsInstance(unraisable[0].exc_value, RuntimeError)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,174 @@
+import threading
+import unittest
+import pyzgc
+from zgc_helpers import PAGE, address, build_list, list_values, page_of
+
+
+def region_pages():
+    return {page["address"] for page in pyzgc.heap_info()["pages"]
+            if page["region"]}
+
+
+def in_pages(obj, pages):
+    return page_of(obj) in pages
+
+
+def scratch(n):
+    # Temporaries only: nothing survives the call
+    for i in range(n):
+        a = pyzgc.Object()
+        b = pyzgc.Object()
+        a.store(0, b)
+        b.store(0, i)
+
+
+class TestRegion(unittest.TestCase):
+    def test_bulk_release(self):
+        print("\nTesting scoped allocation regions...")
+        stats = pyzgc.stats()
+        with pyzgc.region() as r:
+            self.assertTrue(r.active)
+            scratch(40000)  # More than a page
+            pages = region_pages()
+            self.assertGreaterEqual(len(pages), 2)
+        self.assertFalse(r.active)
+        self.assertTrue(r.released)
+        self.assertEqual(r.escaped, 0)
+        self.assertEqual(r.pages, len(pages))
+        self.assertEqual(r.released_bytes, len(pages) * PAGE)
+        self.assertFalse(region_pages())
+        self.assertIn("released", repr(r))
+
+        after = pyzgc.stats()
+        self.assertEqual(after["regions"] - stats["regions"], 1)
+        self.assertEqual(after["region_fallbacks"], stats["region_fallbacks"])
+        self.assertEqual(after["region_released_bytes"] -
+                         stats["region_released_bytes"], r.released_bytes)
+        self.assertGreater(after["pool_returned"], stats["pool_returned"])
+
+    def test_returned_objects_escape(self):
+        with pyzgc.region() as r:
+            scratch(1000)
+            head = build_list(100)
+            pages = region_pages()
+            self.assertTrue(in_pages(head, pages))
+        self.assertTrue(r.released)
+        self.assertEqual(r.escaped, 100)
+        self.assertFalse(in_pages(head, pages))
+        self.assertEqual(list_values(head), list(range(99, -1, -1)))
+
+        # The copies are ordinary old objects
+        pyzgc.add_root(head)
+        pyzgc.gc()
+        self.assertTrue(pyzgc.is_marked(head))
+        self.assertEqual(list_values(head)[-1], 0)
+
+    def test_stored_objects_escape(self):
+        holder = pyzgc.Object()
+        array = pyzgc.Array('ref', 2)
+        with pyzgc.region() as r:
+            holder.store(0, build_list(10))
+            array[1] = build_list(3)
+            # Overwritten before the end: not an escape
+            holder.store(1, build_list(50))
+            holder.store(1, None)
+        self.assertTrue(r.released)
+        self.assertEqual(r.escaped, 13)
+        self.assertEqual(list_values(holder.load(0)), list(range(9, -1, -1)))
+        self.assertEqual(list_values(array[1]), [2, 1, 0])
+        self.assertIsNone(holder.load(1))
+
+        for _ in range(2):
+            pyzgc.add_root(holder)
+            pyzgc.add_root(array)
+            pyzgc.gc()
+        self.assertEqual(list_values(holder.load(0))[0], 9)
+        self.assertEqual(list_values(array[1])[0], 2)
+
+    def test_roots_follow(self):
+        with pyzgc.region() as r:
+            obj = pyzgc.Object()
+            obj.store(0, build_list(5))
+            pyzgc.add_root(obj)
+        self.assertTrue(r.released)
+        pyzgc.gc()
+        self.assertTrue(pyzgc.is_marked(obj))
+        self.assertEqual(list_values(obj.load(0)), [4, 3, 2, 1, 0])
+
+    def test_typed_structs(self):
+        Node = pyzgc.define("Node", value="i64", next="ref")
+        with pyzgc.region() as r:
+            head = None
+            for i in range(20):
+                head = Node(value=i, next=head)
+        self.assertTrue(r.released)
+        values = []
+        while head is not None:
+            values.append(head.value)
+            head = head.next
+        self.assertEqual(values, list(range(19, -1, -1)))
+
+    def test_pinned_falls_back(self):
+        with pyzgc.region() as r:
+            obj = pyzgc.Object()
+            obj.store(0, "kept")
+            pin = pyzgc.pin(obj)
+            pages = region_pages()
+        self.assertFalse(r.released)
+        self.assertEqual(r.released_bytes, 0)
+        self.assertIn("left to GC", repr(r))
+        # Ordinary young pages now, still holding the body in place
+        self.assertFalse(region_pages())
+        self.assertEqual(address(obj), pin.address)
+        self.assertTrue(in_pages(obj, pages))
+        pin.unpin()
+        pyzgc.add_root(obj)
+        pyzgc.gc()
+        self.assertEqual(obj.load(0), "kept")
+
+    def test_raw_memory_falls_back(self):
+        with pyzgc.region() as r:
+            pyzgc.allocate(24)
+        self.assertFalse(r.released)
+
+    def test_misuse(self):
+        r = pyzgc.region()
+        self.assertFalse(r.active)
+        with self.assertRaises(RuntimeError):
+            r.__exit__(None, None, None)
+        with r:
+            with self.assertRaises(RuntimeError):
+                with pyzgc.region():
+                    pass
+        with self.assertRaises(RuntimeError):
+            with r:
+                pass
+
+    def test_regions_on_two_threads(self):
+        # A body of one region stored into a body of another: whichever
+        # ends first, the slot has to follow
+        entered = threading.Event()
+        stored = threading.Event()
+        box = {}
+
+        def other():
+            with pyzgc.region() as r:
+                box["holder"] = pyzgc.Object()
+                entered.set()
+                stored.wait()
+            box["region"] = r
+
+        thread = threading.Thread(target=other)
+        thread.start()
+        entered.wait()
+        with pyzgc.region() as mine:
+            box["holder"].store(0, build_list(4))
+            stored.set()
+            thread.join()
+            self.assertTrue(box["region"].released)
+        self.assertTrue(mine.released)
+        self.assertEqual(list_values(box["holder"].load(0)), [3, 2, 1, 0])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,81 @@
+import unittest
+import sys
+import threading
+import time
+import pyzgc
+
+
+class TestSafepoint(unittest.TestCase):
+    def test_stats_layout(self):
+        s = pyzgc.stats()
+        for key in ("safepoints", "cycles", "minor_cycles", "gc_cpu_ns",
+                    "gc_wall_ns"):
+            self.assertIn(key, s)
+        for key in ("time_to_safepoint", "pause"):
+            h = s[key]
+            for field in ("count", "total_ns", "max_ns", "p50_ns", "p99_ns",
+                          "p999_ns", "histogram"):
+                self.assertIn(field, h)
+            self.assertEqual(sum(c for _, c in h["histogram"]), h["count"])
+
+    def test_cycle_takes_two_safepoints(self):
+        before = pyzgc.stats()["safepoints"]
+        pyzgc.gc()
+        after = pyzgc.stats()
+        # Mark start; mark end + relocate start share the second one
+        self.assertEqual(after["safepoints"] - before, 2)
+        self.assertGreater(after["cycles"], 0)
+        self.assertEqual(after["pause"]["count"],
+                         after["time_to_safepoint"]["count"])
+
+    def test_allocating_mutator_reaches_safepoint(self):
+        print("\nTesting time-to-safepoint under allocation...")
+        before = pyzgc.stats()["safepoints"]
+        pyzgc.start_gc()
+        keep = []
+        deadline = time.time() + 1.0
+        while time.time() < deadline:
+            o = pyzgc.Object()
+            o.store(0, o)
+            keep.append(o)
+            if len(keep) > 5000:
+                keep = []
+        pyzgc.stop_gc()
+
+        s = pyzgc.stats()
+        self.assertGreater(s["safepoints"], before)
+        ttsp = s["time_to_safepoint"]
+        print(f"time-to-safepoint p50={ttsp['p50_ns']}ns "
+              f"p99={ttsp['p99_ns']}ns max={ttsp['max_ns']}ns")
+        # Polls hand over the GIL instead of waiting for the switch interval
+        self.assertLess(ttsp["p50_ns"], sys.getswitchinterval() * 1e9)
+
+    def test_threads_survive_handshakes(self):
+        # Every relocate start retires all TLABs through a handshake
+        errors = []
+
+        def worker():
+            try:
+                prev = None
+                for i in range(20000):
+                    o = pyzgc.Object()
+                    o.store(0, prev)
+                    o.store(1, i)
+                    prev = o if i % 100 else None
+                    if prev is not None and prev.load(1) != i:
+                        errors.append(i)
+            except Exception as e:
+                errors.append(e)
+
+        pyzgc.start_gc()
+        threads = [threading.Thread(target=worker) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        pyzgc.stop_gc()
+        self.assertEqual(errors, [])
+
+
+if __name__ == '__main__':
+    unittest.main()
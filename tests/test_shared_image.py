@@ -0,0 +1,124 @@
+import os
+import subprocess
+import sys
+import unittest
+import pyzgc
+from zgc_helpers import address
+
+
+def build_graph(n):
+    root = pyzgc.Object()
+    head = None
+    for i in range(n):
+        node = pyzgc.Object()
+        node.store(0, head)
+        node.store(1, i)
+        node.store(2, "node-%d" % i)
+        head = node
+    root.store(0, head)
+    root.store(1, root)  # Cycle back to the root
+    return root
+
+
+def walk(root):
+    node, count = root.load(0), 0
+    while node is not None:
+        count += 1
+        node = node.load(0)
+    return count
+
+
+class TestSharedImage(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.fd = pyzgc.share_image(build_graph(60000))
+        cls.root = pyzgc.attach_image(cls.fd)
+
+    def test_reads(self):
+        print("\nTesting shared heap image reads...")
+        root = self.root
+        self.assertIs(root.load(1), root)
+        head = root.load(0)
+        self.assertEqual(head.load(1), 59999)
+        self.assertEqual(head.load(2), "node-59999")
+        self.assertEqual(walk(root), 60000)
+        self.assertIn("gen=2", repr(root))
+        pages = [p for p in pyzgc.heap_info()["pages"]
+                 if p["generation"] == "shared"]
+        self.assertGreaterEqual(len(pages), 3)
+        self.assertTrue(all(p["immortal"] for p in pages))
+
+    def test_read_only(self):
+        with self.assertRaises(TypeError):
+            self.root.store(2, 1)
+        with self.assertRaises(TypeError):
+            self.root.load(0).store(0, pyzgc.Object())
+        self.assertEqual(self.root.load(0).load(1), 59999)
+        # The memfd is sealed
+        with self.assertRaises(OSError):
+            os.write(self.fd, b"x")
+
+    def test_gc_leaves_shared_pages_alone(self):
+        holder = pyzgc.Object()
+        holder.store(0, self.root)  # Regular heap -> shared image
+        before = address(self.root)
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        pyzgc.add_root(holder)
+        pyzgc.gc()
+        self.assertEqual(address(self.root), before)
+        self.assertIs(holder.load(0), self.root)
+        self.assertEqual(walk(self.root), 60000)
+        for page in pyzgc.heap_info()["pages"]:
+            if page["generation"] == "shared":
+                self.assertEqual(page["live_bytes"], 0)
+                self.assertFalse(page["evacuated"])
+
+    def test_forked_worker(self):
+        pid = os.fork()
+        if pid == 0:
+            ok = walk(self.root) == 60000 and \
+                self.root.load(0).load(2) == "node-59999"
+            os._exit(0 if ok else 1)
+        _, status = os.waitpid(pid, 0)
+        self.assertEqual(os.waitstatus_to_exitcode(status), 0)
+
+    def test_spawned_worker(self):
+        code = (
+            "import pyzgc, sys\n"
+            "root = pyzgc.attach_image(int(sys.argv[1]))\n"
+            "node, n = root.load(0), 0\n"
+            "while node is not None:\n"
+            "    n, node = n + 1, node.load(0)\n"
+            "print(n, root.load(0).load(2))\n")
+        out = subprocess.run([sys.executable, "-c", code, str(self.fd)],
+                             pass_fds=(self.fd,), stdout=subprocess.PIPE,
+                             text=True, check=True)
+        self.assertEqual(out.stdout.split(), ["60000", "node-59999"])
+
+    def test_primitives(self):
+        values = [7, 2 ** 70, 1.5, "s", b"b", False, None, True]
+        obj = pyzgc.Object()
+        for i, value in enumerate(values):
+            obj.store(i, value)
+        fd = pyzgc.share_image(obj)
+        try:
+            shared = pyzgc.attach_image(fd)
+        finally:
+            os.close(fd)
+        for i, value in enumerate(values):
+            self.assertEqual(type(shared.load(i)), type(value))
+            self.assertEqual(shared.load(i), value)
+
+    def test_rejects_bad_descriptors(self):
+        r, w = os.pipe()
+        try:
+            with self.assertRaises(OSError):
+                pyzgc.attach_image(r)
+        finally:
+            os.close(r)
+            os.close(w)
+
+
+if __name__ == '__main__':
+    unittest.main()
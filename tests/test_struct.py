@@ -0,0 +1,147 @@
+import gc
+import tracemalloc
+import unittest
+import pyzgc
+
+Point = pyzgc.define("Point", x='i64', y='f64', next='ref')
+
+
+class TestStruct(unittest.TestCase):
+    def test_fields(self):
+        print("\nTesting typed struct fields...")
+        p = Point(1, y=2.5)
+        self.assertEqual((p.x, p.y, p.next), (1, 2.5, None))
+        p.x = -(2 ** 63)
+        p.y = 7          # ints convert to f64
+        self.assertEqual(p.x, -(2 ** 63))
+        self.assertEqual(p.y, 7.0)
+        self.assertIsInstance(p.y, float)
+
+        q = Point()
+        self.assertEqual((q.x, q.y, q.next), (0, 0.0, None))
+        q.next = p
+        self.assertIs(q.next, p)
+        q.next = "any object"
+        self.assertEqual(q.next, "any object")
+        q.next = None
+        self.assertIsNone(q.next)
+
+        self.assertEqual(Point._fields, ('x', 'y', 'next'))
+        self.assertIsInstance(p, pyzgc.Struct)
+        self.assertEqual(repr(Point(3, 0.5)),
+                         "pyzgc.Point(x=3, y=0.5, next=None)")
+        p.next = p
+        self.assertEqual(repr(p),
+                         "pyzgc.Point(x=%d, y=7.0, next=pyzgc.Point(...))" % p.x)
+
+    def test_errors(self):
+        p = Point()
+        with self.assertRaises(OverflowError):
+            p.x = 2 ** 63
+        with self.assertRaises(TypeError):
+            p.x = "1"
+        with self.assertRaises(TypeError):
+            p.y = None
+        with self.assertRaises(TypeError):
+            del p.x
+        with self.assertRaises(AttributeError):
+            p.z = 1
+        with self.assertRaises(TypeError):
+            Point(1, 2, None, 4)
+        with self.assertRaises(TypeError):
+            Point(1, x=2)
+        with self.assertRaises(TypeError):
+            Point(z=1)
+        with self.assertRaises(ValueError):
+            pyzgc.define(x='i32')
+        with self.assertRaises(ValueError):
+            pyzgc.define(_x='i64')
+        with self.assertRaises(TypeError):
+            pyzgc.define()
+        with self.assertRaises(TypeError):
+            pyzgc.define(**{"f%d" % i: 'i64' for i in range(32)})
+        with self.assertRaises(TypeError):
+            pyzgc.Struct()
+        with self.assertRaises(TypeError):
+            class Sub(Point):
+                pass
+
+    def test_survives_gc(self):
+        # A linked list of structs reachable only through ref fields,
+        # hanging off a plain object
+        root = pyzgc.Object()
+        head = None
+        for i in range(20000):
+            head = Point(i, i * 0.5, head)
+        root.store(0, head)
+        del head
+
+        pyzgc.add_root(root)
+        pyzgc.gc()
+        pyzgc.add_root(root)
+        pyzgc.minor_gc()
+
+        node, expected = root.load(0), 19999
+        while node is not None:
+            self.assertEqual(node.x, expected)
+            self.assertEqual(node.y, expected * 0.5)
+            node, expected = node.next, expected - 1
+        self.assertEqual(expected, -1)
+
+    def test_bodies_fit_the_layout(self):
+        fields = {"f%d" % i: 'i64' for i in range(30)}
+        Wide = pyzgc.define("Wide", next='ref', **fields)
+        # Header, fields and handle back-pointer, one word each
+        for make, words in ((Point, 5), (Wide, 33)):
+            records = [make() for _ in range(100)]
+            steps = [pyzgc.get_body_address(b) - pyzgc.get_body_address(a)
+                     for a, b in zip(records, records[1:])]
+            self.assertEqual(max(set(steps), key=steps.count), words * 8)
+
+        # The last slot is a traced reference too
+        head = None
+        for i in range(5000):
+            head = Wide(next=head, f29=i)
+        root = pyzgc.Object()
+        root.store(0, head)
+        del head, records
+        for _ in range(2):
+            pyzgc.add_root(root)
+            pyzgc.gc()
+        node, expected = root.load(0), 4999
+        while node is not None:
+            self.assertEqual((node.f29, node.f0), (expected, 0))
+            node, expected = node.next, expected - 1
+        self.assertEqual(expected, -1)
+
+    def test_numbers_are_unboxed(self):
+        Record = pyzgc.define("Record", **{"f%d" % i: 'f64' for i in range(9)})
+
+        def retained(make):
+            gc.collect()
+            tracemalloc.start()
+            start = tracemalloc.get_traced_memory()[0]
+            records = [make(i) for i in range(2000)]
+            used = tracemalloc.get_traced_memory()[0] - start
+            tracemalloc.stop()
+            del records
+            return used
+
+        def boxed(i):
+            o = pyzgc.Object()
+            for s in range(9):
+                o.store(s, i + s + 0.5)
+            return o
+
+        def unboxed(i):
+            r = Record()
+            for s in range(9):
+                setattr(r, "f%d" % s, i + s + 0.5)
+            return r
+
+        # Only the handle lives on the CPython heap
+        self.assertLess(retained(unboxed) * 3, retained(boxed))
+
+
+if __name__ == '__main__':
+    unittest.main()
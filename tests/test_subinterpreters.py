@@ -0,0 +1,186 @@
+import os
+import threading
+import time
+import unittest
+import pyzgc
+
+try:
+    import _interpreters as interpreters  # 3.13
+except ImportError:
+    try:
+        import _xxsubinterpreters as interpreters
+    except ImportError:
+        interpreters = None
+
+
+def run(interp, code):
+    """Runs code in interp and returns what it assigned to `result`."""
+    r, w = os.pipe()
+    try:
+        # 3.13 returns what went wrong instead of raising
+        error = interpreters.run_string(interp, code + f"""
+import os
+os.write({w}, repr(result).encode())
+""")
+        if error is not None:
+            raise RuntimeError(error)
+        return eval(os.read(r, 1 << 16))
+    finally:
+        os.close(r)
+        os.close(w)
+
+
+@unittest.skipIf(interpreters is None, "no subinterpreters module")
+class TestSubinterpreters(unittest.TestCase):
+    def setUp(self):
+        self.interp = interpreters.create()
+
+    def tearDown(self):
+        interpreters.destroy(self.interp)
+
+    def test_separate_heaps(self):
+        print("\nTesting per-interpreter heaps...")
+        keep = [pyzgc.Object() for _ in range(100)]
+        pages = pyzgc.heap_info()["totals"]["pages"]
+        cycles = pyzgc.stats()["cycles"]
+        result = run(self.interp, """
+import pyzgc
+objs = []
+for i in range(60000):      # Two pages or so
+    o = pyzgc.Object()
+    o.store(0, i)
+    objs.append(o)
+before = pyzgc.stats()["cycles"]
+pyzgc.gc()
+result = (pyzgc.heap_info()["totals"]["pages"], before,
+          pyzgc.stats()["cycles"],
+          all(objs[i].load(0) == i for i in range(60000)))
+""")
+        sub_pages, sub_before, sub_after, intact = result
+        self.assertGreater(sub_pages, 1)
+        self.assertEqual((sub_before, sub_after, intact), (0, 1, True))
+        # The main heap neither grew nor collected meanwhile
+        self.assertEqual(pyzgc.heap_info()["totals"]["pages"], pages)
+        self.assertEqual(pyzgc.stats()["cycles"], cycles)
+
+        # Nor does the subinterpreter see the main one's cycles
+        pyzgc.gc()
+        self.assertEqual(run(self.interp, """
+result = pyzgc.stats()["cycles"]
+"""), 1)
+        self.assertEqual(len(keep), 100)
+
+    def test_configure_is_per_interpreter(self):
+        soft_max = pyzgc.configure()["soft_max_heap_bytes"]
+        self.assertEqual(run(self.interp, """
+import pyzgc
+result = pyzgc.configure(soft_max_heap_bytes=64 << 20)[
+    "soft_max_heap_bytes"]
+"""), 64 << 20)
+        self.assertEqual(pyzgc.configure()["soft_max_heap_bytes"], soft_max)
+
+    def test_gc_threads_and_destroy(self):
+        # Both collectors run at once, each with its own GC thread
+        pyzgc.start_gc()
+        try:
+            result = run(self.interp, """
+import pyzgc, time
+pyzgc.start_gc()
+objs = [pyzgc.Object() for _ in range(20000)]
+for i, o in enumerate(objs):
+    o.store(0, i)
+deadline = time.monotonic() + 10
+while pyzgc.stats()["cycles"] < 2 and time.monotonic() < deadline:
+    pyzgc.Object()
+    time.sleep(0.01)
+result = (pyzgc.stats()["cycles"] >= 2,
+          all(o.load(0) == i for i, o in enumerate(objs)))
+""")
+            self.assertEqual(result, (True, True))
+        finally:
+            pyzgc.stop_gc()
+
+        # Destroying the interpreter stops its GC thread and gives its heap
+        # back; the main one goes on
+        interpreters.destroy(self.interp)
+        self.interp = interpreters.create()
+        o = pyzgc.Object()
+        o.store(0, "still here")
+        pyzgc.gc()
+        self.assertEqual(o.load(0), "still here")
+        self.assertEqual(run(self.interp, """
+import pyzgc
+result = pyzgc.stats()["cycles"]
+"""), 0)
+
+    def test_threads_in_both(self):
+        # A thread of the main interpreter allocates while the subinterpreter
+        # collects. It lets go of the GIL now and then: before 3.12, a thread
+        # of one interpreter can't ask one of another to drop it.
+        stop = threading.Event()
+        errors = []
+
+        def mutate():
+            try:
+                holder = pyzgc.Object()
+                while not stop.is_set():
+                    o = pyzgc.Object()
+                    o.store(0, holder)
+                    holder = o
+                    time.sleep(0)
+            except Exception as e:
+                errors.append(e)
+
+        thread = threading.Thread(target=mutate)
+        thread.start()
+        try:
+            self.assertTrue(run(self.interp, """
+import pyzgc
+objs = [pyzgc.Object() for _ in range(10000)]
+for i, o in enumerate(objs):
+    o.store(0, i)
+for _ in range(3):
+    pyzgc.gc()
+    pyzgc.minor_gc()
+result = all(o.load(0) == i for i, o in enumerate(objs))
+"""))
+        finally:
+            stop.set()
+            thread.join()
+        self.assertEqual(errors, [])
+
+    def test_types_are_per_interpreter(self):
+        result = run(self.interp, """
+import pyzgc
+Point = pyzgc.define("Point", x='i64', next='ref')
+d = pyzgc.Dict(a=Point(1))
+d["b"] = Point(2, d["a"])
+pyzgc.gc()
+result = ([id(t) for t in (pyzgc.Object, pyzgc.Struct, pyzgc.Dict)],
+          isinstance(d["b"], pyzgc.Struct), d["b"].next.x)
+""")
+        ids, is_struct, x = result
+        for theirs, ours in zip(ids, (pyzgc.Object, pyzgc.Struct, pyzgc.Dict)):
+            self.assertNotEqual(theirs, id(ours))
+        self.assertEqual((is_struct, x), (True, 1))
+        # Heap types, as fixed as the static ones were
+        with self.assertRaises(TypeError):
+            pyzgc.Object.extra = 1
+        with self.assertRaises(TypeError):
+            type(iter(pyzgc.Dict()))()
+
+    def test_weakref_callbacks(self):
+        # No pending calls outside the main interpreter: gc() runs them
+        self.assertEqual(run(self.interp, """
+import pyzgc
+called = []
+o = pyzgc.Object()
+r = pyzgc.WeakRef(o, called.append)
+del o
+pyzgc.gc()
+result = (r() is None, len(called))
+"""), (True, 1))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,44 @@
+"""Helpers shared by the test modules."""
+import pyzgc
+
+ADDRESS_MASK = (1 << 60) - 1  # Strips the color bits
+PAGE = 2 * 1024 * 1024
+
+
+def address(obj):
+    return pyzgc.get_body_address(obj) & ADDRESS_MASK
+
+
+def page_of(obj):
+    return address(obj) & ~(PAGE - 1)
+
+
+def scratch(n):
+    # Short-lived bodies, dead as soon as they are made
+    for _ in range(n):
+        pyzgc.Object()
+
+
+def retire_current_page():
+    # Fill the current page so that the next cycle may evacuate it
+    scratch(30000)
+
+
+def build_list(n):
+    # Linked list of n nodes: value in slot 0, next in slot 1; the head
+    # holds n - 1
+    head = None
+    for i in range(n):
+        node = pyzgc.Object()
+        node.store(0, i)
+        node.store(1, head)
+        head = node
+    return head
+
+
+def list_values(head):
+    values = []
+    while head is not None:
+        values.append(head.load(0))
+        head = head.load(1)
+    return values